@@ -0,0 +1,58 @@
+# Numeric vectors in a ShmArray compared with a ShmList of the same numbers and with pickling.
+# The array keeps the numbers inline in a single block, so it is filled and read back at once,
+# and memoryview/numpy.frombuffer read it in place, while every ShmList item is a value of its own.
+#
+# Usage: python3 benchmarks/array_vs_list.py [count] [repeat]    (default: 60000 5)
+
+import sys
+import time
+import pickle
+import pso
+
+def timed(func, repeat):
+    best = None
+    for i in range(repeat):
+        start = time.perf_counter()
+        func()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None or elapsed < best else best
+    return best
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 60000
+    repeat = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+    pso.init()
+    native = [i * 0.5 for i in range(count)]
+    a = pso.ShmArray('d', native)
+    l = pso.ShmList(native)
+
+    def view_sum():
+        m = memoryview(a)
+        rslt = sum(m)
+        m.release()
+        return rslt
+
+    def assign_all():
+        a[:] = native
+
+    cases = [
+        ('pickle.dumps + loads', lambda: pickle.loads(pickle.dumps(native))),
+        ('ShmList(values)', lambda: pso.ShmList(native)),
+        ('ShmArray(d, values)', lambda: pso.ShmArray('d', native)),
+        ('ShmList l[:]', lambda: l[:]),
+        ('ShmArray a[:]', lambda: a[:]),
+        ('ShmArray a[:] = values', assign_all),
+        ('memoryview(a) sum', view_sum),
+        ('memoryview(a) open', lambda: memoryview(a).release()),
+    ]
+    try:
+        import numpy
+        cases.append(('numpy.frombuffer(a).sum()', lambda: numpy.frombuffer(a).sum()))
+    except ImportError:
+        pass
+    for label, func in cases:
+        print(f'{label:>28} {timed(func, repeat) * 1e3:10.3f} ms')
+    assert a[:] == native and l[:] == native and memoryview(a).tolist() == native
+
+if __name__ == '__main__':
+    main()
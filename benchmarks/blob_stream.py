@@ -0,0 +1,54 @@
+# Streaming a large payload through a ShmBlob. The blob is split into segments of the largest heap block,
+# so it is not limited by the block size like a bytes value. The payload is written in chunks within
+# a single transaction, readers see either the old or the new version, then read back in chunks and
+# as small partial reads at random offsets, which only copy the bytes asked for.
+#
+# Usage: python3 benchmarks/blob_stream.py [megabytes] [chunk_kb]    (default: 64 256)
+
+import os
+import random
+import sys
+import time
+import pso
+
+def main():
+    size = int(sys.argv[1]) * 1024 * 1024 if len(sys.argv) > 1 else 64 * 1024 * 1024
+    chunk = int(sys.argv[2]) * 1024 if len(sys.argv) > 2 else 256 * 1024
+    pso.init()
+    blob = pso.ShmBlob()
+    payload = os.urandom(chunk)
+
+    start = time.perf_counter()
+    pso.transaction_start()
+    for position in range(0, size, chunk):
+        blob.write(payload[:min(chunk, size - position)])
+    pso.transaction_commit()
+    write_elapsed = time.perf_counter() - start
+
+    buffer = bytearray(chunk)
+    start = time.perf_counter()
+    blob.seek(0)
+    total = 0
+    while True:
+        n = blob.readinto(buffer)
+        if n == 0:
+            break
+        total += n
+    read_elapsed = time.perf_counter() - start
+    assert total == size == len(blob)
+
+    rnd = random.Random(1)
+    reads = 20000
+    start = time.perf_counter()
+    for i in range(reads):
+        blob.seek(rnd.randrange(0, size - 64))
+        blob.read(64)
+    partial_elapsed = time.perf_counter() - start
+
+    print(f'{"blob size":>24} {size / 1024 / 1024:10.0f} MB')
+    print(f'{"chunked write":>24} {size / write_elapsed / 1e6:10.0f} MB/s')
+    print(f'{"chunked readinto":>24} {size / read_elapsed / 1e6:10.0f} MB/s')
+    print(f'{"64 byte random reads":>24} {partial_elapsed / reads * 1e6:10.2f} us')
+
+if __name__ == '__main__':
+    main()
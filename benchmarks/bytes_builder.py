@@ -0,0 +1,47 @@
+# Storing a large serialized message into a ShmDict. The usual way builds the message in a local
+# bytearray and stores its bytes, copying the payload twice, while ShmBytesBuilder is filled in
+# place through a writable memoryview and frozen into a ShmValue without another copy.
+#
+# Usage: python3 benchmarks/bytes_builder.py [size] [repeat]    (default: 500000 2000)
+
+import sys
+import struct
+import time
+import pso
+
+def timed(func, repeat):
+    start = time.perf_counter()
+    for i in range(repeat):
+        func(i)
+    return (time.perf_counter() - start) / repeat
+
+def main():
+    # a single shared block is limited to 512KB
+    size = int(sys.argv[1]) if len(sys.argv) > 1 else 500000
+    repeat = int(sys.argv[2]) if len(sys.argv) > 2 else 2000
+    pso.init()
+    d = pso.ShmDict()
+    body = bytes(range(256)) * ((size - 16) // 256)
+
+    def fill(buffer, i):
+        struct.pack_into('<QQ', buffer, 0, i, len(body))
+        buffer[16:16 + len(body)] = body
+
+    def local_then_store(i):
+        message = bytearray(size)
+        fill(message, i)
+        d['message'] = bytes(message)
+
+    def builder(i):
+        b = pso.ShmBytesBuilder(size)
+        with b.view() as m:
+            fill(m, i)
+        d['message'] = b.freeze()
+
+    print(f'{"message size":>14} {size:>10}')
+    print(f'{"bytearray + store":>20} {timed(local_then_store, repeat) * 1e6:10.2f} us')
+    print(f'{"ShmBytesBuilder":>20} {timed(builder, repeat) * 1e6:10.2f} us')
+    assert struct.unpack_from('<QQ', d['message']) == (repeat - 1, len(body))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,60 @@
+# Batched ShmDict access against item-by-item access: update()/set_many() and get_many() take
+# every lock once and commit once, while each d[k] outside a transaction is a transaction of its own.
+# A persistent transaction around the loop is shown too, it also locks once but commits a larger delta.
+#
+# Usage: python3 benchmarks/dict_batch.py [count] [repeat]    (default: 2000 5)
+
+import sys
+import time
+import pso
+
+def timed(func, repeat):
+    best = None
+    for i in range(repeat):
+        start = time.perf_counter()
+        func()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None or elapsed < best else best
+    return best
+
+def in_transaction(func):
+    def wrapper():
+        pso.transaction_start()
+        func()
+        pso.transaction_commit()
+    return wrapper
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+    repeat = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+    pso.init()
+    keys = ['key%d' % i for i in range(count)]
+    items = {k: i for i, k in enumerate(keys)}
+
+    print(f'{"dict":>12} {"operation":>22} {"ms":>10}')
+    for concurrent in (False, True):
+        d = pso.ShmDict(concurrent=concurrent)
+        name = 'concurrent' if concurrent else 'plain'
+
+        def set_each():
+            for k, v in items.items():
+                d[k] = v
+
+        def get_each():
+            return [d[k] for k in keys]
+
+        cases = [
+            ('set item by item', set_each),
+            ('set in transaction', in_transaction(set_each)),
+            ('update()', lambda: d.update(items)),
+            ('set_many()', lambda: d.set_many(items.items())),
+            ('get item by item', get_each),
+            ('get in transaction', in_transaction(get_each)),
+            ('get_many()', lambda: d.get_many(keys)),
+        ]
+        for label, func in cases:
+            print(f'{name:>12} {label:>22} {timed(func, repeat) * 1e3:10.2f}')
+        assert d.get_many(keys) == list(range(count))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,41 @@
+# Commit cost of a transaction that bulk-loads a fresh ShmDict, and of one rewriting every item of a filled dict.
+#
+# Usage: python3 benchmarks/dict_bulk_commit.py [count...]    (default: 10000 100000)
+
+import sys
+import time
+import pso
+
+def timed_transaction(fill):
+    pso.transaction_start()
+    start = time.perf_counter()
+    fill()
+    set_time = time.perf_counter() - start
+    start = time.perf_counter()
+    pso.transaction_commit()
+    return set_time, time.perf_counter() - start
+
+def run(count):
+    d = pso.ShmDict()
+    def load():
+        for i in range(count):
+            d[i] = i
+    load_set, load_commit = timed_transaction(load)
+    def rewrite():
+        for i in range(count):
+            d[i] = -i
+    rewrite_set, rewrite_commit = timed_transaction(rewrite)
+    assert d[count - 1] == 1 - count
+    print(f'{count:10} {load_set * 1e3:12.1f} {load_commit * 1e3:12.1f} {rewrite_set * 1e3:12.1f} {rewrite_commit * 1e3:12.1f}')
+    return d
+
+def main():
+    counts = [int(arg) for arg in sys.argv[1:]] or [10000, 100000]
+    pso.init()
+    print(f'{"keys":>10} {"load set ms":>12} {"commit ms":>12} {"rewrite ms":>12} {"commit ms":>12}')
+    keep = []
+    for count in counts:
+        keep.append(run(count))
+
+if __name__ == '__main__':
+    main()
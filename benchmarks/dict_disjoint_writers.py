@@ -0,0 +1,52 @@
+# Multi-process workload where every worker writes its own keys into one shared ShmDict.
+# Compares a plain dict, where all writers queue on the single dict lock, with
+# ShmDict(concurrent=True), where keys are striped over separately locked segments.
+#
+# Usage: python3 benchmarks/dict_disjoint_writers.py [max_workers] [iterations]
+
+import sys
+import os
+import time
+import subprocess
+import pso
+
+def worker(coord_name, name, index, iterations):
+    pso.connect(coord_name)
+    root = pso.root()
+    d = getattr(root, name)
+    pso.transient_start()
+    start = time.perf_counter()
+    for i in range(iterations):
+        key = index * iterations + i
+        d[key] = i
+        d[key]
+    elapsed = time.perf_counter() - start
+    pso.transient_end()
+    root.timings[index] = elapsed
+
+def run(coord_name, concurrent, worker_count, iterations):
+    root = pso.root()
+    name = 'concurrent' if concurrent else 'plain'
+    setattr(root, name, pso.ShmDict(concurrent=concurrent))
+    root.timings = [0.0] * worker_count
+    workers = [subprocess.Popen([sys.executable, sys.argv[0], 'worker', coord_name, name, str(i), str(iterations)])
+        for i in range(worker_count)]
+    for w in workers:
+        w.wait()
+    timings = list(root.timings)
+    ops = 2 * iterations * worker_count
+    print(f'{name:>10} {worker_count} workers: {ops / max(timings):12.0f} ops/s total')
+
+if __name__ == '__main__':
+    if len(sys.argv) == 6 and sys.argv[1] == 'worker':
+        worker(sys.argv[2], sys.argv[3], int(sys.argv[4]), int(sys.argv[5]))
+    else:
+        max_workers = int(sys.argv[1]) if len(sys.argv) > 1 else min(4, os.cpu_count() or 1)
+        iterations = int(sys.argv[2]) if len(sys.argv) > 2 else 20000
+        coord_name = pso.init()
+        pso.transient_start()
+        count = 1
+        while count <= max_workers:
+            run(coord_name, False, count, iterations)
+            run(coord_name, True, count, iterations)
+            count *= 2
@@ -0,0 +1,30 @@
+# Latency of single ShmDict inserts across a growth of the hash table.
+# The dict is filled through the bulk constructor to just below the growth threshold
+# (half of 2**log_buckets), then every following insert is timed on its own.
+#
+# Usage: python3 benchmarks/dict_grow_latency.py [log_buckets] [inserts]
+
+import sys
+import time
+import pso
+
+def main():
+    log_buckets = int(sys.argv[1]) if len(sys.argv) > 1 else 20
+    inserts = int(sys.argv[2]) if len(sys.argv) > 2 else 2000
+    pso.init()
+    prefill = (1 << log_buckets) // 2 - inserts // 4
+    d = pso.ShmDict(dict.fromkeys(range(prefill), 0))
+    latencies = []
+    for key in range(prefill, prefill + inserts):
+        start = time.perf_counter()
+        d[key] = 1
+        latencies.append(time.perf_counter() - start)
+    ordered = sorted(latencies)
+    def pct(p):
+        return ordered[min(len(ordered) - 1, int(len(ordered) * p))] * 1e6
+    print(f'{prefill} prefilled keys, {inserts} inserts, microseconds:')
+    print(f'{"p50":>10} {"p99":>10} {"p99.9":>10} {"max":>10}')
+    print(f'{pct(0.5):10.0f} {pct(0.99):10.0f} {pct(0.999):10.0f} {ordered[-1] * 1e6:10.0f}')
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,46 @@
+# keys()/values() and iteration of a ShmDict, both filled and after most of its items were deleted,
+# which leaves the table sparse since it never shrinks.
+#
+# Usage: python3 benchmarks/dict_iterate.py [count] [repeat]    (default: 100000 5)
+
+import sys
+import time
+import pso
+
+def timed(func, repeat):
+    best = None
+    for i in range(repeat):
+        start = time.perf_counter()
+        func()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None or elapsed < best else best
+    return best
+
+def report(name, d, repeat):
+    keys = timed(lambda: d.keys(), repeat)
+    values = timed(lambda: d.values(), repeat)
+    pso.transaction_start()
+    iterate = timed(lambda: sum(1 for v in d), repeat)
+    pso.transaction_commit()
+    print(f'{name:>16} {len(d):10} {keys * 1e3:10.2f} {values * 1e3:10.2f} {iterate * 1e3:10.2f}')
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    repeat = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+    pso.init()
+    d = pso.ShmDict()
+    pso.transaction_start()
+    for i in range(count):
+        d[i] = i
+    pso.transaction_commit()
+    print(f'{"":>16} {"items":>10} {"keys ms":>10} {"values ms":>10} {"iter ms":>10}')
+    report('filled', d, repeat)
+    pso.transaction_start()
+    for i in range(count):
+        if i % 10 != 0:
+            del d[i]
+    pso.transaction_commit()
+    report('90% deleted', d, repeat)
+
+if __name__ == '__main__':
+    main()
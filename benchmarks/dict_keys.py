@@ -0,0 +1,52 @@
+# Native int/bytes/tuple ShmDict keys against the old workaround of formatting the key into str.
+# Memory is the growth of the shared memory resident set (RssShmem), so it includes the hash tables.
+#
+# Usage: python3 benchmarks/dict_keys.py [count]
+
+import sys
+import time
+import pso
+
+KEY_TYPES = {
+    'str(int)': lambda i: str(i * 7919),
+    'int': lambda i: i * 7919,
+    'bytes': lambda i: b'key:%d' % i,
+    'tuple': lambda i: (i, 'k'),
+}
+
+def rss_shmem_kb():
+    with open('/proc/self/status') as f:
+        for line in f:
+            if line.startswith('RssShmem:'):
+                return int(line.split()[1])
+    return 0
+
+def run(name, make_key, count):
+    keys = [make_key(i) for i in range(count)]
+    mem_before = rss_shmem_kb()
+    d = pso.ShmDict()
+    pso.transient_start()
+    start = time.perf_counter()
+    for i, k in enumerate(keys):
+        d[k] = i
+    insert_time = time.perf_counter() - start
+    start = time.perf_counter()
+    for k in keys:
+        d[k]
+    lookup_time = time.perf_counter() - start
+    pso.transient_end()
+    mem = rss_shmem_kb() - mem_before
+    print(f'{name:10} {count / insert_time:12.0f} {count / lookup_time:12.0f} {mem:12d}')
+    return d
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+    pso.init()
+    print(f'{count} keys')
+    print(f'{"key":10} {"inserts/s":>12} {"lookups/s":>12} {"shm KiB":>12}')
+    keep = []
+    for name, make_key in KEY_TYPES.items():
+        keep.append(run(name, make_key, count))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,49 @@
+# Hash table probing: builds a ShmDict through the bulk constructor, then looks up every key
+# (hits) and as many absent keys (misses, which walk the probe chain up to an empty bucket).
+# The lookups run in a single transient transaction, so they mostly measure the table itself.
+#
+# Usage: python3 benchmarks/dict_probe.py [count...]    (default: 1000 1000000 10000000)
+
+import sys
+import time
+import pso
+
+def rss_shmem_kb():
+    with open('/proc/self/status') as f:
+        for line in f:
+            if line.startswith('RssShmem:'):
+                return int(line.split()[1])
+    return 0
+
+def run(count):
+    keys = [i * 7919 for i in range(count)]
+    absent = [-1 - k for k in keys]
+    mem_before = rss_shmem_kb()
+    start = time.perf_counter()
+    d = pso.ShmDict(dict.fromkeys(keys, 1))
+    build_time = time.perf_counter() - start
+    mem = rss_shmem_kb() - mem_before
+    pso.transient_start()
+    start = time.perf_counter()
+    for k in keys:
+        d[k]
+    hit_time = time.perf_counter() - start
+    start = time.perf_counter()
+    for k in absent:
+        try:
+            d[k]
+        except KeyError:
+            pass
+    miss_time = time.perf_counter() - start
+    pso.transient_end()
+    print(f'{count:10} {count / build_time:12.0f} {count / hit_time:12.0f} {count / miss_time:12.0f} {mem:12d}')
+
+def main():
+    counts = [int(arg) for arg in sys.argv[1:]] or [1000, 1000000, 10000000]
+    pso.init()
+    print(f'{"keys":>10} {"inserts/s":>12} {"hits/s":>12} {"misses/s":>12} {"shm KiB":>12}')
+    for count in counts:
+        run(count)
+
+if __name__ == '__main__':
+    main()
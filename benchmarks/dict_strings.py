@@ -0,0 +1,63 @@
+# Dict-of-strings workload: fill a ShmDict with str keys and values, then look all the keys up
+# and read the values back. Run for ASCII, Latin-1, BMP (UCS-2) and astral (UCS-4) strings,
+# since the shared memory strings keep the PEP 393 kind of the source string.
+# Memory is the growth of the shared memory resident set (RssShmem), so it includes the hash tables.
+#
+# Usage: python3 benchmarks/dict_strings.py [count] [value_length]
+
+import sys
+import time
+import pso
+
+ALPHABETS = {
+    'ascii': 'abcdefghijklmnopqrstuvwxyz',
+    'latin1': 'àáâãäåæçèéêëìíîïðñòóôõö',
+    'ucs2': 'абвгдеёжзийклмнопрстуфхцчшщ',
+    'ucs4': '\U0001F600\U0001F601\U0001F602\U0001F603\U0001F604\U0001F605',
+}
+
+def rss_shmem_kb():
+    with open('/proc/self/status') as f:
+        for line in f:
+            if line.startswith('RssShmem:'):
+                return int(line.split()[1])
+    return 0
+
+def make_string(alphabet, index, length):
+    chars = []
+    while index or len(chars) < length:
+        chars.append(alphabet[index % len(alphabet)])
+        index //= len(alphabet)
+    return ''.join(chars)
+
+def run(name, alphabet, count, value_length):
+    keys = [make_string(alphabet, i, 8) for i in range(count)]
+    values = [make_string(alphabet, i * 7919, value_length) for i in range(count)]
+    mem_before = rss_shmem_kb()
+    d = pso.ShmDict()
+    pso.transient_start()
+    start = time.perf_counter()
+    for k, v in zip(keys, values):
+        d[k] = v
+    insert_time = time.perf_counter() - start
+    start = time.perf_counter()
+    for k in keys:
+        d[k]
+    lookup_time = time.perf_counter() - start
+    pso.transient_end()
+    mem = rss_shmem_kb() - mem_before
+    print(f'{name:8} {count / insert_time:12.0f} {count / lookup_time:12.0f} {mem:12d} {mem * 1024 / count:10.1f}')
+    return d
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    value_length = int(sys.argv[2]) if len(sys.argv) > 2 else 32
+    pso.init()
+    print(f'{count} keys, {value_length} chars per value')
+    print(f'{"kind":8} {"inserts/s":>12} {"lookups/s":>12} {"shm KiB":>12} {"B/entry":>10}')
+    keep = []
+    for name, alphabet in ALPHABETS.items():
+        keep.append(run(name, alphabet, count, value_length))
+
+if __name__ == '__main__':
+    main()
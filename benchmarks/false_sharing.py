@@ -0,0 +1,54 @@
+# Multi-process append/get workload where every worker owns a separate container.
+# Containers are allocated back to back by the primary process, so any slowdown
+# from adding workers comes from shared cache lines (heaps, superblock, neighbouring
+# containers) rather than from real contention. Needs as many CPUs as workers to
+# show anything, a single CPU just runs the workers one after another.
+#
+# Usage: python3 benchmarks/false_sharing.py [max_workers] [iterations]
+
+import sys
+import os
+import time
+import subprocess
+import pso
+
+def worker(coord_name, index, iterations):
+    pso.connect(coord_name)
+    root = pso.root()
+    lst = root.lists[index]
+    obj = root.objects[index]
+    pso.transient_start()
+    start = time.perf_counter()
+    for i in range(iterations):
+        lst.append(i)
+        obj.value = lst[i]
+    elapsed = time.perf_counter() - start
+    pso.transient_end()
+    root.timings[index] = elapsed
+
+def run(coord_name, worker_count, iterations):
+    root = pso.root()
+    root.lists = [[] for i in range(worker_count)]
+    root.objects = [pso.ShmObject() for i in range(worker_count)]
+    root.timings = [0.0] * worker_count
+    workers = [subprocess.Popen([sys.executable, sys.argv[0], 'worker', coord_name, str(i), str(iterations)])
+        for i in range(worker_count)]
+    for w in workers:
+        w.wait()
+    timings = list(root.timings)
+    ops = 2 * iterations * worker_count
+    wall = max(timings)
+    print(f'{worker_count} workers: {ops / wall:12.0f} ops/s total, {2 * iterations / (sum(timings) / worker_count):10.0f} ops/s per worker')
+
+if __name__ == '__main__':
+    if len(sys.argv) == 5 and sys.argv[1] == 'worker':
+        worker(sys.argv[2], int(sys.argv[3]), int(sys.argv[4]))
+    else:
+        max_workers = int(sys.argv[1]) if len(sys.argv) > 1 else min(4, os.cpu_count() or 1)
+        iterations = int(sys.argv[2]) if len(sys.argv) > 2 else 20000
+        coord_name = pso.init()
+        pso.transient_start()
+        count = 1
+        while count <= max_workers:
+            run(coord_name, count, iterations)
+            count *= 2
@@ -0,0 +1,92 @@
+# Static count of the memory barriers emitted for the core sources.
+# Every p_atomic_* call is an out of line sequentially consistent operation, so it is counted
+# separately from the barriers the compiler inlined (explicit order shm_atomic_* helpers).
+# Optionally compares against another git revision of the tree.
+#
+# Usage: python3 benchmarks/fence_count.py [--cc gcc|aarch64-linux-gnu-gcc|clang --target=aarch64-linux-gnu] [--rev REV]
+#
+# ARM64 counts only need a cross compiler, nothing is executed. The object code can be run under
+# qemu-aarch64 afterwards, but the instruction counts here do not depend on that.
+
+import sys
+import os
+import re
+import shlex
+import argparse
+import subprocess
+import tempfile
+import collections
+
+SOURCES = ['shm_base.c', 'MM.c', 'shm_types.c', 'coordinator.c', 'shm_event_linux.c']
+
+PATTERNS = {
+    'x86_64': {
+        'full fence': re.compile(r'^\s+(mfence|xchg[lqwb]?\s+\S+,\s*-?\w*\(|lock\s)'),
+    },
+    'aarch64': {
+        'full fence': re.compile(r'^\s+dmb\s'),
+        'acquire/release': re.compile(r'^\s+(ldar|stlr|ldaxr|stlxr|ldapr|cas[a-z]*al|ldadd[a-z]*al|swp[a-z]*al)\w*\s'),
+    },
+}
+ATOMIC_CALL = re.compile(r'^\s+(call|bl)\s+(p_atomic_\w+)')
+
+def detect_arch(cc):
+    machine = subprocess.run(cc + ['-dumpmachine'], capture_output=True, text=True, check=True).stdout
+    return 'aarch64' if machine.startswith('aarch64') else 'x86_64'
+
+def count(tree, cc, arch):
+    totals = collections.Counter()
+    calls = collections.Counter()
+    for source in SOURCES:
+        path = os.path.join(tree, 'src', source)
+        if not os.path.exists(path):
+            continue
+        cmd = cc + ['-O2', '-fno-strict-aliasing', '-DSHM_NOASSERT', '-S', '-o', '-',
+            '-I' + os.path.join(tree, 'src'), '-I' + os.path.join(tree, 'src', 'plibsys-mini'),
+            '-I' + os.path.join(tree, 'src', 'safeclib-mini'), path]
+        asm = subprocess.run(cmd, capture_output=True, text=True, check=True).stdout
+        for line in asm.splitlines():
+            for name, pattern in PATTERNS[arch].items():
+                if pattern.match(line):
+                    totals[source, name] += 1
+            m = ATOMIC_CALL.match(line)
+            if m:
+                calls[source, 'load' if m.group(2).endswith('_get') else 'store/rmw'] += 1
+    return totals, calls
+
+def export_rev(rev, target):
+    archive = subprocess.run(['git', 'archive', rev, 'src'], capture_output=True, check=True).stdout
+    subprocess.run(['tar', 'xf', '-', '-C', target], input=archive, check=True)
+
+def pick(counter, source, name):
+    return sum(v for (s, n), v in counter.items() if n == name and source in (s, 'total'))
+
+def report(title, totals, calls, arch):
+    print(title)
+    names = list(PATTERNS[arch])
+    print(f'  {"source":20} {"seq_cst loads":>14} {"seq_cst st/rmw":>14}' + ''.join(f' {"inline " + n:>24}' for n in names))
+    for source in SOURCES + ['total']:
+        print(f'  {source:20} {pick(calls, source, "load"):14} {pick(calls, source, "store/rmw"):14}' +
+            ''.join(f' {pick(totals, source, n):24}' for n in names))
+    # seq_cst loads compile to a plain mov on x86, seq_cst stores and every RMW are full barriers
+    if arch == 'x86_64':
+        print(f'  full barrier sites: {pick(calls, "total", "store/rmw") + pick(totals, "total", "full fence")}')
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('--cc', default=os.environ.get('CC', 'cc'))
+    parser.add_argument('--rev', default=None, help='git revision to compare with, e.g. HEAD~1')
+    args = parser.parse_args()
+    cc = shlex.split(args.cc)
+    arch = detect_arch(cc)
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    totals, calls = count(root, cc, arch)
+    report(f'working tree ({arch}):', totals, calls, arch)
+    if args.rev:
+        with tempfile.TemporaryDirectory() as tmp:
+            export_rev(args.rev, tmp)
+            old_totals, old_calls = count(tmp, cc, arch)
+        report(f'{args.rev} ({arch}):', old_totals, old_calls, arch)
+
+if __name__ == '__main__':
+    main()
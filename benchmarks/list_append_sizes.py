@@ -0,0 +1,48 @@
+# Append throughput of a ShmList at growing sizes. The list index is kept in pages of 256 blocks,
+# a new block is added to the index in place, so the cost of an append should not depend on how
+# many items the list already holds, compared with the same appends to a native list.
+#
+# Usage: python3 benchmarks/list_append_sizes.py [max_size] [appends]    (default: 4000000 20000)
+
+import sys
+import time
+import pso
+
+def timed_appends(l, appends):
+    start = time.perf_counter()
+    # a transaction holds a limited number of list changes
+    for first in range(0, appends, 16):
+        pso.transaction_start()
+        for value in range(first, min(first + 16, appends)):
+            l.append(value)
+        pso.transaction_commit()
+    return time.perf_counter() - start
+
+def main():
+    max_size = int(sys.argv[1]) if len(sys.argv) > 1 else 4000000
+    appends = int(sys.argv[2]) if len(sys.argv) > 2 else 20000
+    pso.init()
+    l = pso.ShmList()
+    native = []
+    chunk = list(range(100000))
+    size = 0
+    print(f'{"size":>12} {"ShmList ns/append":>18} {"native ns/append":>18}')
+    target = 10000
+    while target <= max_size:
+        while size < target:
+            part = chunk[:target - size]
+            l.extend(part)
+            native.extend(part)
+            size += len(part)
+        elapsed = timed_appends(l, appends)
+        start = time.perf_counter()
+        for value in range(appends):
+            native.append(value)
+        native_elapsed = time.perf_counter() - start
+        size += appends
+        print(f'{target:>12} {elapsed / appends * 1e9:18.0f} {native_elapsed / appends * 1e9:18.1f}')
+        target *= 4
+    assert len(l) == len(native) and l[-1] == native[-1]
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,84 @@
+# ShmList used as a stack, a queue and a deque. The ends of every block keep free cells, so pop(), popleft() and
+# appendleft() touch a single cell, while insert()/del in the middle shift at most one block worth of items.
+# Every operation runs outside of a transaction and thus commits on its own, so append() is the baseline to compare with.
+# A native list is shown for reference.
+#
+# Usage: python3 benchmarks/list_deque.py [count] [repeat]    (default: 2000 3)
+
+import sys
+import time
+import pso
+
+def timed(func, repeat):
+    best = None
+    for i in range(repeat):
+        start = time.perf_counter()
+        func()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None or elapsed < best else best
+    return best
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+    repeat = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+    pso.init()
+
+    def run(make):
+        l = make()
+
+        def append():
+            l.clear()
+            for i in range(count):
+                l.append(i)
+
+        def appendleft():
+            l.clear()
+            for i in range(count):
+                l.insert(0, i)
+
+        def pop_tail():
+            l.clear()
+            l.extend(range(count))
+            for i in range(count):
+                l.pop()
+
+        def popleft():
+            l.clear()
+            l.extend(range(count))
+            for i in range(count):
+                l.pop(0)
+
+        def insert_middle():
+            l.clear()
+            l.extend(range(count))
+            for i in range(count // 4):
+                l.insert(len(l) // 2, i)
+
+        def del_middle():
+            l.clear()
+            l.extend(range(count))
+            for i in range(count // 4):
+                del l[len(l) // 2]
+
+        return [
+            ('append(v)', append),
+            ('insert(0, v)', appendleft),
+            ('pop()', pop_tail),
+            ('pop(0)', popleft),
+            ('insert in the middle', insert_middle),
+            ('del in the middle', del_middle),
+        ]
+
+    print(f'{"operation":>22} {"ShmList ms":>12} {"list ms":>12}')
+    for (label, shm_func), (_, native_func) in zip(run(pso.ShmList), run(list)):
+        print(f'{label:>22} {timed(shm_func, repeat) * 1e3:12.2f} {timed(native_func, repeat) * 1e3:12.2f}')
+
+    l = pso.ShmList()
+    l.extend(range(10))
+    l.appendleft(-1)
+    l.insert(5, 'x')
+    del l[-1]
+    assert l.pop() == 8 and l.pop(0) == -1 and l[:] == [0, 1, 2, 3, 'x', 4, 5, 6, 7]
+
+if __name__ == '__main__':
+    main()
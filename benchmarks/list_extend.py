@@ -0,0 +1,49 @@
+# Bulk loading of a ShmList: the ShmList(seq) constructor and extend() size the blocks and the index once
+# and fill the cells in a single pass, while each append() outside a transaction takes the lock, commits
+# on its own and grows the tail block step by step.
+#
+# Usage: python3 benchmarks/list_extend.py [count] [repeat]    (default: 100000 3)
+
+import sys
+import time
+import pso
+
+def timed(func, repeat):
+    best = None
+    for i in range(repeat):
+        start = time.perf_counter()
+        func()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None or elapsed < best else best
+    return best
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    repeat = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+    pso.init()
+    native = list(range(count))
+    # item by item appends are timed on a smaller slice, they are too slow for the full count
+    slice_count = min(count, 2000)
+
+    def append_each():
+        l = pso.ShmList()
+        for value in native[:slice_count]:
+            l.append(value)
+
+    def extend():
+        l = pso.ShmList()
+        l.extend(native)
+        assert len(l) == count
+
+    cases = [
+        ('append() x%d' % slice_count, append_each),
+        ('ShmList(seq)', lambda: pso.ShmList(native)),
+        ('extend()', extend),
+        ('extend() generator', lambda: pso.ShmList().extend(v for v in native)),
+    ]
+    for label, func in cases:
+        print(f'{label:>22} {timed(func, repeat) * 1e3:10.2f} ms')
+    assert pso.ShmList(native)[:] == native
+
+if __name__ == '__main__':
+    main()
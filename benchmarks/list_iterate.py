@@ -0,0 +1,55 @@
+# Iteration and slicing of a ShmList. The iterator and the slices fetch the items in chunks under
+# a single lock, compared with the item by item indexing, where each l[i] outside a transaction
+# takes the lock on its own, and with the same walk over a native list.
+#
+# Usage: python3 benchmarks/list_iterate.py [count] [repeat]    (default: 20000 5)
+
+import sys
+import time
+import pso
+
+def timed(func, repeat):
+    best = None
+    for i in range(repeat):
+        start = time.perf_counter()
+        func()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None or elapsed < best else best
+    return best
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 20000
+    repeat = int(sys.argv[2]) if len(sys.argv) > 2 else 5
+    pso.init()
+    native = list(range(count))
+    l = pso.ShmList()
+    # a transaction holds a limited number of list changes
+    for start in range(0, count, 16):
+        pso.transaction_start()
+        for value in native[start:start + 16]:
+            l.append(value)
+        pso.transaction_commit()
+
+    def index_each():
+        return [l[i] for i in range(count)]
+
+    def iterate_transacted():
+        pso.transaction_start()
+        rslt = sum(1 for v in l)
+        pso.transaction_commit()
+        return rslt
+
+    cases = [
+        ('native iteration', lambda: sum(1 for v in native)),
+        ('l[i] item by item', index_each),
+        ('iteration', lambda: sum(1 for v in l)),
+        ('iteration in transaction', iterate_transacted),
+        ('l[:]', lambda: l[:]),
+        ('l[::-3]', lambda: l[::-3]),
+    ]
+    for label, func in cases:
+        print(f'{label:>26} {timed(func, repeat) * 1e3:10.2f} ms')
+    assert l[:] == native and list(l) == native and l[::-3] == native[::-3]
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,34 @@
+#!/bin/sh
+# Builds the extension with the default flags, with LTO and with LTO+PGO trained on tests/test.c,
+# and measures tests/accounts.py run time for each of them. Rebuilds src/_pso*.so in place.
+#
+# Usage: sh benchmarks/pgo_accounts.sh [runs]
+
+set -e
+cd "$(dirname "$0")/.."
+RUNS=${1:-3}
+export PYTHONPATH="$PWD/src"
+
+measure() {
+	for i in $(seq "$RUNS"); do
+		python3 - "$1" <<'PY'
+import sys, time, subprocess
+start = time.perf_counter()
+subprocess.run([sys.executable, '-m', 'pso', 'tests/accounts.py'], check=True, stdout=subprocess.DEVNULL)
+print(f'{sys.argv[1]}: {time.perf_counter() - start:.2f} s')
+PY
+	done
+}
+
+PSO_BUILD_PROFILE= python3 setup.py -q build_ext --inplace --force
+measure default
+
+PSO_BUILD_PROFILE=lto python3 setup.py -q build_ext --inplace --force
+measure lto
+
+rm -rf build/pgo
+PSO_BUILD_PROFILE=pgo-generate python3 setup.py -q build_ext --inplace --force
+PSO_BUILD_PROFILE=pgo-generate python3 setup.py -q build_test --inplace --force
+./src/pso_test > /dev/null
+PSO_BUILD_PROFILE=pgo-use python3 setup.py -q build_ext --inplace --force
+measure lto+pgo
@@ -0,0 +1,62 @@
+# Aggregates over metrics rows kept as a ShmTable of typed columns, compared with the same rows
+# kept as a ShmList of ShmObject and aggregated from Python. The table computes the sums, the extremes
+# and the filters in C over the column chunks, no Python object is created per row.
+#
+# Usage: python3 benchmarks/table_aggregates.py [rows] [repeat]    (default: 100000 3)
+
+import sys
+import time
+import random
+import pso
+
+class Metric(pso.ShmObject):
+    def __init__(self, ts, host, value):
+        self.ts = ts
+        self.host = host
+        self.value = value
+
+def timed(func, repeat):
+    best = None
+    for i in range(repeat):
+        start = time.perf_counter()
+        func()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None or elapsed < best else best
+    return best
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    repeat = int(sys.argv[2]) if len(sys.argv) > 2 else 3
+    pso.init()
+    rows = [(ts, random.randrange(16), random.random() * 100) for ts in range(count)]
+    table = pso.ShmTable([('ts', 'q'), ('host', 'i'), ('value', 'd')])
+    table.extend(rows)
+    objects = pso.ShmList()
+    # a transaction holds a limited number of list changes
+    for start in range(0, count, 16):
+        pso.transaction_start()
+        for ts, host, value in rows[start:start + 16]:
+            objects.append(Metric(ts, host, value))
+        pso.transaction_commit()
+
+    where = [('host', '==', 3), ('value', '>', 50.0)]
+    cases = [
+        ('table.sum', lambda: table.sum('value'),
+            lambda: sum(m.value for m in objects)),
+        ('table.max', lambda: table.max('value'),
+            lambda: max(m.value for m in objects)),
+        ('table.sum where', lambda: table.sum('value', where),
+            lambda: sum(m.value for m in objects if m.host == 3 and m.value > 50.0)),
+        ('table.count where', lambda: table.count(where),
+            lambda: sum(1 for m in objects if m.host == 3 and m.value > 50.0)),
+        ('table.filter', lambda: table.filter(where),
+            lambda: [i for i, m in enumerate(objects) if m.host == 3 and m.value > 50.0]),
+    ]
+    print(f'{"":>20} {"ShmTable ms":>12} {"ShmList ms":>12}')
+    for label, table_func, list_func in cases:
+        table_result, list_result = table_func(), list_func()
+        assert table_result == list_result or abs(table_result - list_result) < 1e-6 * abs(list_result)
+        print(f'{label:>20} {timed(table_func, repeat) * 1e3:12.3f} {timed(list_func, repeat) * 1e3:12.1f}')
+
+if __name__ == '__main__':
+    main()
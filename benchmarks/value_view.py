@@ -0,0 +1,42 @@
+# Reading large bytes values of a ShmDict. The d[key] copies the whole value into a new bytes object
+# on every access, while d.get_value(key).view() maps the shared block into a read-only memoryview,
+# so a consumer looking at a small part of the payload pays only for what it reads.
+#
+# Usage: python3 benchmarks/value_view.py [repeat]    (default: 2000)
+
+import sys
+import time
+import pso
+
+def timed(func, repeat):
+    start = time.perf_counter()
+    for i in range(repeat):
+        func()
+    return (time.perf_counter() - start) / repeat
+
+def main():
+    repeat = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+    pso.init()
+    d = pso.ShmDict()
+    print(f'{"size":>10} {"d[key] us":>12} {"view() us":>12} {"header copy us":>16} {"header view us":>16}')
+    # a single shared block is limited to 512KB
+    for size in (1000, 10000, 100000, 500000):
+        payload = bytes(range(256)) * (size // 256) + bytes(size % 256)
+        d['payload'] = payload
+
+        def header_copy():
+            return d['payload'][:16]
+
+        def header_view():
+            with d.get_value('payload').view() as m:
+                return bytes(m[:16])
+
+        copy_us = timed(lambda: d['payload'], repeat) * 1e6
+        view_us = timed(lambda: d.get_value('payload').view(), repeat) * 1e6
+        print(f'{size:>10} {copy_us:12.2f} {view_us:12.2f} '
+              f'{timed(header_copy, repeat) * 1e6:16.2f} {timed(header_view, repeat) * 1e6:16.2f}')
+        assert header_copy() == header_view() == payload[:16]
+        assert bytes(d.get_value('payload').view()) == payload
+
+if __name__ == '__main__':
+    main()
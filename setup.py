@@ -44,10 +44,22 @@ else:
     if '--debug' in sys.argv or '-g' in sys.argv:
         extra_compile_args += ['-O0']
     extra_libs = ['rt']
+    # Optional optimized builds, see INSTALL.txt and benchmarks/pgo_accounts.sh:
+    # PSO_BUILD_PROFILE=lto, or pgo-generate -> run src/pso_test -> pgo-use (implies lto).
+    build_profile = os.environ.get('PSO_BUILD_PROFILE', '')
+    pgo_dir = os.path.abspath(os.path.join('build', 'pgo'))
+    if build_profile in ('lto', 'pgo-use'):
+        extra_combo_flags += ['-flto']
+    if build_profile == 'pgo-generate':
+        extra_combo_flags += ['-fprofile-generate=' + pgo_dir, '-fprofile-update=atomic']
+    elif build_profile == 'pgo-use':
+        extra_combo_flags += ['-fprofile-use=' + pgo_dir, '-fprofile-correction', '-Wno-missing-profile']
+    elif build_profile not in ('', 'lto'):
+        sys.exit('Unknown PSO_BUILD_PROFILE: ' + build_profile)
 
 pso_ext_sources = ['_pso.c']
 pso_common_sources = ['shm_base.c', 'shm_types.c', 'shm_utils.c', 'coordinator.c', 'MM.c', 'unordered_map.c',
-    'shm_event.c', libsys('puthread.c')] + pso_ext_sources
+    'shm_event.c', 'shm_table.c', 'shm_blob.c', libsys('puthread.c')] + pso_ext_sources
 
 # XXX: for some reason pso.c is also compiled into test application
 pso_module = TestExtension(
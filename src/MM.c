@@ -154,6 +154,9 @@ static int block_in_new_segment = 0;
 static int block_appended_to_segment = 0;
 static int block_from_free_list = 0;
 static int block_in_new_sector = 0;
+// not static, tests check them
+int garbage_throttled = 0;
+int garbage_throttle_drained = 0;
 static int prev_allocs = 0;
 static int prev_frees = 0;
 static int allocs = 0;
@@ -206,6 +209,8 @@ dump_mm_debug()
 		flex_sector_count, flex_sector_sign, flex_sector_delta);
 	fprintf(stderr, "   New sectors %d, new segments %d, new blocks %d, reused %d\n",
 		block_in_new_sector, block_in_new_segment, block_appended_to_segment, block_from_free_list);
+	fprintf(stderr, "   Pending garbage %d, throttled %d, of which drained %d\n",
+		superblock->pending_garbage, garbage_throttled, garbage_throttle_drained);
 	prev_flex_sectors = flex_sector_count;
 	prev_sectors = sector_count;
 	prev_segments = segment_count;
@@ -215,6 +220,8 @@ dump_mm_debug()
 	block_appended_to_segment = 0;
 	block_from_free_list = 0;
 	block_in_new_sector = 0;
+	garbage_throttled = 0;
+	garbage_throttle_drained = 0;
 	fprintf(stderr, "   get_mem locking time %9.3f ms, of which spinlocking %9.3f ms\n",
 		get_mem_locking / 3500000.0, get_mem_spinlocking / 3500000.0);
 	get_mem_locking = 0;
@@ -230,6 +237,56 @@ offset_to_int(volatile void *higher, volatile void *lower)
 	return value;
 }
 
+#define GARBAGE_SOFT_THROTTLE_ROUNDS 12
+#define GARBAGE_HARD_THROTTLE_ROUNDS 60
+
+// Backpressure for the case of reclaimer lagging behind allocations.
+// Called with heap->lock taken right before the arena is grown by superblock_alloc_more.
+// While pending_garbage is above the watermarks we release the heap lock (reclaimer needs it to return blocks into our sectors)
+// and give the reclaimer some time. Returns true when the backlog was drained, so the caller should rescan its sectors.
+static bool
+mm_garbage_backpressure(ShmHeap *heap)
+{
+	ShmInt soft_limit = shm_atomic_int_get_relaxed(&superblock->garbage_soft_limit);
+	ShmInt hard_limit = shm_atomic_int_get_relaxed(&superblock->garbage_hard_limit);
+	ShmInt pending = shm_atomic_int_get_relaxed(&superblock->pending_garbage);
+	if (soft_limit <= 0 || pending < soft_limit)
+		return false;
+
+	// Make sure reclaimer is awake.
+	shm_atomic_int_set_release(&superblock->has_garbage, 1);
+	shm_event_signal(&superblock->has_garbage_event);
+
+	// Reclaimer waits for persistent transactions to finish, so waiting inside of one is pointless.
+	ThreadContext *thread = shm_pointer_to_pointer(heap->thread);
+	if (thread == NULL || p_atomic_int_get(&thread->transaction_mode) > TRANSACTION_TRANSIENT)
+		return false;
+
+	int rounds = GARBAGE_SOFT_THROTTLE_ROUNDS;
+	if (hard_limit > 0 && pending >= hard_limit)
+		rounds = GARBAGE_HARD_THROTTLE_ROUNDS;
+
+	garbage_throttled++;
+	bool drained = false;
+	shm_lock_release(&heap->lock, __LINE__);
+	for (int i = 0; i < rounds; ++i)
+	{
+		if (i < 10)
+			Sleep(0);
+		else
+			Sleep(1);
+		if (shm_atomic_int_get_relaxed(&superblock->pending_garbage) < soft_limit)
+		{
+			drained = true;
+			break;
+		}
+	}
+	shm_lock_acquire(&heap->lock);
+	if (drained)
+		garbage_throttle_drained++;
+	return drained;
+}
+
 int
 alloc_sector(ShmHeap *heap, ShmHeapSectorHeader **newblock, ShmPointer *newblock_shm)
 {
@@ -237,6 +294,9 @@ alloc_sector(ShmHeap *heap, ShmHeapSectorHeader **newblock, ShmPointer *newblock
 	// old.head = heap->sectors.head;
 	// old.tail = heap->sectors.tail;
 	int newindex = -1;
+	// reclaimed blocks might be available now, let the caller search for them
+	if (mm_garbage_backpressure(heap))
+		return RESULT_REPEAT;
 	// relies on outer lock to ensure uninitialized shared memory block will not become visible and multiple thread won't overallocate redundant blocks on contention.
 	int err = superblock_alloc_more(heap->thread, SHM_BLOCK_TYPE_THREAD_SECTOR, &newindex, -2);
 	shmassert(err != RESULT_FAILURE);
@@ -590,12 +650,15 @@ allocate_block_of_size(ShmHeap *heap, int size, ShmHeapSectorHeader **sector)
 					// remove it from empty segments
 					run->segments_heads[SIZE_CLASS_COUNT] = segment->next_segment;
 					sector_claim_segment(run, segment, size);
-					// append into appropriate class
-					segment->next_segment = run->segments_heads[size];
-					run->segments_heads[size] = offset_to_int(segment, run);
-
 					block = segment_alloc_block(segment);
 					shmassert_msg(block, "Could not allocate a new block in an empty segment");
+					// append into appropriate class, unless the segment holds a single block which is already taken.
+					// The full segment is linked back by reclaim_small_block, linking it twice would loop the list.
+					if (segment->used_count < segment->max_capacity)
+					{
+						segment->next_segment = run->segments_heads[size];
+						run->segments_heads[size] = offset_to_int(segment, run);
+					}
 					shmassert(block_get_segment(block) == segment);
 					shmassert(segment_get_sector(block_get_segment(block)) == run);
 					if (sector)
@@ -619,11 +682,14 @@ allocate_block_of_size(ShmHeap *heap, int size, ShmHeapSectorHeader **sector)
 
 			run->segments_heads[SIZE_CLASS_COUNT] = segment->next_segment;
 			sector_claim_segment(run, segment, size);
-			segment->next_segment = run->segments_heads[size];
-			run->segments_heads[size] = offset_to_int(segment, run);
-
 			block = segment_alloc_block(segment);
 			shmassert_msg(block, "Could not allocate a new block in an empty segment");
+			// same as for a free segment above
+			if (segment->used_count < segment->max_capacity)
+			{
+				segment->next_segment = run->segments_heads[size];
+				run->segments_heads[size] = offset_to_int(segment, run);
+			}
 			shmassert(block_get_segment(block) == segment);
 			shmassert(segment_get_sector(block_get_segment(block)) == run);
 			if (sector)
@@ -984,11 +1050,19 @@ allocate_medium_block_of_size(ShmHeap *heap, int size, ShmHeapFlexSectorHeader *
 	shmassert(size >= 0 && size < MEDIUM_SIZE_CLASS_COUNT);
 
 	// You should rewrite this function to support RESULT_REPEAT
+	bool throttled = false;
 	for (int trying_size = size; trying_size <= MEDIUM_SIZE_CLASS_COUNT; ++trying_size)
 	{
 		if (trying_size == MEDIUM_SIZE_CLASS_COUNT)
 		{
 			// free block not found
+			if (!throttled && mm_garbage_backpressure(heap))
+			{
+				// rescan once, reclaimer might've returned some blocks
+				throttled = true;
+				trying_size = size - 1;
+				continue;
+			}
 			ShmHeapFlexSectorHeader *new_sector = NULL;
 			ShmPointer new_sector_shm = EMPTY_SHM;
 			int rslt = alloc_flex_sector(heap, &new_sector, &new_sector_shm);
@@ -1377,6 +1451,8 @@ free_mem(ThreadContext *thread, ShmPointer shm_pointer, int size)
 		thread->private_data->free_list_shm = EMPTY_SHM;
 		thread->private_data->free_list = NULL;
 
+		// account before publishing, the block belongs to reclaimer afterwards
+		shm_atomic_int_add_relaxed(&superblock->pending_garbage, block->count);
 		bool success = false;
 		for (int i = 0; i < 20; ++i)
 		{
@@ -1385,7 +1461,7 @@ free_mem(ThreadContext *thread, ShmPointer shm_pointer, int size)
 			success = PCAS(&thread->free_list, block_shm, next); // "transaction commit"
 			if (success)
 			{
-				p_atomic_int_set(&superblock->has_garbage, 1);
+				shm_atomic_int_set_release(&superblock->has_garbage, 1);
 				// always trigger event after setting the flag, otherwise coordinator might not see it.
 				shm_event_signal(&superblock->has_garbage_event);
 				break;
@@ -48,6 +48,20 @@ typedef ShmBase ShmValueObject;
 typedef ShmBase ShmDictObject;
 typedef ShmBase ShmObjectObject;
 typedef ShmBase ShmPromiseObject;
+typedef ShmBase ShmArrayObject;
+typedef ShmBase ShmTableObject;
+
+typedef struct {
+	PyObject_HEAD
+	__ShmPointer data; // same layout as ShmBase
+	Py_ssize_t position; // file position is local to the object like the one of a file object
+} ShmBlobObject;
+
+typedef struct {
+	PyObject_HEAD
+	__ShmPointer data; // bytes value being filled, EMPTY_SHM once frozen. Same layout as ShmBase.
+	Py_ssize_t exports; // count of the buffer views
+} ShmBytesBuilderObject;
 
 typedef struct {
 	PyObject_HEAD
@@ -56,12 +70,18 @@ typedef struct {
 	int itemindex;
 } ShmTupleIterObject;
 
+// The list iterator fetches this many items per lock acquisition
+#define SHM_LIST_ITER_CHUNK 256
+
 typedef struct {
 	PyObject_HEAD
 	ShmPointer list_shm;
 	ShmList *list;
 	bool is_transient;
-	int itemindex;
+	int itemindex; // of the next item to fetch
+	int chunk_pos;
+	int chunk_count;
+	ShmPointer chunk[SHM_LIST_ITER_CHUNK]; // acquired items from chunk_pos to chunk_count
 } ShmListIterObject;
 
 typedef struct {
@@ -69,11 +89,13 @@ typedef struct {
 	ShmPointer dict_shm;
 	ShmUnDict *dict;
 	bool is_transient;
+	int segment; // see shm_undict_get_segment()
 	int itemindex; // table is sparse so that's a next item to try
 } ShmDictIterObject;
 
 static PyTypeObject ShmObject_Type;
 static PyTypeObject ShmValue_Type;
+static PyTypeObject ShmBytesBuilder_Type;
 static PyTypeObject ShmTuple_Type;
 static PyTypeObject ShmTupleIter_Type;
 static PyTypeObject ShmList_Type;
@@ -81,6 +103,9 @@ static PyTypeObject ShmListIter_Type;
 static PyTypeObject ShmDict_Type;
 static PyTypeObject ShmDictIter_Type;
 static PyTypeObject ShmPromise_Type;
+static PyTypeObject ShmArray_Type;
+static PyTypeObject ShmTable_Type;
+static PyTypeObject ShmBlob_Type;
 
 static PyObject *Shm_Exception;
 static PyObject *Shm_Abort;
@@ -99,9 +124,13 @@ tuple_to_shm_tuple(PyObject *obj, __ShmPointer *rslt);
 int
 list_to_shm_list(PyObject *obj, __ShmPointer *rslt);
 int
-dict_to_shm_dict(PyObject *obj, __ShmPointer *rslt);
+dict_to_shm_dict(PyObject *obj, __ShmPointer *rslt, bool concurrent);
 bool
 object_to_dict_key(PyObject *key, ShmUnDictKey *dictkey);
+void
+free_dict_key(ShmUnDictKey *dictkey);
+void
+set_dict_key_error(PyObject *key);
 
 static PyObject*
 init(PyObject *self, PyObject *args) {
@@ -114,7 +143,8 @@ init(PyObject *self, PyObject *args) {
 	init_thread_context(&thread);
 	debug_print("%d. Thread context inited\n", ShmGetCurrentProcessId());
 
-	ShmUnDict *dict = new_shm_undict(thread, &superblock->root_container);
+	// every process writes into the root, so let them write different keys without contention
+	ShmUnDict *dict = new_shm_undict_concurrent(thread, &superblock->root_container);
 	dict->type = SHM_TYPE_OBJECT;
 
 	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
@@ -198,6 +228,31 @@ set_debug_reclaimer(PyObject *self, PyObject *obj)
 	}
 }
 
+static PyObject*
+set_garbage_watermarks(PyObject *self, PyObject *args)
+{
+	int soft_limit, hard_limit;
+	if (!PyArg_ParseTuple(args, "ii", &soft_limit, &hard_limit))
+		return NULL;
+	if (!check_thread_inited())
+		return NULL;
+	if (soft_limit < 0 || hard_limit < 0 || (hard_limit != 0 && hard_limit < soft_limit))
+	{
+		PyErr_SetString(PyExc_ValueError, "set_garbage_watermarks requires 0 <= soft <= hard, zero disables the limit");
+		return NULL;
+	}
+	p_atomic_int_set(&superblock->garbage_soft_limit, soft_limit);
+	p_atomic_int_set(&superblock->garbage_hard_limit, hard_limit);
+	Py_RETURN_NONE;
+}
+
+static PyObject*
+get_pending_garbage(PyObject *self, PyObject *args)
+{
+	if (!check_thread_inited())
+		return NULL;
+	return PyLong_FromLong(p_atomic_int_get(&superblock->pending_garbage));
+}
 
 static PyObject*
 set_debug_print(PyObject *self, PyObject *obj)
@@ -227,6 +282,7 @@ int64_t total_wait_loops = 0;
 static PyObject*
 print_thread_counters(PyObject *self, PyObject *args)
 {
+	printf("Results registered, summed transaction age in clock ticks (~65 us):\n");
 	printf("Times:        waited %5d, %5d,     waited2 %5d, %5d,\n",
 		thread->private_data->times_waiting, thread->private_data->tickets_waiting,
 		thread->private_data->times_waiting2, thread->private_data->tickets_waiting2);
@@ -491,20 +547,103 @@ object_to_shm_value(PyObject *obj, ShmPointer *data)
 	}
 	else if (type == &PyUnicode_Type)
 	{
-		Py_ssize_t size;
-		// const char* val = PyUnicode_AsUTF8AndSize(obj, &size);
-		size = PyUnicode_GetLength(obj);
-		ShmValueHeader *val_data = new_shm_value(thread, size * isizeof(Py_UCS4), SHM_TYPE_UNICODE, data);
+		if (PyUnicode_READY(obj) == -1)
+			return -1;
+		// Keep the PEP 393 kind, so ASCII/Latin-1 strings take one byte per character instead of four.
+		Py_ssize_t size = PyUnicode_GET_LENGTH(obj);
+		int kind = PyUnicode_KIND(obj);
+		ShmValueHeader *val_data = new_shm_unicode_value_kind(thread, kind, PyUnicode_DATA(obj), (int)size, data);
 		if (!shm_value_get_data(val_data))
 			shmassert_msg(false, "NULL value data");
-		// strncpy_s(shm_value_get_data(val_data), size + 1, val, size);
-		Py_UCS4 *rslt = PyUnicode_AsUCS4(obj, shm_value_get_data(val_data), size, false);
-		shmassert(rslt != NULL);
 		return 0;
 	}
 	return -1;
 }
 
+// Bools, small ints, floats representable as float32 and short Latin-1 str/bytes are stored into containers without allocation.
+// ShmValue objects still get a heap block because they need the ShmValueHeader.
+static bool
+object_to_shm_immediate(PyObject *obj, __ShmPointer *data)
+{
+	PyTypeObject *type = Py_TYPE(obj);
+	if (obj == Py_False || obj == Py_True)
+	{
+		*data = shm_immediate_from_bool(obj == Py_True);
+		return true;
+	}
+	else if (type == &PyLong_Type)
+	{
+		int overflow;
+		long long val = PyLong_AsLongLongAndOverflow(obj, &overflow);
+		if (overflow != 0 || val < SHM_IMMEDIATE_INT_MIN || val > SHM_IMMEDIATE_INT_MAX)
+			return false;
+		*data = shm_immediate_from_int((intptr_t)val);
+		return true;
+	}
+#if SHM_IMMEDIATE_HAS_FLOAT
+	else if (type == &PyFloat_Type)
+	{
+		double val = PyFloat_AS_DOUBLE(obj);
+		if (!shm_immediate_float_fits(val))
+			return false;
+		*data = shm_immediate_from_float(val);
+		return true;
+	}
+#endif
+	else if (type == &PyUnicode_Type)
+	{
+		if (PyUnicode_READY(obj) == -1)
+		{
+			PyErr_Clear();
+			return false;
+		}
+		Py_ssize_t size = PyUnicode_GET_LENGTH(obj);
+		if (PyUnicode_KIND(obj) != PyUnicode_1BYTE_KIND || size > SHM_IMMEDIATE_SHORT_MAX)
+			return false;
+		*data = shm_immediate_from_short(SHM_IMMEDIATE_SHORT_STR, PyUnicode_1BYTE_DATA(obj), (int)size);
+		return true;
+	}
+	else if (type == &PyBytes_Type)
+	{
+		Py_ssize_t size = PyBytes_GET_SIZE(obj);
+		if (size > SHM_IMMEDIATE_SHORT_MAX)
+			return false;
+		*data = shm_immediate_from_short(SHM_IMMEDIATE_SHORT_BYTES, (const uint8_t *)PyBytes_AS_STRING(obj), (int)size);
+		return true;
+	}
+	return false;
+}
+
+static PyObject *
+shm_immediate_to_object(ShmPointer pntr)
+{
+	switch (shm_immediate_get_tag(pntr)) {
+	case SHM_IMMEDIATE_INT:
+		return PyLong_FromSsize_t(shm_immediate_get_int(pntr));
+	case SHM_IMMEDIATE_BOOL:
+		return PyBool_FromLong(shm_immediate_get_bool(pntr));
+#if SHM_IMMEDIATE_HAS_FLOAT
+	case SHM_IMMEDIATE_FLOAT:
+		return PyFloat_FromDouble(shm_immediate_get_float(pntr));
+#endif
+	case SHM_IMMEDIATE_SHORT_STR:
+	{
+		uint8_t chars[SHM_IMMEDIATE_SHORT_MAX];
+		int length = shm_immediate_get_short(pntr, chars);
+		return PyUnicode_FromKindAndData(PyUnicode_1BYTE_KIND, chars, length);
+	}
+	case SHM_IMMEDIATE_SHORT_BYTES:
+	{
+		uint8_t chars[SHM_IMMEDIATE_SHORT_MAX];
+		int length = shm_immediate_get_short(pntr, chars);
+		return PyBytes_FromStringAndSize((const char *)chars, length);
+	}
+	default:
+		PyErr_Format(Shm_Exception, "Unknown immediate value tag: %d", shm_immediate_get_tag(pntr));
+		return NULL;
+	}
+}
+
 // rslt is uninitialized on failure
 int
 prepare_item_for_shm_container(PyObject *value, ShmPointer *rslt)
@@ -512,7 +651,8 @@ prepare_item_for_shm_container(PyObject *value, ShmPointer *rslt)
 	PyTypeObject *type = Py_TYPE(value);
 	__ShmPointer newval = EMPTY_SHM;
 	if (type == &ShmValue_Type || type == &ShmTuple_Type || type == &ShmPromise_Type ||
-		type == &ShmList_Type || type == &ShmDict_Type ||
+		type == &ShmList_Type || type == &ShmDict_Type || type == &ShmArray_Type || type == &ShmTable_Type ||
+		type == &ShmBlob_Type ||
 		type == &ShmObject_Type || PyType_IsSubtype(type, &ShmObject_Type)) // only ShmObject descendants are supported
 	{
 		newval = ((ShmBase*)value)->data;
@@ -522,7 +662,7 @@ prepare_item_for_shm_container(PyObject *value, ShmPointer *rslt)
 	}
 	else if (PyDict_Check(value))
 	{
-		if (dict_to_shm_dict(value, &newval) < 0)
+		if (dict_to_shm_dict(value, &newval, false) < 0)
 			shmassert(newval == EMPTY_SHM);
 	}
 	else if (PyTuple_Check(value))
@@ -535,6 +675,10 @@ prepare_item_for_shm_container(PyObject *value, ShmPointer *rslt)
 		if (list_to_shm_list(value, &newval) < 0)
 			shmassert(newval == EMPTY_SHM);
 	}
+	else if (object_to_shm_immediate(value, &newval))
+	{
+		shmassert(shm_pointer_is_immediate(newval));
+	}
 	else if (object_to_shm_value(value, &newval) != 0)
 	{
 		shmassert(EMPTY_SHM == newval);
@@ -660,8 +804,7 @@ abstract_block_to_object(ShmAbstractBlock *data, ShmPointer data_shm)
 	}
 	case SHM_TYPE(SHM_TYPE_UNICODE):
 	{
-		const Py_UCS4 *unival = shm_value_get_data(val_data);
-		ShmInt size = shm_value_get_size(val_data) / isizeof(Py_UCS4);
+		RefUnicode unival = shm_unicode_value_get(val_data);
 		/* Don't do this, kids, coz eventually you going to get:
 		 _PyUnicode_CheckConsistency: Assertion `maxchar >= 0x10000' failed.
 		PyObject *rslt = PyUnicode_New(size, 0x10ffffU); // 4-byte maxchar
@@ -684,7 +827,7 @@ abstract_block_to_object(ShmAbstractBlock *data, ShmPointer data_shm)
 			PyUnicode_WRITE(kind, data, i, unival[i]);
 		*/
 		SHM_UNUSED(unicode_modifiable);
-		PyObject *rslt = PyUnicode_FromKindAndData(PyUnicode_4BYTE_KIND, unival, size);
+		PyObject *rslt = PyUnicode_FromKindAndData(unival.kind, CAST_VL(unival.data), unival.len);
 		return rslt;
 	}
 	case SHM_TYPE(SHM_TYPE_BYTES):
@@ -715,6 +858,8 @@ abstract_block_to_object(ShmAbstractBlock *data, ShmPointer data_shm)
 PyObject *
 shm_pointer_to_object_consume(ShmPointer pntr)
 {
+	if (shm_pointer_is_immediate(pntr))
+		return shm_immediate_to_object(pntr);
 	ShmAbstractBlock *block = LOCAL(pntr);
 	if (block == NULL)
 		Py_RETURN_NONE;
@@ -779,7 +924,7 @@ shm_pointer_to_object_consume(ShmPointer pntr)
 			int separator = -1;
 			for (int i = 0; i < class_path.len; i++)
 			{
-				if (class_path.data[i] == '\t')
+				if (shm_unicode_read(class_path.kind, class_path.data, i) == '\t')
 				{
 					separator = i;
 					break;
@@ -792,17 +937,17 @@ shm_pointer_to_object_consume(ShmPointer pntr)
 				shm_pointer_release(thread, pntr);
 				return NULL;
 			}
-			shmassert(class_path.data[class_path.len - 1] == 0); // null-terminator
-			PyObject *module_name = PyUnicode_FromKindAndData(PyUnicode_4BYTE_KIND,
-			                                                  CAST_VL(class_path.data), separator);
+			shmassert(shm_unicode_read(class_path.kind, class_path.data, class_path.len - 1) == 0); // null-terminator
+			const char *class_chars = CAST_VL(class_path.data);
+			PyObject *module_name = PyUnicode_FromKindAndData(class_path.kind, class_chars, separator);
 			if (module_name == NULL)
 			{
 				PyErr_Format(Shm_Exception, "Internal error");
 				shm_pointer_release(thread, pntr);
 				return NULL;
 			}
-			PyObject *class_name = PyUnicode_FromKindAndData(PyUnicode_4BYTE_KIND,
-			                                                 CAST_VL(&class_path.data[separator+1]),
+			PyObject *class_name = PyUnicode_FromKindAndData(class_path.kind,
+			                                                 class_chars + (separator + 1) * class_path.kind,
 			                                                 class_path.len - 1 - separator - 1);
 			if (class_name == NULL)
 			{
@@ -900,6 +1045,43 @@ shm_pointer_to_object_consume(ShmPointer pntr)
 		result_obj->data = pntr;
 		return (PyObject *)result_obj;
 	}
+	else if (actual_type == shm_type_get_type(SHM_TYPE_ARRAY))
+	{
+		ShmArrayObject *result_obj = PyObject_New(ShmArrayObject, &ShmArray_Type);
+		if (result_obj == NULL)
+		{
+			PyErr_Format(Shm_Exception, "Error creating ShmArrayObject");
+			shm_pointer_release(thread, pntr);
+			return NULL;
+		}
+		result_obj->data = pntr;
+		return (PyObject *)result_obj;
+	}
+	else if (actual_type == shm_type_get_type(SHM_TYPE_TABLE))
+	{
+		ShmTableObject *result_obj = PyObject_New(ShmTableObject, &ShmTable_Type);
+		if (result_obj == NULL)
+		{
+			PyErr_Format(Shm_Exception, "Error creating ShmTableObject");
+			shm_pointer_release(thread, pntr);
+			return NULL;
+		}
+		result_obj->data = pntr;
+		return (PyObject *)result_obj;
+	}
+	else if (actual_type == shm_type_get_type(SHM_TYPE_BLOB))
+	{
+		ShmBlobObject *result_obj = PyObject_New(ShmBlobObject, &ShmBlob_Type);
+		if (result_obj == NULL)
+		{
+			PyErr_Format(Shm_Exception, "Error creating ShmBlobObject");
+			shm_pointer_release(thread, pntr);
+			return NULL;
+		}
+		result_obj->data = pntr;
+		result_obj->position = 0;
+		return (PyObject *)result_obj;
+	}
 	else
 	{
 		PyErr_Format(Shm_Exception, "Unknown type of value: %d", actual_type);
@@ -908,6 +1090,42 @@ shm_pointer_to_object_consume(ShmPointer pntr)
 	}
 }
 
+// Same as shm_pointer_to_object_consume, but the str and bytes blocks are returned as ShmValue holding the reference,
+// so their data can be read in place with ShmValue.view() instead of being copied into a native object.
+// The short strings kept inline in the pointer get a new ShmValue block for the same interface.
+PyObject *
+shm_pointer_to_value_consume(ShmPointer pntr)
+{
+	if (shm_pointer_is_immediate(pntr))
+	{
+		int tag = shm_immediate_get_tag(pntr);
+		if (tag != SHM_IMMEDIATE_SHORT_STR && tag != SHM_IMMEDIATE_SHORT_BYTES)
+			return shm_immediate_to_object(pntr);
+		PyObject *short_obj = shm_immediate_to_object(pntr);
+		if (short_obj == NULL)
+			return NULL;
+		pntr = EMPTY_SHM;
+		int rslt = object_to_shm_value(short_obj, &pntr);
+		Py_DECREF(short_obj);
+		if (rslt != 0)
+			return NULL;
+	}
+	ShmAbstractBlock *block = LOCAL(pntr);
+	if (block == NULL || (block->type & SHM_TYPE_CELL) == SHM_TYPE_CELL ||
+		(SHM_TYPE(block->type) != SHM_TYPE(SHM_TYPE_UNICODE) && SHM_TYPE(block->type) != SHM_TYPE(SHM_TYPE_BYTES)))
+	{
+		return shm_pointer_to_object_consume(pntr);
+	}
+	ShmValueObject *result_obj = PyObject_New(ShmValueObject, &ShmValue_Type);
+	if (result_obj == NULL)
+	{
+		shm_pointer_release(thread, pntr);
+		return NULL;
+	}
+	result_obj->data = pntr;
+	return (PyObject *)result_obj;
+}
+
 PyObject *
 abstract_block_to_repr(ShmValueHeader *val_data, const char *debug_name, void *pntr)
 {
@@ -944,12 +1162,12 @@ abstract_block_to_repr(ShmValueHeader *val_data, const char *debug_name, void *p
 	}
 	case SHM_TYPE(SHM_TYPE_UNICODE):
 	{
-		int size = shm_value_get_size(val_data) / isizeof(Py_UCS4);
+		RefUnicode unival = shm_unicode_value_get(val_data);
 		// Py_UCS1 *buf = calloc((size_t)(size + 1), 1);
 		// ASCII_from_UCS4(buf, shm_value_get_data(val_data), size);
 		// buf[size] = 0;
 		// return PyUnicode_FromFormat("%s <string %s at %p>", buf, debug_name, pntr);
-		PyObject *buf = PyUnicode_FromKindAndData(PyUnicode_4BYTE_KIND, shm_value_get_data(val_data), size);
+		PyObject *buf = PyUnicode_FromKindAndData(unival.kind, CAST_VL(unival.data), unival.len);
 		shmassert(buf);
 		PyObject *rslt = PyUnicode_FromFormat("%U <string %s at %p>", buf, debug_name, pntr);
 		Py_DECREF(buf);
@@ -1012,6 +1230,107 @@ ShmBase_dealloc(ShmBase *self)
 	Py_TYPE(self)->tp_free((PyObject *)self);
 }
 
+// Kept in Py_buffer.internal for the lifetime of the view.
+typedef struct {
+	ShmPointer data; // acquired ShmValueHeader
+	Py_ssize_t shape;
+	Py_ssize_t strides;
+} ShmValueView;
+
+// The value is immutable, so the view points straight into the shared block. The bytes are exposed as 'B' items,
+// the str as its code units of the stored kind: 'B' for latin-1, 'H' for UCS-2 and 'I' for UCS-4 characters.
+static int
+shm_value_getbuffer(ShmValueObject *self, Py_buffer *view, int flags)
+{
+	ShmValueHeader *val_data = shm_pointer_is_immediate(self->data) ? NULL : LOCAL(self->data);
+	if (val_data == NULL)
+	{
+		PyErr_SetString(PyExc_BufferError, "Invalid value object");
+		return -1;
+	}
+	if (flags & PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "ShmValue buffer is read-only");
+		return -1;
+	}
+	vl void *buf;
+	int itemsize;
+	Py_ssize_t count;
+	const char *format;
+	switch (SHM_TYPE(val_data->type)) {
+	case SHM_TYPE(SHM_TYPE_BYTES):
+		buf = shm_value_get_data(val_data);
+		itemsize = 1;
+		count = shm_value_get_size(val_data);
+		format = "B";
+		break;
+	case SHM_TYPE(SHM_TYPE_UNICODE):
+	{
+		RefUnicode unival = shm_unicode_value_get(val_data);
+		buf = unival.data;
+		itemsize = unival.kind;
+		count = unival.len;
+		format = unival.kind == 1 ? "B" : unival.kind == 2 ? "H" : "I";
+		break;
+	}
+	default:
+		PyErr_SetString(PyExc_BufferError, "Only str and bytes ShmValue support the buffer protocol");
+		return -1;
+	}
+	ShmValueView *internal = PyMem_Malloc(sizeof(ShmValueView));
+	if (internal == NULL)
+	{
+		PyErr_NoMemory();
+		return -1;
+	}
+	// the block outlives the ShmValue object in case the view is exported further
+	shm_pointer_acq(thread, self->data);
+	internal->data = self->data;
+	internal->shape = count;
+	internal->strides = itemsize;
+
+	view->obj = (PyObject *)self;
+	Py_INCREF(self);
+	view->buf = CAST_VL(buf);
+	view->len = count * itemsize;
+	view->readonly = 1;
+	view->itemsize = itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? (char *)format : NULL;
+	view->ndim = 1;
+	view->shape = (flags & PyBUF_ND) ? &internal->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &internal->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = internal;
+	return 0;
+}
+
+static void
+shm_value_releasebuffer(ShmValueObject *self, Py_buffer *view)
+{
+	ShmValueView *internal = view->internal;
+	shm_pointer_release(thread, internal->data);
+	PyMem_Free(internal);
+}
+
+static PyObject *
+ShmValue_view(ShmValueObject *self, PyObject *unused)
+{
+	return PyMemoryView_FromObject((PyObject *)self);
+}
+
+static PyBufferProcs shm_value_as_buffer = {
+	(getbufferproc)shm_value_getbuffer,
+	(releasebufferproc)shm_value_releasebuffer,
+};
+
+static PyMethodDef ShmValue_methods[] = {
+	{
+		"view", (PyCFunction)ShmValue_view, METH_NOARGS,
+		"Returns a read-only memoryview of the str or bytes value data, without copying it"
+	},
+	{NULL}  /* Sentinel */
+};
+
 static PyTypeObject ShmValue_Type = {
 	PyVarObject_HEAD_INIT(NULL, 0)
 	.tp_name = "pso.ShmValue",
@@ -1020,12 +1339,134 @@ static PyTypeObject ShmValue_Type = {
 	.tp_repr = (reprfunc) ShmValue_repr,
 	.tp_dealloc = (destructor) ShmBase_dealloc,
 	.tp_flags = Py_TPFLAGS_DEFAULT,
-	// .tp_methods = ShmValue_methods,
+	.tp_as_buffer = &shm_value_as_buffer,
+	.tp_methods = ShmValue_methods,
 	// .tp_members = ShmValue_members,
 	.tp_init = (initproc) ShmValue_init,
 	.tp_new = PyType_GenericNew,
 };
 
+// ///////////
+// ShmBytesBuilder
+// ////////////
+
+// The bytes block is allocated up front and filled in place through a writable buffer.
+// Nobody else can see the block until it's frozen, so the writes need no transaction.
+static int
+ShmBytesBuilder_init(ShmBytesBuilderObject *self, PyObject *args, PyObject *kwds)
+{
+	if (!check_thread_inited())
+		return -1;
+	Py_ssize_t size = 0;
+	if (!PyArg_ParseTuple(args, "n:ShmBytesBuilder", &size))
+		return -1;
+	if (self->exports > 0)
+	{
+		PyErr_SetString(PyExc_BufferError, "Existing exports of data: builder cannot be re-initialized");
+		return -1;
+	}
+	if (size < 0 || size > shm_value_max_size())
+	{
+		PyErr_Format(PyExc_ValueError, "ShmBytesBuilder size must be from 0 to %d bytes", (int)shm_value_max_size());
+		return -1;
+	}
+	if (shm_pointer_is_valid(self->data))
+		shm_pointer_release(thread, self->data);
+	self->data = EMPTY_SHM;
+	new_shm_value(thread, (ShmInt)size, SHM_TYPE_BYTES, &self->data); // zero-filled
+	return 0;
+}
+
+static int
+shm_bytes_builder_getbuffer(ShmBytesBuilderObject *self, Py_buffer *view, int flags)
+{
+	ShmValueHeader *val_data = LOCAL(self->data);
+	if (val_data == NULL)
+	{
+		PyErr_SetString(PyExc_BufferError, "ShmBytesBuilder is already frozen");
+		return -1;
+	}
+	if (PyBuffer_FillInfo(view, (PyObject *)self, shm_value_get_data(val_data), shm_value_get_size(val_data), 0, flags) < 0)
+		return -1;
+	self->exports++;
+	return 0;
+}
+
+static void
+shm_bytes_builder_releasebuffer(ShmBytesBuilderObject *self, Py_buffer *view)
+{
+	self->exports--;
+}
+
+static PyObject *
+ShmBytesBuilder_view(ShmBytesBuilderObject *self, PyObject *unused)
+{
+	return PyMemoryView_FromObject((PyObject *)self);
+}
+
+// Hands the filled block over to a new ShmValue as is, the builder becomes empty.
+static PyObject *
+ShmBytesBuilder_freeze(ShmBytesBuilderObject *self, PyObject *unused)
+{
+	if (LOCAL(self->data) == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "ShmBytesBuilder is already frozen");
+		return NULL;
+	}
+	if (self->exports > 0)
+	{
+		PyErr_SetString(PyExc_BufferError, "Existing exports of data: release the views before freezing the builder");
+		return NULL;
+	}
+	ShmValueObject *rslt = PyObject_New(ShmValueObject, &ShmValue_Type);
+	if (rslt == NULL)
+		return NULL;
+	rslt->data = self->data;
+	self->data = EMPTY_SHM;
+	return (PyObject *)rslt;
+}
+
+static PyObject *
+ShmBytesBuilder_repr(ShmBytesBuilderObject *self)
+{
+	ShmValueHeader *val_data = LOCAL(self->data);
+	if (val_data == NULL)
+		return PyUnicode_FromFormat("<frozen %s object at %p>", self->ob_base.ob_type->tp_name, self);
+	return PyUnicode_FromFormat("<%s of %d bytes at %p>", self->ob_base.ob_type->tp_name,
+	                            (int)shm_value_get_size(val_data), self);
+}
+
+static PyBufferProcs shm_bytes_builder_as_buffer = {
+	(getbufferproc)shm_bytes_builder_getbuffer,
+	(releasebufferproc)shm_bytes_builder_releasebuffer,
+};
+
+static PyMethodDef ShmBytesBuilder_methods[] = {
+	{
+		"view", (PyCFunction)ShmBytesBuilder_view, METH_NOARGS,
+		"Returns a writable memoryview of the bytes to be filled in place"
+	},
+	{
+		"freeze", (PyCFunction)ShmBytesBuilder_freeze, METH_NOARGS,
+		"Turns the filled bytes into an immutable ShmValue without copying them, the views should be released by then"
+	},
+	{NULL}  /* Sentinel */
+};
+
+static PyTypeObject ShmBytesBuilder_Type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "pso.ShmBytesBuilder",
+	.tp_doc = "Shared bytes of fixed size filled in place, then frozen into ShmValue.",
+	.tp_basicsize = sizeof(ShmBytesBuilderObject),
+	.tp_repr = (reprfunc) ShmBytesBuilder_repr,
+	.tp_dealloc = (destructor) ShmBase_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_as_buffer = &shm_bytes_builder_as_buffer,
+	.tp_methods = ShmBytesBuilder_methods,
+	.tp_init = (initproc) ShmBytesBuilder_init,
+	.tp_new = PyType_GenericNew,
+};
+
 // ///////////
 // ShmTuple
 // ////////////
@@ -1260,44 +1701,52 @@ static PyTypeObject ShmTupleIter_Type = {
 //       ShmList
 // //////////////////////
 
+// values are converted and stored in chunks, every chunk walks the list blocks once
+#define SHM_LIST_FILL_CHUNK 256
+
 int
 list_to_shm_list(PyObject *obj, __ShmPointer *rslt)
 {
 	PyObject *seq = PySequence_Fast(obj, "");
 	if (seq == NULL) return -1;
-	Py_ssize_t arglen = PySequence_Length(seq);
+	Py_ssize_t arglen = PySequence_Fast_GET_SIZE(seq);
 	*rslt = EMPTY_SHM;
 
 	ShmList *list = new_shm_list_with_capacity(thread, rslt, arglen);
+	ListRef list_ref = { .local = list, .shared = *rslt };
 	// all elements in the list are EMPTY_SHM now
-	for (int i = 0; i < arglen; i++)
+	ShmPointer chunk[SHM_LIST_FILL_CHUNK];
+	for (Py_ssize_t start = 0; start < arglen; start += SHM_LIST_FILL_CHUNK)
 	{
-		PyObject *item = PySequence_Fast_GET_ITEM(seq, i);
-		shmassert(item);
-		ShmPointer newval = EMPTY_SHM;
-		if (prepare_item_for_shm_container(item, &newval) == -1 || newval == EMPTY_SHM)
+		int chunk_count = arglen - start < SHM_LIST_FILL_CHUNK ? (int)(arglen - start) : SHM_LIST_FILL_CHUNK;
+		for (int i = 0; i < chunk_count; i++)
 		{
-			if (!PyErr_Occurred())
-				PyErr_Format(Shm_Exception,
-							 "could not marshall sequence item at index %d of type %.200s",
-							 i, item->ob_type->tp_name);
-			return -1;
+			PyObject *item = PySequence_Fast_GET_ITEM(seq, start + i);
+			shmassert(item);
+			chunk[i] = EMPTY_SHM;
+			if (prepare_item_for_shm_container(item, &chunk[i]) == -1 || chunk[i] == EMPTY_SHM)
+			{
+				if (!PyErr_Occurred())
+					PyErr_Format(Shm_Exception,
+								 "could not marshall sequence item at index %zd of type %.200s",
+								 start + i, item->ob_type->tp_name);
+				for (int k = 0; k < i; k++)
+					shm_pointer_release(thread, chunk[k]);
+				Py_DECREF(seq);
+				return -1;
+			}
 		}
 
-		int status = shm_list_set_item_raw(thread, (ListRef){.local = list, .shared = *rslt}, i, newval, true);
-		if (status == RESULT_INVALID)
+		int status = shm_list_set_range_raw(thread, list_ref, start, chunk, chunk_count);
+		if (status != RESULT_OK)
 		{
 			PyErr_Format(Shm_Exception, "internal failure in list_to_shm_list");
+			Py_DECREF(seq);
 			return -1;
 		}
-		if (status == RESULT_FAILURE)
-		{
-			PyErr_Format(Shm_Exception, "internal failure in shm_list_set_item_raw");
-			return -1;
-		}
-		shmassert(status == RESULT_OK);
 	}
 
+	Py_DECREF(seq);
 	return 0;
 }
 
@@ -1321,6 +1770,7 @@ ShmList_init(ShmListObject *self, PyObject *args, PyObject *kwds)
 		PyErr_Format(PyExc_TypeError,
 					 "cannot initialize ShmList from %.200s, list or other sequence object is required",
 					 obj->ob_type->tp_name);
+		return -1;
 	}
 
 	return list_to_shm_list(obj, &self->data);
@@ -1390,6 +1840,16 @@ ShmList_repr(ShmListObject *self)
 			});
 
 		shmassert((value_shm != EMPTY_SHM) == (out_of_range == false));
+		if (shm_pointer_is_immediate(value_shm))
+		{
+			PyObject *first_obj = shm_immediate_to_object(value_shm);
+			if (first_obj == NULL)
+				return NULL;
+			PyObject *rslt = PyUnicode_FromFormat("ShmList: %d elements <%s object at %p>, first element: %R",
+				list.local->count, self->ob_base.ob_type->tp_name, self, first_obj);
+			Py_DECREF(first_obj);
+			return rslt;
+		}
 		ShmValueHeader *first_value = LOCAL(value_shm);
 		value_shm = EMPTY_SHM;
 		// char *astr = "None";
@@ -1472,6 +1932,8 @@ ShmList_iter(PyObject *obj)
 	shm_pointer_acq(thread, list.shared);
 	it->list_shm = list.shared;
 	it->itemindex = 0;
+	it->chunk_pos = 0;
+	it->chunk_count = 0;
 	it->is_transient = is_transient;
 	return (PyObject *)it;
 }
@@ -1553,59 +2015,313 @@ ShmList_popleft(PyObject* obj, PyObject *noargs)
 	return result_obj;
 }
 
-static Py_ssize_t
-shm_list_length(ShmListObject *self)
+// Removes the item at index (negative counts from the end) into value, raises IndexError when out of range.
+static int
+ShmList_pop_item(ListRef list, Py_ssize_t index, ShmPointer *value, const char *out_of_range_msg)
 {
-	ListRef list;
-	if (!init_list_ref(self->data, &list))
+	bool valid = false;
+	RETRY_LOOP(shm_list_pop(thread, list, index, value, &valid),
+		{ shmassert(*value == EMPTY_SHM); },
+		{ return -1; },
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in ShmList_pop");
+			return -1;
+		});
+	shmassert((*value != EMPTY_SHM) == valid);
+	if (valid == false)
 	{
-		PyErr_SetString(Shm_Exception, "Invalid list object");
+		PyErr_SetString(PyExc_IndexError, out_of_range_msg);
 		return -1;
 	}
-	ShmListCounts count = shm_list_get_fast_count(thread, list.local, shm_cell_have_write_lock(thread, &list.local->base.lock));
-	return count.count;
+	return 0;
 }
 
 static PyObject *
-shm_list_item(ShmListObject* self, Py_ssize_t i)
+ShmList_pop(PyObject* obj, PyObject *args)
+{
+	ShmListObject *self = (ShmListObject *)obj;
+	Py_ssize_t index = -1;
+	if (!PyArg_ParseTuple(args, "|n:pop", &index))
+		return NULL;
+	ListRef list;
+	if (!init_list_ref(self->data, &list))
+	{
+		PyErr_SetString(Shm_Exception, "Invalid list object");
+		return NULL;
+	}
+	ShmPointer value = EMPTY_SHM;
+	if (ShmList_pop_item(list, index, &value, "pop index out of range") < 0)
+		return NULL;
+	return shm_pointer_to_object_consume(value);
+}
+
+static PyObject *
+ShmList_insert_do(ShmListObject *self, Py_ssize_t index, PyObject *value)
+{
+	ListRef list;
+	if (!init_list_ref(self->data, &list))
+	{
+		PyErr_SetString(Shm_Exception, "Invalid list object");
+		return NULL;
+	}
+	ShmPointer newval = EMPTY_SHM;
+	if (prepare_item_for_shm_container(value, &newval) == -1 || newval == EMPTY_SHM)
+	{
+		if (!PyErr_Occurred())
+			PyErr_SetString(Shm_Exception, "Invalid pso object when inserting into ShmList");
+		return NULL;
+	}
+	RETRY_LOOP(shm_list_insert(thread, list, index, newval),
+		{},
+		{
+			shm_pointer_release(thread, newval);
+			return NULL;
+		},
+		{
+			shm_pointer_release(thread, newval);
+			PyErr_SetString(Shm_Exception, "Internal failure in ShmList_insert");
+			return NULL;
+		});
+	shm_pointer_release(thread, newval);
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+ShmList_insert(PyObject* obj, PyObject *args)
+{
+	Py_ssize_t index = 0;
+	PyObject *value = NULL;
+	if (!PyArg_ParseTuple(args, "nO:insert", &index, &value))
+		return NULL;
+	return ShmList_insert_do((ShmListObject *)obj, index, value);
+}
+
+static PyObject *
+ShmList_appendleft(PyObject* obj, PyObject *value)
+{
+	return ShmList_insert_do((ShmListObject *)obj, 0, value);
+}
+
+static PyObject *
+ShmList_clear(PyObject* obj, PyObject *noargs)
+{
+	ShmListObject *self = (ShmListObject *)obj;
+	ListRef list;
+	if (!init_list_ref(self->data, &list))
+	{
+		PyErr_SetString(Shm_Exception, "Invalid list object");
+		return NULL;
+	}
+	RETRY_LOOP(shm_list_clear(thread, list),
+		{},
+		{ return NULL; },
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in ShmList_clear");
+			return NULL;
+		});
+	Py_RETURN_NONE;
+}
+
+static int
+ShmList_extend_prepared(ListRef list, ShmPointer *newvals, Py_ssize_t count)
+{
+	RETRY_LOOP(shm_list_extend(thread, list, newvals, count),
+		{},
+		{ return -1; },
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in ShmList_extend");
+			return -1;
+		});
+	return 0;
+}
+
+// All the values are converted before taking the lock, then appended within a single transient transaction,
+// so other threads see either none or all of them.
+static PyObject *
+ShmList_extend(PyObject* obj, PyObject *iterable)
 {
+	ShmListObject *self = (ShmListObject *)obj;
 	ListRef list;
 	if (!init_list_ref(self->data, &list))
 	{
 		PyErr_SetString(Shm_Exception, "Invalid list object");
 		return NULL;
 	}
+	PyObject *seq = PySequence_Fast(iterable, "ShmList.extend() argument must be iterable");
+	if (seq == NULL)
+		return NULL;
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+	ShmPointer *newvals = PyMem_Malloc((count > 0 ? count : 1) * sizeof(ShmPointer));
+	if (newvals == NULL)
+	{
+		Py_DECREF(seq);
+		return PyErr_NoMemory();
+	}
+	Py_ssize_t prepared = 0;
+	int rslt = 0;
+	for (; prepared < count; prepared++)
+	{
+		newvals[prepared] = EMPTY_SHM;
+		if (prepare_item_for_shm_container(PySequence_Fast_GET_ITEM(seq, prepared), &newvals[prepared]) < 0 ||
+		    newvals[prepared] == EMPTY_SHM)
+		{
+			if (!PyErr_Occurred())
+				PyErr_SetString(Shm_Exception, "Invalid pso object when extending ShmList");
+			rslt = -1;
+			break;
+		}
+	}
+	if (rslt == 0)
+		rslt = ShmList_extend_prepared(list, newvals, count);
+
+	for (Py_ssize_t i = 0; i < prepared; i++)
+		shm_pointer_release(thread, newvals[i]);
+	PyMem_Free((void *)newvals);
+	Py_DECREF(seq);
+	if (rslt < 0)
+		return NULL;
+	Py_RETURN_NONE;
+}
+
+static Py_ssize_t
+shm_list_length(ShmListObject *self)
+{
+	ListRef list;
+	if (!init_list_ref(self->data, &list))
+	{
+		PyErr_SetString(Shm_Exception, "Invalid list object");
+		return -1;
+	}
+	ShmListCounts count = shm_list_get_fast_count(thread, list.local, shm_cell_have_write_lock(thread, &list.local->base.lock));
+	return count.count;
+}
+
+// Returns -1 with exception set
+static int
+shm_list_acq_item_at(ShmListObject* self, Py_ssize_t i, ShmPointer *value)
+{
+	ListRef list;
+	if (!init_list_ref(self->data, &list))
+	{
+		PyErr_SetString(Shm_Exception, "Invalid list object");
+		return -1;
+	}
 	if (i < 0)
 	{
 		PyErr_SetString(PyExc_IndexError, "list index out of range");
-		return NULL;
+		return -1;
 	}
-	ShmPointer value = EMPTY_SHM;
 	bool out_of_range = false;
-	RETRY_LOOP(shm_list_acq_item(thread, list, i, &value),
+	RETRY_LOOP(shm_list_acq_item(thread, list, i, value),
 		{
-			shmassert(value == EMPTY_SHM);
+			shmassert(*value == EMPTY_SHM);
 			if (_rslt == RESULT_INVALID)
 			{
 				out_of_range = true;
 				break;
 			}
 		},
-		{ return NULL; },
+		{ return -1; },
 		{
 			PyErr_SetString(Shm_Exception, "Internal failure");
-			return NULL;
+			return -1;
 		});
-	shmassert((value != EMPTY_SHM) == (out_of_range == false));
+	shmassert((*value != EMPTY_SHM) == (out_of_range == false));
 	if (out_of_range)
 	{
 		PyErr_SetString(PyExc_IndexError, "list index out of range");
-		return NULL;
+		return -1;
 	}
+	return 0;
+}
+
+static PyObject *
+shm_list_item(ShmListObject* self, Py_ssize_t i)
+{
+	ShmPointer value = EMPTY_SHM;
+	if (shm_list_acq_item_at(self, i, &value) < 0)
+		return NULL;
 	PyObject *result_obj = shm_pointer_to_object_consume(value);
 	return result_obj;
 }
 
+// Like l[index], but the str and bytes items are returned as ShmValue without copying their data
+static PyObject *
+ShmList_get_value(PyObject* obj, PyObject *arg)
+{
+	ShmListObject *self = (ShmListObject *)obj;
+	Py_ssize_t i = PyNumber_AsSsize_t(arg, PyExc_IndexError);
+	if (i == -1 && PyErr_Occurred())
+		return NULL;
+	if (i < 0)
+		i += shm_list_length(self);
+	ShmPointer value = EMPTY_SHM;
+	if (shm_list_acq_item_at(self, i, &value) < 0)
+		return NULL;
+	return shm_pointer_to_value_consume(value);
+}
+
+// All the items of the slice are fetched under a single lock.
+static PyObject *
+shm_list_slice(ShmListObject *self, PyObject *slice)
+{
+	ListRef list;
+	if (!init_list_ref(self->data, &list))
+	{
+		PyErr_SetString(Shm_Exception, "Invalid list object");
+		return NULL;
+	}
+	Py_ssize_t start, stop, step;
+	if (PySlice_Unpack(slice, &start, &stop, &step) < 0)
+		return NULL;
+	Py_ssize_t length = shm_list_length(self);
+	if (length < 0)
+		return NULL;
+	Py_ssize_t slicelength = PySlice_AdjustIndices(length, &start, &stop, step);
+	if (slicelength <= 0)
+		return PyList_New(0);
+	// a reversed slice is fetched forward from its last item
+	Py_ssize_t first = step > 0 ? start : start + (slicelength - 1) * step;
+	Py_ssize_t abs_step = step > 0 ? step : -step;
+
+	ShmPointer *values = PyMem_Malloc(slicelength * sizeof(ShmPointer));
+	if (values == NULL)
+		return PyErr_NoMemory();
+	ShmInt fetched = 0;
+	RETRY_LOOP(shm_list_acq_range(thread, list, first, abs_step, slicelength, values, &fetched),
+		{ shmassert(fetched == 0); },
+		{
+			PyMem_Free((void *)values);
+			return NULL;
+		},
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in shm_list_slice");
+			PyMem_Free((void *)values);
+			return NULL;
+		});
+
+	// the list might've been shortened since its length was taken
+	PyObject *rslt = PyList_New(fetched);
+	for (ShmInt i = 0; i < fetched; i++)
+	{
+		ShmPointer value = values[step > 0 ? i : fetched - 1 - i];
+		if (rslt == NULL)
+		{
+			shm_pointer_release(thread, value);
+			continue;
+		}
+		PyObject *obj = shm_pointer_to_object_consume(value);
+		if (obj == NULL)
+		{
+			Py_CLEAR(rslt);
+			continue;
+		}
+		PyList_SET_ITEM(rslt, i, obj);
+	}
+	PyMem_Free((void *)values);
+	return rslt;
+}
+
 static PyObject *
 shm_list_subscript(ShmListObject* self, PyObject* item)
 {
@@ -1616,12 +2332,12 @@ shm_list_subscript(ShmListObject* self, PyObject* item)
 		if (i == -1 && PyErr_Occurred())
 			return NULL;
 		if (i < 0)
-			i += PyList_GET_SIZE(self);
+			i += shm_list_length(self);
 		return shm_list_item(self, i);
 	}
 	else if (PySlice_Check(item))
 	{
-		return NULL;
+		return shm_list_slice(self, item);
 	}
 	else
 	{
@@ -1646,6 +2362,15 @@ shm_list_ass_item(ShmListObject *self, Py_ssize_t i, PyObject *value)
 		PyErr_SetString(Shm_Exception, "Invalid list object");
 		return -1;
 	}
+	if (value == NULL)
+	{
+		// del l[i]
+		ShmPointer removed = EMPTY_SHM;
+		if (ShmList_pop_item(list, i, &removed, "list assignment index out of range") < 0)
+			return -1;
+		shm_pointer_release(thread, removed);
+		return 0;
+	}
 
 	ShmPointer newval = EMPTY_SHM;
 	if (prepare_item_for_shm_container(value, &newval) == -1 || newval == EMPTY_SHM)
@@ -1688,7 +2413,7 @@ shm_list_ass_subscript(ShmListObject* self, PyObject* item, PyObject* value)
 		if (i == -1 && PyErr_Occurred())
 			return -1;
 		if (i < 0)
-			i += PyList_GET_SIZE(self);
+			i += shm_list_length(self);
 		return shm_list_ass_item(self, i, value);
 	}
 	else if (PySlice_Check(item)) {
@@ -1727,6 +2452,30 @@ static PyMethodDef ShmList_methods[] = {
 		"popleft", ShmList_popleft, METH_NOARGS,
 		"Remove first element from list"
 	},
+	{
+		"extend", ShmList_extend, METH_O,
+		"Appends the items of the iterable to the list at once"
+	},
+	{
+		"pop", ShmList_pop, METH_VARARGS,
+		"Removes and returns the item at index (default last)"
+	},
+	{
+		"appendleft", ShmList_appendleft, METH_O,
+		"Inserts a value at the start of the list"
+	},
+	{
+		"insert", ShmList_insert, METH_VARARGS,
+		"Inserts a value before the index"
+	},
+	{
+		"clear", ShmList_clear, METH_NOARGS,
+		"Removes all the items from the list"
+	},
+	{
+		"get_value", ShmList_get_value, METH_O,
+		"Returns the item at index, str and bytes as ShmValue so they can be viewed without copying"
+	},
 
 	{NULL, NULL} // sentinel
 };
@@ -1782,45 +2531,48 @@ ShmListIter_next(ShmListIterObject *it)
 		shm_value = NONE_SHM;
 	}*/
 
-	ShmPointer value = EMPTY_SHM;
-	ListRef list = { .local = it->list, .shared = it->list_shm };
-	bool out_of_range = false;
-	// Could optimize into shm_list_get_item for persistent transactions.
-	// shm_list_acq_item() is doing locking for transient transactions too.
-	RETRY_LOOP(shm_list_acq_item(thread, list, it->itemindex, &value),
-		{
-			shmassert(value == EMPTY_SHM);
-			if (_rslt == RESULT_INVALID)
+	// A transaction writing to the list should see its own modifications,
+	// so the prefetched items are dropped once it takes the write lock.
+	bool owned = shm_cell_have_write_lock(thread, &it->list->base.lock);
+	if (owned && it->chunk_pos < it->chunk_count)
+	{
+		it->itemindex -= it->chunk_count - it->chunk_pos;
+		for (; it->chunk_pos < it->chunk_count; it->chunk_pos++)
+			shm_pointer_empty(thread, &it->chunk[it->chunk_pos]);
+	}
+	if (it->chunk_pos == it->chunk_count)
+	{
+		// A transient iterator sees each chunk in a consistent state, though not the whole list.
+		ListRef list = { .local = it->list, .shared = it->list_shm };
+		ShmInt fetched = 0;
+		ShmInt chunk_size = owned ? 1 : SHM_LIST_ITER_CHUNK;
+		RETRY_LOOP(shm_list_acq_range(thread, list, it->itemindex, 1, chunk_size, it->chunk, &fetched),
+			{ shmassert(fetched == 0); },
+			{ return NULL; },
 			{
-				out_of_range = true;
-				break;
-			}
-		},
-		{
-			shm_pointer_release(thread, value);
-			return NULL;
-		},
-		{
-			PyErr_Format(Shm_Exception, "Error (%d) getting item at index %d.", _rslt, it->itemindex);
-			shm_pointer_release(thread, value);
+				PyErr_Format(Shm_Exception, "Error (%d) getting items at index %d.", _rslt, it->itemindex);
+				return NULL;
+			});
+		it->chunk_pos = 0;
+		it->chunk_count = (int)fetched;
+		it->itemindex += (int)fetched;
+		if (fetched == 0)
 			return NULL;
-		});
-
-	shmassert((value != EMPTY_SHM) == (out_of_range == false));
-	if (out_of_range)
-		return NULL;
+	}
 
-	PyObject *result_obj = shm_pointer_to_object_consume(value);
-	it->itemindex++;
-	// result_obj->persistent = true;
-	return result_obj;
+	ShmPointer value = it->chunk[it->chunk_pos];
+	it->chunk[it->chunk_pos] = EMPTY_SHM;
+	it->chunk_pos++;
+	return shm_pointer_to_object_consume(value);
 }
 
 static void
-ShmListIter_dealloc(ShmBase *self)
+ShmListIter_dealloc(ShmListIterObject *self)
 {
-	if (shm_pointer_is_valid(self->data))
-		shm_pointer_release(thread, self->data);
+	for (int i = self->chunk_pos; i < self->chunk_count; ++i)
+		shm_pointer_release(thread, self->chunk[i]);
+	if (shm_pointer_is_valid(self->list_shm))
+		shm_pointer_release(thread, self->list_shm);
 	else
 		debug_print("Nothing to release\n");
 
@@ -1844,47 +2596,1599 @@ static PyTypeObject ShmListIter_Type = {
 };
 
 // ////////////////
-// ShmDict
+// ShmArray
 // /////////////////
 
-int
-dict_to_shm_dict(PyObject *obj, __ShmPointer *rslt)
+typedef struct {
+	char typecode; // same as in the array module
+	int itemsize;
+	const char *format; // of the buffer view
+} ShmArrayTypecode;
+
+static const ShmArrayTypecode shm_array_typecodes[] = {
+	{ 'b', sizeof(signed char), "b" },
+	{ 'B', sizeof(unsigned char), "B" },
+	{ 'h', sizeof(short), "h" },
+	{ 'H', sizeof(unsigned short), "H" },
+	{ 'i', sizeof(int), "i" },
+	{ 'I', sizeof(unsigned int), "I" },
+	{ 'l', sizeof(long), "l" },
+	{ 'L', sizeof(unsigned long), "L" },
+	{ 'q', sizeof(long long), "q" },
+	{ 'Q', sizeof(unsigned long long), "Q" },
+	{ 'f', sizeof(float), "f" },
+	{ 'd', sizeof(double), "d" },
+};
+
+static const ShmArrayTypecode *
+shm_array_find_typecode(int typecode)
 {
-	*rslt = EMPTY_SHM;
-	ShmUnDict *dict = new_shm_undict(thread, rslt);
+	for (size_t i = 0; i < sizeof(shm_array_typecodes) / sizeof(shm_array_typecodes[0]); i++)
+		if (shm_array_typecodes[i].typecode == typecode)
+			return &shm_array_typecodes[i];
+	return NULL;
+}
 
-	// similar to dict_merge()
-	PyObject *keys = PyMapping_Keys(obj);
-	if (keys == NULL)
-		return -1;
-	PyObject *iter = PyObject_GetIter(keys);
-	Py_DECREF(keys);
-	if (iter == NULL)
-		return -1;
+#define SHM_ARRAY_PACK_SIGNED(ctype, minval, maxval) { \
+	long long v = PyLong_AsLongLong(value); \
+	if (v == -1 && PyErr_Occurred()) \
+		return -1; \
+	if (v < (minval) || v > (maxval)) \
+		goto overflow; \
+	*(ctype *)dest = (ctype)v; \
+	return 0; \
+}
 
-	for (PyObject *key = PyIter_Next(iter); key; key = PyIter_Next(iter))
-	{
-		ShmUnDictKey dictkey = EMPTY_SHM_UNDICT_KEY;
-		if (!object_to_dict_key(key, &dictkey))
-		{
-			Py_DECREF(iter);
-			Py_DECREF(key);
-			PyErr_Format(PyExc_TypeError,
-			             "dict key must be a string, not %.200s",
-			             key->ob_type->tp_name);
-			return -1;
-		}
-		PyObject *value = PyObject_GetItem(obj, key);
-		if (value == NULL)
-		{
-			Py_DECREF(iter);
-			Py_DECREF(key);
+#define SHM_ARRAY_PACK_UNSIGNED(ctype, maxval) { \
+	unsigned long long v = PyLong_AsUnsignedLongLong(value); \
+	if (v == (unsigned long long)-1 && PyErr_Occurred()) \
+		return -1; \
+	if (v > (maxval)) \
+		goto overflow; \
+	*(ctype *)dest = (ctype)v; \
+	return 0; \
+}
+
+static int
+shm_array_pack_item(int typecode, PyObject *value, void *dest)
+{
+	switch (typecode)
+	{
+	case 'b': SHM_ARRAY_PACK_SIGNED(signed char, SCHAR_MIN, SCHAR_MAX)
+	case 'B': SHM_ARRAY_PACK_UNSIGNED(unsigned char, UCHAR_MAX)
+	case 'h': SHM_ARRAY_PACK_SIGNED(short, SHRT_MIN, SHRT_MAX)
+	case 'H': SHM_ARRAY_PACK_UNSIGNED(unsigned short, USHRT_MAX)
+	case 'i': SHM_ARRAY_PACK_SIGNED(int, INT_MIN, INT_MAX)
+	case 'I': SHM_ARRAY_PACK_UNSIGNED(unsigned int, UINT_MAX)
+	case 'l': SHM_ARRAY_PACK_SIGNED(long, LONG_MIN, LONG_MAX)
+	case 'L': SHM_ARRAY_PACK_UNSIGNED(unsigned long, ULONG_MAX)
+	case 'q': SHM_ARRAY_PACK_SIGNED(long long, LLONG_MIN, LLONG_MAX)
+	case 'Q': SHM_ARRAY_PACK_UNSIGNED(unsigned long long, ULLONG_MAX)
+	case 'f':
+	case 'd':
+	{
+		double v = PyFloat_AsDouble(value);
+		if (v == -1.0 && PyErr_Occurred())
 			return -1;
-		}
-		ShmPointer newval = EMPTY_SHM;
-		if (prepare_item_for_shm_container(value, &newval) < 0)
-		{
-			Py_DECREF(iter);
+		if (typecode == 'f')
+			*(float *)dest = (float)v;
+		else
+			*(double *)dest = v;
+		return 0;
+	}
+	}
+	shmassert(false);
+	return -1;
+overflow:
+	PyErr_Format(PyExc_OverflowError, "value is out of range for ShmArray of typecode '%c'", typecode);
+	return -1;
+}
+
+static PyObject *
+shm_array_unpack_item(int typecode, const void *src)
+{
+	switch (typecode)
+	{
+	case 'b': return PyLong_FromLong(*(const signed char *)src);
+	case 'B': return PyLong_FromLong(*(const unsigned char *)src);
+	case 'h': return PyLong_FromLong(*(const short *)src);
+	case 'H': return PyLong_FromLong(*(const unsigned short *)src);
+	case 'i': return PyLong_FromLong(*(const int *)src);
+	case 'I': return PyLong_FromUnsignedLong(*(const unsigned int *)src);
+	case 'l': return PyLong_FromLong(*(const long *)src);
+	case 'L': return PyLong_FromUnsignedLong(*(const unsigned long *)src);
+	case 'q': return PyLong_FromLongLong(*(const long long *)src);
+	case 'Q': return PyLong_FromUnsignedLongLong(*(const unsigned long long *)src);
+	case 'f': return PyFloat_FromDouble(*(const float *)src);
+	case 'd': return PyFloat_FromDouble(*(const double *)src);
+	}
+	shmassert(false);
+	return NULL;
+}
+
+// Packs the items of the sequence one after another into dest, returns -1 with an exception set on failure.
+static int
+shm_array_pack_sequence(ShmArray *array, PyObject *seq, Py_ssize_t count, char *dest)
+{
+	for (Py_ssize_t i = 0; i < count; i++)
+	{
+		if (shm_array_pack_item(array->typecode, PySequence_Fast_GET_ITEM(seq, i), dest + i * array->itemsize) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int
+ShmArray_init(ShmArrayObject *self, PyObject *args, PyObject *kwds)
+{
+	self->data = EMPTY_SHM;
+	if (!check_thread_inited())
+		return -1;
+
+	int typecode = 0;
+	PyObject *obj = NULL;
+	if (!PyArg_ParseTuple(args, "CO", &typecode, &obj))
+		return -1;
+	const ShmArrayTypecode *desc = shm_array_find_typecode(typecode);
+	if (desc == NULL)
+	{
+		PyErr_SetString(PyExc_ValueError, "ShmArray typecode must be one of b, B, h, H, i, I, l, L, q, Q, f or d");
+		return -1;
+	}
+
+	PyObject *seq = NULL;
+	Py_ssize_t count = 0;
+	if (PyIndex_Check(obj))
+	{
+		count = PyNumber_AsSsize_t(obj, PyExc_OverflowError);
+		if (count == -1 && PyErr_Occurred())
+			return -1;
+		if (count < 0)
+		{
+			PyErr_SetString(PyExc_ValueError, "ShmArray size cannot be negative");
+			return -1;
+		}
+	}
+	else
+	{
+		seq = PySequence_Fast(obj, "ShmArray requires a size or an iterable of numbers");
+		if (seq == NULL)
+			return -1;
+		count = PySequence_Fast_GET_SIZE(seq);
+	}
+	ShmInt max_count = shm_array_max_count(desc->itemsize);
+	if (count > max_count)
+	{
+		PyErr_Format(PyExc_ValueError, "ShmArray of typecode '%c' can hold at most %d items", typecode, (int)max_count);
+		Py_XDECREF(seq);
+		return -1;
+	}
+
+	ShmArray *array = new_shm_array(thread, &self->data, typecode, desc->itemsize, (ShmInt)count);
+	if (seq)
+	{
+		// the array is not shared yet, so the items are written in place
+		ShmArrayData *data = LOCAL(array->data);
+		int rslt = shm_array_pack_sequence(array, seq, count, CAST_VL(shm_array_data_items(data)));
+		Py_DECREF(seq);
+		if (rslt < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static Py_ssize_t
+shm_array_length(ShmArrayObject *self)
+{
+	ShmArray *array = LOCAL(self->data);
+	if (array == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid array object");
+		return -1;
+	}
+	return array->count;
+}
+
+// Copies the items into dest, a negative step is fetched forward from the last item of the slice.
+static int
+shm_array_fetch(ArrayRef array, Py_ssize_t start, Py_ssize_t step, Py_ssize_t slicelength, char *dest)
+{
+	Py_ssize_t first = step > 0 ? start : start + (slicelength - 1) * step;
+	Py_ssize_t abs_step = step > 0 ? step : -step;
+	RETRY_LOOP(shm_array_get_range(thread, array, first, abs_step, slicelength, dest),
+		{ },
+		{ return -1; },
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in shm_array_fetch");
+			return -1;
+		});
+	return 0;
+}
+
+static int
+shm_array_store(ArrayRef array, Py_ssize_t start, Py_ssize_t step, Py_ssize_t slicelength, const char *src)
+{
+	Py_ssize_t first = step > 0 ? start : start + (slicelength - 1) * step;
+	Py_ssize_t abs_step = step > 0 ? step : -step;
+	RETRY_LOOP(shm_array_set_range(thread, array, first, abs_step, slicelength, src),
+		{ },
+		{ return -1; },
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in shm_array_store");
+			return -1;
+		});
+	return 0;
+}
+
+static PyObject *
+shm_array_item(ShmArrayObject *self, Py_ssize_t i)
+{
+	ArrayRef array = { .shared = self->data, .local = LOCAL(self->data) };
+	if (array.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid array object");
+		return NULL;
+	}
+	if (i < 0 || i >= array.local->count)
+	{
+		PyErr_SetString(PyExc_IndexError, "array index out of range");
+		return NULL;
+	}
+	char item[sizeof(double) > sizeof(long long) ? sizeof(double) : sizeof(long long)];
+	if (shm_array_fetch(array, i, 1, 1, item) < 0)
+		return NULL;
+	return shm_array_unpack_item(array.local->typecode, item);
+}
+
+// All the items of the slice are copied under a single lock.
+static PyObject *
+shm_array_slice(ShmArrayObject *self, Py_ssize_t start, Py_ssize_t stop, Py_ssize_t step)
+{
+	ArrayRef array = { .shared = self->data, .local = LOCAL(self->data) };
+	Py_ssize_t slicelength = PySlice_AdjustIndices(array.local->count, &start, &stop, step);
+	if (slicelength <= 0)
+		return PyList_New(0);
+	int itemsize = array.local->itemsize;
+	char *items = PyMem_Malloc(slicelength * itemsize);
+	if (items == NULL)
+		return PyErr_NoMemory();
+	if (shm_array_fetch(array, start, step, slicelength, items) < 0)
+	{
+		PyMem_Free(items);
+		return NULL;
+	}
+	PyObject *rslt = PyList_New(slicelength);
+	for (Py_ssize_t i = 0; rslt && i < slicelength; i++)
+	{
+		PyObject *obj = shm_array_unpack_item(array.local->typecode, items + (step > 0 ? i : slicelength - 1 - i) * itemsize);
+		if (obj == NULL)
+			Py_CLEAR(rslt);
+		else
+			PyList_SET_ITEM(rslt, i, obj);
+	}
+	PyMem_Free(items);
+	return rslt;
+}
+
+static PyObject *
+shm_array_subscript(ShmArrayObject *self, PyObject *item)
+{
+	if (LOCAL(self->data) == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid array object");
+		return NULL;
+	}
+	if (PyIndex_Check(item))
+	{
+		Py_ssize_t i = PyNumber_AsSsize_t(item, PyExc_IndexError);
+		if (i == -1 && PyErr_Occurred())
+			return NULL;
+		if (i < 0)
+			i += shm_array_length(self);
+		return shm_array_item(self, i);
+	}
+	else if (PySlice_Check(item))
+	{
+		Py_ssize_t start, stop, step;
+		if (PySlice_Unpack(item, &start, &stop, &step) < 0)
+			return NULL;
+		return shm_array_slice(self, start, stop, step);
+	}
+	else
+	{
+		PyErr_Format(PyExc_TypeError,
+		             "array indices must be integers or slices, not %.200s",
+		             item->ob_type->tp_name);
+		return NULL;
+	}
+}
+
+static int
+shm_array_ass_item(ShmArrayObject *self, Py_ssize_t i, PyObject *value)
+{
+	ArrayRef array = { .shared = self->data, .local = LOCAL(self->data) };
+	if (array.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid array object");
+		return -1;
+	}
+	if (value == NULL)
+	{
+		PyErr_SetString(PyExc_TypeError, "ShmArray has a fixed size, its items cannot be deleted");
+		return -1;
+	}
+	if (i < 0 || i >= array.local->count)
+	{
+		PyErr_SetString(PyExc_IndexError, "array assignment index out of range");
+		return -1;
+	}
+	char item[sizeof(double) > sizeof(long long) ? sizeof(double) : sizeof(long long)];
+	if (shm_array_pack_item(array.local->typecode, value, item) < 0)
+		return -1;
+	return shm_array_store(array, i, 1, 1, item);
+}
+
+// The value is either a buffer of the same format, copied as is, or a sequence of numbers of the slice length.
+static int
+shm_array_ass_slice(ShmArrayObject *self, PyObject *slice, PyObject *value)
+{
+	ArrayRef array = { .shared = self->data, .local = LOCAL(self->data) };
+	if (value == NULL)
+	{
+		PyErr_SetString(PyExc_TypeError, "ShmArray has a fixed size, its items cannot be deleted");
+		return -1;
+	}
+	Py_ssize_t start, stop, step;
+	if (PySlice_Unpack(slice, &start, &stop, &step) < 0)
+		return -1;
+	Py_ssize_t slicelength = PySlice_AdjustIndices(array.local->count, &start, &stop, step);
+	int itemsize = array.local->itemsize;
+
+	if (PyObject_CheckBuffer(value) && step > 0)
+	{
+		Py_buffer view;
+		if (PyObject_GetBuffer(value, &view, PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) < 0)
+			return -1;
+		const char *format = view.format ? view.format : "B";
+		if (format[0] == '@')
+			format++;
+		if (view.itemsize == itemsize && format[0] == array.local->typecode && format[1] == '\0')
+		{
+			int rslt = -1;
+			if (view.len / itemsize != slicelength)
+				PyErr_Format(PyExc_ValueError, "attempt to assign buffer of %zd items to slice of %zd items",
+				             view.len / itemsize, slicelength);
+			else
+				rslt = slicelength ? shm_array_store(array, start, step, slicelength, view.buf) : 0;
+			PyBuffer_Release(&view);
+			return rslt;
+		}
+		PyBuffer_Release(&view);
+		// different format, converted item by item
+	}
+
+	PyObject *seq = PySequence_Fast(value, "can only assign a buffer or an iterable of numbers to a ShmArray slice");
+	if (seq == NULL)
+		return -1;
+	if (PySequence_Fast_GET_SIZE(seq) != slicelength)
+	{
+		PyErr_Format(PyExc_ValueError, "attempt to assign sequence of size %zd to slice of size %zd",
+		             PySequence_Fast_GET_SIZE(seq), slicelength);
+		Py_DECREF(seq);
+		return -1;
+	}
+	if (slicelength == 0)
+	{
+		Py_DECREF(seq);
+		return 0;
+	}
+	char *items = PyMem_Malloc(slicelength * itemsize);
+	if (items == NULL)
+	{
+		Py_DECREF(seq);
+		PyErr_NoMemory();
+		return -1;
+	}
+	int rslt = -1;
+	if (step < 0)
+	{
+		// stored forward from the last item of the slice
+		for (Py_ssize_t i = 0; i < slicelength; i++)
+			if (shm_array_pack_item(array.local->typecode, PySequence_Fast_GET_ITEM(seq, slicelength - 1 - i), items + i * itemsize) < 0)
+				goto done;
+	}
+	else if (shm_array_pack_sequence(array.local, seq, slicelength, items) < 0)
+		goto done;
+	rslt = shm_array_store(array, start, step, slicelength, items);
+done:
+	PyMem_Free(items);
+	Py_DECREF(seq);
+	return rslt;
+}
+
+static int
+shm_array_ass_subscript(ShmArrayObject *self, PyObject *item, PyObject *value)
+{
+	if (LOCAL(self->data) == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid array object");
+		return -1;
+	}
+	if (PyIndex_Check(item))
+	{
+		Py_ssize_t i = PyNumber_AsSsize_t(item, PyExc_IndexError);
+		if (i == -1 && PyErr_Occurred())
+			return -1;
+		if (i < 0)
+			i += shm_array_length(self);
+		return shm_array_ass_item(self, i, value);
+	}
+	else if (PySlice_Check(item))
+	{
+		return shm_array_ass_slice(self, item, value);
+	}
+	else
+	{
+		PyErr_Format(PyExc_TypeError,
+		             "array indices must be integers or slices, not %.200s",
+		             item->ob_type->tp_name);
+		return -1;
+	}
+}
+
+// Kept in Py_buffer.internal for the lifetime of the view.
+typedef struct {
+	ShmPointer data; // acquired ShmArrayData
+	Py_ssize_t shape;
+	Py_ssize_t strides;
+} ShmArrayView;
+
+// The view points straight into the shared block of the items. The committed block is never modified in place,
+// so the view is a stable snapshot, only the writes of the same transaction made after the view was taken are seen by it.
+static int
+shm_array_getbuffer(ShmArrayObject *self, Py_buffer *view, int flags)
+{
+	ArrayRef array = { .shared = self->data, .local = LOCAL(self->data) };
+	if (array.local == NULL)
+	{
+		PyErr_SetString(PyExc_BufferError, "Invalid array object");
+		return -1;
+	}
+	if (flags & PyBUF_WRITABLE)
+	{
+		PyErr_SetString(PyExc_BufferError, "ShmArray buffer is read-only, assign its items or slices instead");
+		return -1;
+	}
+	ShmArrayView *internal = PyMem_Malloc(sizeof(ShmArrayView));
+	if (internal == NULL)
+	{
+		PyErr_NoMemory();
+		return -1;
+	}
+	ShmPointer data_shm = EMPTY_SHM;
+	RETRY_LOOP(shm_array_acq_data(thread, array, &data_shm),
+		{ },
+		{
+			PyMem_Free(internal);
+			return -1;
+		},
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in shm_array_getbuffer");
+			PyMem_Free(internal);
+			return -1;
+		});
+	ShmArrayData *data = LOCAL(data_shm);
+	internal->data = data_shm;
+	internal->shape = data->count;
+	internal->strides = data->itemsize;
+
+	view->obj = (PyObject *)self;
+	Py_INCREF(self);
+	view->buf = CAST_VL(shm_array_data_items(data));
+	view->len = data->count * data->itemsize;
+	view->readonly = 1;
+	view->itemsize = data->itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? (char *)shm_array_find_typecode(array.local->typecode)->format : NULL;
+	view->ndim = 1;
+	view->shape = (flags & PyBUF_ND) ? &internal->shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? &internal->strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = internal;
+	return 0;
+}
+
+static void
+shm_array_releasebuffer(ShmArrayObject *self, Py_buffer *view)
+{
+	ShmArrayView *internal = view->internal;
+	shm_pointer_release(thread, internal->data);
+	PyMem_Free(internal);
+}
+
+static PyObject *
+ShmArray_tolist(ShmArrayObject *self, PyObject *unused)
+{
+	if (LOCAL(self->data) == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid array object");
+		return NULL;
+	}
+	return shm_array_slice(self, 0, PY_SSIZE_T_MAX, 1);
+}
+
+static PyObject *
+ShmArray_get_typecode(ShmArrayObject *self, void *context)
+{
+	ShmArray *array = LOCAL(self->data);
+	if (array == NULL)
+		Py_RETURN_NONE;
+	return PyUnicode_FromOrdinal(array->typecode);
+}
+
+static PyObject *
+ShmArray_get_itemsize(ShmArrayObject *self, void *context)
+{
+	ShmArray *array = LOCAL(self->data);
+	if (array == NULL)
+		Py_RETURN_NONE;
+	return PyLong_FromLong(array->itemsize);
+}
+
+static PyObject *
+ShmArray_repr(ShmArrayObject *self)
+{
+	ShmArray *array = LOCAL(self->data);
+	if (array == NULL)
+		return PyUnicode_FromFormat("<empty %s object at %p>", self->ob_base.ob_type->tp_name, self);
+	return PyUnicode_FromFormat("<%s of %d items of typecode '%c' at %p>",
+	                            self->ob_base.ob_type->tp_name, (int)array->count, (int)array->typecode, self);
+}
+
+static PySequenceMethods shm_array_as_sequence = {
+	.sq_length = (lenfunc)shm_array_length,
+	.sq_item = (ssizeargfunc)shm_array_item,
+	.sq_ass_item = (ssizeobjargproc)shm_array_ass_item,
+};
+
+static PyMappingMethods shm_array_as_mapping = {
+	(lenfunc)shm_array_length,
+	(binaryfunc)shm_array_subscript,
+	(objobjargproc)shm_array_ass_subscript
+};
+
+static PyBufferProcs shm_array_as_buffer = {
+	(getbufferproc)shm_array_getbuffer,
+	(releasebufferproc)shm_array_releasebuffer,
+};
+
+static PyMethodDef ShmArray_methods[] = {
+	{
+		"tolist", (PyCFunction)ShmArray_tolist, METH_NOARGS,
+		"Returns the items as a list, copied under a single lock"
+	},
+
+	{NULL, NULL} // sentinel
+};
+
+static PyGetSetDef ShmArray_getset[] = {
+	{"typecode", (getter)ShmArray_get_typecode, NULL, "Typecode of the items, same as in the array module"},
+	{"itemsize", (getter)ShmArray_get_itemsize, NULL, "Size of an item in bytes"},
+	{NULL, NULL} // sentinel
+};
+
+static PyTypeObject ShmArray_Type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "pso.ShmArray",
+	.tp_doc = "Shared fixed-size array of numbers stored inline, ShmArray(typecode, size_or_iterable)",
+	.tp_basicsize = sizeof(ShmArrayObject),
+	.tp_repr = (reprfunc) ShmArray_repr,
+	.tp_dealloc = (destructor) ShmBase_dealloc,
+	.tp_getattro = PyObject_GenericGetAttr,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_as_sequence = &shm_array_as_sequence,
+	.tp_as_mapping = &shm_array_as_mapping,
+	.tp_as_buffer = &shm_array_as_buffer,
+	.tp_methods = ShmArray_methods,
+	.tp_getset = ShmArray_getset,
+	.tp_init = (initproc) ShmArray_init,
+	.tp_new = PyType_GenericNew,
+};
+
+// ////////////////
+// ShmTable
+// /////////////////
+
+#define SHM_TABLE_MAX_PREDICATES 16
+
+static int
+shm_table_column_from_object(ShmTable *table, PyObject *obj)
+{
+	if (PyUnicode_Check(obj))
+	{
+		const char *name = PyUnicode_AsUTF8(obj);
+		if (name == NULL)
+			return -1;
+		for (int i = 0; i < table->column_count; i++)
+			if (strcmp(name, CAST_VL(table->columns[i].name)) == 0)
+				return i;
+		PyErr_Format(PyExc_KeyError, "ShmTable has no column %R", obj);
+		return -1;
+	}
+	if (PyIndex_Check(obj))
+	{
+		Py_ssize_t i = PyNumber_AsSsize_t(obj, PyExc_IndexError);
+		if (i == -1 && PyErr_Occurred())
+			return -1;
+		if (i < 0 || i >= table->column_count)
+		{
+			PyErr_SetString(PyExc_IndexError, "ShmTable column index out of range");
+			return -1;
+		}
+		return (int)i;
+	}
+	PyErr_Format(PyExc_TypeError, "ShmTable column must be a name or an index, not %.200s", obj->ob_type->tp_name);
+	return -1;
+}
+
+static int
+shm_table_value_from_object(ShmTable *table, int column, PyObject *obj, ShmTableValue *value)
+{
+	switch (shm_table_typecode_kind(table->columns[column].typecode))
+	{
+	case SHM_TABLE_KIND_SIGNED:
+		value->i = PyLong_AsLongLong(obj);
+		return value->i == -1 && PyErr_Occurred() ? -1 : 0;
+	case SHM_TABLE_KIND_UNSIGNED:
+		value->u = PyLong_AsUnsignedLongLong(obj);
+		return value->u == (uint64_t)-1 && PyErr_Occurred() ? -1 : 0;
+	default:
+		value->d = PyFloat_AsDouble(obj);
+		return value->d == -1.0 && PyErr_Occurred() ? -1 : 0;
+	}
+}
+
+static PyObject *
+shm_table_value_to_object(ShmTable *table, int column, ShmTableValue value)
+{
+	switch (shm_table_typecode_kind(table->columns[column].typecode))
+	{
+	case SHM_TABLE_KIND_SIGNED:
+		return PyLong_FromLongLong(value.i);
+	case SHM_TABLE_KIND_UNSIGNED:
+		return PyLong_FromUnsignedLongLong(value.u);
+	default:
+		return PyFloat_FromDouble(value.d);
+	}
+}
+
+static int
+shm_table_predicate_from_object(ShmTable *table, PyObject *obj, ShmTablePredicate *predicate)
+{
+	static const char *ops[] = { "<", "<=", "==", "!=", ">=", ">" };
+	if (!PyTuple_Check(obj) || PyTuple_GET_SIZE(obj) != 3 || !PyUnicode_Check(PyTuple_GET_ITEM(obj, 1)))
+	{
+		PyErr_SetString(PyExc_TypeError, "ShmTable condition must be a (column, operator, value) tuple");
+		return -1;
+	}
+	int column = shm_table_column_from_object(table, PyTuple_GET_ITEM(obj, 0));
+	if (column < 0)
+		return -1;
+	const char *op = PyUnicode_AsUTF8(PyTuple_GET_ITEM(obj, 1));
+	if (op == NULL)
+		return -1;
+	predicate->op = -1;
+	for (int i = 0; i < (int)(sizeof(ops) / sizeof(ops[0])); i++)
+		if (strcmp(op, ops[i]) == 0)
+			predicate->op = SHM_TABLE_LT + i;
+	if (predicate->op < 0)
+	{
+		PyErr_Format(PyExc_ValueError, "ShmTable condition operator must be one of <, <=, ==, !=, >=, >, not %s", op);
+		return -1;
+	}
+	predicate->column = column;
+	return shm_table_value_from_object(table, column, PyTuple_GET_ITEM(obj, 2), &predicate->value);
+}
+
+// where is None, a single (column, operator, value) condition or a list of conditions that all must hold.
+// Returns the number of predicates or -1.
+static int
+shm_table_predicates_from_object(ShmTable *table, PyObject *where, ShmTablePredicate *predicates)
+{
+	if (where == NULL || where == Py_None)
+		return 0;
+	if (PyTuple_Check(where) && PyTuple_GET_SIZE(where) == 3 && PyUnicode_Check(PyTuple_GET_ITEM(where, 1)))
+		return shm_table_predicate_from_object(table, where, &predicates[0]) < 0 ? -1 : 1;
+	PyObject *seq = PySequence_Fast(where, "ShmTable where must be a condition or a list of conditions");
+	if (seq == NULL)
+		return -1;
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+	if (count > SHM_TABLE_MAX_PREDICATES)
+	{
+		PyErr_Format(PyExc_ValueError, "ShmTable supports at most %d conditions", SHM_TABLE_MAX_PREDICATES);
+		Py_DECREF(seq);
+		return -1;
+	}
+	for (Py_ssize_t i = 0; i < count; i++)
+	{
+		if (shm_table_predicate_from_object(table, PySequence_Fast_GET_ITEM(seq, i), &predicates[i]) < 0)
+		{
+			Py_DECREF(seq);
+			return -1;
+		}
+	}
+	Py_DECREF(seq);
+	return (int)count;
+}
+
+static int
+ShmTable_init(ShmTableObject *self, PyObject *args, PyObject *kwds)
+{
+	self->data = EMPTY_SHM;
+	if (!check_thread_inited())
+		return -1;
+
+	PyObject *obj = NULL;
+	if (!PyArg_ParseTuple(args, "O", &obj))
+		return -1;
+	PyObject *seq = PySequence_Fast(obj, "ShmTable requires a list of (name, typecode) columns");
+	if (seq == NULL)
+		return -1;
+	Py_ssize_t column_count = PySequence_Fast_GET_SIZE(seq);
+	if (column_count < 1 || column_count > SHM_TABLE_MAX_COLUMNS)
+	{
+		PyErr_Format(PyExc_ValueError, "ShmTable must have from 1 to %d columns", SHM_TABLE_MAX_COLUMNS);
+		Py_DECREF(seq);
+		return -1;
+	}
+	ShmTableColumn columns[SHM_TABLE_MAX_COLUMNS];
+	memclear(columns, sizeof(columns));
+	for (Py_ssize_t i = 0; i < column_count; i++)
+	{
+		PyObject *name_obj = NULL;
+		int typecode = 0;
+		PyObject *column = PySequence_Fast_GET_ITEM(seq, i);
+		if (!PyTuple_Check(column) || !PyArg_ParseTuple(column, "UC", &name_obj, &typecode))
+		{
+			if (!PyErr_Occurred())
+				PyErr_SetString(PyExc_TypeError, "ShmTable column must be a (name, typecode) tuple");
+			Py_DECREF(seq);
+			return -1;
+		}
+		Py_ssize_t name_size = 0;
+		const char *name = PyUnicode_AsUTF8AndSize(name_obj, &name_size);
+		if (name == NULL)
+		{
+			Py_DECREF(seq);
+			return -1;
+		}
+		const ShmArrayTypecode *desc = shm_array_find_typecode(typecode);
+		if (desc == NULL)
+		{
+			PyErr_SetString(PyExc_ValueError, "ShmTable typecode must be one of b, B, h, H, i, I, l, L, q, Q, f or d");
+			Py_DECREF(seq);
+			return -1;
+		}
+		if (name_size >= SHM_TABLE_NAME_SIZE)
+		{
+			PyErr_Format(PyExc_ValueError, "ShmTable column name must be shorter than %d bytes", SHM_TABLE_NAME_SIZE);
+			Py_DECREF(seq);
+			return -1;
+		}
+		for (Py_ssize_t k = 0; k < i; k++)
+		{
+			if (strcmp(CAST_VL(columns[k].name), name) == 0)
+			{
+				PyErr_Format(PyExc_ValueError, "ShmTable column %s is repeated", name);
+				Py_DECREF(seq);
+				return -1;
+			}
+		}
+		columns[i].typecode = typecode;
+		columns[i].itemsize = desc->itemsize;
+		memcpy(CAST_VL(columns[i].name), name, (size_t)name_size);
+	}
+	Py_DECREF(seq);
+	new_shm_table(thread, &self->data, (ShmInt)column_count, columns);
+	return 0;
+}
+
+static Py_ssize_t
+shm_table_length(ShmTableObject *self)
+{
+	TableRef table = { .shared = self->data, .local = LOCAL(self->data) };
+	if (table.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid table object");
+		return -1;
+	}
+	ShmInt count = 0;
+	RETRY_LOOP(shm_table_get_count(thread, table, &count),
+		{ },
+		{ return -1; },
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in shm_table_length");
+			return -1;
+		});
+	return count;
+}
+
+static PyObject *
+shm_table_row(ShmTableObject *self, Py_ssize_t i)
+{
+	TableRef table = { .shared = self->data, .local = LOCAL(self->data) };
+	if (table.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid table object");
+		return NULL;
+	}
+	if (i < 0)
+	{
+		PyErr_SetString(PyExc_IndexError, "table index out of range");
+		return NULL;
+	}
+	PyObject *rslt = PyTuple_New(table.local->column_count);
+	if (rslt == NULL)
+		return NULL;
+	for (int column = 0; column < table.local->column_count; column++)
+	{
+		// rows are never modified once appended, so the columns can be read one by one
+		char item[sizeof(double) > sizeof(long long) ? sizeof(double) : sizeof(long long)];
+		bool out_of_range = false;
+		RETRY_LOOP(shm_table_get_range(thread, table, column, i, 1, item),
+			{
+				if (_rslt == RESULT_INVALID)
+				{
+					out_of_range = true;
+					break;
+				}
+			},
+			{
+				Py_DECREF(rslt);
+				return NULL;
+			},
+			{
+				PyErr_SetString(Shm_Exception, "Internal failure in shm_table_row");
+				Py_DECREF(rslt);
+				return NULL;
+			});
+		if (out_of_range)
+		{
+			PyErr_SetString(PyExc_IndexError, "table index out of range");
+			Py_DECREF(rslt);
+			return NULL;
+		}
+		PyObject *obj = shm_array_unpack_item(table.local->columns[column].typecode, item);
+		if (obj == NULL)
+		{
+			Py_DECREF(rslt);
+			return NULL;
+		}
+		PyTuple_SET_ITEM(rslt, column, obj);
+	}
+	return rslt;
+}
+
+static PyObject *
+shm_table_subscript(ShmTableObject *self, PyObject *item)
+{
+	if (PyIndex_Check(item))
+	{
+		Py_ssize_t i = PyNumber_AsSsize_t(item, PyExc_IndexError);
+		if (i == -1 && PyErr_Occurred())
+			return NULL;
+		if (i < 0)
+		{
+			Py_ssize_t length = shm_table_length(self);
+			if (length < 0)
+				return NULL;
+			i += length;
+		}
+		return shm_table_row(self, i);
+	}
+	PyErr_Format(PyExc_TypeError,
+	             "table indices must be integers, not %.200s",
+	             item->ob_type->tp_name);
+	return NULL;
+}
+
+// All the rows are packed column by column and appended at once.
+static PyObject *
+ShmTable_extend(ShmTableObject *self, PyObject *rows)
+{
+	TableRef table = { .shared = self->data, .local = LOCAL(self->data) };
+	if (table.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid table object");
+		return NULL;
+	}
+	PyObject *seq = PySequence_Fast(rows, "ShmTable.extend() requires an iterable of rows");
+	if (seq == NULL)
+		return NULL;
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+	int column_count = table.local->column_count;
+	char *columns[SHM_TABLE_MAX_COLUMNS];
+	memset(columns, 0, sizeof(columns));
+	PyObject *rslt = NULL;
+	for (int column = 0; column < column_count; column++)
+	{
+		columns[column] = PyMem_Malloc(count * table.local->columns[column].itemsize + 1);
+		if (columns[column] == NULL)
+		{
+			PyErr_NoMemory();
+			goto done;
+		}
+	}
+	for (Py_ssize_t i = 0; i < count; i++)
+	{
+		PyObject *row = PySequence_Fast(PySequence_Fast_GET_ITEM(seq, i), "ShmTable row must be a sequence of values");
+		if (row == NULL)
+			goto done;
+		if (PySequence_Fast_GET_SIZE(row) != column_count)
+		{
+			PyErr_Format(PyExc_ValueError, "ShmTable row must have %d values, got %zd", column_count, PySequence_Fast_GET_SIZE(row));
+			Py_DECREF(row);
+			goto done;
+		}
+		for (int column = 0; column < column_count; column++)
+		{
+			ShmInt itemsize = table.local->columns[column].itemsize;
+			if (shm_array_pack_item(table.local->columns[column].typecode, PySequence_Fast_GET_ITEM(row, column),
+			                        columns[column] + i * itemsize) < 0)
+			{
+				Py_DECREF(row);
+				goto done;
+			}
+		}
+		Py_DECREF(row);
+	}
+	bool full = false;
+	RETRY_LOOP(shm_table_append(thread, table, count, (const void *const *)columns),
+		{
+			if (_rslt == RESULT_INVALID)
+			{
+				full = true;
+				break;
+			}
+		},
+		{ goto done; },
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in ShmTable_extend");
+			goto done;
+		});
+	if (full)
+	{
+		PyErr_Format(Shm_Exception, "ShmTable cannot hold more than %d rows", (int)shm_table_max_count(column_count));
+		goto done;
+	}
+	rslt = Py_None;
+	Py_INCREF(rslt);
+done:
+	for (int column = 0; column < column_count; column++)
+		PyMem_Free(columns[column]);
+	Py_DECREF(seq);
+	return rslt;
+}
+
+static PyObject *
+ShmTable_append(ShmTableObject *self, PyObject *row)
+{
+	PyObject *rows = PyTuple_Pack(1, row);
+	if (rows == NULL)
+		return NULL;
+	PyObject *rslt = ShmTable_extend(self, rows);
+	Py_DECREF(rows);
+	return rslt;
+}
+
+static PyObject *
+ShmTable_column(ShmTableObject *self, PyObject *name)
+{
+	TableRef table = { .shared = self->data, .local = LOCAL(self->data) };
+	if (table.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid table object");
+		return NULL;
+	}
+	int column = shm_table_column_from_object(table.local, name);
+	if (column < 0)
+		return NULL;
+	Py_ssize_t count = shm_table_length(self);
+	if (count < 0)
+		return NULL;
+	ShmInt itemsize = table.local->columns[column].itemsize;
+	char *items = PyMem_Malloc(count * itemsize + 1);
+	if (items == NULL)
+		return PyErr_NoMemory();
+	RETRY_LOOP(shm_table_get_range(thread, table, column, 0, count, items),
+		{ },
+		{
+			PyMem_Free(items);
+			return NULL;
+		},
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in ShmTable_column");
+			PyMem_Free(items);
+			return NULL;
+		});
+	PyObject *rslt = PyList_New(count);
+	for (Py_ssize_t i = 0; rslt && i < count; i++)
+	{
+		PyObject *obj = shm_array_unpack_item(table.local->columns[column].typecode, items + i * itemsize);
+		if (obj == NULL)
+			Py_CLEAR(rslt);
+		else
+			PyList_SET_ITEM(rslt, i, obj);
+	}
+	PyMem_Free(items);
+	return rslt;
+}
+
+static PyObject *
+shm_table_do_aggregate(ShmTableObject *self, int aggregate, PyObject *args, PyObject *kwds)
+{
+	TableRef table = { .shared = self->data, .local = LOCAL(self->data) };
+	if (table.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid table object");
+		return NULL;
+	}
+	static char *column_kwlist[] = { "column", "where", NULL };
+	static char *count_kwlist[] = { "where", NULL };
+	PyObject *column_obj = NULL;
+	PyObject *where = NULL;
+	int column = -1;
+	if (aggregate == SHM_TABLE_COUNT)
+	{
+		if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", count_kwlist, &where))
+			return NULL;
+	}
+	else
+	{
+		if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", column_kwlist, &column_obj, &where))
+			return NULL;
+		column = shm_table_column_from_object(table.local, column_obj);
+		if (column < 0)
+			return NULL;
+	}
+	ShmTablePredicate predicates[SHM_TABLE_MAX_PREDICATES];
+	int predicate_count = shm_table_predicates_from_object(table.local, where, predicates);
+	if (predicate_count < 0)
+		return NULL;
+	ShmTableValue result;
+	ShmInt matched = 0;
+	RETRY_LOOP(shm_table_aggregate(thread, table, column, aggregate, predicates, predicate_count, &result, &matched),
+		{ },
+		{ return NULL; },
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in shm_table_do_aggregate");
+			return NULL;
+		});
+	if (aggregate == SHM_TABLE_COUNT)
+		return PyLong_FromLongLong(result.i);
+	if (matched == 0 && aggregate != SHM_TABLE_SUM)
+		Py_RETURN_NONE;
+	return shm_table_value_to_object(table.local, column, result);
+}
+
+static PyObject *
+ShmTable_count(ShmTableObject *self, PyObject *args, PyObject *kwds)
+{
+	return shm_table_do_aggregate(self, SHM_TABLE_COUNT, args, kwds);
+}
+
+static PyObject *
+ShmTable_sum(ShmTableObject *self, PyObject *args, PyObject *kwds)
+{
+	return shm_table_do_aggregate(self, SHM_TABLE_SUM, args, kwds);
+}
+
+static PyObject *
+ShmTable_min(ShmTableObject *self, PyObject *args, PyObject *kwds)
+{
+	return shm_table_do_aggregate(self, SHM_TABLE_MIN, args, kwds);
+}
+
+static PyObject *
+ShmTable_max(ShmTableObject *self, PyObject *args, PyObject *kwds)
+{
+	return shm_table_do_aggregate(self, SHM_TABLE_MAX, args, kwds);
+}
+
+static PyObject *
+ShmTable_filter(ShmTableObject *self, PyObject *where)
+{
+	TableRef table = { .shared = self->data, .local = LOCAL(self->data) };
+	if (table.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid table object");
+		return NULL;
+	}
+	ShmTablePredicate predicates[SHM_TABLE_MAX_PREDICATES];
+	int predicate_count = shm_table_predicates_from_object(table.local, where, predicates);
+	if (predicate_count < 0)
+		return NULL;
+	// the rows appended after the length was taken are not checked
+	Py_ssize_t count = shm_table_length(self);
+	if (count < 0)
+		return NULL;
+	ShmInt *rows = PyMem_Malloc(count * sizeof(ShmInt) + 1);
+	if (rows == NULL)
+		return PyErr_NoMemory();
+	ShmInt found = 0;
+	RETRY_LOOP(shm_table_filter(thread, table, predicates, predicate_count, rows, count, &found),
+		{ },
+		{
+			PyMem_Free(rows);
+			return NULL;
+		},
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in ShmTable_filter");
+			PyMem_Free(rows);
+			return NULL;
+		});
+	PyObject *rslt = PyList_New(found);
+	for (ShmInt i = 0; rslt && i < found; i++)
+	{
+		PyObject *obj = PyLong_FromLong(rows[i]);
+		if (obj == NULL)
+			Py_CLEAR(rslt);
+		else
+			PyList_SET_ITEM(rslt, i, obj);
+	}
+	PyMem_Free(rows);
+	return rslt;
+}
+
+static PyObject *
+ShmTable_get_columns(ShmTableObject *self, void *context)
+{
+	ShmTable *table = LOCAL(self->data);
+	if (table == NULL)
+		Py_RETURN_NONE;
+	PyObject *rslt = PyTuple_New(table->column_count);
+	for (int i = 0; rslt && i < table->column_count; i++)
+	{
+		PyObject *column = Py_BuildValue("(sC)", CAST_VL(table->columns[i].name), (int)table->columns[i].typecode);
+		if (column == NULL)
+			Py_CLEAR(rslt);
+		else
+			PyTuple_SET_ITEM(rslt, i, column);
+	}
+	return rslt;
+}
+
+static PyObject *
+ShmTable_repr(ShmTableObject *self)
+{
+	ShmTable *table = LOCAL(self->data);
+	if (table == NULL)
+		return PyUnicode_FromFormat("<empty %s object at %p>", self->ob_base.ob_type->tp_name, self);
+	return PyUnicode_FromFormat("<%s of %d columns at %p>", self->ob_base.ob_type->tp_name, (int)table->column_count, self);
+}
+
+static PySequenceMethods shm_table_as_sequence = {
+	.sq_length = (lenfunc)shm_table_length,
+	.sq_item = (ssizeargfunc)shm_table_row,
+};
+
+static PyMappingMethods shm_table_as_mapping = {
+	(lenfunc)shm_table_length,
+	(binaryfunc)shm_table_subscript,
+	NULL
+};
+
+static PyMethodDef ShmTable_methods[] = {
+	{
+		"append", (PyCFunction)ShmTable_append, METH_O,
+		"Appends a row, a sequence of the values of all the columns"
+	},
+	{
+		"extend", (PyCFunction)ShmTable_extend, METH_O,
+		"Appends the rows of the iterable at once"
+	},
+	{
+		"column", (PyCFunction)ShmTable_column, METH_O,
+		"Returns the values of the column as a list"
+	},
+	{
+		"count", (PyCFunction)(void(*)(void))ShmTable_count, METH_VARARGS | METH_KEYWORDS,
+		"count(where=None): number of the rows satisfying the (column, operator, value) condition or the list of conditions"
+	},
+	{
+		"sum", (PyCFunction)(void(*)(void))ShmTable_sum, METH_VARARGS | METH_KEYWORDS,
+		"sum(column, where=None): sum of the column over the rows satisfying the conditions"
+	},
+	{
+		"min", (PyCFunction)(void(*)(void))ShmTable_min, METH_VARARGS | METH_KEYWORDS,
+		"min(column, where=None): smallest value of the column over the rows satisfying the conditions, None if there are no such rows"
+	},
+	{
+		"max", (PyCFunction)(void(*)(void))ShmTable_max, METH_VARARGS | METH_KEYWORDS,
+		"max(column, where=None): largest value of the column over the rows satisfying the conditions, None if there are no such rows"
+	},
+	{
+		"filter", (PyCFunction)ShmTable_filter, METH_O,
+		"Returns the list of the numbers of the rows satisfying the conditions"
+	},
+
+	{NULL, NULL} // sentinel
+};
+
+static PyGetSetDef ShmTable_getset[] = {
+	{"columns", (getter)ShmTable_get_columns, NULL, "Tuple of the (name, typecode) columns"},
+	{NULL, NULL} // sentinel
+};
+
+static PyTypeObject ShmTable_Type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "pso.ShmTable",
+	.tp_doc = "Shared append-only table of typed columns, ShmTable([(name, typecode), ...])",
+	.tp_basicsize = sizeof(ShmTableObject),
+	.tp_repr = (reprfunc) ShmTable_repr,
+	.tp_dealloc = (destructor) ShmBase_dealloc,
+	.tp_getattro = PyObject_GenericGetAttr,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_as_sequence = &shm_table_as_sequence,
+	.tp_as_mapping = &shm_table_as_mapping,
+	.tp_methods = ShmTable_methods,
+	.tp_getset = ShmTable_getset,
+	.tp_init = (initproc) ShmTable_init,
+	.tp_new = PyType_GenericNew,
+};
+
+// ////////////////
+// ShmBlob
+// /////////////////
+
+// Returns -1 with exception set, the index is EMPTY_SHM for the empty blob
+static int
+shm_blob_acq_index_object(ShmBlobObject *self, ShmPointer *index)
+{
+	BlobRef blob = { .shared = self->data, .local = LOCAL(self->data) };
+	if (blob.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid blob object");
+		return -1;
+	}
+	RETRY_LOOP(shm_blob_acq_index(thread, blob, index),
+		{ },
+		{ return -1; },
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in shm_blob_acq_index_object");
+			return -1;
+		});
+	return 0;
+}
+
+// Returns -1 with exception set
+static int
+shm_blob_write_object(ShmBlobObject *self, Py_ssize_t position, const void *src, Py_ssize_t count)
+{
+	BlobRef blob = { .shared = self->data, .local = LOCAL(self->data) };
+	if (blob.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid blob object");
+		return -1;
+	}
+	bool too_large = position > shm_blob_max_size(blob.local) || count > shm_blob_max_size(blob.local) - position;
+	if (!too_large)
+	{
+		RETRY_LOOP(shm_blob_write(thread, blob, (ShmInt)position, (ShmInt)count, src),
+			{
+				if (_rslt == RESULT_INVALID)
+				{
+					too_large = true;
+					break;
+				}
+			},
+			{ return -1; },
+			{
+				PyErr_SetString(Shm_Exception, "Internal failure in shm_blob_write_object");
+				return -1;
+			});
+	}
+	if (too_large)
+	{
+		PyErr_Format(PyExc_ValueError, "ShmBlob cannot hold more than %d bytes", (int)shm_blob_max_size(blob.local));
+		return -1;
+	}
+	return 0;
+}
+
+static int
+ShmBlob_init(ShmBlobObject *self, PyObject *args, PyObject *kwds)
+{
+	self->data = EMPTY_SHM;
+	self->position = 0;
+	if (!check_thread_inited())
+		return -1;
+	PyObject *initial = NULL;
+	if (!PyArg_ParseTuple(args, "|O:ShmBlob", &initial))
+		return -1;
+	new_shm_blob(thread, &self->data);
+	if (initial == NULL)
+		return 0;
+	Py_buffer buffer;
+	if (PyObject_GetBuffer(initial, &buffer, PyBUF_SIMPLE) < 0)
+		return -1;
+	int rslt = shm_blob_write_object(self, 0, buffer.buf, buffer.len);
+	PyBuffer_Release(&buffer);
+	return rslt;
+}
+
+static Py_ssize_t
+shm_blob_length(ShmBlobObject *self)
+{
+	ShmPointer index = EMPTY_SHM;
+	if (shm_blob_acq_index_object(self, &index) < 0)
+		return -1;
+	ShmInt size = shm_blob_index_size(LOCAL(index));
+	if (SBOOL(index))
+		shm_pointer_release(thread, index);
+	return size;
+}
+
+// Copies up to count bytes at the current position into dest, or into a new bytes object when dest is NULL.
+// Returns the number of the bytes or -1 with exception set.
+static Py_ssize_t
+shm_blob_read_object(ShmBlobObject *self, Py_ssize_t count, char *dest, PyObject **bytes)
+{
+	ShmPointer index_shm = EMPTY_SHM;
+	if (shm_blob_acq_index_object(self, &index_shm) < 0)
+		return -1;
+	ShmBlobIndex *index = LOCAL(index_shm);
+	Py_ssize_t size = shm_blob_index_size(index);
+	Py_ssize_t available = size > self->position ? size - self->position : 0;
+	if (count < 0 || count > available)
+		count = available;
+	if (dest == NULL)
+	{
+		*bytes = PyBytes_FromStringAndSize(NULL, count);
+		if (*bytes == NULL)
+		{
+			if (SBOOL(index_shm))
+				shm_pointer_release(thread, index_shm);
+			return -1;
+		}
+		dest = PyBytes_AS_STRING(*bytes);
+	}
+	if (count > 0)
+		shm_blob_index_read(LOCAL(self->data), index, (ShmInt)self->position, (ShmInt)count, dest);
+	if (SBOOL(index_shm))
+		shm_pointer_release(thread, index_shm);
+	self->position += count;
+	return count;
+}
+
+static PyObject *
+ShmBlob_read(ShmBlobObject *self, PyObject *args)
+{
+	Py_ssize_t count = -1;
+	if (!PyArg_ParseTuple(args, "|n:read", &count))
+		return NULL;
+	PyObject *rslt = NULL;
+	if (shm_blob_read_object(self, count, NULL, &rslt) < 0)
+		return NULL;
+	return rslt;
+}
+
+static PyObject *
+ShmBlob_readinto(ShmBlobObject *self, PyObject *obj)
+{
+	Py_buffer buffer;
+	if (PyObject_GetBuffer(obj, &buffer, PyBUF_WRITABLE) < 0)
+		return NULL;
+	Py_ssize_t count = shm_blob_read_object(self, buffer.len, buffer.buf, NULL);
+	PyBuffer_Release(&buffer);
+	if (count < 0)
+		return NULL;
+	return PyLong_FromSsize_t(count);
+}
+
+static PyObject *
+ShmBlob_write(ShmBlobObject *self, PyObject *obj)
+{
+	Py_buffer buffer;
+	if (PyObject_GetBuffer(obj, &buffer, PyBUF_SIMPLE) < 0)
+		return NULL;
+	int rslt = shm_blob_write_object(self, self->position, buffer.buf, buffer.len);
+	Py_ssize_t count = buffer.len;
+	PyBuffer_Release(&buffer);
+	if (rslt < 0)
+		return NULL;
+	self->position += count;
+	return PyLong_FromSsize_t(count);
+}
+
+static PyObject *
+ShmBlob_seek(ShmBlobObject *self, PyObject *args)
+{
+	Py_ssize_t offset = 0;
+	int whence = SEEK_SET;
+	if (!PyArg_ParseTuple(args, "n|i:seek", &offset, &whence))
+		return NULL;
+	Py_ssize_t base;
+	if (whence == SEEK_SET)
+		base = 0;
+	else if (whence == SEEK_CUR)
+		base = self->position;
+	else if (whence == SEEK_END)
+	{
+		base = shm_blob_length(self);
+		if (base < 0)
+			return NULL;
+	}
+	else
+	{
+		PyErr_Format(PyExc_ValueError, "invalid whence (%d, should be 0, 1 or 2)", whence);
+		return NULL;
+	}
+	if (offset < -base)
+	{
+		PyErr_Format(PyExc_ValueError, "negative seek position %zd", base + offset);
+		return NULL;
+	}
+	self->position = base + offset;
+	return PyLong_FromSsize_t(self->position);
+}
+
+static PyObject *
+ShmBlob_tell(ShmBlobObject *self, PyObject *unused)
+{
+	return PyLong_FromSsize_t(self->position);
+}
+
+// Like the file truncate, the position is not changed
+static PyObject *
+ShmBlob_truncate(ShmBlobObject *self, PyObject *args)
+{
+	Py_ssize_t size = self->position;
+	if (!PyArg_ParseTuple(args, "|n:truncate", &size))
+		return NULL;
+	if (size < 0)
+	{
+		PyErr_Format(PyExc_ValueError, "negative size value %zd", size);
+		return NULL;
+	}
+	BlobRef blob = { .shared = self->data, .local = LOCAL(self->data) };
+	if (blob.local == NULL)
+	{
+		PyErr_SetString(Shm_Exception, "Invalid blob object");
+		return NULL;
+	}
+	bool too_large = size > shm_blob_max_size(blob.local);
+	if (!too_large)
+	{
+		RETRY_LOOP(shm_blob_truncate(thread, blob, (ShmInt)size),
+			{
+				if (_rslt == RESULT_INVALID)
+				{
+					too_large = true;
+					break;
+				}
+			},
+			{ return NULL; },
+			{
+				PyErr_SetString(Shm_Exception, "Internal failure in ShmBlob_truncate");
+				return NULL;
+			});
+	}
+	if (too_large)
+	{
+		PyErr_Format(PyExc_ValueError, "ShmBlob cannot hold more than %d bytes", (int)shm_blob_max_size(blob.local));
+		return NULL;
+	}
+	return PyLong_FromSsize_t(size);
+}
+
+static PyObject *
+ShmBlob_true(ShmBlobObject *self, PyObject *unused)
+{
+	Py_RETURN_TRUE;
+}
+
+static PyObject *
+ShmBlob_repr(ShmBlobObject *self)
+{
+	if (LOCAL(self->data) == NULL)
+		return PyUnicode_FromFormat("<empty %s object at %p>", self->ob_base.ob_type->tp_name, self);
+	Py_ssize_t size = shm_blob_length(self);
+	if (size < 0)
+		return NULL;
+	return PyUnicode_FromFormat("<%s of %zd bytes at %p>", self->ob_base.ob_type->tp_name, size, self);
+}
+
+static PySequenceMethods shm_blob_as_sequence = {
+	.sq_length = (lenfunc)shm_blob_length,
+};
+
+static PyMethodDef ShmBlob_methods[] = {
+	{
+		"read", (PyCFunction)ShmBlob_read, METH_VARARGS,
+		"read(size=-1): reads up to size bytes from the current position, all the rest when size is negative"
+	},
+	{
+		"readinto", (PyCFunction)ShmBlob_readinto, METH_O,
+		"Reads bytes from the current position into the writable buffer, returns their count"
+	},
+	{
+		"write", (PyCFunction)ShmBlob_write, METH_O,
+		"Writes the bytes-like object at the current position, returns the count of the bytes written"
+	},
+	{
+		"seek", (PyCFunction)ShmBlob_seek, METH_VARARGS,
+		"seek(offset, whence=0): changes the position like the file seek, returns the new position"
+	},
+	{
+		"tell", (PyCFunction)ShmBlob_tell, METH_NOARGS,
+		"Returns the current position"
+	},
+	{
+		"truncate", (PyCFunction)ShmBlob_truncate, METH_VARARGS,
+		"truncate(size=None): cuts the blob or extends it with zeros to size, the current position by default"
+	},
+	{"readable", (PyCFunction)ShmBlob_true, METH_NOARGS, "Always True"},
+	{"writable", (PyCFunction)ShmBlob_true, METH_NOARGS, "Always True"},
+	{"seekable", (PyCFunction)ShmBlob_true, METH_NOARGS, "Always True"},
+	{NULL, NULL} // sentinel
+};
+
+static PyTypeObject ShmBlob_Type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "pso.ShmBlob",
+	.tp_doc = "Shared file-like byte string of segments, ShmBlob(initial_bytes=None)",
+	.tp_basicsize = sizeof(ShmBlobObject),
+	.tp_repr = (reprfunc) ShmBlob_repr,
+	.tp_dealloc = (destructor) ShmBase_dealloc,
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_as_sequence = &shm_blob_as_sequence,
+	.tp_methods = ShmBlob_methods,
+	.tp_init = (initproc) ShmBlob_init,
+	.tp_new = PyType_GenericNew,
+};
+
+// ////////////////
+// ShmDict
+// /////////////////
+
+int
+dict_to_shm_dict(PyObject *obj, __ShmPointer *rslt, bool concurrent)
+{
+	*rslt = EMPTY_SHM;
+	ShmUnDict *dict = concurrent ? new_shm_undict_concurrent(thread, rslt) : new_shm_undict(thread, rslt);
+
+	// similar to dict_merge()
+	PyObject *keys = PyMapping_Keys(obj);
+	if (keys == NULL)
+		return -1;
+	PyObject *iter = PyObject_GetIter(keys);
+	Py_DECREF(keys);
+	if (iter == NULL)
+		return -1;
+
+	for (PyObject *key = PyIter_Next(iter); key; key = PyIter_Next(iter))
+	{
+		ShmUnDictKey dictkey = EMPTY_SHM_UNDICT_KEY;
+		if (!object_to_dict_key(key, &dictkey))
+		{
+			set_dict_key_error(key);
+			Py_DECREF(iter);
+			Py_DECREF(key);
+			return -1;
+		}
+		PyObject *value = PyObject_GetItem(obj, key);
+		if (value == NULL)
+		{
+			free_dict_key(&dictkey);
+			Py_DECREF(iter);
+			Py_DECREF(key);
+			return -1;
+		}
+		ShmPointer newval = EMPTY_SHM;
+		if (prepare_item_for_shm_container(value, &newval) < 0)
+		{
+			free_dict_key(&dictkey);
+			Py_DECREF(iter);
 			Py_DECREF(key);
 			Py_DECREF(value);
 			if (!PyErr_Occurred())
@@ -1893,6 +4197,7 @@ dict_to_shm_dict(PyObject *obj, __ShmPointer *rslt)
 		}
 		int status = shm_undict_set_item_raw(thread, dict, &dictkey, newval, true);
 		shmassert(RESULT_OK == status);
+		free_dict_key(&dictkey);
 		Py_DECREF(key);
 		Py_DECREF(value);
 	}
@@ -1910,12 +4215,14 @@ ShmDict_init(ShmDictObject *self, PyObject *args, PyObject *kwds)
 	self->data = EMPTY_SHM;
 	if (!check_thread_inited())
 		return -1;
+	static char *kwlist[] = {"data", "concurrent", NULL};
 	PyObject *obj = NULL;
-	if (!PyArg_ParseTuple(args, "|O", &obj))
+	int concurrent = false;
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O$p", kwlist, &obj, &concurrent))
 		return -1;
 	if (obj == NULL)
 	{
-		ShmUnDict *dict = new_shm_undict(thread, &self->data);
+		ShmUnDict *dict = concurrent ? new_shm_undict_concurrent(thread, &self->data) : new_shm_undict(thread, &self->data);
 		shmassert(dict->type == SHM_TYPE_UNDICT);
 		return 0;
 	}
@@ -1925,7 +4232,7 @@ ShmDict_init(ShmDictObject *self, PyObject *args, PyObject *kwds)
 		             "cannot initialize ShmDict from %.200s, dict required instead",
 		             obj->ob_type->tp_name);
 	}
-	return dict_to_shm_dict(obj, &self->data);
+	return dict_to_shm_dict(obj, &self->data, concurrent);
 }
 
 static Py_ssize_t
@@ -1952,24 +4259,136 @@ ShmDictObject_length(ShmDictObject *mp)
 	return count;
 }
 
-// borrows the data from key, so the dictkey doesn't need to be freed
+// None, bool, int, str, bytes and tuples of them. Floats are rejected, since the stored float would only be equal to
+// the same float while Python has 1 == 1.0, so (1,) and (1.0,) would be two different keys.
+static bool
+check_dict_key_item(PyObject *item)
+{
+	PyTypeObject *type = Py_TYPE(item);
+	if (item == Py_None || type == &PyBool_Type || type == &PyUnicode_Type || type == &PyBytes_Type)
+		return true;
+	if (type == &PyLong_Type)
+	{
+		int overflow;
+		PyLong_AsLongAndOverflow(item, &overflow);
+		if (overflow != 0)
+		{
+			PyErr_SetString(PyExc_OverflowError, "ShmDict int key doesn't fit into C long");
+			return false;
+		}
+		return true;
+	}
+	if (type == &PyTuple_Type)
+	{
+		for (Py_ssize_t i = 0; i < PyTuple_GET_SIZE(item); i++)
+		{
+			if (!check_dict_key_item(PyTuple_GET_ITEM(item, i)))
+				return false;
+		}
+		return true;
+	}
+	PyErr_Format(PyExc_TypeError, "unsupported ShmDict key item type %.200s", type->tp_name);
+	return false;
+}
+
+// Same as shm_value_hash() of the key item stored by prepare_item_for_shm_container(), the item is checked by check_dict_key_item().
+static uint32_t
+dict_key_item_hash(PyObject *item)
+{
+	PyTypeObject *type = Py_TYPE(item);
+	if (item == Py_None)
+		return shm_value_hash(NONE_SHM);
+	if (type == &PyBool_Type || type == &PyLong_Type)
+		return hash_int(PyLong_AsLong(item));
+	if (type == &PyUnicode_Type)
+		return hash_string_kind(PyUnicode_KIND(item), PyUnicode_DATA(item), (int)PyUnicode_GET_LENGTH(item));
+	if (type == &PyBytes_Type)
+		return hash_bytes(PyBytes_AS_STRING(item), (int)PyBytes_GET_SIZE(item));
+	shmassert(type == &PyTuple_Type);
+	Py_ssize_t size = PyTuple_GET_SIZE(item);
+	uint32_t hash = hash_tuple_start((int)size);
+	for (Py_ssize_t i = 0; i < size; i++)
+		hash = hash_tuple_add(hash, dict_key_item_hash(PyTuple_GET_ITEM(item, i)));
+	return hash;
+}
+
+static bool
+dict_key_item_equal(ShmPointer stored, PyObject *item)
+{
+	PyTypeObject *type = Py_TYPE(item);
+	if (item == Py_None || stored == NONE_SHM)
+		return item == Py_None && stored == NONE_SHM;
+	if (type == &PyBool_Type || type == &PyLong_Type)
+	{
+		long value = PyLong_AsLong(item);
+		if (shm_pointer_is_immediate(stored))
+		{
+			switch (shm_immediate_get_tag(stored))
+			{
+			case SHM_IMMEDIATE_INT:
+				return shm_immediate_get_int(stored) == value;
+			case SHM_IMMEDIATE_BOOL:
+				return (long)shm_immediate_get_bool(stored) == value;
+			}
+			return false;
+		}
+		ShmValueHeader *header = LOCAL(stored);
+		return header && SHM_TYPE(header->type) == SHM_TYPE(SHM_TYPE_LONG) && *(long *)shm_value_get_data(header) == value;
+	}
+	if (type == &PyUnicode_Type)
+	{
+		Py_UCS1 buffer[SHM_IMMEDIATE_SHORT_MAX];
+		return shm_ref_unicode_equal(shm_unicode_key_get(stored, buffer), PyUnicode_KIND(item), PyUnicode_DATA(item),
+		                             (ShmInt)PyUnicode_GET_LENGTH(item));
+	}
+	if (type == &PyBytes_Type)
+		return shm_bytes_key_equal(stored, PyBytes_AS_STRING(item), (int)PyBytes_GET_SIZE(item));
+	shmassert(type == &PyTuple_Type);
+	if (shm_pointer_is_immediate(stored))
+		return false;
+	ShmValueHeader *header = LOCAL(stored);
+	Py_ssize_t size = PyTuple_GET_SIZE(item);
+	if (!header || SHM_TYPE(header->type) != SHM_TYPE(SHM_TYPE_TUPLE) || shm_value_get_size(header) != size * isizeof(ShmPointer))
+		return false;
+	ShmPointer *elements = shm_value_get_data(header);
+	for (Py_ssize_t i = 0; i < size; i++)
+	{
+		if (!dict_key_item_equal(elements[i], PyTuple_GET_ITEM(item, i)))
+			return false;
+	}
+	return true;
+}
+
+static bool
+dict_key_local_equal(ShmPointer stored, const void *key_local)
+{
+	return dict_key_item_equal(stored, (PyObject *)key_local);
+}
+
+static ShmPointer
+dict_key_local_new(ThreadContext *context, const void *key_local)
+{
+	__ShmPointer rslt = EMPTY_SHM;
+	if (prepare_item_for_shm_container((PyObject *)key_local, &rslt) < 0)
+		return EMPTY_SHM;
+	return rslt;
+}
+
+// Borrows the data from str and bytes keys. Ints fitting into the immediates are converted into key_shm,
+// other int and tuple keys are borrowed as key_local and only get to the shared memory when stored,
+// so the lookups don't allocate. The dictkey should be freed with free_dict_key().
 bool
 object_to_dict_key(PyObject *key, ShmUnDictKey *dictkey)
 {
 	// hashing function for small strings from pyhash.c (DJBX33A) gives very poor dispersion.
 	// Also see dictobject.c comments.
+	*dictkey = (ShmUnDictKey)EMPTY_SHM_UNDICT_KEY;
 	PyTypeObject *type = Py_TYPE(key);
 	if (type == &PyBytes_Type) {
-		/*char* val;
-		Py_ssize_t size;
-		if (PyBytes_AsStringAndSize(key, &val, &size) == -1)
-			return false;
-		dictkey->key = val;
-		dictkey->keysize = size;
-		dictkey->hash = hash_string(val, size);
-		return true;*/
-		shmassert_msg(false, "not supported");
-		return false;
+		dictkey->key_bytes = PyBytes_AS_STRING(key);
+		dictkey->keysize = PyBytes_GET_SIZE(key);
+		dictkey->hash = hash_bytes(dictkey->key_bytes, dictkey->keysize);
+		return true;
 	}
 	else if (type == &PyUnicode_Type) {
 		// from as_ucs4() and PyUnicode_GetLength()
@@ -1990,7 +4409,6 @@ object_to_dict_key(PyObject *key, ShmUnDictKey *dictkey)
 		kind = PyUnicode_KIND(key);
 		data = PyUnicode_DATA(key);
 
-		*dictkey = (ShmUnDictKey)EMPTY_SHM_UNDICT_KEY;
 		dictkey->keysize = size;
 		switch (kind)
 		{
@@ -1999,10 +4417,8 @@ object_to_dict_key(PyObject *key, ShmUnDictKey *dictkey)
 				dictkey->hash = hash_string_ascii(data, size);
 				break;
 			case PyUnicode_2BYTE_KIND:
-				shmassert(false);
 				dictkey->key2 = data;
-				shmassert_msg(false, "Unsupported 2-byte string");
-				// dictkey->hash = hash_string(buffer, size);
+				dictkey->hash = hash_string_ucs2(data, size);
 				break;
 			case PyUnicode_4BYTE_KIND:
 				dictkey->key4 = data;
@@ -2013,10 +4429,76 @@ object_to_dict_key(PyObject *key, ShmUnDictKey *dictkey)
 		}
 		return true;
 	}
+	else if (type == &PyLong_Type || type == &PyBool_Type || type == &PyTuple_Type)
+	{
+		if (!check_dict_key_item(key))
+			return false;
+		__ShmPointer key_shm = EMPTY_SHM;
+		if (type != &PyTuple_Type && object_to_shm_immediate(key, &key_shm))
+		{
+			// compared without touching the memory
+			dictkey->key_shm = key_shm;
+			dictkey->hash = shm_value_hash(key_shm);
+			return true;
+		}
+		dictkey->key_local = key;
+		dictkey->key_local_equal = dict_key_local_equal;
+		dictkey->key_local_new = dict_key_local_new;
+		dictkey->hash = dict_key_item_hash(key);
+		return true;
+	}
 
 	return false;
 }
 
+void
+free_dict_key(ShmUnDictKey *dictkey)
+{
+	shm_pointer_empty(thread, &dictkey->key_shm);
+}
+
+void
+set_dict_key_error(PyObject *key)
+{
+	if (!PyErr_Occurred())
+		PyErr_Format(PyExc_TypeError,
+		             "dict key must be str, bytes, int or tuple, not %.200s",
+		             key->ob_type->tp_name);
+}
+
+// Tuple keys are returned as tuples instead of ShmTuple, so they can be used for the lookups again.
+static PyObject *
+dict_key_to_object(ShmPointer key_shm)
+{
+	if (key_shm == NONE_SHM)
+		Py_RETURN_NONE;
+	ShmValueHeader *header = LOCAL(key_shm);
+	if (header == NULL || SHM_TYPE(header->type) != SHM_TYPE(SHM_TYPE_TUPLE))
+	{
+		shm_pointer_acq(thread, key_shm);
+		return shm_pointer_to_object_consume(key_shm);
+	}
+	Py_ssize_t size = shm_value_get_size(header) / isizeof(ShmPointer);
+	PyObject *rslt = PyTuple_New(size);
+	if (rslt == NULL)
+		return NULL;
+	ShmPointer *elements = shm_value_get_data(header);
+	for (Py_ssize_t i = 0; i < size; i++)
+	{
+		PyObject *item = dict_key_to_object(elements[i]);
+		if (item == NULL)
+		{
+			Py_DECREF(rslt);
+			return NULL;
+		}
+		PyTuple_SET_ITEM(rslt, i, item);
+	}
+	return rslt;
+}
+
+static PyObject *
+ShmDict_GetItemByKey(UnDictRef dict, ShmUnDictKey *dictkey, PyObject *key);
+
 static PyObject *
 ShmDictObject_subscript(ShmDictObject *mp, PyObject *key)
 {
@@ -2025,21 +4507,29 @@ ShmDictObject_subscript(ShmDictObject *mp, PyObject *key)
 	ShmUnDictKey dictkey = EMPTY_SHM_UNDICT_KEY;
 	if (!object_to_dict_key(key, &dictkey))
 	{
-		PyErr_Format(PyExc_TypeError,
-		             "dict key must be a string, not %.200s",
-		             key->ob_type->tp_name);
+		set_dict_key_error(key);
 		return NULL;
 	}
 
 	UnDictRef dict;
 	if (!init_undict_ref(mp->data, &dict))
 	{
+		free_dict_key(&dictkey);
 		PyErr_SetString(Shm_Exception, "init_undict_ref(mp->data, &dict)");
 		return NULL;
 	}
 
+	PyObject *rslt = ShmDict_GetItemByKey(dict, &dictkey, key);
+	free_dict_key(&dictkey);
+	return rslt;
+}
+
+// Raises KeyError when key != NULL
+static PyObject *
+ShmDict_GetItemByKey(UnDictRef dict, ShmUnDictKey *dictkey, PyObject *key)
+{
 	ShmPointer result_value = EMPTY_SHM;
-	RETRY_LOOP(shm_undict_acq(thread, dict, &dictkey, &result_value),
+	RETRY_LOOP(shm_undict_acq(thread, dict, dictkey, &result_value),
 		{ shmassert(result_value == EMPTY_SHM); },
 		{
 			shm_pointer_release(thread, result_value);
@@ -2063,7 +4553,8 @@ ShmDictObject_subscript(ShmDictObject *mp, PyObject *key)
 	}
 	else
 	{
-		_PyErr_SetKeyError(key);
+		if (key)
+			_PyErr_SetKeyError(key);
 		// transient_abort(thread);
 		return NULL;
 	}
@@ -2076,33 +4567,13 @@ ShmDict_GetItem(UnDictRef dict, PyObject *key)
 	ShmUnDictKey dictkey = EMPTY_SHM_UNDICT_KEY;
 	if (!object_to_dict_key(key, &dictkey))
 	{
-		PyErr_Format(PyExc_TypeError,
-		            "dict key must be a string, not %.200s",
-		            key->ob_type->tp_name);
-		return NULL;
-		}
-
-	ShmPointer result_value = EMPTY_SHM;
-	RETRY_LOOP(shm_undict_acq(thread, dict, &dictkey, &result_value),
-		{ shmassert(result_value == EMPTY_SHM); },
-		{
-			shm_pointer_release(thread, result_value);
-			return NULL;
-		},
-		{
-			PyErr_SetString(Shm_Exception, "Internal failure in ShmDict_GetItem");
-			shm_pointer_release(thread, result_value);
-			return NULL;
-		});
-
-	if (result_value != EMPTY_SHM)
-	{
-		return shm_pointer_to_object_consume(result_value);
-	}
-	else
-	{
+		set_dict_key_error(key);
 		return NULL;
 	}
+
+	PyObject *rslt = ShmDict_GetItemByKey(dict, &dictkey, NULL);
+	free_dict_key(&dictkey);
+	return rslt;
 }
 
 int
@@ -2159,12 +4630,12 @@ ShmDict_SetItem(UnDictRef dict, PyObject *key, PyObject *value)
 	ShmUnDictKey dictkey = EMPTY_SHM_UNDICT_KEY;
 	if (!object_to_dict_key(key, &dictkey))
 	{
-		PyErr_Format(PyExc_TypeError,
-		             "dict key must be a string, not %.200s",
-		             key->ob_type->tp_name);
+		set_dict_key_error(key);
 		return -1;
 	}
-	return ShmDict_SetItemInternal(dict, &dictkey, value);
+	int rslt = ShmDict_SetItemInternal(dict, &dictkey, value);
+	free_dict_key(&dictkey);
+	return rslt;
 }
 
 int
@@ -2185,9 +4656,7 @@ ShmDictObject_ass_sub(ShmDictObject *mp, PyObject *v, PyObject *w)
 	ShmUnDictKey dictkey = EMPTY_SHM_UNDICT_KEY;
 	if (!object_to_dict_key(v, &dictkey))
 	{
-		PyErr_Format(PyExc_TypeError,
-		             "dict key must be a string, not %.200s",
-		             v->ob_type->tp_name);
+		set_dict_key_error(v);
 		return -1;
 	}
 	int rslt = -1;
@@ -2196,6 +4665,7 @@ ShmDictObject_ass_sub(ShmDictObject *mp, PyObject *v, PyObject *w)
 	else
 		rslt = ShmDictObject_SetItem(mp, &dictkey, w);
 
+	free_dict_key(&dictkey);
 	return rslt;
 }
 
@@ -2231,7 +4701,10 @@ ShmDictObject_iter(PyObject *obj)
 	shmassert(is_transient || mode == TRANSACTION_PERSISTENT);
 	if (is_transient == false)
 	{
-		RETRY_LOOP(transaction_lock_read(thread, &dict.local->lock, dict.shared, CONTAINER_UNORDERED_DICT, NULL),
+		// the following segments of a concurrent dict are locked by ShmDictIter_next
+		UnDictRef segment;
+		shm_undict_get_segment(dict, 0, &segment);
+		RETRY_LOOP(transaction_lock_read(thread, &segment.local->lock, segment.shared, CONTAINER_UNORDERED_DICT, NULL),
 			{},
 			{ return NULL; },
 			{
@@ -2239,7 +4712,7 @@ ShmDictObject_iter(PyObject *obj)
 				return NULL;
 			});
 
-		shm_cell_check_read_write_lock(thread, &dict.local->lock);
+		shm_cell_check_read_write_lock(thread, &segment.local->lock);
 	}
 
 
@@ -2256,6 +4729,7 @@ ShmDictObject_iter(PyObject *obj)
 	it->dict = dict.local;
 	shm_pointer_acq(thread, dict.shared);
 	it->dict_shm = dict.shared;
+	it->segment = 0;
 	it->itemindex = 0;
 	it->is_transient = is_transient;
 	return (PyObject *)it;
@@ -2288,7 +4762,6 @@ ShmDict_keys_values(ShmDictObject *self, int mode)
 			return NULL;
 		});
 
-	shm_cell_check_read_lock(thread, &dict.local->lock);
 	shmassert(committed_count != -1);
 
 	PyObject *list = PyList_New(committed_count);
@@ -2298,14 +4771,26 @@ ShmDict_keys_values(ShmDictObject *self, int mode)
 		return NULL;
 	}
 	int result_count = 0;
+	// every segment is read-locked by _shm_undict_get_count
+	int segment_index = 0;
+	UnDictRef segment;
+	shm_undict_get_segment(dict, segment_index, &segment);
+	shm_cell_check_read_lock(thread, &segment.local->lock);
 	int table_itemindex = 0;
 	while (true)
 	{
 		// TODO: We should really check for preemption here
 		ShmPointer value_shm = EMPTY_SHM;
 		ShmPointer key_shm = EMPTY_SHM;
-		bool eot = shm_undict_get_bucket_at_index(thread, dict.local, table_itemindex, &key_shm, &value_shm);
+		bool eot = shm_undict_get_bucket_at_index(thread, segment.local, table_itemindex, &key_shm, &value_shm);
 		table_itemindex++;
+		if (eot && shm_undict_get_segment(dict, segment_index + 1, &segment))
+		{
+			segment_index++;
+			shm_cell_check_read_lock(thread, &segment.local->lock);
+			table_itemindex = 0;
+			continue;
+		}
 		if (eot || value_shm != EMPTY_SHM)
 		{
 			if (value_shm != EMPTY_SHM)
@@ -2314,8 +4799,7 @@ ShmDict_keys_values(ShmDictObject *self, int mode)
 				PyObject *marshalled_obj = NULL;
 				if (mode == MODE_KEYS)
 				{
-					shm_pointer_acq(thread, key_shm);
-					marshalled_obj = shm_pointer_to_object_consume(key_shm);
+					marshalled_obj = dict_key_to_object(key_shm);
 				}
 				else if (mode == MODE_VALUES)
 				{
@@ -2375,9 +4859,346 @@ ShmDict_values(ShmDictObject *self)
 	return ShmDict_keys_values(self, MODE_VALUES);
 }
 
+// Converts a sequence of keys into dictkeys. The str and bytes keys borrow the data,
+// so the sequence should outlive the dictkeys. Returns NULL with exception set.
+static ShmUnDictKey *
+sequence_to_dict_keys(PyObject *keys)
+{
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(keys);
+	if (count > INT_MAX)
+	{
+		PyErr_SetString(PyExc_OverflowError, "too many keys for a single ShmDict batch");
+		return NULL;
+	}
+	ShmUnDictKey *dictkeys = PyMem_Malloc((count > 0 ? count : 1) * sizeof(ShmUnDictKey));
+	if (dictkeys == NULL)
+	{
+		PyErr_NoMemory();
+		return NULL;
+	}
+	for (Py_ssize_t i = 0; i < count; i++)
+	{
+		PyObject *key = PySequence_Fast_GET_ITEM(keys, i);
+		if (!object_to_dict_key(key, &dictkeys[i]))
+		{
+			set_dict_key_error(key);
+			for (Py_ssize_t j = 0; j < i; j++)
+				free_dict_key(&dictkeys[j]);
+			PyMem_Free(dictkeys);
+			return NULL;
+		}
+	}
+	return dictkeys;
+}
+
+static void
+free_dict_keys(ShmUnDictKey *dictkeys, Py_ssize_t count)
+{
+	for (Py_ssize_t i = 0; i < count; i++)
+		free_dict_key(&dictkeys[i]);
+	PyMem_Free(dictkeys);
+}
+
+// Like get(), but the str and bytes values are returned as ShmValue without copying their data
+static PyObject *
+ShmDict_get_value(ShmDictObject *self, PyObject *args)
+{
+	PyObject *key = NULL;
+	PyObject *default_value = Py_None;
+	if (!PyArg_ParseTuple(args, "O|O:get_value", &key, &default_value))
+		return NULL;
+	UnDictRef dict;
+	if (!init_undict_ref(self->data, &dict))
+	{
+		PyErr_SetString(Shm_Exception, "Invalid ShmDict object");
+		return NULL;
+	}
+	ShmUnDictKey dictkey = EMPTY_SHM_UNDICT_KEY;
+	if (!object_to_dict_key(key, &dictkey))
+	{
+		set_dict_key_error(key);
+		return NULL;
+	}
+	ShmPointer value = EMPTY_SHM;
+	RETRY_LOOP(shm_undict_acq(thread, dict, &dictkey, &value),
+		{ shmassert(value == EMPTY_SHM); },
+		{
+			free_dict_key(&dictkey);
+			return NULL;
+		},
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in ShmDict_get_value");
+			free_dict_key(&dictkey);
+			return NULL;
+		});
+	free_dict_key(&dictkey);
+	if (value == EMPTY_SHM)
+	{
+		Py_INCREF(default_value);
+		return default_value;
+	}
+	return shm_pointer_to_value_consume(value);
+}
+
+static PyObject *
+ShmDict_get_many(ShmDictObject *self, PyObject *args)
+{
+	PyObject *keys_obj = NULL;
+	PyObject *default_value = Py_None;
+	if (!PyArg_ParseTuple(args, "O|O:get_many", &keys_obj, &default_value))
+		return NULL;
+	UnDictRef dict;
+	if (!init_undict_ref(self->data, &dict))
+	{
+		PyErr_SetString(Shm_Exception, "Invalid ShmDict object");
+		return NULL;
+	}
+	PyObject *keys = PySequence_Fast(keys_obj, "get_many() argument must be an iterable of keys");
+	if (keys == NULL)
+		return NULL;
+	Py_ssize_t count = PySequence_Fast_GET_SIZE(keys);
+	ShmUnDictKey *dictkeys = sequence_to_dict_keys(keys);
+	if (dictkeys == NULL)
+	{
+		Py_DECREF(keys);
+		return NULL;
+	}
+	ShmPointer *values = PyMem_Malloc((count > 0 ? count : 1) * sizeof(ShmPointer));
+	if (values == NULL)
+	{
+		free_dict_keys(dictkeys, count);
+		Py_DECREF(keys);
+		return PyErr_NoMemory();
+	}
+	for (Py_ssize_t i = 0; i < count; i++)
+		values[i] = EMPTY_SHM;
+
+	// a single lock per segment and a single commit for the whole batch
+	RETRY_LOOP(shm_undict_acq_many(thread, dict, dictkeys, values, (int)count),
+		{},
+		{
+			PyMem_Free((void *)values);
+			free_dict_keys(dictkeys, count);
+			Py_DECREF(keys);
+			return NULL;
+		},
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in ShmDict_get_many");
+			PyMem_Free((void *)values);
+			free_dict_keys(dictkeys, count);
+			Py_DECREF(keys);
+			return NULL;
+		});
+	free_dict_keys(dictkeys, count);
+	Py_DECREF(keys);
+
+	PyObject *list = PyList_New(count);
+	for (Py_ssize_t i = 0; i < count; i++)
+	{
+		PyObject *item = NULL;
+		if (list == NULL)
+			shm_pointer_release(thread, values[i]);
+		else if (values[i] == EMPTY_SHM)
+		{
+			Py_INCREF(default_value);
+			item = default_value;
+		}
+		else
+		{
+			item = shm_pointer_to_object_consume(values[i]);
+			if (item == NULL)
+				Py_CLEAR(list);
+		}
+		if (list)
+			PyList_SET_ITEM(list, i, item);
+	}
+	PyMem_Free((void *)values);
+	return list;
+}
+
+static int
+ShmDict_set_many_prepared(UnDictRef dict, ShmUnDictKey *dictkeys, ShmPointer *newvals, int count)
+{
+	RETRY_LOOP(shm_undict_set_many(thread, dict, dictkeys, newvals, count),
+		{},
+		{ return -1; },
+		{
+			PyErr_SetString(Shm_Exception, "Internal failure in ShmDict_set_many_prepared");
+			return -1;
+		});
+	return 0;
+}
+
+// Sets the items within a single transient transaction, so the batch takes every lock once
+// and becomes visible to other threads at once.
+static int
+ShmDict_set_batch(ShmDictObject *self, PyObject *keys, PyObject *values)
+{
+	UnDictRef dict;
+	if (!init_undict_ref(self->data, &dict))
+	{
+		PyErr_SetString(Shm_Exception, "Invalid ShmDict object");
+		return -1;
+	}
+	Py_ssize_t count = PyList_GET_SIZE(keys);
+	shmassert(count == PyList_GET_SIZE(values));
+	ShmUnDictKey *dictkeys = sequence_to_dict_keys(keys);
+	if (dictkeys == NULL)
+		return -1;
+	ShmPointer *newvals = PyMem_Malloc((count > 0 ? count : 1) * sizeof(ShmPointer));
+	if (newvals == NULL)
+	{
+		free_dict_keys(dictkeys, count);
+		PyErr_NoMemory();
+		return -1;
+	}
+	Py_ssize_t prepared = 0;
+	int rslt = 0;
+	for (; prepared < count; prepared++)
+	{
+		newvals[prepared] = EMPTY_SHM;
+		if (prepare_item_for_shm_container(PyList_GET_ITEM(values, prepared), &newvals[prepared]) < 0)
+		{
+			if (!PyErr_Occurred())
+				PyErr_SetString(Shm_Exception, "Invalid pso object when assigning ShmDict's item");
+			rslt = -1;
+			break;
+		}
+	}
+	if (rslt == 0)
+		rslt = ShmDict_set_many_prepared(dict, dictkeys, newvals, (int)count);
+
+	for (Py_ssize_t i = 0; i < prepared; i++)
+		shm_pointer_release(thread, newvals[i]);
+	PyMem_Free((void *)newvals);
+	free_dict_keys(dictkeys, count);
+	return rslt;
+}
+
+// Appends the (key, value) pairs of the iterable to the keys and values lists.
+static int
+collect_dict_items(PyObject *items, PyObject *keys, PyObject *values)
+{
+	PyObject *iter = PyObject_GetIter(items);
+	if (iter == NULL)
+		return -1;
+	PyObject *item;
+	while ((item = PyIter_Next(iter)) != NULL)
+	{
+		PyObject *pair = PySequence_Fast(item, "ShmDict items must be (key, value) pairs");
+		Py_DECREF(item);
+		if (pair == NULL)
+			break;
+		if (PySequence_Fast_GET_SIZE(pair) != 2)
+		{
+			PyErr_Format(PyExc_ValueError, "ShmDict item has length %zd; 2 is required",
+			             PySequence_Fast_GET_SIZE(pair));
+			Py_DECREF(pair);
+			break;
+		}
+		int status = PyList_Append(keys, PySequence_Fast_GET_ITEM(pair, 0));
+		if (status == 0)
+			status = PyList_Append(values, PySequence_Fast_GET_ITEM(pair, 1));
+		Py_DECREF(pair);
+		if (status < 0)
+			break;
+	}
+	Py_DECREF(iter);
+	return PyErr_Occurred() ? -1 : 0;
+}
+
+// Like dict_to_shm_dict, uses keys() and __getitem__ of any mapping.
+static int
+collect_mapping_items(PyObject *mapping, PyObject *keys, PyObject *values)
+{
+	if (PyDict_Check(mapping))
+	{
+		Py_ssize_t pos = 0;
+		PyObject *key, *value;
+		while (PyDict_Next(mapping, &pos, &key, &value))
+		{
+			if (PyList_Append(keys, key) < 0 || PyList_Append(values, value) < 0)
+				return -1;
+		}
+		return 0;
+	}
+	PyObject *mapping_keys = PyMapping_Keys(mapping);
+	if (mapping_keys == NULL)
+		return -1;
+	PyObject *iter = PyObject_GetIter(mapping_keys);
+	Py_DECREF(mapping_keys);
+	if (iter == NULL)
+		return -1;
+	PyObject *key;
+	while ((key = PyIter_Next(iter)) != NULL)
+	{
+		PyObject *value = PyObject_GetItem(mapping, key);
+		int status = value ? PyList_Append(keys, key) : -1;
+		if (status == 0)
+			status = PyList_Append(values, value);
+		Py_DECREF(key);
+		Py_XDECREF(value);
+		if (status < 0)
+			break;
+	}
+	Py_DECREF(iter);
+	return PyErr_Occurred() ? -1 : 0;
+}
+
+static PyObject *
+ShmDict_set_many(ShmDictObject *self, PyObject *items)
+{
+	PyObject *keys = PyList_New(0);
+	PyObject *values = PyList_New(0);
+	int rslt = -1;
+	if (keys && values && collect_dict_items(items, keys, values) == 0)
+		rslt = ShmDict_set_batch(self, keys, values);
+	Py_XDECREF(keys);
+	Py_XDECREF(values);
+	if (rslt < 0)
+		return NULL;
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+ShmDict_update(ShmDictObject *self, PyObject *args, PyObject *kwds)
+{
+	PyObject *other = NULL;
+	if (!PyArg_UnpackTuple(args, "update", 0, 1, &other))
+		return NULL;
+	PyObject *keys = PyList_New(0);
+	PyObject *values = PyList_New(0);
+	int rslt = keys && values ? 0 : -1;
+	if (rslt == 0 && other != NULL)
+	{
+		// same as dict.update(): anything with keys() is a mapping, otherwise an iterable of pairs
+		if (PyDict_Check(other) || PyObject_HasAttrString(other, "keys"))
+			rslt = collect_mapping_items(other, keys, values);
+		else
+			rslt = collect_dict_items(other, keys, values);
+	}
+	if (rslt == 0 && kwds != NULL)
+		rslt = collect_mapping_items(kwds, keys, values);
+	if (rslt == 0)
+		rslt = ShmDict_set_batch(self, keys, values);
+	Py_XDECREF(keys);
+	Py_XDECREF(values);
+	if (rslt < 0)
+		return NULL;
+	Py_RETURN_NONE;
+}
+
 static PyMethodDef ShmDict_methods[] = {
 	{"keys",            (PyCFunction)ShmDict_keys,      METH_NOARGS },
 	{"values",           (PyCFunction)ShmDict_values,     METH_NOARGS },
+	{"get_many",        (PyCFunction)ShmDict_get_many,  METH_VARARGS,
+	 "get_many(keys, default=None) -> list of values, looked up under a single lock" },
+	{"get_value",       (PyCFunction)ShmDict_get_value, METH_VARARGS,
+	 "get_value(key, default=None) -> like get(), but str and bytes are returned as ShmValue to be viewed without copying" },
+	{"set_many",        (PyCFunction)ShmDict_set_many,  METH_O,
+	 "set_many(items) -> None, sets (key, value) pairs within a single commit" },
+	{"update",          (PyCFunction)ShmDict_update,    METH_VARARGS | METH_KEYWORDS,
+	 "update([other], **kwargs) -> None, like dict.update() within a single commit" },
 	{NULL, NULL} // sentinel
 };
 
@@ -2385,7 +5206,7 @@ static PyMethodDef ShmDict_methods[] = {
 static PyTypeObject ShmDict_Type = {
 	PyVarObject_HEAD_INIT(NULL, 0)
 	.tp_name = "pso.ShmDict",
-	.tp_doc = "Shared mutable dictionary",
+	.tp_doc = "Shared mutable dictionary, keys are str, bytes, int, bool, None or tuples of them, floats are rejected",
 	.tp_basicsize = sizeof(ShmDictObject),
 		// .tp_repr = (reprfunc) ShmDict_repr,
 	.tp_dealloc = (destructor) ShmBase_dealloc,
@@ -2415,41 +5236,49 @@ ShmDictIter_next(ShmDictIterObject *it)
 	}
 
 	UnDictRef dict = { .local = it->dict, .shared = it->dict_shm };
-	if (it->is_transient)
-	{
-		RETRY_LOOP(transaction_lock_read(thread, &dict.local->lock, dict.shared, CONTAINER_UNORDERED_DICT, NULL),
-			{},
-			{
-				transient_abort(thread);
-				return NULL;
-			},
-			{
-				transient_abort(thread);
-				PyErr_SetString(Shm_Exception, "Internal failure during ShmDictIter_next");
-				return NULL;
-			});
-	}
-	shm_cell_check_read_lock(thread, &dict.local->lock);
-
-	while (true)
+	UnDictRef segment;
+	while (shm_undict_get_segment(dict, it->segment, &segment))
 	{
-		// TODO: We should really check for preemption here
-		ShmPointer value = EMPTY_SHM;
-		bool eot = shm_undict_get_bucket_at_index(thread, dict.local, it->itemindex, NULL, &value);
-		it->itemindex++;
-		if (eot)
+		// A persistent transaction keeps the read locks till its end, so only the segments past the first one
+		// (locked by ShmDictObject_iter) need locking.
+		if (it->is_transient || it->segment > 0)
 		{
-			transient_commit(thread);
-			return NULL;
+			RETRY_LOOP(transaction_lock_read(thread, &segment.local->lock, segment.shared, CONTAINER_UNORDERED_DICT, NULL),
+				{},
+				{
+					transient_abort(thread);
+					return NULL;
+				},
+				{
+					transient_abort(thread);
+					PyErr_SetString(Shm_Exception, "Internal failure during ShmDictIter_next");
+					return NULL;
+				});
 		}
-		if (value != EMPTY_SHM)
+		shm_cell_check_read_lock(thread, &segment.local->lock);
+
+		while (true)
 		{
-			PyObject *result_obj = shm_pointer_to_object_consume(value);
-			transient_commit(thread);
-			return result_obj;
+			// TODO: We should really check for preemption here
+			ShmPointer value = EMPTY_SHM;
+			bool eot = shm_undict_get_bucket_at_index(thread, segment.local, it->itemindex, NULL, &value);
+			it->itemindex++;
+			if (eot)
+			{
+				transient_commit(thread);
+				break;
+			}
+			if (value != EMPTY_SHM)
+			{
+				PyObject *result_obj = shm_pointer_to_object_consume(value);
+				transient_commit(thread);
+				return result_obj;
+			}
 		}
+		it->segment++;
+		it->itemindex = 0;
 	}
-	shmassert(false); // unreachable
+	return NULL;
 }
 
 static PyTypeObject ShmDictIter_Type = {
@@ -2473,6 +5302,7 @@ static PyTypeObject ShmDictIter_Type = {
 _Py_IDENTIFIER(__module__);
 _Py_IDENTIFIER(__qualname__);
 _Py_IDENTIFIER(__name__);
+_Py_IDENTIFIER(__pso_concurrent__);
 
 //def class_fullname(o):
 //  klass = o.__class__
@@ -2493,7 +5323,15 @@ ShmObjectObject_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 	self->data = EMPTY_SHM;
 	if (!check_thread_inited())
 		return NULL;
-	ShmUnDict *dict = new_shm_undict(thread, &self->data);
+	// "__pso_concurrent__ = True" in the class body makes its instances concurrent dicts (see pso.ShmDict)
+	PyObject *concurrent_attr = NULL;
+	if (_PyObject_LookupAttrId((PyObject *)type, &PyId___pso_concurrent__, &concurrent_attr) < 0)
+		return NULL;
+	int concurrent = concurrent_attr ? PyObject_IsTrue(concurrent_attr) : false;
+	Py_XDECREF(concurrent_attr);
+	if (concurrent < 0)
+		return NULL;
+	ShmUnDict *dict = concurrent ? new_shm_undict_concurrent(thread, &self->data) : new_shm_undict(thread, &self->data);
 	shmassert(dict->type == SHM_TYPE_UNDICT);
 	dict->type = SHM_TYPE_OBJECT;
 
@@ -2518,21 +5356,19 @@ ShmObjectObject_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 	if (qualname == NULL) // Error already set by _PyObject_GetAttrId
 		goto error;
 
-	Py_ssize_t qualname_size = -1;
-	const Py_UCS1 *qualname_utf8 = (const Py_UCS1 *)PyUnicode_AsUTF8AndSize(qualname, &qualname_size);
-	if (qualname_utf8 == NULL)
-		goto error;
-	Py_ssize_t module_size = -1;
-	const Py_UCS1 *module_utf8 = (const Py_UCS1 *)PyUnicode_AsUTF8AndSize(module, &module_size);
-	if (module_utf8 == NULL)
+	PyObject *class_path = PyUnicode_FromFormat("%U\t%U", module, qualname);
+	if (class_path == NULL || PyUnicode_READY(class_path) == -1)
+	{
+		Py_XDECREF(class_path);
 		goto error;
-
-	ShmPointer str_shm = shm_ref_unicode_new(thread, NULL, qualname_size + 1 + module_size + 1);
+	}
+	Py_ssize_t class_path_size = PyUnicode_GET_LENGTH(class_path);
+	int kind = PyUnicode_KIND(class_path);
+	// zeroed string with a place for the null-terminator
+	ShmPointer str_shm = shm_ref_unicode_new(thread, kind, NULL, (int)class_path_size + 1);
 	RefUnicode str = shm_ref_unicode_get(str_shm);
-	UCS4_from_ASCII(CAST_VL(str.data), module_utf8, module_size);
-	str.data[module_size] = '\t';
-	UCS4_from_ASCII(CAST_VL(&str.data[module_size + 1]), qualname_utf8, qualname_size);
-	str.data[qualname_size + 1 + module_size] = 0;
+	memcpy(CAST_VL(str.data), PyUnicode_DATA(class_path), (size_t)(class_path_size * kind));
+	Py_DECREF(class_path);
 	dict->class_name = str_shm;
 
 	return (PyObject *)self;
@@ -2845,6 +5681,14 @@ static PyMethodDef pso_methods[] = {
 		"set_debug_reclaimer", set_debug_reclaimer, METH_O,
 		"Enable reclaimer's statistic print for debugging purpose"
 	},
+	{
+		"set_garbage_watermarks", set_garbage_watermarks, METH_VARARGS,
+		"Set reclaimer backlog limits (soft, hard) in blocks, above which allocator throttles instead of growing the shared memory"
+	},
+	{
+		"get_pending_garbage", get_pending_garbage, METH_NOARGS,
+		"Get the number of freed blocks waiting for the reclaimer"
+	},
 	{
 		"set_debug_print", set_debug_print, METH_O,
 		"Enable pso module debug printf-s"
@@ -2894,6 +5738,7 @@ PyMODINIT_FUNC PyInit__pso(void) {
 	PyObject *m;
 	return_null_on_failure(PyType_Ready(&ShmObject_Type));
 	return_null_on_failure(PyType_Ready(&ShmValue_Type));
+	return_null_on_failure(PyType_Ready(&ShmBytesBuilder_Type));
 	return_null_on_failure(PyType_Ready(&ShmTuple_Type));
 	return_null_on_failure(PyType_Ready(&ShmTupleIter_Type));
 	return_null_on_failure(PyType_Ready(&ShmList_Type));
@@ -2901,6 +5746,9 @@ PyMODINIT_FUNC PyInit__pso(void) {
 	return_null_on_failure(PyType_Ready(&ShmDict_Type));
 	return_null_on_failure(PyType_Ready(&ShmDictIter_Type));
 	return_null_on_failure(PyType_Ready(&ShmPromise_Type));
+	return_null_on_failure(PyType_Ready(&ShmArray_Type));
+	return_null_on_failure(PyType_Ready(&ShmTable_Type));
+	return_null_on_failure(PyType_Ready(&ShmBlob_Type));
 
 	m = PyModule_Create(&pso_definition);
 	if (m == NULL)
@@ -2919,6 +5767,8 @@ PyMODINIT_FUNC PyInit__pso(void) {
 	return_null_on_failure(PyModule_AddObject(m, "ShmObject", (PyObject *)&ShmObject_Type));
 	Py_INCREF(&ShmValue_Type);
 	return_null_on_failure(PyModule_AddObject(m, "ShmValue", (PyObject *)&ShmValue_Type));
+	Py_INCREF(&ShmBytesBuilder_Type);
+	return_null_on_failure(PyModule_AddObject(m, "ShmBytesBuilder", (PyObject *)&ShmBytesBuilder_Type));
 	Py_INCREF(&ShmTuple_Type);
 	return_null_on_failure(PyModule_AddObject(m, "ShmTuple", (PyObject *)&ShmTuple_Type));
 	Py_INCREF(&ShmTupleIter_Type);
@@ -2933,6 +5783,12 @@ PyMODINIT_FUNC PyInit__pso(void) {
 	return_null_on_failure(PyModule_AddObject(m, "ShmDictIter", (PyObject *)&ShmDictIter_Type));
 	Py_INCREF(&ShmPromise_Type);
 	return_null_on_failure(PyModule_AddObject(m, "ShmPromise", (PyObject *)&ShmPromise_Type));
+	Py_INCREF(&ShmArray_Type);
+	return_null_on_failure(PyModule_AddObject(m, "ShmArray", (PyObject *)&ShmArray_Type));
+	Py_INCREF(&ShmTable_Type);
+	return_null_on_failure(PyModule_AddObject(m, "ShmTable", (PyObject *)&ShmTable_Type));
+	Py_INCREF(&ShmBlob_Type);
+	return_null_on_failure(PyModule_AddObject(m, "ShmBlob", (PyObject *)&ShmBlob_Type));
 
 	return m;
 }
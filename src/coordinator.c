@@ -185,7 +185,7 @@ process_garbage(void)
 				if (revival_count > release_count)
 				{
 					// item revived, wait for the new owner to send a new release request
-					p_atomic_int_add(&refcounted->release_count, 1);
+					shm_atomic_int_add_relaxed(&refcounted->release_count, 1);
 					continue;
 				}
 			}
@@ -240,6 +240,7 @@ process_garbage(void)
 			unallocated_count++;
 		}
 
+		shm_atomic_int_add_relaxed(&superblock->pending_garbage, -item->count);
 		prev = item;
 		prev_shm = current_shm;
 		current_shm = item->next;
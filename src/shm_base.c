@@ -99,33 +99,7 @@ superblock_get_block_noside(int index)
 	return superblock_mmap[group_index] + itemindex * SHM_FIXED_CHUNK_SIZE;
 }
 
-// ShmPointer routines
-
-shminline ShmWord
-shm_pointer_get_block(ShmPointer pntr)
-{
-	return (pntr) >> SHM_OFFSET_BITS;
-}
-
-shminline ShmWord
-shm_pointer_get_offset(ShmPointer pntr)
-{
-	return (pntr) & SHM_INVALID_OFFSET; // 20 bits
-}
-
-shminline bool
-shm_pointer_is_valid(ShmPointer pntr)
-{
-	ShmWord block = shm_pointer_get_block(pntr);
-	return block >= 0 && block <= SHM_MAX_BLOCK && pntr != NONE_SHM && shm_pointer_get_offset(pntr) != SHM_INVALID_OFFSET &&
-	       shm_pointer_get_offset(pntr) > SHM_FIXED_CHUNK_HEADER_SIZE; // only internal routines can read the header
-}
-
-shminline bool
-SBOOL(ShmPointer pntr)
-{
-	return shm_pointer_get_block(pntr) != SHM_INVALID_BLOCK && pntr != NONE_SHM;
-}
+// ShmPointer routines, fast paths are in shm_types.h
 
 void *
 shm_pointer_to_pointer_root(ShmPointer pntr)
@@ -163,8 +137,8 @@ shm_pointer_to_pointer_root(ShmPointer pntr)
 	return CAST_VL(block + offset);
 }
 
-shminline void *
-shm_pointer_to_pointer_unsafe(ShmPointer pntr)
+void *
+shm_pointer_to_pointer_slow(ShmPointer pntr)
 {
 	ShmWord idx = shm_pointer_get_block(pntr);
 	vl char *block;
@@ -188,15 +162,6 @@ shm_pointer_to_pointer_unsafe(ShmPointer pntr)
 	return CAST_VL(block + offset);
 }
 
-inline void *
-shm_pointer_to_pointer(ShmPointer pntr)
-{
-	if (P_UNLIKELY(!shm_pointer_is_valid(pntr)))
-		return NULL;
-	return shm_pointer_to_pointer_unsafe(pntr);
-}
-
-
 void *
 shm_pointer_to_pointer_no_side(ShmPointer pntr)
 {
@@ -223,18 +188,6 @@ shm_pointer_to_pointer_no_side(ShmPointer pntr)
 	return CAST_VL(block + SHM_FIXED_CHUNK_SIZE * (idx % SHM_BLOCK_GROUP_SIZE) + offset);
 }
 
-ShmPointer
-pack_shm_pointer(ShmWord offset, ShmWord block)
-{
-	shmassert(offset >= 0);
-	shmassert(offset <= (ShmWord)SHM_INVALID_OFFSET);
-	shmassert(block >= 0);
-	shmassert(block <= SHM_MAX_BLOCK || block == SHM_INVALID_BLOCK);
-	uintptr_t _offset = (uintptr_t)offset & SHM_INVALID_OFFSET;
-	uintptr_t _block = (uintptr_t)block & SHM_INVALID_BLOCK;
-	return (_block << SHM_OFFSET_BITS) | _offset;
-}
-
 ShmPointer
 pointer_to_shm_pointer(void *pntr, ShmWord block)
 {
@@ -264,12 +217,49 @@ shm_pointer_shift(ShmPointer pointer, ShmWord offset)
 	self->private_data->last_operation = __LINE__; \
 } while (0);
 
+// Transaction tickets are built from a system-wide monotonic clock and the thread index instead of a shared counter,
+// so starting a transaction does not write to a cache line contended by every other thread.
+// Clock ticks are ~65 us, the lower SHM_TICKET_INDEX_BITS hold the thread index which keeps tickets of different threads distinct.
+// 26 bits of clock wrap every ~73 minutes, shm_thread_start_compare stays correct for tickets less than half of that apart.
+#define SHM_TICKET_INDEX_BITS 6
+#define SHM_TICKET_CLOCK_BITS (32 - SHM_TICKET_INDEX_BITS)
+#define SHM_TICKET_CLOCK_SHIFT 16
+
+ShmInt
+shm_ticket_clock(void)
+{
+	uint64_t ns;
+#if defined(P_OS_WIN) || defined(P_OS_WIN64)
+	static LARGE_INTEGER frequency = { 0 };
+	LARGE_INTEGER counter;
+	if (frequency.QuadPart == 0)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	ns = (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000 +
+		(uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ns = (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#endif
+	// same units as the clock part of a ticket
+	return (ShmInt)((uint32_t)(ns >> SHM_TICKET_CLOCK_SHIFT) & ((1u << SHM_TICKET_CLOCK_BITS) - 1));
+}
+
+// Clock ticks from earlier to later, correct across the wrap of the clock.
+ShmInt
+shm_ticket_clock_diff(ShmInt later, ShmInt earlier)
+{
+	return (ShmInt)(((uint32_t)later - (uint32_t)earlier) & ((1u << SHM_TICKET_CLOCK_BITS) - 1));
+}
+
+#define last_start_ticks(thread) ((ShmInt)((uint32_t)(thread)->last_start >> SHM_TICKET_INDEX_BITS))
+
+// Debug tickets_* counters sum the age of the transaction in clock ticks at the moment it waited, repeated or aborted.
 void
 update_tickets(ThreadContext *thread, vl ShmInt *cell)
 {
-	ShmInt ticket = superblock->ticket;
-	*cell += ticket - thread->private_data->last_known_ticket;
-	thread->private_data->last_known_ticket = ticket;
+	*cell += shm_ticket_clock_diff(shm_ticket_clock(), last_start_ticks(thread));
 }
 
 #define thread_debug_register_result(times_var, tickets_var) do {\
@@ -290,7 +280,7 @@ update_tickets(ThreadContext *thread, vl ShmInt *cell)
 void
 register_write_contention(ShmLock *lock)
 {
-	p_atomic_int_add(&lock->write_contention_count, 1);
+	shm_atomic_int_add_relaxed(&lock->write_contention_count, 1);
 	// if (lock->write_contention_count > 50)
 	// 	DebugPauseAll();
 	if (lock->break_on_contention)
@@ -300,7 +290,7 @@ register_write_contention(ShmLock *lock)
 void
 register_read_contention(ShmLock *lock, ShmPointer thread_shm)
 {
-	p_atomic_int_add(&lock->read_contention_count, 1);
+	shm_atomic_int_add_relaxed(&lock->read_contention_count, 1);
 	// if (lock->read_contention_count > 500)
 	// {
 	// }
@@ -384,7 +374,7 @@ shm_thread_start_compare(ShmInt thread1, ShmInt thread2)
 {
 	if (thread1 == 0 || thread2 == 0 || thread1 == thread2)
 		return 0;
-	else if (thread1 - thread2 > 0)
+	else if ((ShmInt)((uint32_t)thread1 - (uint32_t)thread2) > 0) // tickets wrap around
 		return COMPARED_LOW_HIGH;
 	else
 		return COMPARED_HIGH_LOW;
@@ -511,7 +501,6 @@ take_read_lock(ThreadContext *self, ShmLock *lock, ShmPointer shm_lock, bool *lo
 	int check_result = take_read_lock__checks(self, lock, next_writer, writer_lock, &oldest_writer, &the_lock_is_mine);
 	if (check_result != RESULT_INVALID)
 	{
-		self->private_data->last_known_ticket = p_atomic_int_get(&superblock->ticket);
 		return check_result;
 	}
 	// not preempted and there are no higher priority writers.
@@ -601,7 +590,6 @@ take_read_lock(ThreadContext *self, ShmLock *lock, ShmPointer shm_lock, bool *lo
 	}
 
 	self->private_data->last_read_rslt = RESULT_OK;
-	self->private_data->last_known_ticket = p_atomic_int_get(&superblock->ticket);
 	return RESULT_OK;
 }
 
@@ -622,9 +610,9 @@ shm_cell_check_write_lock(ThreadContext *thread, ShmLock *lock)
 {
 	// shmassert(atomic_bitmap_check_exclusive(&lock->reader_lock, thread->index));
 	shmassert(shm_cell_have_write_lock(thread, lock));
-	shmassert(p_atomic_int_get(&lock->writers_count) == 1);
+	shmassert(shm_atomic_int_get_relaxed(&lock->writers_count) == 1);
 
-	ShmInt readers_count = p_atomic_int_get(&lock->readers_count);
+	ShmInt readers_count = shm_atomic_int_get_relaxed(&lock->readers_count);
 	ShmInt reference;
 	if (shm_cell_have_read_lock(thread, lock))
 		reference = 1;
@@ -639,12 +627,12 @@ shm_cell_check_read_lock(ThreadContext *thread, ShmLock *lock)
 {
 	// shmassert(atomic_bitmap_check_exclusive(&lock->reader_lock, thread->index));
 	shmassert(shm_cell_have_read_lock(thread, lock));
-	shmassert(p_atomic_int_get(&lock->readers_count) > 0);
+	shmassert(shm_atomic_int_get_relaxed(&lock->readers_count) > 0);
 	// On very rare occasions can the lock->readers_count be higher for a very short period of time with "thread->preempted" assigned
 	if (shm_cell_have_write_lock(thread, lock))
-		shmassert(p_atomic_int_get(&lock->writers_count) == 1);
+		shmassert(shm_atomic_int_get_relaxed(&lock->writers_count) == 1);
 	else
-		shmassert(p_atomic_int_get(&lock->writers_count) == 0);
+		shmassert(shm_atomic_int_get_relaxed(&lock->writers_count) == 0);
 }
 
 void
@@ -660,7 +648,7 @@ void
 _thread_set_pending_lock(ThreadContext *thread, ShmPointer shm_lock)
 {
 	p_atomic_shm_pointer_set(&thread->pending_lock, shm_lock);
-	p_atomic_int_add(&thread->private_data->pending_lock_count, 1);
+	thread->private_data->pending_lock_count++;
 }
 
 void
@@ -698,7 +686,7 @@ _thread_unqueue_from_lock(ThreadContext *thread, ShmLock *lock)
 	bool rslt = PCAS2(&lock->next_writer, LOCK_UNLOCKED, thread->self);
 
 	p_atomic_shm_pointer_set(&thread->pending_lock, EMPTY_SHM);
-	p_atomic_int_dec_and_test(&thread->private_data->pending_lock_count);
+	thread->private_data->pending_lock_count--;
 	atomic_bitmap_reset(&lock->queue_threads, thread->index);
 	return rslt;
 }
@@ -864,7 +852,7 @@ take_write_lock__checks(ThreadContext *self, ShmLock *lock, ShmPointer container
 	{
 		if (shm_cell_have_write_lock(self, lock))
 		{
-			shmassert(p_atomic_int_get(&lock->writers_count) <= 1);
+			shmassert(shm_atomic_int_get_relaxed(&lock->writers_count) <= 1);
 			thread_debug_register_line();
 			self->private_data->last_operation_rslt = RESULT_OK;
 			return RESULT_OK; // already have the valid lock
@@ -994,7 +982,6 @@ take_write_lock(ThreadContext *self, ShmLock *lock, ShmPointer container_shm, bo
 	int check_rslt = take_write_lock__checks(self, lock, container_shm, false);
 	if (check_rslt != RESULT_INVALID)
 	{
-		self->private_data->last_known_ticket = p_atomic_int_get(&superblock->ticket);
 		return check_rslt;
 	}
 	// Thread is not preempted, doesn't have the lock yet, there are no higher priority readers...
@@ -1113,7 +1100,7 @@ take_write_lock(ThreadContext *self, ShmLock *lock, ShmPointer container_shm, bo
 		return RESULT_REPEAT;
 	}
 	self->private_data->write_locks_taken++;
-	p_atomic_int_add(&superblock->debug_lock_count, 1);
+	shm_atomic_int_add_relaxed(&superblock->debug_lock_count, 1);
 	*locked = true;
 	// lock_taken(self, lock, container_shm);
 	self->private_data->last_writer_lock = lock->writer_lock;
@@ -1161,7 +1148,6 @@ take_write_lock(ThreadContext *self, ShmLock *lock, ShmPointer container_shm, bo
 		self->private_data->last_operation = __LINE__;
 		self->private_data->last_operation_rslt = after_check_rslt;
 	}
-	self->private_data->last_known_ticket = p_atomic_int_get(&superblock->ticket);
 	return after_check_rslt;
 	///////////////////////////////////////////////////////////////////////////////////////////////
 	// Legacy
@@ -1196,7 +1182,7 @@ take_write_lock(ThreadContext *self, ShmLock *lock, ShmPointer container_shm, bo
 	// taking the lock because readers will keep coming again.
 	if (shm_cell_have_write_lock(self, lock) || false)
 	{
-		shmassert(p_atomic_int_get(&lock->writers_count) <= 1);
+		shmassert(shm_atomic_int_get_relaxed(&lock->writers_count) <= 1);
 
 		// preempt readers or abort
 		thread_reset_signal(self);
@@ -1284,9 +1270,9 @@ take_write_lock(ThreadContext *self, ShmLock *lock, ShmPointer container_shm, bo
 				return RESULT_PREEMPTED;
 			}
 
-			p_atomic_int_add(&superblock->debug_lock_count, 1);
+			shm_atomic_int_add_relaxed(&superblock->debug_lock_count, 1);
 
-			p_atomic_int_add(&lock->writers_count, 1);
+			shm_atomic_int_add_relaxed(&lock->writers_count, 1);
 			lock_taken(self, lock, container_shm);
 			self->private_data->last_writer_lock_pntr = lock;
 			self->private_data->last_writer_lock = lock->writer_lock;
@@ -1423,7 +1409,7 @@ _shm_cell_unlock(ThreadContext *thread, ShmLock *lock, ShmInt type)
 			shmassert(thread->pending_lock == EMPTY_SHM);
 			//_thread_unqueue_from_lock(thread, lock);
 
-			p_atomic_int_dec_and_test(&superblock->debug_lock_count);
+			shm_atomic_int_add_relaxed(&superblock->debug_lock_count, -1);
 			// p_atomic_int_dec_and_test(&lock->writers_count);
 			thread->private_data->write_locks_taken--;
 
@@ -1664,14 +1650,9 @@ thread_unregister_last_lock(ThreadContext *thread, ShmTransactionElement *elemen
 	_unallocate_mem(to_release, 0);
 }
 
-// here lock_shm is a pointer to the parent structure, aligned to the correct memory manager border
-int
-transaction_lock_read(ThreadContext *thread, ShmLock *lock, ShmPointer container_shm, int container_type, bool *lock_taken)
+static int
+transaction_lock_read_engaged(ThreadContext *thread, ShmLock *lock, ShmPointer container_shm, int container_type, bool *lock_taken)
 {
-	shmassert(thread != NULL);
-	shmassert_msg(thread->transaction_mode != TRANSACTION_NONE, "thread->transaction_mode != TRANSACTION_NONE");
-	engage_transient(thread);
-
 	if (thread->async_mode)
 	{
 		switch (thread->transaction_lock_mode)
@@ -1831,7 +1812,7 @@ transaction_lock_read(ThreadContext *thread, ShmLock *lock, ShmPointer container
 						if (lock_taken)
 							*lock_taken = true;
 						// count the lock only after we've ensured exclusive access at least once.
-						p_atomic_int_add(&lock->readers_count, 1);
+						shm_atomic_int_add_relaxed(&lock->readers_count, 1);
 						shm_cell_check_read_lock(thread, lock);
 					}
 					else
@@ -1853,13 +1834,9 @@ transaction_lock_read(ThreadContext *thread, ShmLock *lock, ShmPointer container
 
 int last_take_write_lock_result = 0;
 
-int
-transaction_lock_write(ThreadContext *thread, ShmLock *lock, ShmPointer lock_shm, int container_type, bool *lock_taken)
+static int
+transaction_lock_write_engaged(ThreadContext *thread, ShmLock *lock, ShmPointer lock_shm, int container_type, bool *lock_taken)
 {
-	shmassert(thread != NULL);
-	shmassert_msg(thread->transaction_mode != TRANSACTION_NONE, "thread->transaction_mode != TRANSACTION_NONE");
-	engage_transient(thread);
-
 	// LOCKING_TRANSIENT usually does not hold more than one lock at a time
 	if (thread->async_mode)
 	{
@@ -2039,7 +2016,7 @@ transaction_lock_write(ThreadContext *thread, ShmLock *lock, ShmPointer lock_shm
 					if (final_result == RESULT_OK)
 					{
 						if (lock_taken) *lock_taken = true;
-						p_atomic_int_add(&lock->writers_count, 1);
+						shm_atomic_int_add_relaxed(&lock->writers_count, 1);
 						shm_cell_check_write_lock(thread, lock);
 					}
 					else
@@ -2058,6 +2035,44 @@ transaction_lock_write(ThreadContext *thread, ShmLock *lock, ShmPointer lock_shm
 	return RESULT_OK;
 }
 
+// here lock_shm is a pointer to the parent structure, aligned to the correct memory manager border
+int
+transaction_lock_read(ThreadContext *thread, ShmLock *lock, ShmPointer container_shm, int container_type, bool *lock_taken)
+{
+	shmassert(thread != NULL);
+	shmassert_msg(thread->transaction_mode != TRANSACTION_NONE, "thread->transaction_mode != TRANSACTION_NONE");
+	engage_transient(thread);
+	return transaction_lock_read_engaged(thread, lock, container_shm, container_type, lock_taken);
+}
+
+int
+transaction_lock_write(ThreadContext *thread, ShmLock *lock, ShmPointer lock_shm, int container_type, bool *lock_taken)
+{
+	shmassert(thread != NULL);
+	shmassert_msg(thread->transaction_mode != TRANSACTION_NONE, "thread->transaction_mode != TRANSACTION_NONE");
+	engage_transient(thread);
+	return transaction_lock_write_engaged(thread, lock, lock_shm, container_type, lock_taken);
+}
+
+// A transient transaction normally takes a single lock. Operations spanning several containers
+// (e.g. segments of a concurrent ShmUnDict) take the first lock with transaction_lock_read/write
+// and the following ones with these, so transient_commit/transient_abort releases all of them at once.
+int
+transaction_lock_read_continued(ThreadContext *thread, ShmLock *lock, ShmPointer container_shm, int container_type, bool *lock_taken)
+{
+	shmassert(thread != NULL);
+	shmassert_msg(thread->transaction_mode >= TRANSACTION_TRANSIENT, "thread->transaction_mode >= TRANSACTION_TRANSIENT");
+	return transaction_lock_read_engaged(thread, lock, container_shm, container_type, lock_taken);
+}
+
+int
+transaction_lock_write_continued(ThreadContext *thread, ShmLock *lock, ShmPointer lock_shm, int container_type, bool *lock_taken)
+{
+	shmassert(thread != NULL);
+	shmassert_msg(thread->transaction_mode >= TRANSACTION_TRANSIENT, "thread->transaction_mode >= TRANSACTION_TRANSIENT");
+	return transaction_lock_write_engaged(thread, lock, lock_shm, container_type, lock_taken);
+}
+
 // status is a status of the last locking operation
 int
 transaction_unlock_local(ThreadContext *thread, ShmLock *lock, ShmPointer lock_shm, int status, bool lock_taken)
@@ -2147,13 +2162,15 @@ transaction_length(ThreadContext *thread)
 void
 thread_refresh_ticket(ThreadContext *thread)
 {
-	int ticket = p_atomic_int_add(&superblock->ticket, 1);
-	if (ticket != 0) // zero is reserved
-		thread->last_start = ticket;
-	else
-		thread->last_start = p_atomic_int_add(&superblock->ticket, 1);
+	shmassert(thread->index >= 0 && thread->index < (1 << SHM_TICKET_INDEX_BITS));
+	ShmInt ticket = (ShmInt)(((uint32_t)shm_ticket_clock() << SHM_TICKET_INDEX_BITS) | (uint32_t)thread->index);
+	if (ticket == 0) // zero is reserved
+		ticket = 1 << SHM_TICKET_INDEX_BITS;
+	shm_atomic_int_set_release(&thread->last_start, ticket); // published to other threads by the lock RMW that follows
 
-	superblock->ticket_history[thread->last_start % 64] = thread->self;
+#if DEBUG_TICKET_HISTORY
+	superblock->ticket_history[(ticket >> SHM_TICKET_INDEX_BITS) % 64] = thread->self;
+#endif
 }
 
 bool debug_stop_on_contention = false;
@@ -2195,17 +2212,17 @@ transaction_unlock_all(ThreadContext *thread)
 			ShmContainer *container = LOCAL(element->container);
 			if (element->element_type == TRANSACTION_ELEMENT_READ)
 			{
-				p_atomic_int_dec_and_test(&container->lock.readers_count);
-				shmassert(p_atomic_int_get(&container->lock.readers_count) >= 0);
+				shm_atomic_int_add_relaxed(&container->lock.readers_count, -1);
+				shmassert(shm_atomic_int_get_relaxed(&container->lock.readers_count) >= 0);
 				int ref = shm_cell_have_write_lock(thread, &container->lock) ? 1 : 0;
-				shmassert(p_atomic_int_get(&container->lock.writers_count) == ref);
+				shmassert(shm_atomic_int_get_relaxed(&container->lock.writers_count) == ref);
 			}
 			else
 			{
-				p_atomic_int_dec_and_test(&container->lock.writers_count);
-				shmassert(p_atomic_int_get(&container->lock.writers_count) == 0);
+				shm_atomic_int_add_relaxed(&container->lock.writers_count, -1);
+				shmassert(shm_atomic_int_get_relaxed(&container->lock.writers_count) == 0);
 				int ref = shm_cell_have_read_lock(thread, &container->lock) ? 1 : 0;
-				shmassert(p_atomic_int_get(&container->lock.readers_count) == ref);
+				shmassert(shm_atomic_int_get_relaxed(&container->lock.readers_count) == ref);
 			}
 		}
 		shm_types_transaction_unlock(thread, element);
@@ -2694,7 +2711,6 @@ init_superblock(const char *id)
 		shm_simple_lock_init(&superblock->lock);
 
 		superblock->block_count = 0;
-		superblock->ticket = 0;
 		superblock->mm_last_used_root_sector = (ShmInt)-1;
 		superblock->last_available_event_id = 0;
 		// memclear(superblock->block_groups);
@@ -2712,6 +2728,9 @@ init_superblock(const char *id)
 		superblock->superheap.self = pack_shm_pointer((intptr_t)&superblock->superheap - (intptr_t)superblock, SHM_INVALID_BLOCK);
 
 		superblock->has_garbage = 0;
+		superblock->pending_garbage = 0;
+		superblock->garbage_soft_limit = DEFAULT_GARBAGE_SOFT_LIMIT;
+		superblock->garbage_hard_limit = DEFAULT_GARBAGE_HARD_LIMIT;
 		// event initialization uses superblock variable, so we do it last.
 		shm_event_init(&superblock->has_garbage_event);
 
@@ -2740,7 +2759,7 @@ release_superblock(bool is_coordinator)
 ShmRefcountedBlock *
 shm_pointer_to_refcounted(ThreadContext *thread, ShmPointer pointer, bool strict_refcounted, bool strict_check_type)
 {
-	if (SBOOL(pointer) == false)
+	if (SBOOL(pointer) == false || shm_pointer_is_immediate(pointer))
 		return NULL;
 	ShmRefcountedBlock *ref_block = (ShmRefcountedBlock *)LOCAL(pointer);
 	shmassert(ref_block);
@@ -2779,20 +2798,27 @@ shm_pointer_to_refcounted(ThreadContext *thread, ShmPointer pointer, bool strict
 	return ref_block;
 }
 
+void
+shm_pointer_acq_revived(ThreadContext *thread, ShmRefcountedBlock *block)
+{
+	// Item revived, register this fact so the coordinator will wait for our release.
+	// Of course that implies we are in transaction right now, otherwise we are not allowed to see this pointer at all.
+	if (thread)
+		shmassert_msg(thread->transaction_mode >= TRANSACTION_TRANSIENT,
+		             "Mister, don't use unacquired references outside transaction");
+	shm_atomic_int_add_relaxed(&block->revival_count, 1);
+}
+
 vl void *
-shm_pointer_acq(ThreadContext *thread, ShmPointer pointer)
+shm_pointer_acq_slow(ThreadContext *thread, ShmPointer pointer)
 {
 	// shm_pointer_to_refcounted will complain if the item revived outside transaction
 	ShmRefcountedBlock *block = shm_pointer_to_refcounted(thread, pointer, true, false);
 
 	shmassert(block);
-	ShmInt oldval = p_atomic_int_add(&block->refcount, 1);
+	ShmInt oldval = shm_atomic_int_add_relaxed(&block->refcount, 1);
 	if (0 == oldval)
-	{
-		// Item revived, register this fact so the coordinator will wait for our release.
-		// Of course that implies we are in transaction right now, otherwise we are not allowed to see this pointer at all.
-		p_atomic_int_add(&block->revival_count, 1);
-	}
+		shm_pointer_acq_revived(thread, block);
 	return block;
 }
 
@@ -2818,6 +2844,8 @@ int
 shm_pointer_refcount(ThreadContext *thread, ShmPointer pointer)
 {
 	ShmRefcountedBlock *block = shm_pointer_to_refcounted(thread, pointer, true, false);
+	if (block == NULL)
+		return 0;
 
 	return p_atomic_int_get(&block->refcount);
 }
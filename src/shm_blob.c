@@ -0,0 +1,303 @@
+/*
+ * The MIT License
+ *
+ * Copyright (C) 2021 Pavel Kostyuchenko <byko3y@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//  Blob: a byte string larger than a single heap block, split into segments of the largest block size.
+//  Every version of the blob is an immutable index of the segments, a write copies the index and the segments
+//  it touches, the untouched segments are shared between the versions. Readers acquire the index of the version
+//  and copy the bytes they need, so a partial read never materializes the whole blob.
+
+#include "shm_types.h"
+
+ShmBlob *
+new_shm_blob(ThreadContext *thread, PShmPointer result)
+{
+	ShmBlob *blob = get_mem(thread, result, sizeof(ShmBlob), SHM_BLOB_DEBUG_ID);
+	init_container((ShmContainer *)blob, sizeof(ShmBlob), SHM_TYPE_BLOB);
+	// the largest heap block rounded to pages
+	blob->segment_size = shm_array_max_count(1) & ~4095;
+	blob->index = EMPTY_SHM;
+	blob->new_index = EMPTY_SHM;
+	return blob;
+}
+
+static ShmInt
+shm_blob_max_segments(void)
+{
+	shmassert(max_heap_block_size != 0);
+	return ((ShmInt)max_heap_block_size - (ShmInt)SHM_BLOB_INDEX_HEADER_SIZE) / isizeof(ShmPointer);
+}
+
+ShmInt
+shm_blob_max_size(ShmBlob *blob)
+{
+	ShmInt max_segments = shm_blob_max_segments();
+	if (max_segments > P_MAXINT / blob->segment_size)
+		return P_MAXINT;
+	return max_segments * blob->segment_size;
+}
+
+static ShmPointer
+shm_blob_get_index(ShmBlob *blob, bool owned)
+{
+	if (owned && SBOOL(blob->new_index))
+		return blob->new_index;
+	return p_atomic_shm_pointer_get(&blob->index);
+}
+
+// Returns the acquired index of the visible version, EMPTY_SHM for the empty blob.
+// Its length and bytes stay unchanged until released, see shm_blob_index_read.
+int
+shm_blob_acq_index(ThreadContext *thread, BlobRef blob, ShmPointer *result)
+{
+	*result = EMPTY_SHM;
+	if_failure(
+		transaction_lock_read(thread, &blob.local->lock, blob.shared, CONTAINER_BLOB, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_read_write_lock(thread, &blob.local->lock);
+	bool owned = shm_cell_have_write_lock(thread, &blob.local->lock);
+	ShmPointer index = shm_blob_get_index(blob.local, owned);
+	if (SBOOL(index))
+		shm_pointer_acq(thread, index); // must acquire inside transient transaction
+	*result = index;
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+// Copies count bytes starting at position of the acquired index, needs no lock. The range is checked by the caller.
+void
+shm_blob_index_read(ShmBlob *blob, ShmBlobIndex *index, ShmInt position, ShmInt count, void *dest)
+{
+	shmassert(position >= 0 && count >= 0 && count <= shm_blob_index_size(index) - position);
+	char *to = dest;
+	while (count > 0)
+	{
+		ShmInt segment = position / blob->segment_size;
+		ShmInt offset = position % blob->segment_size;
+		ShmInt n = blob->segment_size - offset;
+		if (n > count)
+			n = count;
+		ShmArrayData *data = LOCAL(index->segments[segment]);
+		if (data)
+			memcpy(to, CAST_VL((vl char *)shm_array_data_items(data) + offset), (size_t)n);
+		else
+			memset(to, 0, (size_t)n);
+		to += n;
+		position += n;
+		count -= n;
+	}
+}
+
+// Makes sure the lock owner has new_index with room for the size bytes. The first call of a transaction copies
+// the committed index, the grown index takes over the references of the old one.
+static ShmBlobIndex *
+shm_blob_reserve(ThreadContext *thread, ShmBlob *blob, ShmInt size)
+{
+	ShmInt segment_count = (ShmInt)(((int64_t)size + blob->segment_size - 1) / blob->segment_size);
+	ShmBlobIndex *index = LOCAL(blob->new_index);
+	bool is_new = index == NULL;
+	if (is_new)
+		index = LOCAL(blob->index);
+	ShmInt capacity = index ? index->capacity : 0;
+	if (is_new || segment_count > capacity)
+	{
+		ShmInt new_capacity = capacity ? capacity : 4;
+		while (new_capacity < segment_count)
+			new_capacity *= 2;
+		if (new_capacity > shm_blob_max_segments())
+			new_capacity = shm_blob_max_segments();
+		shmassert(new_capacity >= segment_count);
+		ShmPointer new_index_shm = EMPTY_SHM;
+		ShmInt block_size = (ShmInt)SHM_BLOB_INDEX_HEADER_SIZE + new_capacity * isizeof(ShmPointer);
+		ShmBlobIndex *new_index = new_shm_refcounted_block(thread, &new_index_shm, block_size, SHM_TYPE_BLOB_INDEX,
+		                                                   SHM_BLOB_INDEX_DEBUG_ID);
+		new_index->length = shm_blob_index_size(index);
+		new_index->capacity = new_capacity;
+		for (ShmInt i = 0; i < new_capacity; ++i)
+		{
+			ShmPointer segment = i < capacity ? index->segments[i] : EMPTY_SHM;
+			if (SBOOL(segment))
+				shm_pointer_acq(thread, segment);
+			new_index->segments[i] = segment;
+		}
+		if (is_new)
+			blob->new_index = new_index_shm;
+		else
+			shm_pointer_move(thread, &blob->new_index, &new_index_shm);
+		index = new_index;
+	}
+	return index;
+}
+
+// Returns the bytes of the segment owned by new_index, copying the segment shared with the committed index.
+static vl char *
+shm_blob_own_segment(ThreadContext *thread, ShmBlob *blob, ShmBlobIndex *new_index, ShmInt segment)
+{
+	shmassert(segment < new_index->capacity);
+	ShmPointer current = new_index->segments[segment];
+	ShmBlobIndex *committed = LOCAL(blob->index);
+	bool shared = SBOOL(current) && committed && segment < committed->capacity && committed->segments[segment] == current;
+	if (SBOOL(current) && !shared)
+		return shm_array_data_items(LOCAL(current));
+	ShmPointer own = EMPTY_SHM;
+	ShmArrayData *data = new_shm_array_data(thread, &own, 1, blob->segment_size, SHM_BLOB_SEGMENT_DEBUG_ID); // zero-filled
+	if (shared)
+	{
+		memcpy(CAST_VL(shm_array_data_items(data)), CAST_VL(shm_array_data_items(LOCAL(current))), (size_t)blob->segment_size);
+		shm_pointer_release(thread, current);
+	}
+	new_index->segments[segment] = own;
+	return shm_array_data_items(data);
+}
+
+// Stores count bytes from src at position, the gap past the end of the blob is filled with zeros.
+// Returns RESULT_INVALID when the blob cannot grow that large.
+int
+shm_blob_write(ThreadContext *thread, BlobRef blob, ShmInt position, ShmInt count, const void *src)
+{
+	shmassert(position >= 0 && count >= 0);
+	if_failure(
+		transaction_lock_write(thread, &blob.local->lock, blob.shared, CONTAINER_BLOB, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_write_lock(thread, &blob.local->lock);
+	ShmBlob *local = blob.local;
+	if (count > shm_blob_max_size(local) - position)
+	{
+		transient_commit(thread);
+		return RESULT_INVALID;
+	}
+	if (count == 0)
+	{
+		transient_commit(thread);
+		return RESULT_OK;
+	}
+	ShmBlobIndex *index = shm_blob_reserve(thread, local, position + count);
+	const char *from = src;
+	ShmInt end = position + count;
+	while (position < end)
+	{
+		ShmInt segment = position / local->segment_size;
+		ShmInt offset = position % local->segment_size;
+		ShmInt n = local->segment_size - offset;
+		if (n > end - position)
+			n = end - position;
+		vl char *items = shm_blob_own_segment(thread, local, index, segment);
+		memcpy(CAST_VL(items + offset), from, (size_t)n);
+		from += n;
+		position += n;
+	}
+	if (end > index->length)
+		index->length = end;
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+// Cuts the blob to size or extends it with zeros, RESULT_INVALID when the blob cannot grow that large.
+int
+shm_blob_truncate(ThreadContext *thread, BlobRef blob, ShmInt size)
+{
+	shmassert(size >= 0);
+	if_failure(
+		transaction_lock_write(thread, &blob.local->lock, blob.shared, CONTAINER_BLOB, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_write_lock(thread, &blob.local->lock);
+	ShmBlob *local = blob.local;
+	if (size > shm_blob_max_size(local))
+	{
+		transient_commit(thread);
+		return RESULT_INVALID;
+	}
+	ShmBlobIndex *index = shm_blob_reserve(thread, local, size);
+	if (size < index->length)
+	{
+		ShmInt segment_count = (ShmInt)(((int64_t)index->length + local->segment_size - 1) / local->segment_size);
+		ShmInt kept = size / local->segment_size;
+		ShmInt offset = size % local->segment_size;
+		if (offset != 0)
+		{
+			// keep the bytes past the end zero
+			if (SBOOL(index->segments[kept]))
+			{
+				vl char *items = shm_blob_own_segment(thread, local, index, kept);
+				memset(CAST_VL(items + offset), 0, (size_t)(local->segment_size - offset));
+			}
+			kept++;
+		}
+		for (ShmInt i = kept; i < segment_count; ++i)
+			if (SBOOL(index->segments[i]))
+				shm_pointer_empty(thread, &index->segments[i]);
+	}
+	index->length = size;
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+int
+shm_blob_commit(ThreadContext *thread, ShmBlob *blob)
+{
+	shm_cell_check_write_lock(thread, &blob->lock);
+	if (SBOOL(blob->new_index))
+		shm_pointer_move_atomic(thread, &blob->index, &blob->new_index);
+	return RESULT_OK;
+}
+
+int
+shm_blob_rollback(ThreadContext *thread, ShmBlob *blob)
+{
+	shm_cell_check_write_lock(thread, &blob->lock);
+	if (SBOOL(blob->new_index))
+		shm_pointer_empty(thread, &blob->new_index);
+	return RESULT_OK;
+}
+
+int
+shm_blob_unlock(ThreadContext *thread, ShmBlob *blob, ShmInt type)
+{
+	if (TRANSACTION_ELEMENT_WRITE == type)
+		shm_atomic_shm_pointer_set_release(&blob->lock.transaction_data, EMPTY_SHM);
+	_shm_cell_unlock(thread, &blob->lock, type);
+	return RESULT_OK;
+}
+
+void
+shm_blob_index_destroy(ThreadContext *thread, ShmBlobIndex *index)
+{
+	for (ShmInt i = 0; i < index->capacity; ++i)
+	{
+		if (SBOOL(index->segments[i]))
+			shm_pointer_empty(thread, &index->segments[i]);
+	}
+}
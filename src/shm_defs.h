@@ -57,6 +57,15 @@
 // naive ShmPointer routines inlining is not very efficient
 // (approx x1.3 accounts.py run time with shmassertions enabled)
 #define shminline inline
+// So the ShmPointer fast paths in shm_types.h are forced inline into every translation unit,
+// while their rarely taken branches are kept in SHM_COLD functions out of line to keep the inlined body small.
+#if defined(_MSC_VER)
+	#define SHM_ALWAYS_INLINE static __forceinline
+	#define SHM_COLD __declspec(noinline)
+#else
+	#define SHM_ALWAYS_INLINE static inline __attribute__((always_inline))
+	#define SHM_COLD __attribute__((noinline, cold))
+#endif
 
 typedef pint ShmInt; // Small aligned integer value for atomic access
 					 // typedef vl __ShmPointer ShmPointer;
@@ -126,6 +135,15 @@ extern ShmWord medium_size_map[MEDIUM_SIZE_CLASS_COUNT + 1];
 
 #define MAX_THREAD_COUNT 64
 
+// Fields written by different processes are kept on separate cache lines to avoid false sharing.
+// Only meaningful for memory with known alignment (superblock is page-aligned), heap blocks are 8-aligned.
+#define SHM_CACHE_LINE_SIZE 64
+#if defined(_MSC_VER)
+	#define SHM_CACHE_ALIGNED __declspec(align(SHM_CACHE_LINE_SIZE))
+#else
+	#define SHM_CACHE_ALIGNED __attribute__((aligned(SHM_CACHE_LINE_SIZE)))
+#endif
+
 
 // 1 for 2-aligned, 2 for 4-aligned, 3 for 8-aligned, 4 for 16-aligned, 5 for 32-aligned, 6 for 64-aligned
 static inline ShmWord
@@ -104,12 +104,12 @@ shm_lock_tryacquire(ShmSimpleLock *lock)
 	if (rslt)
 	{
 		shmassert(lock->lock_state != 0);
-		p_atomic_int_set(&lock->owner, ShmGetCurrentThreadId());
-		bool correct = p_atomic_int_add(&lock->threads_inside, 1) == 0;
+		shm_atomic_int_set_relaxed(&lock->owner, ShmGetCurrentThreadId());
+		bool correct = shm_atomic_int_add_relaxed(&lock->threads_inside, 1) == 0;
 		shmassert(correct);
 	}
 	else
-		p_atomic_int_add(&lock->contention_count, 1);
+		shm_atomic_int_add_relaxed(&lock->contention_count, 1);
 
 	return rslt;
 }
@@ -124,7 +124,7 @@ shm_lock_acquire_with_cb(ShmSimpleLock *lock, ShmSimpleLockCallback callback, vo
 	bool fast_path = futex_compare_and_exchange(&lock->lock_state, 0, 1);
 	if (!fast_path)
 	{
-		p_atomic_int_add(&lock->contention_count, 1);
+		shm_atomic_int_add_relaxed(&lock->contention_count, 1);
 		uint32_t old_state = futex_exchange(&lock->lock_state, 2);
 		while (old_state != 0)
 		{
@@ -132,15 +132,15 @@ shm_lock_acquire_with_cb(ShmSimpleLock *lock, ShmSimpleLockCallback callback, vo
 			struct timespec timeout = timeout_in_ms(2000);
 			uint64_t started = rdtsc();
 			long rslt = syscall(SYS_futex, &lock->lock_state, FUTEX_WAIT, 2, &timeout, 0, 0);
-			p_atomic_int_inc(&lock->wait_count);
+			shm_atomic_int_add_relaxed(&lock->wait_count, 1);
 
 			uint64_t diff = rdtsc() - started;
 			uint32_t lower = (diff & 0xFFFFFFFF);
 			uint32_t higher = (diff >> 32);
-			uint32_t prev = (uint32_t)p_atomic_int_add((volatile pint*)&lock->contention_duration, (pint)lower);
+			uint32_t prev = (uint32_t)shm_atomic_int_add_relaxed((volatile pint*)&lock->contention_duration, (pint)lower);
 			if (lower > UINT_MAX - prev)
 				higher++;
-			p_atomic_int_add((volatile pint*)&lock->contention_duration_high, (pint)higher);
+			shm_atomic_int_add_relaxed((volatile pint*)&lock->contention_duration_high, (pint)higher);
 
 			if (rslt != 0)
 			{
@@ -161,9 +161,9 @@ shm_lock_acquire_with_cb(ShmSimpleLock *lock, ShmSimpleLockCallback callback, vo
 	}
 	// Success
 	shmassert(lock->lock_state != 0);
-	p_atomic_int_set(&lock->owner, ShmGetCurrentThreadId());
-	p_atomic_int_set(&lock->last_owner, ShmGetCurrentThreadId());
-	bool correct = p_atomic_int_add(&lock->threads_inside, 1) == 0;
+	shm_atomic_int_set_relaxed(&lock->owner, ShmGetCurrentThreadId());
+	shm_atomic_int_set_relaxed(&lock->last_owner, ShmGetCurrentThreadId());
+	bool correct = shm_atomic_int_add_relaxed(&lock->threads_inside, 1) == 0;
 	shmassert(correct);
 
 	return RESULT_OK;
@@ -193,7 +193,7 @@ shm_lock_acquire(ShmSimpleLock *lock)
 bool
 shm_lock_owned(ShmSimpleLock *lock)
 {
-	int rslt1 = p_atomic_int_get(&lock->owner) == ShmGetCurrentThreadId();
+	int rslt1 = shm_atomic_int_get_relaxed(&lock->owner) == ShmGetCurrentThreadId();
 	int rslt2 = futex_get(&lock->lock_state) > 0;
 	return rslt1 && rslt2;
 }
@@ -204,9 +204,9 @@ shm_lock_release(ShmSimpleLock *lock, int linenum)
 	ShmInt state = futex_get(&lock->lock_state);
 	shmassert(state == 1 || state == 2);
 
-	shmassert(p_atomic_int_get(&lock->owner) == ShmGetCurrentThreadId());
-	p_atomic_int_set(&lock->owner, 0); // without this shm_lock_owned will return true
-	bool correct = p_atomic_int_dec_and_test(&lock->threads_inside);
+	shmassert(shm_atomic_int_get_relaxed(&lock->owner) == ShmGetCurrentThreadId());
+	shm_atomic_int_set_relaxed(&lock->owner, 0); // without this shm_lock_owned will return true
+	bool correct = shm_atomic_int_add_relaxed(&lock->threads_inside, -1) == 1;
 	shmassert(correct);
 	lock->release_line = linenum;
 
@@ -214,7 +214,7 @@ shm_lock_release(ShmSimpleLock *lock, int linenum)
 	{
 		futex_set(&lock->lock_state, 0);
 		syscall(SYS_futex, &lock->lock_state, FUTEX_WAKE, 1, 0, 0, 0);
-		p_atomic_int_inc(&lock->wake_count);
+		shm_atomic_int_add_relaxed(&lock->wake_count, 1);
 	}
 	return RESULT_OK;
 }
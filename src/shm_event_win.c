@@ -505,12 +505,12 @@ shm_lock_tryacquire(ShmSimpleLock *lock)
 	if (rslt)
 	{
 		shmassert(lock->lock_count > 0);
-		p_atomic_int_set(&lock->owner, GetCurrentThreadId());
-		bool correct = p_atomic_int_add(&lock->threads_inside, 1) == 0;
+		shm_atomic_int_set_relaxed(&lock->owner, GetCurrentThreadId());
+		bool correct = shm_atomic_int_add_relaxed(&lock->threads_inside, 1) == 0;
 		shmassert(correct);
 	}
 	else
-		p_atomic_int_add(&lock->contention_count, 1);
+		shm_atomic_int_add_relaxed(&lock->contention_count, 1);
 
 	return rslt;
 }
@@ -526,7 +526,7 @@ shm_lock_acquire_with_cb(ShmSimpleLock *lock, ShmSimpleLockCallback callback, vo
 	bool timeout = false;
 	if (!p_atomic_int_compare_and_exchange(&lock->lock_count, 0, 1))
 	{
-		p_atomic_int_add(&lock->contention_count, 1);
+		shm_atomic_int_add_relaxed(&lock->contention_count, 1);
 		uint64_t started = __rdtsc();
 		if (DEBUG_LOCK == 0)
 		{
@@ -599,8 +599,8 @@ shm_lock_acquire_with_cb(ShmSimpleLock *lock, ShmSimpleLockCallback callback, vo
 	shmassert(lock->lock_count > 0);
 	if (rslt == RESULT_OK)
 	{
-		p_atomic_int_set(&lock->owner, GetCurrentThreadId());
-		bool correct = p_atomic_int_add(&lock->threads_inside, 1) == 0;
+		shm_atomic_int_set_relaxed(&lock->owner, GetCurrentThreadId());
+		bool correct = shm_atomic_int_add_relaxed(&lock->threads_inside, 1) == 0;
 		shmassert(correct);
 	}
 	return rslt;
@@ -614,7 +614,7 @@ shm_lock_acquire(ShmSimpleLock *lock)
 
 bool shm_lock_owned(ShmSimpleLock *lock)
 {
-	int rslt1 = p_atomic_int_get(&lock->owner) == GetCurrentThreadId();
+	int rslt1 = shm_atomic_int_get_relaxed(&lock->owner) == GetCurrentThreadId();
 	int rslt2 = p_atomic_int_get(&lock->lock_count) > 0;
 
 	return rslt1 && rslt2;
@@ -624,9 +624,9 @@ int
 shm_lock_release(ShmSimpleLock *lock, int linenum)
 {
 	shmassert(lock->lock_count > 0);
-	shmassert(p_atomic_int_get(&lock->owner) == GetCurrentThreadId());
-	p_atomic_int_set(&lock->owner, 0); // without this shm_lock_owned will return true
-	bool correct = p_atomic_int_dec_and_test(&lock->threads_inside);
+	shmassert(shm_atomic_int_get_relaxed(&lock->owner) == GetCurrentThreadId());
+	shm_atomic_int_set_relaxed(&lock->owner, 0); // without this shm_lock_owned will return true
+	bool correct = shm_atomic_int_add_relaxed(&lock->threads_inside, -1) == 1;
 	shmassert(correct);
 	lock->release_line = linenum;
 	bool has_waiters = ! p_atomic_int_dec_and_test(&lock->lock_count);
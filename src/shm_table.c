@@ -0,0 +1,518 @@
+/*
+ * The MIT License
+ *
+ * Copyright (C) 2021 Pavel Kostyuchenko <byko3y@gmail.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * 'Software'), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED 'AS IS', WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+//  Columnar table: every column is a chain of fixed-size chunks of inline numbers.
+//  The aggregates and the filters are computed chunk by chunk: the predicates fill a byte mask of the chunk,
+//  then the masked column is reduced. The loops are branch-free and keep 4 independent accumulators,
+//  so the compiler vectorizes them without any intrinsics.
+
+#include <math.h>
+#include "shm_types.h"
+
+int
+shm_table_typecode_kind(ShmInt typecode)
+{
+	switch (typecode)
+	{
+	case 'b': case 'h': case 'i': case 'l': case 'q':
+		return SHM_TABLE_KIND_SIGNED;
+	case 'B': case 'H': case 'I': case 'L': case 'Q':
+		return SHM_TABLE_KIND_UNSIGNED;
+	case 'f': case 'd':
+		return SHM_TABLE_KIND_FLOAT;
+	}
+	return SHM_TABLE_KIND_INVALID;
+}
+
+// Rows a table of column_count columns can hold before its index exceeds the largest heap block.
+ShmInt
+shm_table_max_count(ShmInt column_count)
+{
+	shmassert(max_heap_block_size != 0 && column_count > 0);
+	ShmInt max_chunks = ((ShmInt)max_heap_block_size - (ShmInt)SHM_TABLE_INDEX_HEADER_SIZE) / isizeof(ShmPointer) / column_count;
+	return max_chunks * SHM_TABLE_CHUNK_ROWS;
+}
+
+ShmTable *
+new_shm_table(ThreadContext *thread, PShmPointer result, ShmInt column_count, const ShmTableColumn *columns)
+{
+	shmassert(column_count > 0 && column_count <= SHM_TABLE_MAX_COLUMNS);
+	ShmTable *table = get_mem(thread, result, sizeof(ShmTable), SHM_TABLE_DEBUG_ID);
+	init_container((ShmContainer *)table, sizeof(ShmTable), SHM_TYPE_TABLE);
+	table->column_count = column_count;
+	table->count = 0;
+	table->new_count = -1;
+	table->index = EMPTY_SHM;
+	memclear(table->columns, sizeof(table->columns));
+	for (ShmInt i = 0; i < column_count; ++i)
+	{
+		shmassert(shm_table_typecode_kind(columns[i].typecode) != SHM_TABLE_KIND_INVALID);
+		table->columns[i] = columns[i];
+	}
+	return table;
+}
+
+static ShmInt
+shm_table_visible_count(ShmTable *table, bool owned)
+{
+	if (owned && table->new_count >= 0)
+		return table->new_count;
+	return p_atomic_int_get(&table->count);
+}
+
+static vl void *
+shm_table_chunk_items(ShmTableIndex *index, ShmInt chunk, ShmInt column)
+{
+	shmassert(index && chunk < index->capacity);
+	ShmArrayData *data = LOCAL(p_atomic_shm_pointer_get(&index->chunks[chunk * index->column_count + column]));
+	shmassert(data);
+	return shm_array_data_items(data);
+}
+
+int
+shm_table_get_count(ThreadContext *thread, TableRef table, ShmInt *count)
+{
+	if_failure(
+		transaction_lock_read(thread, &table.local->lock, table.shared, CONTAINER_TABLE, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_read_write_lock(thread, &table.local->lock);
+	bool owned = shm_cell_have_write_lock(thread, &table.local->lock);
+	*count = shm_table_visible_count(table.local, owned);
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+// The chunks are only added, the grown index takes over the references of the old one.
+static int
+shm_table_reserve(ThreadContext *thread, ShmTable *table, ShmInt chunk_count)
+{
+	ShmTableIndex *index = LOCAL(table->index);
+	ShmInt capacity = index ? index->capacity : 0;
+	if (chunk_count > capacity)
+	{
+		ShmInt max_capacity = shm_table_max_count(table->column_count) / SHM_TABLE_CHUNK_ROWS;
+		if (chunk_count > max_capacity)
+			return RESULT_INVALID;
+		ShmInt new_capacity = capacity ? capacity : 4;
+		while (new_capacity < chunk_count)
+			new_capacity *= 2;
+		if (new_capacity > max_capacity)
+			new_capacity = max_capacity;
+		ShmPointer new_index_shm = EMPTY_SHM;
+		ShmInt size = (ShmInt)SHM_TABLE_INDEX_HEADER_SIZE + new_capacity * table->column_count * isizeof(ShmPointer);
+		ShmTableIndex *new_index = new_shm_refcounted_block(thread, &new_index_shm, size, SHM_TYPE_TABLE_INDEX, SHM_TABLE_INDEX_DEBUG_ID);
+		new_index->column_count = table->column_count;
+		new_index->capacity = new_capacity;
+		for (ShmInt i = 0; i < new_capacity * table->column_count; ++i)
+		{
+			ShmPointer chunk = i < capacity * table->column_count ? index->chunks[i] : EMPTY_SHM;
+			if (SBOOL(chunk))
+				shm_pointer_acq(thread, chunk);
+			new_index->chunks[i] = chunk;
+		}
+		shm_pointer_move_atomic(thread, &table->index, &new_index_shm);
+		index = new_index;
+	}
+	for (ShmInt i = 0; i < chunk_count * table->column_count; ++i)
+	{
+		if (!SBOOL(index->chunks[i]))
+		{
+			ShmPointer chunk = EMPTY_SHM;
+			new_shm_array_data(thread, &chunk, table->columns[i % table->column_count].itemsize,
+			                   SHM_TABLE_CHUNK_ROWS, SHM_TABLE_CHUNK_DEBUG_ID);
+			p_atomic_shm_pointer_set(&index->chunks[i], chunk);
+		}
+	}
+	return RESULT_OK;
+}
+
+// Appends count rows, columns[c] points to count packed items of the column c.
+// Returns RESULT_INVALID when the table cannot hold that many rows.
+int
+shm_table_append(ThreadContext *thread, TableRef table, ShmInt count, const void *const *columns)
+{
+	shmassert(count >= 0);
+	if_failure(
+		transaction_lock_write(thread, &table.local->lock, table.shared, CONTAINER_TABLE, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_write_lock(thread, &table.local->lock);
+	ShmTable *local = table.local;
+	ShmInt start = shm_table_visible_count(local, true);
+	if (count > shm_table_max_count(local->column_count) - start ||
+	    shm_table_reserve(thread, local, (start + count + SHM_TABLE_CHUNK_ROWS - 1) >> SHM_TABLE_CHUNK_LOG) != RESULT_OK)
+	{
+		transient_commit(thread);
+		return RESULT_INVALID;
+	}
+	ShmTableIndex *index = LOCAL(local->index);
+	for (ShmInt column = 0; column < local->column_count; ++column)
+	{
+		ShmInt itemsize = local->columns[column].itemsize;
+		const char *src = columns[column];
+		ShmInt row = start;
+		while (row < start + count)
+		{
+			ShmInt offset = row & (SHM_TABLE_CHUNK_ROWS - 1);
+			ShmInt n = SHM_TABLE_CHUNK_ROWS - offset;
+			if (n > start + count - row)
+				n = start + count - row;
+			vl char *items = shm_table_chunk_items(index, row >> SHM_TABLE_CHUNK_LOG, column);
+			memcpy(CAST_VL(items + offset * itemsize), src, (size_t)(n * itemsize));
+			src += n * itemsize;
+			row += n;
+		}
+	}
+	local->new_count = start + count;
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+// Copies the items of the column from the rows start to start + count - 1, RESULT_INVALID if some of them do not exist.
+int
+shm_table_get_range(ThreadContext *thread, TableRef table, ShmInt column, ShmInt start, ShmInt count, void *dest)
+{
+	shmassert(column >= 0 && column < table.local->column_count && start >= 0 && count >= 0);
+	if_failure(
+		transaction_lock_read(thread, &table.local->lock, table.shared, CONTAINER_TABLE, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_read_write_lock(thread, &table.local->lock);
+	bool owned = shm_cell_have_write_lock(thread, &table.local->lock);
+	if (start + count > shm_table_visible_count(table.local, owned))
+	{
+		transient_commit(thread);
+		return RESULT_INVALID;
+	}
+	ShmTableIndex *index = LOCAL(p_atomic_shm_pointer_get(&table.local->index));
+	ShmInt itemsize = table.local->columns[column].itemsize;
+	char *dst = dest;
+	ShmInt row = start;
+	while (row < start + count)
+	{
+		ShmInt offset = row & (SHM_TABLE_CHUNK_ROWS - 1);
+		ShmInt n = SHM_TABLE_CHUNK_ROWS - offset;
+		if (n > start + count - row)
+			n = start + count - row;
+		vl char *items = shm_table_chunk_items(index, row >> SHM_TABLE_CHUNK_LOG, column);
+		memcpy(dst, CAST_VL(items + offset * itemsize), (size_t)(n * itemsize));
+		dst += n * itemsize;
+		row += n;
+	}
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+// Kernels
+
+typedef void (*shm_table_mask_func)(const void *items, ShmInt n, int op, ShmTableValue value, uint8_t *mask);
+typedef void (*shm_table_reduce_func)(const void *items, ShmInt n, const uint8_t *mask, int aggregate, ShmTableValue *result);
+
+// acc_type and field are of the kind of the column, the sums are accumulated as sum_type
+#define SHM_TABLE_KERNELS(name, ctype, acc_type, sum_type, field, lowest, highest) \
+static void \
+shm_table_mask_##name(const void *items, ShmInt n, int op, ShmTableValue value, uint8_t *mask) \
+{ \
+	const ctype *v = items; \
+	const acc_type c = value.field; \
+	switch (op) \
+	{ \
+	case SHM_TABLE_LT: for (ShmInt i = 0; i < n; i++) mask[i] &= (acc_type)v[i] < c; break; \
+	case SHM_TABLE_LE: for (ShmInt i = 0; i < n; i++) mask[i] &= (acc_type)v[i] <= c; break; \
+	case SHM_TABLE_EQ: for (ShmInt i = 0; i < n; i++) mask[i] &= (acc_type)v[i] == c; break; \
+	case SHM_TABLE_NE: for (ShmInt i = 0; i < n; i++) mask[i] &= (acc_type)v[i] != c; break; \
+	case SHM_TABLE_GE: for (ShmInt i = 0; i < n; i++) mask[i] &= (acc_type)v[i] >= c; break; \
+	case SHM_TABLE_GT: for (ShmInt i = 0; i < n; i++) mask[i] &= (acc_type)v[i] > c; break; \
+	default: shmassert(false); \
+	} \
+} \
+\
+static void \
+shm_table_reduce_##name(const void *items, ShmInt n, const uint8_t *mask, int aggregate, ShmTableValue *result) \
+{ \
+	const ctype *v = items; \
+	ShmInt tail = n & ~(ShmInt)3; \
+	switch (aggregate) \
+	{ \
+	case SHM_TABLE_SUM: \
+	{ \
+		sum_type lanes[4] = { 0, 0, 0, 0 }; \
+		for (ShmInt i = 0; i < tail; i += 4) \
+			for (int l = 0; l < 4; l++) \
+				lanes[l] += mask[i + l] ? (sum_type)v[i + l] : (sum_type)0; \
+		for (ShmInt i = tail; i < n; i++) \
+			lanes[0] += mask[i] ? (sum_type)v[i] : (sum_type)0; \
+		result->field = (acc_type)((sum_type)result->field + (lanes[0] + lanes[1]) + (lanes[2] + lanes[3])); \
+		break; \
+	} \
+	case SHM_TABLE_MIN: \
+	{ \
+		acc_type lanes[4] = { highest, highest, highest, highest }; \
+		for (ShmInt i = 0; i < tail; i += 4) \
+			for (int l = 0; l < 4; l++) \
+			{ \
+				acc_type x = mask[i + l] ? (acc_type)v[i + l] : highest; \
+				lanes[l] = x < lanes[l] ? x : lanes[l]; \
+			} \
+		for (ShmInt i = tail; i < n; i++) \
+		{ \
+			acc_type x = mask[i] ? (acc_type)v[i] : highest; \
+			lanes[0] = x < lanes[0] ? x : lanes[0]; \
+		} \
+		for (int l = 0; l < 4; l++) \
+			result->field = lanes[l] < result->field ? lanes[l] : result->field; \
+		break; \
+	} \
+	case SHM_TABLE_MAX: \
+	{ \
+		acc_type lanes[4] = { lowest, lowest, lowest, lowest }; \
+		for (ShmInt i = 0; i < tail; i += 4) \
+			for (int l = 0; l < 4; l++) \
+			{ \
+				acc_type x = mask[i + l] ? (acc_type)v[i + l] : lowest; \
+				lanes[l] = x > lanes[l] ? x : lanes[l]; \
+			} \
+		for (ShmInt i = tail; i < n; i++) \
+		{ \
+			acc_type x = mask[i] ? (acc_type)v[i] : lowest; \
+			lanes[0] = x > lanes[0] ? x : lanes[0]; \
+		} \
+		for (int l = 0; l < 4; l++) \
+			result->field = lanes[l] > result->field ? lanes[l] : result->field; \
+		break; \
+	} \
+	default: \
+		shmassert(false); \
+	} \
+}
+
+// signed sums wrap around at 64 bits instead of overflowing
+SHM_TABLE_KERNELS(b, signed char, int64_t, uint64_t, i, INT64_MIN, INT64_MAX)
+SHM_TABLE_KERNELS(B, unsigned char, uint64_t, uint64_t, u, 0, UINT64_MAX)
+SHM_TABLE_KERNELS(h, short, int64_t, uint64_t, i, INT64_MIN, INT64_MAX)
+SHM_TABLE_KERNELS(H, unsigned short, uint64_t, uint64_t, u, 0, UINT64_MAX)
+SHM_TABLE_KERNELS(i, int, int64_t, uint64_t, i, INT64_MIN, INT64_MAX)
+SHM_TABLE_KERNELS(I, unsigned int, uint64_t, uint64_t, u, 0, UINT64_MAX)
+SHM_TABLE_KERNELS(l, long, int64_t, uint64_t, i, INT64_MIN, INT64_MAX)
+SHM_TABLE_KERNELS(L, unsigned long, uint64_t, uint64_t, u, 0, UINT64_MAX)
+SHM_TABLE_KERNELS(q, long long, int64_t, uint64_t, i, INT64_MIN, INT64_MAX)
+SHM_TABLE_KERNELS(Q, unsigned long long, uint64_t, uint64_t, u, 0, UINT64_MAX)
+SHM_TABLE_KERNELS(f, float, double, double, d, -INFINITY, INFINITY)
+SHM_TABLE_KERNELS(d, double, double, double, d, -INFINITY, INFINITY)
+
+static void
+shm_table_kernels(ShmInt typecode, shm_table_mask_func *mask, shm_table_reduce_func *reduce)
+{
+#define SHM_TABLE_KERNELS_CASE(code, name) case code: *mask = shm_table_mask_##name; *reduce = shm_table_reduce_##name; return;
+	switch (typecode)
+	{
+	SHM_TABLE_KERNELS_CASE('b', b)
+	SHM_TABLE_KERNELS_CASE('B', B)
+	SHM_TABLE_KERNELS_CASE('h', h)
+	SHM_TABLE_KERNELS_CASE('H', H)
+	SHM_TABLE_KERNELS_CASE('i', i)
+	SHM_TABLE_KERNELS_CASE('I', I)
+	SHM_TABLE_KERNELS_CASE('l', l)
+	SHM_TABLE_KERNELS_CASE('L', L)
+	SHM_TABLE_KERNELS_CASE('q', q)
+	SHM_TABLE_KERNELS_CASE('Q', Q)
+	SHM_TABLE_KERNELS_CASE('f', f)
+	SHM_TABLE_KERNELS_CASE('d', d)
+	}
+#undef SHM_TABLE_KERNELS_CASE
+	shmassert(false);
+}
+
+static ShmInt
+shm_table_mask_count(const uint8_t *mask, ShmInt n)
+{
+	ShmInt count = 0;
+	for (ShmInt i = 0; i < n; i++)
+		count += mask[i];
+	return count;
+}
+
+// Fills the mask of the rows of the chunk that satisfy all the predicates.
+static void
+shm_table_chunk_mask(ShmTable *table, ShmTableIndex *index, ShmInt chunk, ShmInt n,
+                     const ShmTablePredicate *predicates, int predicate_count, uint8_t *mask)
+{
+	memset(mask, 1, (size_t)n);
+	for (int p = 0; p < predicate_count; p++)
+	{
+		shm_table_mask_func mask_func = NULL;
+		shm_table_reduce_func reduce_func = NULL;
+		ShmInt column = predicates[p].column;
+		shm_table_kernels(table->columns[column].typecode, &mask_func, &reduce_func);
+		mask_func(CAST_VL(shm_table_chunk_items(index, chunk, column)), n, predicates[p].op, predicates[p].value, mask);
+	}
+}
+
+// Reduces the column over the rows satisfying all the predicates, the column is ignored for SHM_TABLE_COUNT.
+// The result is of the kind of the column, the min and the max are meaningful only when matched > 0.
+int
+shm_table_aggregate(ThreadContext *thread, TableRef table, ShmInt column, int aggregate,
+                    const ShmTablePredicate *predicates, int predicate_count, ShmTableValue *result, ShmInt *matched)
+{
+	shmassert(aggregate == SHM_TABLE_COUNT || (column >= 0 && column < table.local->column_count));
+	int kind = aggregate == SHM_TABLE_COUNT ? SHM_TABLE_KIND_SIGNED : shm_table_typecode_kind(table.local->columns[column].typecode);
+	switch (aggregate)
+	{
+	case SHM_TABLE_MIN:
+		if (kind == SHM_TABLE_KIND_SIGNED) result->i = INT64_MAX;
+		else if (kind == SHM_TABLE_KIND_UNSIGNED) result->u = UINT64_MAX;
+		else result->d = INFINITY;
+		break;
+	case SHM_TABLE_MAX:
+		if (kind == SHM_TABLE_KIND_SIGNED) result->i = INT64_MIN;
+		else if (kind == SHM_TABLE_KIND_UNSIGNED) result->u = 0;
+		else result->d = -INFINITY;
+		break;
+	default:
+		if (kind == SHM_TABLE_KIND_FLOAT) result->d = 0.0;
+		else result->u = 0;
+	}
+	*matched = 0;
+	if_failure(
+		transaction_lock_read(thread, &table.local->lock, table.shared, CONTAINER_TABLE, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_read_write_lock(thread, &table.local->lock);
+	bool owned = shm_cell_have_write_lock(thread, &table.local->lock);
+	ShmInt count = shm_table_visible_count(table.local, owned);
+	ShmTableIndex *index = LOCAL(p_atomic_shm_pointer_get(&table.local->index));
+	shm_table_mask_func mask_func = NULL;
+	shm_table_reduce_func reduce_func = NULL;
+	if (aggregate != SHM_TABLE_COUNT)
+		shm_table_kernels(table.local->columns[column].typecode, &mask_func, &reduce_func);
+	uint8_t mask[SHM_TABLE_CHUNK_ROWS];
+	for (ShmInt chunk = 0; chunk << SHM_TABLE_CHUNK_LOG < count; chunk++)
+	{
+		ShmInt n = count - (chunk << SHM_TABLE_CHUNK_LOG);
+		if (n > SHM_TABLE_CHUNK_ROWS)
+			n = SHM_TABLE_CHUNK_ROWS;
+		shm_table_chunk_mask(table.local, index, chunk, n, predicates, predicate_count, mask);
+		*matched += shm_table_mask_count(mask, n);
+		if (reduce_func)
+			reduce_func(CAST_VL(shm_table_chunk_items(index, chunk, column)), n, mask, aggregate, result);
+	}
+	if (aggregate == SHM_TABLE_COUNT)
+		result->i = *matched;
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+// Stores the numbers of the rows satisfying all the predicates, only the first capacity rows are checked.
+int
+shm_table_filter(ThreadContext *thread, TableRef table, const ShmTablePredicate *predicates, int predicate_count,
+                 ShmInt *rows, ShmInt capacity, ShmInt *found)
+{
+	*found = 0;
+	if_failure(
+		transaction_lock_read(thread, &table.local->lock, table.shared, CONTAINER_TABLE, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_read_write_lock(thread, &table.local->lock);
+	bool owned = shm_cell_have_write_lock(thread, &table.local->lock);
+	ShmInt count = shm_table_visible_count(table.local, owned);
+	if (count > capacity)
+		count = capacity;
+	ShmTableIndex *index = LOCAL(p_atomic_shm_pointer_get(&table.local->index));
+	uint8_t mask[SHM_TABLE_CHUNK_ROWS];
+	ShmInt total = 0;
+	for (ShmInt chunk = 0; chunk << SHM_TABLE_CHUNK_LOG < count; chunk++)
+	{
+		ShmInt first = chunk << SHM_TABLE_CHUNK_LOG;
+		ShmInt n = count - first;
+		if (n > SHM_TABLE_CHUNK_ROWS)
+			n = SHM_TABLE_CHUNK_ROWS;
+		shm_table_chunk_mask(table.local, index, chunk, n, predicates, predicate_count, mask);
+		// branch-free compaction
+		for (ShmInt i = 0; i < n; i++)
+		{
+			rows[total] = first + i;
+			total += mask[i];
+		}
+	}
+	*found = total;
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+int
+shm_table_commit(ThreadContext *thread, ShmTable *table)
+{
+	shm_cell_check_write_lock(thread, &table->lock);
+	if (table->new_count >= 0)
+	{
+		// the rows are written before they are published
+		p_atomic_int_set(&table->count, table->new_count);
+		table->new_count = -1;
+	}
+	return RESULT_OK;
+}
+
+int
+shm_table_rollback(ThreadContext *thread, ShmTable *table)
+{
+	shm_cell_check_write_lock(thread, &table->lock);
+	table->new_count = -1;
+	return RESULT_OK;
+}
+
+int
+shm_table_unlock(ThreadContext *thread, ShmTable *table, ShmInt type)
+{
+	if (TRANSACTION_ELEMENT_WRITE == type)
+		shm_atomic_shm_pointer_set_release(&table->lock.transaction_data, EMPTY_SHM);
+	_shm_cell_unlock(thread, &table->lock, type);
+	return RESULT_OK;
+}
+
+void
+shm_table_index_destroy(ThreadContext *thread, ShmTableIndex *index)
+{
+	for (ShmInt i = 0; i < index->capacity * index->column_count; ++i)
+	{
+		if (SBOOL(index->chunks[i]))
+			shm_pointer_empty(thread, &index->chunks[i]);
+	}
+}
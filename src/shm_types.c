@@ -148,6 +148,33 @@ shm_types_transaction_end(ThreadContext *thread, ShmTransactionElement *element,
 			shm_promise_commit(thread, promise);
 		break;
 	}
+	case CONTAINER_ARRAY:
+	{
+		ShmArray *array = LOCAL(element->container);
+		if (rollback)
+			shm_array_rollback(thread, array);
+		else
+			shm_array_commit(thread, array);
+		break;
+	}
+	case CONTAINER_TABLE:
+	{
+		ShmTable *table = LOCAL(element->container);
+		if (rollback)
+			shm_table_rollback(thread, table);
+		else
+			shm_table_commit(thread, table);
+		break;
+	}
+	case CONTAINER_BLOB:
+	{
+		ShmBlob *blob = LOCAL(element->container);
+		if (rollback)
+			shm_blob_rollback(thread, blob);
+		else
+			shm_blob_commit(thread, blob);
+		break;
+	}
 	default:
 	{
 		char buf[40];
@@ -205,6 +232,24 @@ shm_types_transaction_unlock(ThreadContext *thread, ShmTransactionElement *eleme
 		shm_promise_unlock(thread, promise, element->element_type);
 		break;
 	}
+	case CONTAINER_ARRAY:
+	{
+		ShmArray *array = LOCAL(element->container);
+		shm_array_unlock(thread, array, element->element_type);
+		break;
+	}
+	case CONTAINER_TABLE:
+	{
+		ShmTable *table = LOCAL(element->container);
+		shm_table_unlock(thread, table, element->element_type);
+		break;
+	}
+	case CONTAINER_BLOB:
+	{
+		ShmBlob *blob = LOCAL(element->container);
+		shm_blob_unlock(thread, blob, element->element_type);
+		break;
+	}
 	default:
 		shmassert_msg(false, "transaction_end: element is invalid");
 	}
@@ -358,6 +403,14 @@ new_shm_value(ThreadContext *thread, ShmInt item_size, ShmInt type, PShmPointer
 	return value;
 }
 
+// The largest item_size new_shm_value() can allocate as a single block
+ShmInt
+shm_value_max_size(void)
+{
+	shmassert(max_heap_block_size != 0);
+	return (ShmInt)max_heap_block_size - isizeof(ShmValueHeader);
+}
+
 ShmInt
 shm_value_get_size(ShmValueHeader *value)
 {
@@ -427,7 +480,7 @@ shm_cell_unlock(ThreadContext *thread, ShmCell *item, ShmInt type)
 {
 	// shmassert(item->lock.id == thread->self, "item->lock.id == thread->self");
 	if (TRANSACTION_ELEMENT_WRITE == type)
-		p_atomic_shm_pointer_set(&item->lock.transaction_data, EMPTY_SHM);
+		shm_atomic_shm_pointer_set_release(&item->lock.transaction_data, EMPTY_SHM);
 	_shm_cell_unlock(thread, &item->lock, type);
 	return RESULT_OK;
 }
@@ -447,7 +500,7 @@ do_cell_get_value(ThreadContext *thread, ShmCell *item, PShmPointer value_shm, b
 
 	ShmValueHeader *value = (ShmValueHeader *)LOCAL(data);
 	if (acquire)
-		p_atomic_int_inc(&value->refcount);
+		shm_atomic_int_add_relaxed(&value->refcount, 1);
 
 	return value;
 }
@@ -516,49 +569,84 @@ UCS4_format_number(Py_UCS4 *to, int number)
 ShmPointer
 shm_ref_unicode_new_ascii(ThreadContext *thread, const Py_UCS1 *s, int len)
 {
-	ShmPointer rslt;
-	int total_size = isizeof(ShmRefUnicode) - isizeof(Py_UCS4) + len * isizeof(Py_UCS4);
-	ShmRefUnicode *ref = new_shm_refcounted_block(thread, &rslt, total_size, SHM_TYPE_REF_UNICODE, SHM_REF_STRING_DEBUG_ID);
-	if (ref)
-	{
-		Py_UCS4 *data = (Py_UCS4 *)(intptr_t)&ref->chars;
-		UCS4_from_ASCII(data, s, len);
-	}
-	return rslt;
+	return shm_ref_unicode_new(thread, 1, s, len);
 }
 
+// s == NULL leaves the characters zeroed for the caller to fill them.
 ShmPointer
-shm_ref_unicode_new(ThreadContext *thread, const Py_UCS4 *s, int len)
+shm_ref_unicode_new(ThreadContext *thread, int kind, const void *s, int len)
 {
 	ShmPointer rslt;
-	int total_size = isizeof(ShmRefUnicode) - isizeof(Py_UCS4) + len * isizeof(Py_UCS4);
-	ShmRefUnicode *ref = new_shm_refcounted_block(thread, &rslt, total_size, SHM_TYPE_REF_UNICODE, SHM_REF_STRING_DEBUG_ID);
+	int total_size = SHM_REF_UNICODE_HEADER_SIZE + len * kind;
+	ShmRefUnicode *ref = new_shm_refcounted_block(thread, &rslt, total_size, shm_unicode_type(kind), SHM_REF_STRING_DEBUG_ID);
 	if (ref && s)
+		memcpy(CAST_VL(ref->chars), s, (size_t)(len * kind));
+	return rslt;
+}
+
+RefUnicode
+shm_unicode_value_get(ShmValueHeader *value)
+{
+	RefUnicode rslt;
+	if (!value)
 	{
-		Py_UCS4 *data = (Py_UCS4 *)&ref->chars;
-		memcpy(data, s, len * sizeof(Py_UCS4));
+		rslt.data = NULL;
+		rslt.len = 0;
+		rslt.kind = 1;
+		return rslt;
 	}
+	shmassert(SHM_TYPE(value->type) == SHM_TYPE(SHM_TYPE_REF_UNICODE));
+	ShmRefUnicode *s = (ShmRefUnicode *)value;
+	rslt.kind = shm_type_get_unicode_kind(s->type);
+	rslt.len = (s->size - SHM_REF_UNICODE_HEADER_SIZE) / rslt.kind;
+	rslt.data = s->chars;
 	return rslt;
 }
 
 RefUnicode
 shm_ref_unicode_get(ShmPointer p)
+{
+	return shm_unicode_value_get((ShmValueHeader *)LOCAL(p));
+}
+
+RefUnicode
+shm_unicode_key_get(ShmPointer key, Py_UCS1 *buffer)
 {
 	RefUnicode rslt;
-	ShmRefUnicode *s = LOCAL(p);
-	if (!s)
+	rslt.kind = 1;
+	rslt.len = -1;
+	rslt.data = NULL;
+	if (shm_pointer_is_immediate(key))
 	{
-		rslt.data = NULL;
-		rslt.len = 0;
+		if (shm_immediate_get_tag(key) == SHM_IMMEDIATE_SHORT_STR)
+		{
+			rslt.len = shm_immediate_get_short(key, buffer);
+			rslt.data = buffer;
+		}
 		return rslt;
 	}
-	shmassert(SHM_TYPE(s->type) == SHM_TYPE(SHM_TYPE_REF_UNICODE));
-	int strlen = (s->size - (isizeof(ShmRefUnicode) - isizeof(Py_UCS4))) / isizeof(Py_UCS4);
-	rslt.len = strlen;
-	rslt.data = &s->chars;
+	ShmValueHeader *header = LOCAL(key);
+	if (header && SHM_TYPE(header->type) == SHM_TYPE(SHM_TYPE_UNICODE))
+		return shm_unicode_value_get(header);
 	return rslt;
 }
 
+bool
+shm_ref_unicode_equal(RefUnicode s1, int kind2, const void *data2, ShmInt len2)
+{
+	if (s1.len != len2)
+		return false;
+	if (s1.kind == kind2)
+		return memcmp(CAST_VL(s1.data), data2, (size_t)(len2 * kind2)) == 0;
+	// Strings from Python always have the narrowest kind, but strings made in C code might be wider.
+	for (ShmInt i = 0; i < len2; ++i)
+	{
+		if (shm_unicode_read(s1.kind, s1.data, i) != shm_unicode_read(kind2, data2, i))
+			return false;
+	}
+	return true;
+}
+
 // FNV_prime = 2^24 + 2^8 + 0x93 = 16777619
 #define FNV_prime  16777619
 #define FNV_basis  2166136261
@@ -576,6 +664,7 @@ hash_string(const Py_UCS4 *s, int len)
 	return hash;
 }
 
+// Also hashes Latin-1 strings
 uint32_t
 hash_string_ascii(const char *s, int len)
 {
@@ -588,15 +677,215 @@ hash_string_ascii(const char *s, int len)
 	return hash;
 }
 
+uint32_t
+hash_string_ucs2(const Py_UCS2 *s, int len)
+{
+	uint32_t hash = FNV_basis;
+	for (int i = 0; i < len; ++i)
+	{
+		hash = hash ^ s[i];
+		hash = hash * FNV_prime;
+	}
+	return hash;
+}
+
+// The hash is computed over the code points, so it does not depend on the kind.
+uint32_t
+hash_string_kind(int kind, const void *s, int len)
+{
+	switch (kind)
+	{
+	case 1:
+		return hash_string_ascii(s, len);
+	case 2:
+		return hash_string_ucs2(s, len);
+	case 4:
+		return hash_string(s, len);
+	}
+	shmassert(false);
+	return 0;
+}
+
+uint32_t
+hash_bytes(const char *s, int len)
+{
+	// different basis from hash_string_ascii, so b'a' and 'a' don't collide
+	uint32_t hash = FNV_basis ^ 0xFF;
+	for (int i = 0; i < len; ++i)
+	{
+		hash = hash ^ (unsigned char)s[i];
+		hash = hash * FNV_prime;
+	}
+	return hash;
+}
+
+// murmur3 fmix64, low bits of ints are well distributed for sequential keys
+uint32_t
+hash_int(int64_t value)
+{
+	uint64_t k = (uint64_t)value;
+	k ^= k >> 33;
+	k *= UINT64_C(0xff51afd7ed558ccd);
+	k ^= k >> 33;
+	k *= UINT64_C(0xc4ceb9fe1a85ec53);
+	k ^= k >> 33;
+	return (uint32_t)k;
+}
+
+uint32_t
+hash_double(double value)
+{
+	if (value == 0)
+		value = 0; // -0.0 == 0.0
+	int64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return hash_int(bits);
+}
+
+uint32_t
+hash_tuple_start(int count)
+{
+	return FNV_basis ^ (uint32_t)count;
+}
+
+uint32_t
+hash_tuple_add(uint32_t hash, uint32_t item_hash)
+{
+	return (hash ^ item_hash) * FNV_prime;
+}
+
+// Bool is an int for the dict keys, like True == 1 in Python, and -0.0 is 0.0.
+static __ShmPointer
+shm_value_canonical_key(ShmPointer value)
+{
+	if (shm_pointer_is_immediate(value) && shm_immediate_get_tag(value) == SHM_IMMEDIATE_BOOL)
+		return shm_immediate_from_int(shm_immediate_get_bool(value) ? 1 : 0);
+#if SHM_IMMEDIATE_HAS_FLOAT
+	if (shm_pointer_is_immediate(value) && shm_immediate_get_tag(value) == SHM_IMMEDIATE_FLOAT &&
+	    shm_immediate_get_float(value) == 0)
+		return shm_immediate_from_float(0);
+#endif
+	return value;
+}
+
+uint32_t
+shm_value_hash(ShmPointer value)
+{
+	value = shm_value_canonical_key(value);
+	if (value == NONE_SHM)
+		return 0x9e3779b9;
+	if (shm_pointer_is_immediate(value))
+	{
+		uint8_t chars[SHM_IMMEDIATE_SHORT_MAX];
+		switch (shm_immediate_get_tag(value))
+		{
+		case SHM_IMMEDIATE_INT:
+			return hash_int(shm_immediate_get_int(value));
+#if SHM_IMMEDIATE_HAS_FLOAT
+		case SHM_IMMEDIATE_FLOAT:
+			return hash_double(shm_immediate_get_float(value));
+#endif
+		case SHM_IMMEDIATE_SHORT_STR:
+			return hash_string_ascii((const char *)chars, shm_immediate_get_short(value, chars));
+		case SHM_IMMEDIATE_SHORT_BYTES:
+			return hash_bytes((const char *)chars, shm_immediate_get_short(value, chars));
+		}
+		shmassert(false);
+		return 0;
+	}
+	ShmValueHeader *header = LOCAL(value);
+	shmassert(header);
+	void *data = shm_value_get_data(header);
+	switch (SHM_TYPE(header->type))
+	{
+	case SHM_TYPE(SHM_TYPE_UNICODE):
+	{
+		RefUnicode s = shm_unicode_value_get(header);
+		return hash_string_kind(s.kind, CAST_VL(s.data), s.len);
+	}
+	case SHM_TYPE(SHM_TYPE_BYTES):
+		return hash_bytes(data, shm_value_get_size(header));
+	case SHM_TYPE(SHM_TYPE_LONG):
+		return hash_int(*(long *)data);
+	case SHM_TYPE(SHM_TYPE_FLOAT):
+		return hash_double(*(double *)data);
+	case SHM_TYPE(SHM_TYPE_TUPLE):
+	{
+		int count = shm_value_get_size(header) / isizeof(ShmPointer);
+		ShmPointer *elements = data;
+		uint32_t hash = hash_tuple_start(count);
+		for (int i = 0; i < count; ++i)
+			hash = hash_tuple_add(hash, shm_value_hash(elements[i]));
+		return hash;
+	}
+	}
+	shmassert_msg(false, "Unhashable value");
+	return 0;
+}
+
+bool
+shm_value_equal(ShmPointer value1, ShmPointer value2)
+{
+	value1 = shm_value_canonical_key(value1);
+	value2 = shm_value_canonical_key(value2);
+	if (value1 == value2)
+		return true;
+	// The values which fit into immediates are never stored in blocks.
+	if (shm_pointer_is_immediate(value1) || shm_pointer_is_immediate(value2) || value1 == NONE_SHM || value2 == NONE_SHM)
+		return false;
+	ShmValueHeader *header1 = LOCAL(value1);
+	ShmValueHeader *header2 = LOCAL(value2);
+	shmassert(header1 && header2);
+	if (SHM_TYPE(header1->type) != SHM_TYPE(header2->type))
+		return false;
+	switch (SHM_TYPE(header1->type))
+	{
+	case SHM_TYPE(SHM_TYPE_UNICODE):
+	{
+		RefUnicode s2 = shm_unicode_value_get(header2);
+		return shm_ref_unicode_equal(shm_unicode_value_get(header1), s2.kind, CAST_VL(s2.data), s2.len);
+	}
+	case SHM_TYPE(SHM_TYPE_TUPLE):
+	{
+		int size = shm_value_get_size(header1);
+		if (size != shm_value_get_size(header2))
+			return false;
+		ShmPointer *elements1 = shm_value_get_data(header1);
+		ShmPointer *elements2 = shm_value_get_data(header2);
+		for (int i = 0; i < size / isizeof(ShmPointer); ++i)
+		{
+			if (!shm_value_equal(elements1[i], elements2[i]))
+				return false;
+		}
+		return true;
+	}
+	case SHM_TYPE(SHM_TYPE_BYTES):
+	case SHM_TYPE(SHM_TYPE_LONG):
+	case SHM_TYPE(SHM_TYPE_FLOAT):
+	{
+		int size = shm_value_get_size(header1);
+		return size == shm_value_get_size(header2) &&
+			memcmp(shm_value_get_data(header1), shm_value_get_data(header2), (size_t)size) == 0;
+	}
+	}
+	return false;
+}
+
 ShmValueHeader *
-new_shm_unicode_value(ThreadContext *thread, const char *s, int length, PShmPointer shm_pointer)
+new_shm_unicode_value_kind(ThreadContext *thread, int kind, const void *s, int length, PShmPointer shm_pointer)
 {
-	ShmValueHeader *header = new_shm_value(thread, length * isizeof(Py_UCS4), SHM_TYPE_UNICODE, shm_pointer);
-	Py_UCS4 *data = (Py_UCS4 *)shm_value_get_data(header);
-	UCS4_from_ASCII(data, (const Py_UCS1 *)s, length);
+	ShmValueHeader *header = new_shm_value(thread, length * kind, shm_unicode_type(kind), shm_pointer);
+	if (header && s)
+		memcpy(shm_value_get_data(header), s, (size_t)(length * kind));
 	return header;
 }
 
+ShmValueHeader *
+new_shm_unicode_value(ThreadContext *thread, const char *s, int length, PShmPointer shm_pointer)
+{
+	return new_shm_unicode_value_kind(thread, 1, s, length, shm_pointer);
+}
+
 // ShmQueue
 
 ShmQueue *
@@ -780,7 +1069,7 @@ shm_queue_unlock(ThreadContext *thread, ShmQueue *queue, ShmInt type)
 
 	// shmassert(queue->base.lock.id == thread->self, "queue->lock.id == thread->self");
 	if (TRANSACTION_ELEMENT_WRITE == type)
-		p_atomic_shm_pointer_set(&queue->base.lock.transaction_data, EMPTY_SHM);
+		shm_atomic_shm_pointer_set_release(&queue->base.lock.transaction_data, EMPTY_SHM);
 	// queue->base.lock.id = 0;
 	_shm_cell_unlock(thread, &queue->base.lock, type);
 	return RESULT_OK;
@@ -920,7 +1209,7 @@ do_shm_queue_get_first(ThreadContext *thread, QueueRef queue, PShmPointer shm_po
 					*shm_pointer = data;
 				ShmCell *item = (ShmCell *)LOCAL(data);
 				if (acquire)
-					p_atomic_int_inc(&item->refcount);
+					shm_atomic_int_add_relaxed(&item->refcount, 1);
 				// release_spinlock(&queue->cell.lock);
 				return item;
 			}
@@ -967,7 +1256,7 @@ do_shm_queue_cell_get_next(ThreadContext *thread, ShmCell *item, PShmPointer nex
 					*next_shm = queue_item->next;
 				ShmCell *next_item = (ShmCell *)LOCAL(queue_item->next);
 				if (acquire)
-					p_atomic_int_inc(&next_item->refcount);
+					shm_atomic_int_add_relaxed(&next_item->refcount, 1);
 				//release_spinlock(&queue_item->cell.lock);
 				return next_item;
 			}
@@ -1038,10 +1327,69 @@ shm_list_changes_check_inited(ThreadContext *thread, ShmList *list, ShmListChang
 	return RESULT_OK;
 }
 
+// The shadow cell of the item ii, NULL when the transaction has not touched its chunk of the block.
+static ShmListShadowCell *
+shm_list_shadow_cell(ShmListBlock *block, ShmInt ii)
+{
+	ShmListShadow *shadow = LOCAL(block->shadow);
+	if (shadow == NULL)
+		return NULL;
+	shmassert(shadow->capacity == block->capacity);
+	ShmListShadowChunk *chunk = LOCAL(shadow->chunks[ii >> SHM_LIST_SHADOW_CHUNK_LOG]);
+	if (chunk == NULL)
+		return NULL;
+	return &chunk->cells[ii & (SHM_LIST_SHADOW_CHUNK_SIZE - 1)];
+}
+
+static ShmListShadow *
+shm_list_new_shadow(ThreadContext *thread, ShmListBlock *block)
+{
+	shmassert(block->shadow == EMPTY_SHM);
+	ShmInt chunk_count = (block->capacity + SHM_LIST_SHADOW_CHUNK_SIZE - 1) >> SHM_LIST_SHADOW_CHUNK_LOG;
+	int size = (int)SHM_LIST_SHADOW_HEADER_SIZE + isizeof(ShmPointer) * chunk_count;
+	ShmListShadow *shadow = new_shm_refcounted_block(thread, &block->shadow, size,
+	                                                 SHM_TYPE_LIST_SHADOW, SHM_LIST_SHADOW_DEBUG_ID);
+	shadow->capacity = block->capacity;
+	for (ShmInt chunk_ii = 0; chunk_ii < chunk_count; ++chunk_ii)
+		shadow->chunks[chunk_ii] = EMPTY_SHM;
+	return shadow;
+}
+
+// Same as shm_list_shadow_cell, but allocates the shadow and its chunk when missing.
+static ShmListShadowCell *
+shm_list_make_shadow_cell(ThreadContext *thread, ShmListBlock *block, ShmInt ii)
+{
+	shmassert(ii >= 0 && ii < block->capacity);
+	ShmListShadow *shadow = LOCAL(block->shadow);
+	if (shadow == NULL)
+		shadow = shm_list_new_shadow(thread, block);
+	vl ShmPointer *chunk_shm = &shadow->chunks[ii >> SHM_LIST_SHADOW_CHUNK_LOG];
+	ShmListShadowChunk *chunk = LOCAL(*chunk_shm);
+	if (chunk == NULL)
+	{
+		chunk = new_shm_refcounted_block(thread, chunk_shm, isizeof(ShmListShadowChunk),
+		                                 SHM_TYPE_LIST_SHADOW_CHUNK, SHM_LIST_SHADOW_CHUNK_DEBUG_ID);
+		for (int cell_ii = 0; cell_ii < SHM_LIST_SHADOW_CHUNK_SIZE; ++cell_ii)
+		{
+			chunk->cells[cell_ii].new_data = EMPTY_SHM;
+			chunk->cells[cell_ii].has_new_data = false;
+			chunk->cells[cell_ii].changed = false;
+		}
+	}
+	return &chunk->cells[ii & (SHM_LIST_SHADOW_CHUNK_SIZE - 1)];
+}
+
+static bool
+shm_list_cell_is_changed(ShmListBlock *block, ShmInt ii)
+{
+	ShmListShadowCell *shadow_cell = shm_list_shadow_cell(block, ii);
+	return shadow_cell && shadow_cell->changed;
+}
+
 int
 shm_list_changes_push(ThreadContext *thread, ShmList *list, ShmListBlock *block, ShmInt block_index, ShmInt index)
 {
-	if (block->cells[index].changed)
+	if (shm_list_cell_is_changed(block, index))
 		return RESULT_OK;
 	ShmListChanges *changes = NULL;
 	shm_list_changes_check_inited(thread, list, &changes);
@@ -1051,8 +1399,65 @@ shm_list_changes_push(ThreadContext *thread, ShmList *list, ShmListBlock *block,
 	int idx = changes->count;
 	changes->cells[idx].block_index = block_index;
 	changes->cells[idx].item_index = index;
+	changes->cells[idx].count = 1;
+	changes->count++;
+	shm_list_make_shadow_cell(thread, block, index)->changed = true;
+	return RESULT_OK;
+}
+
+// Records count freshly appended cells as a single change, the caller marks the cells as changed.
+int
+shm_list_changes_push_range(ThreadContext *thread, ShmList *list, ShmInt block_index, ShmInt index, ShmInt count)
+{
+	ShmListChanges *changes = NULL;
+	shm_list_changes_check_inited(thread, list, &changes);
+	shmassert(changes->count < DELTA_ARRAY_SIZE);
+	if (changes->count >= DELTA_ARRAY_SIZE)
+		return RESULT_FAILURE;
+	int idx = changes->count;
+	changes->cells[idx].block_index = block_index;
+	changes->cells[idx].item_index = index;
+	changes->cells[idx].count = count;
 	changes->count++;
-	block->cells[index].changed = true;
+	return RESULT_OK;
+}
+
+// Records the cells [first, first + count) of the block and marks them as changed. Cells adjoining the previous entry
+// of the same block are merged into it, so a run of operations at one end of a block takes a single entry.
+static int
+shm_list_changes_push_cells(ThreadContext *thread, ShmList *list, ShmListBlock *block, ShmInt block_index,
+                            ShmInt first, ShmInt count)
+{
+	shmassert(count > 0 && first >= 0 && first + count <= block->capacity);
+	bool covered = true;
+	for (ShmInt ii = first; ii < first + count; ++ii)
+		if (!shm_list_cell_is_changed(block, ii))
+			covered = false;
+	if (covered)
+		return RESULT_OK;
+
+	ShmListChanges *changes = NULL;
+	shm_list_changes_check_inited(thread, list, &changes);
+	ShmListChangeItem *last = changes->count > 0 ? &changes->cells[changes->count - 1] : NULL;
+	if (last && last->block_index == block_index && last->item_index != -1 &&
+	    last->item_index + last->count <= block->capacity &&
+	    first <= last->item_index + last->count && first + count >= last->item_index)
+	{
+		ShmInt end = last->item_index + last->count;
+		if (first + count > end)
+			end = first + count;
+		if (first < last->item_index)
+			last->item_index = first;
+		last->count = end - last->item_index;
+	}
+	else
+	{
+		int status = shm_list_changes_push_range(thread, list, block_index, first, count);
+		if (status != RESULT_OK)
+			return status;
+	}
+	for (ShmInt ii = first; ii < first + count; ++ii)
+		shm_list_make_shadow_cell(thread, block, ii)->changed = true;
 	return RESULT_OK;
 }
 
@@ -1099,11 +1504,11 @@ shm_list_index_get_count(ShmListIndexItem *item, bool owned)
 ShmListCounts
 shm_list_get_fast_count(ThreadContext *thread, ShmList *list, bool owned)
 {
-	ShmListCounts rslt = { .count = p_atomic_int_get(&list->count), .deleted = p_atomic_int_get(&list->deleted) };
+	ShmListCounts rslt = { .count = shm_atomic_int_get_acquire(&list->count), .deleted = shm_atomic_int_get_acquire(&list->deleted) };
 	if (owned)
 	{
-		ShmInt new_count = p_atomic_int_get(&list->new_count);
-		ShmInt new_deleted = p_atomic_int_get(&list->new_deleted);
+		ShmInt new_count = shm_atomic_int_get_relaxed(&list->new_count); // owned by this thread
+		ShmInt new_deleted = shm_atomic_int_get_relaxed(&list->new_deleted);
 		if (new_count != -1)
 			rslt.count = new_count;
 		if (new_deleted != -1)
@@ -1112,13 +1517,91 @@ shm_list_get_fast_count(ThreadContext *thread, ShmList *list, bool owned)
 	return rslt;
 }
 
+// The slot of the block in its index page, the slots past index_size are only touched by the appending writer.
+static ShmListIndexItem *
+shm_list_index_slot(ShmListIndex *list_index, ShmInt block_index)
+{
+	shmassert(block_index >= 0 && (block_index >> SHM_LIST_INDEX_PAGE_LOG) < list_index->page_capacity);
+	ShmListIndexPage *page = LOCAL(list_index->pages[block_index >> SHM_LIST_INDEX_PAGE_LOG].page);
+	shmassert(page && page->type == SHM_TYPE_LIST_INDEX_PAGE);
+	return &page->cells[block_index & (SHM_LIST_INDEX_PAGE_SIZE - 1)];
+}
+
+static ShmListIndexItem *
+shm_list_index_item(ShmListIndex *list_index, ShmInt block_index)
+{
+	shmassert(block_index >= 0 && block_index < list_index->index_size);
+	return shm_list_index_slot(list_index, block_index);
+}
+
+static ShmInt
+shm_list_index_page_get_count(ShmListIndexPageRef *page_ref, bool owned)
+{
+	if (owned && page_ref->new_count != -1)
+		return page_ref->new_count;
+	return page_ref->count;
+}
+
+// Sets the owned count of the indexed block along with the sum of its page.
+static void
+shm_list_index_set_new_count(ShmListIndex *list_index, ShmInt block_index, ShmInt new_count)
+{
+	ShmListIndexItem *item = shm_list_index_item(list_index, block_index);
+	ShmListIndexPageRef *page_ref = &list_index->pages[block_index >> SHM_LIST_INDEX_PAGE_LOG];
+	ShmInt old_count = shm_list_index_get_count(item, true).count;
+	page_ref->new_count = shm_list_index_page_get_count(page_ref, true) + new_count - old_count;
+	item->new_count = new_count;
+}
+
+// Publishes the sum of the block's page after the commit or clears it for the rollback.
+static void
+shm_list_index_end_page(ShmListIndex *list_index, ShmInt block_index, bool commit)
+{
+	ShmListIndexPageRef *page_ref = &list_index->pages[block_index >> SHM_LIST_INDEX_PAGE_LOG];
+	if (page_ref->new_count == -1)
+		return;
+	if (commit)
+		shm_atomic_int_set_release(&page_ref->count, page_ref->new_count);
+	shm_atomic_int_set_release(&page_ref->new_count, -1);
+}
+
+// Recalculates the sums of all the pages from their items, for a freshly built index.
+static void
+shm_list_index_sum_pages(ShmListIndex *list_index)
+{
+	ShmInt page_count = (list_index->index_size + SHM_LIST_INDEX_PAGE_SIZE - 1) >> SHM_LIST_INDEX_PAGE_LOG;
+	for (ShmInt page_ii = 0; page_ii < page_count; ++page_ii)
+	{
+		ShmListIndexPageRef *page_ref = &list_index->pages[page_ii];
+		ShmInt last = (page_ii + 1) << SHM_LIST_INDEX_PAGE_LOG;
+		if (last > list_index->index_size)
+			last = list_index->index_size;
+		bool changed = false;
+		ShmInt count = 0;
+		ShmInt new_count = 0;
+		for (ShmInt block_index = page_ii << SHM_LIST_INDEX_PAGE_LOG; block_index < last; ++block_index)
+		{
+			ShmListIndexItem *item = shm_list_index_item(list_index, block_index);
+			count += item->count;
+			new_count += shm_list_index_get_count(item, true).count;
+			if (item->new_count != -1)
+				changed = true;
+		}
+		page_ref->count = count;
+		page_ref->new_count = changed ? new_count : -1;
+	}
+}
+
 ShmPointer
-shm_list_cell_get_data(ShmListCell *cell, bool owned)
+shm_list_cell_get_data(ShmListBlock *block, ShmInt ii, bool owned)
 {
-	if (owned && cell->has_new_data)
-		return cell->new_data;
-	else
-		return cell->data;
+	if (owned)
+	{
+		ShmListShadowCell *shadow_cell = shm_list_shadow_cell(block, ii);
+		if (shadow_cell && shadow_cell->has_new_data)
+			return shadow_cell->new_data;
+	}
+	return block->cells[ii].data;
 }
 void
 shm_list_block_verify_clean(ShmListBlock *block)
@@ -1130,6 +1613,7 @@ shm_list_block_verify_clean(ShmListBlock *block)
 		shmassert(block->refcount > 0);
 		shmassert(block->capacity >= block->count + block->deleted);
 		shmassert(block->capacity >= block->count);
+		shmassert(block->shadow == EMPTY_SHM);
 	}
 }
 
@@ -1166,12 +1650,16 @@ shm_list_get_count(ThreadContext *thread, ListRef list, ShmListCounts *result, b
 		ShmListIndex *index_block = (ShmListIndex *)top_block;
 		if (debug)
 		{
+			ShmInt page_counts = 0;
 			for (int i = 0; i < index_block->index_size; ++i)
 			{
-				ShmListCounts cnts = shm_list_index_get_count(&index_block->cells[i], owned);
+				ShmListCounts cnts = shm_list_index_get_count(shm_list_index_item(index_block, i), owned);
 				collected_counts.count += cnts.count;
 				collected_counts.deleted += cnts.deleted;
+				if ((i & (SHM_LIST_INDEX_PAGE_SIZE - 1)) == 0)
+					page_counts += shm_list_index_page_get_count(&index_block->pages[i >> SHM_LIST_INDEX_PAGE_LOG], owned);
 			}
+			shmassert(page_counts == collected_counts.count);
 		}
 	}
 	else
@@ -1211,8 +1699,7 @@ shm_list_get_block(int block_index, ShmListIndex *list_index, ShmListBlockRef fi
 		return first_block;
 	}
 
-	shmassert(block_index >= 0 && block_index < list_index->index_size);
-	ShmListIndexItem *item = &list_index->cells[block_index];
+	ShmListIndexItem *item = shm_list_index_item(list_index, block_index);
 	*index_item = item;
 	result.shared = item->block;
 	result.local = LOCAL(result.shared);
@@ -1224,31 +1711,24 @@ shm_list_get_block(int block_index, ShmListIndex *list_index, ShmListBlockRef fi
 	return result;
 }
 
-void
-shm_list_init_cell(ShmListCell *new_cell, ShmPointer container_shm)
-{
-	memclear(new_cell, sizeof(ShmListCell));
-	// ShmContainedBlock
-	new_cell->type = SHM_TYPE_LIST_CELL;
-	new_cell->size = sizeof(ShmListCell);
-	new_cell->container = container_shm;
-	// ShmCellBase
-	new_cell->data = EMPTY_SHM;
-	new_cell->has_new_data = false;
-	new_cell->new_data = EMPTY_SHM;
-	// ShmListCell
-	new_cell->changed = false;
-}
-
-void
-shm_list_validate_cell(ShmListCell *cell, ShmPointer container_shm)
+// Stores the value (consumed) as the new data of the cell ii, the caller records the cell in ShmListChanges.
+// The cells outside of both the committed and the owned windows of the block hold nothing worth keeping
+// (data is cleared by the commit of a removal, grown blocks are not initialized), they are cleared first.
+// Must be called before the block's new counts are changed by the operation.
+static void
+shm_list_stage_cell(ThreadContext *thread, ShmListBlock *block, ShmInt ii, ShmPointer value)
 {
-	// ShmContainedBlock
-	shmassert(cell->type == SHM_TYPE_LIST_CELL);
-	shmassert(cell->size == sizeof(ShmListCell));
-	shmassert(cell->container == container_shm);
-	if (cell->has_new_data == false)
-		shmassert(cell->new_data == EMPTY_SHM);
+	shmassert(ii >= 0 && ii < block->capacity);
+	ShmListShadowCell *shadow_cell = shm_list_make_shadow_cell(thread, block, ii);
+	ShmListCounts committed = shm_list_block_get_count(block, false);
+	ShmListCounts owned = shm_list_block_get_count(block, true);
+	if (!(ii >= committed.deleted && ii < committed.deleted + committed.count) &&
+	    !(ii >= owned.deleted && ii < owned.deleted + owned.count))
+		block->cells[ii].data = EMPTY_SHM;
+	if (shadow_cell->has_new_data && SBOOL(shadow_cell->new_data))
+		shm_pointer_empty(thread, &shadow_cell->new_data);
+	shadow_cell->new_data = value;
+	shadow_cell->has_new_data = true;
 }
 
 typedef struct {
@@ -1265,8 +1745,11 @@ typedef struct {
 
 // Almost never fails
 // Item is accessed by result.block[result.itemindex]
-shm_list__block_desc
-shm_list_get_item_desc(ThreadContext *thread, ListRef list, ShmInt itemindex, bool owned, shm_list__index_desc *index_desc)
+// Every block keeps its items in the [deleted, deleted + count) window of cells, blocks with no items are skipped.
+// With insert_position the index past the last item of a block resolves into that block instead of the next one.
+static shm_list__block_desc
+shm_list_get_item_desc_do(ThreadContext *thread, ListRef list, ShmInt itemindex, bool owned, bool insert_position,
+                          shm_list__index_desc *index_desc)
 {
 	if (index_desc) {
 		index_desc->index = NULL;
@@ -1303,22 +1786,29 @@ shm_list_get_item_desc(ThreadContext *thread, ListRef list, ShmInt itemindex, bo
 	else
 		shmassert_msg(false, "Invalid top_block->type");
 
-	ShmListCounts counts = shm_list_get_fast_count(thread, list.local, owned);
-
-	ShmInt local_ii = itemindex + counts.deleted;
+	ShmInt local_ii = itemindex;
 	int target_block_index = 0;
+	ShmListCounts block_counts = SHM_LIST_INVALID_COUNTS;
 	if (list_index)
 	{
-		for (int idx = 0; idx < block_count; ++idx)
+		// skip the whole pages first, then the blocks of the page
+		int page_count = (block_count + SHM_LIST_INDEX_PAGE_SIZE - 1) >> SHM_LIST_INDEX_PAGE_LOG;
+		int page_ii = 0;
+		for (; page_ii < page_count - 1; ++page_ii)
 		{
-			ShmListCounts block_counts = shm_list_index_get_count(&list_index->cells[idx], owned);
-			if (local_ii >= block_counts.count + block_counts.deleted)
-			{
-				local_ii = local_ii - (block_counts.count + block_counts.deleted);
-				target_block_index = idx + 1;
-			}
-			else
+			ShmInt page_total = shm_list_index_page_get_count(&list_index->pages[page_ii], owned);
+			if (local_ii < page_total || (insert_position && local_ii == page_total))
+				break;
+			local_ii -= page_total;
+		}
+		for (int idx = page_ii << SHM_LIST_INDEX_PAGE_LOG; idx < block_count; ++idx)
+		{
+			block_counts = shm_list_index_get_count(shm_list_index_item(list_index, idx), owned);
+			target_block_index = idx;
+			if (local_ii < block_counts.count || (insert_position && local_ii == block_counts.count))
 				break;
+			local_ii = local_ii - block_counts.count;
+			target_block_index = idx + 1;
 		}
 		if (target_block_index == list_index->index_size)
 		{
@@ -1332,10 +1822,21 @@ shm_list_get_item_desc(ThreadContext *thread, ListRef list, ShmInt itemindex, bo
 		shmassert(target_block_index >= 0 && target_block_index < list_index->index_size);
 	}
 	else
+	{
 		shmassert(target_block_index == 0);
+		block_counts = shm_list_block_get_count(first_block.local, owned);
+		if (local_ii > block_counts.count || (!insert_position && local_ii == block_counts.count))
+		{
+			shm_list__block_desc rslt;
+			rslt.block = NULL;
+			rslt.itemindex = -1;
+			return rslt;
+		}
+	}
 
 	ShmListIndexItem *index_item = NULL;
 	ShmListBlockRef block = shm_list_get_block(target_block_index, list_index, first_block, &index_item);
+	local_ii += block_counts.deleted;
 
 	if (index_desc)
 	{
@@ -1351,6 +1852,12 @@ shm_list_get_item_desc(ThreadContext *thread, ListRef list, ShmInt itemindex, bo
 	return rslt;
 }
 
+shm_list__block_desc
+shm_list_get_item_desc(ThreadContext *thread, ListRef list, ShmInt itemindex, bool owned, shm_list__index_desc *index_desc)
+{
+	return shm_list_get_item_desc_do(thread, list, itemindex, owned, false, index_desc);
+}
+
 // The only function that can return RESULT_INVALID as a valid result to indicate out of bound access
 // which is not a failure
 int
@@ -1390,15 +1897,10 @@ shm_list_get_item_do(ThreadContext *thread, ListRef list, ShmInt index, ShmPoint
 	int ii = block_desc.itemindex;
 	shmassert(ii >= 0 && ii < block_desc.block->capacity);
 
-	ShmListCell *cell = NULL;
-	cell = &block_desc.block->cells[block_desc.itemindex];
-	if (cell)
-	{
-		ShmPointer value = shm_list_cell_get_data(cell, owned);
-		if (acquire && SBOOL(value))
-			shm_pointer_acq(thread, value); // must acquire inside transient transaction
-		*result = value;
-	}
+	ShmPointer value = shm_list_cell_get_data(block_desc.block, ii, owned);
+	if (acquire && SBOOL(value))
+		shm_pointer_acq(thread, value); // must acquire inside transient transaction
+	*result = value;
 	transient_commit(thread);
 	return RESULT_OK;
 }
@@ -1415,7 +1917,69 @@ shm_list_acq_item(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer
 	return shm_list_get_item_do(thread, list, index, result, true);
 }
 
-// not tested yet
+// Acquires up to count items at index, index + step, ... under a single read lock. Only the first item is
+// looked up through the index, the rest are reached by walking the blocks. *fetched receives the number
+// of the items actually stored into the results, which is less than count past the end of the list.
+int
+shm_list_acq_range(ThreadContext *thread, ListRef list, ShmInt index, ShmInt step, ShmInt count,
+                   ShmPointer *results, ShmInt *fetched)
+{
+	shmassert(index >= 0 && step >= 1 && count >= 0);
+	*fetched = 0;
+	if_failure(
+		transaction_lock_read(thread, &list.local->base.lock, list.shared, CONTAINER_LIST, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_read_write_lock(thread, &list.local->base.lock);
+	bool owned = shm_cell_have_write_lock(thread, &list.local->base.lock);
+
+	ShmListCounts counts = shm_list_get_fast_count(thread, list.local, owned);
+	ShmInt available = index < counts.count ? (counts.count - index + step - 1) / step : 0;
+	if (count > available)
+		count = available;
+	if (count == 0)
+	{
+		transient_commit(thread);
+		return RESULT_OK;
+	}
+
+	shm_list__index_desc index_desc;
+	shm_list__block_desc block_desc = shm_list_get_item_desc(thread, list, index, owned, &index_desc);
+	shmassert(block_desc.block);
+	ShmListBlock *block = block_desc.block;
+	ShmInt ii = block_desc.itemindex;
+	int block_index = index_desc.cell_ii;
+	for (ShmInt i = 0; i < count; ++i)
+	{
+		ShmListCounts cnts = shm_list_block_get_count(block, owned);
+		while (ii >= cnts.count + cnts.deleted)
+		{
+			ii -= cnts.count + cnts.deleted;
+			block_index++;
+			shmassert(index_desc.index && block_index < index_desc.index->index_size);
+			ShmListIndexItem *index_item = NULL;
+			ShmListBlockRef no_block = { EMPTY_SHM, NULL };
+			block = shm_list_get_block(block_index, index_desc.index, no_block, &index_item).local;
+			shmassert(block);
+			cnts = shm_list_block_get_count(block, owned);
+			ii += cnts.deleted;
+		}
+		shmassert(ii >= cnts.deleted && ii < block->capacity);
+		ShmPointer value = shm_list_cell_get_data(block, ii, owned);
+		if (SBOOL(value))
+			shm_pointer_acq(thread, value); // must acquire inside transient transaction
+		results[i] = value;
+		ii += step;
+	}
+	*fetched = count;
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+// not tested yet
 int
 shm_list_set_item_raw(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer value, bool consume)
 {
@@ -1444,14 +2008,52 @@ shm_list_set_item_raw(ThreadContext *thread, ListRef list, ShmInt index, ShmPoin
 	int ii = block_desc.itemindex;
 	shmassert(ii >= 0 && ii < block_desc.block->capacity);
 
-	ShmListCell *cell = NULL;
-	cell = &block_desc.block->cells[block_desc.itemindex];
-	shm_list_validate_cell(cell, list.shared);
-	if (cell)
+	if (!consume)
+		shm_pointer_acq(thread, value);
+	shm_pointer_move(thread, &block_desc.block->cells[ii].data, &value);
+	return RESULT_OK;
+}
+
+// Stores count values starting at index of a list that is not shared yet, see new_shm_list_with_capacity.
+// Only the first item is looked up through the index, the rest are reached by walking the blocks. Values are consumed.
+int
+shm_list_set_range_raw(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer *values, ShmInt count)
+{
+	shmassert(index >= 0 && count >= 0);
+	// cannot manipulate transacted data here anyway
+	bool owned = false;
+	ShmListCounts counts = shm_list_get_fast_count(thread, list.local, owned);
+	if (index + count > counts.count)
 	{
-		if (!consume)
-			shm_pointer_acq(thread, value);
-		shm_pointer_move(thread, &cell->data, &value);
+		for (ShmInt i = 0; i < count; ++i)
+			if (SBOOL(values[i]))
+				shm_pointer_release(thread, values[i]);
+		return RESULT_INVALID;
+	}
+	if (count == 0)
+		return RESULT_OK;
+
+	shm_list__index_desc index_desc;
+	shm_list__block_desc block_desc = shm_list_get_item_desc(thread, list, index, owned, &index_desc);
+	shmassert(block_desc.block);
+	ShmListBlock *block = block_desc.block;
+	ShmInt ii = block_desc.itemindex;
+	int block_index = index_desc.cell_ii;
+	for (ShmInt i = 0; i < count; ++i)
+	{
+		ShmListCounts cnts = shm_list_block_get_count(block, owned);
+		while (ii >= cnts.count + cnts.deleted)
+		{
+			ii -= cnts.count + cnts.deleted;
+			block_index++;
+			shmassert(index_desc.index && block_index < index_desc.index->index_size);
+			block = LOCAL(shm_list_index_item(index_desc.index, block_index)->block);
+			shmassert(block);
+			cnts = shm_list_block_get_count(block, owned);
+			ii += cnts.deleted;
+		}
+		shm_pointer_move(thread, &block->cells[ii].data, &values[i]);
+		ii++;
 	}
 	return RESULT_OK;
 }
@@ -1499,18 +2101,9 @@ shm_list_set_item_do(ThreadContext *thread, ListRef list, ShmInt index, ShmPoint
 	int ii = block_desc.itemindex;
 	shmassert(ii >= 0 && ii < block_desc.block->capacity);
 
-	ShmListCell *cell = NULL;
-	cell = &block_desc.block->cells[block_desc.itemindex];
-	shm_list_validate_cell(cell, list.shared);
-	if (cell)
-	{
-		if (cell->has_new_data && shm_pointer_is_valid(cell->new_data))
-			shm_pointer_empty(thread, &cell->new_data);
-		if (!consume)
-			shm_pointer_acq(thread, value);
-		shm_pointer_move(thread, &cell->new_data, &value);
-		cell->has_new_data = true;
-	}
+	if (!consume)
+		shm_pointer_acq(thread, value);
+	shm_list_stage_cell(thread, block_desc.block, ii, value);
 
 	shm_list_changes_push(thread, list.local, block_desc.block, index_desc.cell_ii, ii);
 	transient_commit(thread);
@@ -1562,13 +2155,13 @@ shm_list_print_to_file(FILE *file, ShmList *list)
 	{
 		ShmListBlock *block;
 		if (list_index)
-			block = LOCAL(list_index->cells[idx].block);
+			block = LOCAL(shm_list_index_item(list_index, idx)->block);
 		else
 			block = first_block;
 
 		shmassert(block);
 
-		for (int item = 0; item < block->count; ++item)
+		for (int item = block->deleted; item < block->deleted + block->count; ++item)
 		{
 			ShmValueHeader *header = LOCAL(block->cells[item].data);
 			if (header)
@@ -1579,7 +2172,7 @@ shm_list_print_to_file(FILE *file, ShmList *list)
 					for (int i = 0; i < s.len; ++i)
 					{
 						// little endian
-						Py_UCS4 c = s.data[i];
+						Py_UCS4 c = shm_unicode_read(s.kind, s.data, i);
 						fputc(c & 0xFF, file);
 						fputc((c & 0xFF00) >> 8, file);
 					}
@@ -1629,18 +2222,127 @@ shm_list_new_block(ThreadContext *thread, ShmList *list, ShmPointer *result_shm,
 	rslt->deleted = 0;
 	rslt->new_deleted = -1;
 	rslt->count_added_after_relocation = 0;
+	rslt->shadow = EMPTY_SHM;
 	return rslt;
 }
 
-// 64k / 28 = 2300 max elements in the single block.
-// 512k / 12 = 24k max blocks in index.
-// 2.3k * 24k = 55M max elements, 1500 Mb of memory.
+// 64k / 8 = 8k max elements in the single block.
+// 256 blocks in an index page, 512k / 16 = 32k pages in the index.
+// 8k * 256 * 32k = 64G max elements, which is way beyond the memory we can map.
 ShmInt
 shm_list_max_index_size() {
 	shmassert(max_heap_block_size != 0);
-	ShmInt rslt = (max_heap_block_size - isizeof(ShmListIndexHeader)) / isizeof(ShmListIndexItem);
+	ShmInt rslt = (max_heap_block_size - (int)SHM_LIST_INDEX_HEADER_SIZE) / isizeof(ShmListIndexPageRef);
 	shmassert(rslt > 0);
-	return rslt;
+	return rslt * SHM_LIST_INDEX_PAGE_SIZE;
+}
+
+// Allocates the index root for index_size blocks with room for page_capacity pages, the pages themselves are
+// allocated by shm_list_index_alloc_pages.
+static ShmListIndex *
+shm_list_new_index(ThreadContext *thread, PShmPointer result_shm, ShmInt index_size, ShmInt page_capacity)
+{
+	shmassert(page_capacity > 0 && page_capacity <= shm_list_max_index_size() >> SHM_LIST_INDEX_PAGE_LOG);
+	shmassert(index_size >= 0 && index_size <= page_capacity << SHM_LIST_INDEX_PAGE_LOG);
+	int size = (int)SHM_LIST_INDEX_HEADER_SIZE + isizeof(ShmListIndexPageRef) * page_capacity;
+	ShmListIndex *list_index = new_shm_refcounted_block(thread, result_shm, size,
+	                                                    SHM_TYPE_LIST_INDEX, SHM_LIST_INDEX_DEBUG_ID);
+	list_index->index_size = index_size;
+	list_index->page_capacity = page_capacity;
+	for (ShmInt page_ii = 0; page_ii < page_capacity; ++page_ii)
+	{
+		ShmListIndexPageRef *page_ref = &list_index->pages[page_ii];
+		page_ref->count = 0;
+		page_ref->new_count = -1;
+		page_ref->page = EMPTY_SHM;
+	}
+	return list_index;
+}
+
+// Allocates the missing pages for the first block_count blocks.
+static void
+shm_list_index_alloc_pages(ThreadContext *thread, ShmListIndex *list_index, ShmInt block_count)
+{
+	ShmInt page_count = (block_count + SHM_LIST_INDEX_PAGE_SIZE - 1) >> SHM_LIST_INDEX_PAGE_LOG;
+	shmassert(page_count <= list_index->page_capacity);
+	for (ShmInt page_ii = 0; page_ii < page_count; ++page_ii)
+	{
+		ShmListIndexPageRef *page_ref = &list_index->pages[page_ii];
+		if (SBOOL(page_ref->page))
+			continue;
+		ShmListIndexPage *page = new_shm_refcounted_block(thread, &page_ref->page, isizeof(ShmListIndexPage),
+		                                                  SHM_TYPE_LIST_INDEX_PAGE, SHM_LIST_INDEX_PAGE_DEBUG_ID);
+		for (int item_ii = 0; item_ii < SHM_LIST_INDEX_PAGE_SIZE; ++item_ii)
+		{
+			ShmListIndexItem *item = &page->cells[item_ii];
+			item->count = 0;
+			item->new_count = -1;
+			item->deleted = 0;
+			item->new_deleted = -1;
+			item->block = EMPTY_SHM;
+		}
+	}
+}
+
+static ShmListIndex *
+shm_list_new_index_with_pages(ThreadContext *thread, PShmPointer result_shm, ShmInt index_size)
+{
+	ShmInt page_count = (index_size + SHM_LIST_INDEX_PAGE_SIZE - 1) >> SHM_LIST_INDEX_PAGE_LOG;
+	ShmListIndex *list_index = shm_list_new_index(thread, result_shm, index_size, page_count > 0 ? page_count : 1);
+	shm_list_index_alloc_pages(thread, list_index, index_size);
+	return list_index;
+}
+
+// Moves the block with its counts into the item of a new index, the old item is left empty.
+static void
+shm_list_index_move_item(ShmListIndexItem *dst, ShmListIndexItem *src)
+{
+	dst->count = src->count;
+	dst->new_count = src->new_count;
+	dst->deleted = src->deleted;
+	dst->new_deleted = src->new_deleted;
+	dst->block = src->block;
+	src->block = EMPTY_SHM;
+}
+
+// Makes room for block_count blocks without copying the index items: only the small array of page references
+// is reallocated when it runs out of capacity, doubling it, the pages are shared by the old and new root.
+// The caller fills the new items and only then publishes them by raising index_size.
+// Returns the current index root, which might be a new top block of the list.
+static ShmListIndex *
+shm_list_index_reserve(ThreadContext *thread, ListRef list, ShmListIndex *list_index, ShmInt block_count)
+{
+	shmassert(block_count <= shm_list_max_index_size());
+	ShmInt page_count = (block_count + SHM_LIST_INDEX_PAGE_SIZE - 1) >> SHM_LIST_INDEX_PAGE_LOG;
+	if (page_count > list_index->page_capacity)
+	{
+		ShmInt max_pages = shm_list_max_index_size() >> SHM_LIST_INDEX_PAGE_LOG;
+		ShmInt page_capacity = list_index->page_capacity;
+		while (page_capacity < page_count)
+			page_capacity *= 2;
+		if (page_capacity > max_pages)
+			page_capacity = max_pages;
+
+		ShmPointer new_index_shm = EMPTY_SHM;
+		ShmListIndex *new_index = shm_list_new_index(thread, &new_index_shm, list_index->index_size, page_capacity);
+		for (ShmInt page_ii = 0; page_ii < list_index->page_capacity; ++page_ii)
+		{
+			ShmListIndexPageRef *old_ref = &list_index->pages[page_ii];
+			ShmListIndexPageRef *new_ref = &new_index->pages[page_ii];
+			new_ref->count = old_ref->count;
+			new_ref->new_count = old_ref->new_count;
+			// dirty readers might still walk the old root, so the pages are shared rather than moved
+			if (SBOOL(old_ref->page))
+			{
+				shm_pointer_acq(thread, old_ref->page);
+				new_ref->page = old_ref->page;
+			}
+		}
+		shm_pointer_move(thread, &list.local->top_block, &new_index_shm);
+		list_index = new_index;
+	}
+	shm_list_index_alloc_pages(thread, list_index, block_count);
+	return list_index;
 }
 
 static ShmInt
@@ -1660,16 +2362,13 @@ new_shm_list_with_capacity(ThreadContext *thread, PShmPointer result, ShmInt tot
 	shmassert(index_capacity >= 0 && index_capacity < shm_list_max_index_size());
 	if (index_capacity > 1)
 	{
-		int index_size = isizeof(ShmListIndexHeader) + isizeof(ShmListIndexItem) * index_capacity;
 		ShmPointer new_index_shm = EMPTY_SHM;
-		ShmListIndex *new_index_block = new_shm_refcounted_block(thread, &new_index_shm, index_size,
-		                                                         SHM_TYPE_LIST_INDEX, SHM_LIST_INDEX_DEBUG_ID);
-		new_index_block->index_size = index_capacity;
-		for (int idx = 0; idx < index_size; idx++)
+		ShmListIndex *new_index_block = shm_list_new_index_with_pages(thread, &new_index_shm, index_capacity);
+		for (int idx = 0; idx < index_capacity; idx++)
 		{
 			int block_capacity = shm_list_max_block_capacity();
 			int block_count = block_capacity;
-			if (idx == index_size - 1)
+			if (idx == index_capacity - 1)
 				if (last_block_count != 0)
 				{
 					block_count = last_block_count;
@@ -1681,27 +2380,399 @@ new_shm_list_with_capacity(ThreadContext *thread, PShmPointer result, ShmInt tot
 			                                         block_capacity, SHM_LIST_BLOCK_DEBUG_ID);
 			block->count = block_count;
 			for (int bi = 0; bi < block_count; bi++)
-				shm_list_init_cell(&block->cells[bi], *result);
+				block->cells[bi].data = EMPTY_SHM;
+
+			ShmListIndexItem *index_item = shm_list_index_item(new_index_block, idx);
+			index_item->count = block_count;
+			index_item->new_count = -1;
+			index_item->deleted = 0;
+			index_item->new_deleted = -1;
+			index_item->block = block_shm; // consume
 		}
+		shm_list_index_sum_pages(new_index_block);
 		shm_pointer_move(thread, &list->top_block, &new_index_shm);
 		list->count = total_capacity;
 	}
 	else
 	{
+		// a single full block has no remainder
 		ShmPointer top_block_shm = EMPTY_SHM;
-		int top_block_capacity = last_block_count >= 8 ? last_block_count : 8;
+		int top_block_capacity = total_capacity >= 8 ? total_capacity : 8;
 		ShmListBlock *top_block = shm_list_new_block(thread, list, &top_block_shm,
 		                                             top_block_capacity, SHM_LIST_BLOCK_DEBUG_ID);
-		top_block->count = last_block_count;
+		top_block->count = total_capacity;
 		shm_pointer_move(thread, &list->top_block, &top_block_shm);
 		list->count = total_capacity;
 		for (int bi = 0; bi < total_capacity; bi++)
-			shm_list_init_cell(&top_block->cells[bi], *result);
+			top_block->cells[bi].data = EMPTY_SHM;
 	}
 	list->inited = true;
 	return list;
 }
 
+// Finds the tail block of the list, an empty list gets its first block of initial_capacity cells.
+// Returns NULL for a corrupted list.
+static ShmListBlock *
+shm_list_get_tail_block(ThreadContext *thread, ListRef list, ShmInt initial_capacity, shm_list__index_desc *index_desc)
+{
+	ShmListBlock *tail_block = NULL;
+	ShmRefcountedBlock *top_block = LOCAL(list.local->top_block);
+	if (top_block == NULL)
+	{
+		// create initial block
+		shmassert(list.local->inited == false);
+		ShmPointer new_top_shm = EMPTY_SHM;
+		tail_block = shm_list_new_block(thread, list.local, &new_top_shm, (int)initial_capacity, SHM_LIST_BLOCK_FIRST_DEBUG_ID);
+		index_desc->index = NULL;
+		index_desc->cell = NULL;
+		index_desc->cell_ii = 0;
+		index_desc->block_shm = new_top_shm;
+		shm_pointer_move(thread, &list.local->top_block, &new_top_shm);
+		list.local->inited = true;
+	}
+	else if (SHM_TYPE_LIST_BLOCK == top_block->type)
+	{
+		tail_block = (ShmListBlock *)top_block;
+		index_desc->index = NULL;
+		index_desc->cell = NULL;
+		index_desc->cell_ii = 0;
+		index_desc->block_shm = list.local->top_block;
+	}
+	else if (SHM_TYPE_LIST_INDEX == top_block->type)
+	{
+		index_desc->index = (ShmListIndex *)top_block;
+		shmassert(index_desc->index->index_size > 0);
+		index_desc->cell_ii = index_desc->index->index_size - 1;
+		index_desc->cell = shm_list_index_item(index_desc->index, index_desc->cell_ii);
+		tail_block = LOCAL(index_desc->cell->block);
+		index_desc->block_shm = index_desc->cell->block;
+		shm_list_validate_indexed_block(index_desc->cell, tail_block);
+	}
+	return tail_block;
+}
+
+// Replaces the block described by index_desc with a copy holding new_capacity cells.
+// Offsets of the existing cells are kept, so ShmListChanges stays valid and the reallocation needs no rollback.
+static ShmListBlock *
+shm_list_grow_block(ThreadContext *thread, ListRef list, ShmListBlock *old_block, ShmInt new_capacity,
+                    shm_list__index_desc *index_desc)
+{
+	ShmInt old_capacity = old_block->capacity;
+	ShmPointer new_block_shm = EMPTY_SHM;
+	int block_size = SHM_LIST_BLOCK_HEADER_SIZE + isizeof(ShmListCell) * (int)new_capacity;
+	int old_block_size = SHM_LIST_BLOCK_HEADER_SIZE + isizeof(ShmListCell) * (int)old_capacity;
+	shmassert(old_block_size < block_size);
+	shmassert(index_desc->block_shm != EMPTY_SHM);
+	int old_block_id = mm_block_get_debug_id(old_block, index_desc->block_shm);
+	shmassert(SHM_LIST_BLOCK_FIRST_DEBUG_ID == old_block_id || SHM_LIST_BLOCK_DEBUG_ID == old_block_id);
+
+	ShmListBlock *block = shm_list_new_block(thread, list.local, &new_block_shm, (int)new_capacity, old_block_id);
+	shmassert(block->size == block_size);
+
+	block->count = old_block->count;
+	block->new_count = old_block->new_count;
+	block->deleted = old_block->deleted;
+	block->new_deleted = old_block->new_deleted;
+
+	memcpy(CAST_VL(&block->cells[0]), CAST_VL(&old_block->cells[0]), (size_t)(isizeof(ShmListCell) * old_capacity));
+	memset(CAST_VL(&block->cells[old_capacity]), 0xF7, (size_t)(block_size - old_block_size));
+	ShmListShadow *old_shadow = LOCAL(old_block->shadow);
+	if (old_shadow)
+	{
+		// the chunks of the staged items keep their offsets, only the shadow root is reallocated
+		ShmListShadow *shadow = shm_list_new_shadow(thread, block);
+		ShmInt old_chunk_count = (old_capacity + SHM_LIST_SHADOW_CHUNK_SIZE - 1) >> SHM_LIST_SHADOW_CHUNK_LOG;
+		for (ShmInt chunk_ii = 0; chunk_ii < old_chunk_count; ++chunk_ii)
+			shm_pointer_move(thread, &shadow->chunks[chunk_ii], &old_shadow->chunks[chunk_ii]);
+		shm_pointer_empty(thread, &old_block->shadow);
+	}
+
+	index_desc->block_shm = new_block_shm;
+	if (index_desc->cell)
+		shm_pointer_move(thread, &index_desc->cell->block, &new_block_shm);
+	else
+		shm_pointer_move(thread, &list.local->top_block, &new_block_shm);
+	return block;
+}
+
+// Appends block_count empty blocks after the tail block, a single top block becomes the first index item.
+// The existing index is extended in place, so the growth never copies the index items.
+// The last new block gets last_capacity cells, the rest are of the maximal capacity.
+// index_desc is pointed to the first new block, which is returned.
+static ShmListBlock *
+shm_list_add_tail_blocks(ThreadContext *thread, ListRef list, int block_count, ShmInt last_capacity,
+                         shm_list__index_desc *index_desc)
+{
+	shmassert(block_count > 0);
+	ShmInt max_block_capacity = shm_list_max_block_capacity();
+	ShmListIndex *list_index = index_desc->index;
+	int old_index_size = list_index ? list_index->index_size : 1; // first block already exists
+	int new_index_size = old_index_size + block_count;
+	shmassert(new_index_size > 0 && new_index_size < shm_list_max_index_size());
+
+	if (list_index)
+	{
+		shmassert(list_index->index_size > 0);
+		list_index = shm_list_index_reserve(thread, list, list_index, new_index_size);
+	}
+	else
+	{
+		shmassert(list.local->top_block == index_desc->block_shm);
+		ShmListBlock *old_tail = LOCAL(list.local->top_block);
+		ShmPointer new_index_shm = EMPTY_SHM;
+		list_index = shm_list_new_index(thread, &new_index_shm, 1, 1);
+		shm_list_index_alloc_pages(thread, list_index, new_index_size);
+		ShmListIndexItem *first_item = shm_list_index_slot(list_index, 0);
+		first_item->count = old_tail->count;
+		first_item->new_count = old_tail->new_count;
+		first_item->deleted = old_tail->deleted;
+		first_item->new_deleted = old_tail->new_deleted;
+		// move top_block into first position
+		shm_pointer_move(thread, &first_item->block, &list.local->top_block);
+		shm_list_index_sum_pages(list_index);
+		// shm_pointer_move is not thread-safe on weak ordering arch
+		shm_pointer_move(thread, &list.local->top_block, &new_index_shm);
+	}
+
+	ShmListBlock *first_new_block = NULL;
+	for (int idx = old_index_size; idx < new_index_size; idx++)
+	{
+		ShmInt capacity = idx == new_index_size - 1 ? last_capacity : max_block_capacity;
+		ShmListIndexItem *index_item = shm_list_index_slot(list_index, idx);
+		ShmPointer new_tail_shm = EMPTY_SHM;
+		ShmListBlock *tail_block = shm_list_new_block(thread, list.local, &new_tail_shm, (int)capacity, SHM_LIST_BLOCK_DEBUG_ID);
+
+		if (first_new_block == NULL)
+		{
+			first_new_block = tail_block;
+			index_desc->block_shm = new_tail_shm;
+		}
+		index_item->count = tail_block->count;
+		index_item->new_count = tail_block->new_count;
+		index_item->deleted = tail_block->deleted;
+		index_item->new_deleted = tail_block->new_deleted;
+		shm_pointer_move(thread, &index_item->block, &new_tail_shm);
+	}
+	// the new items become visible to the readers only now
+	shm_atomic_int_set_release(&list_index->index_size, new_index_size);
+
+	index_desc->cell = shm_list_index_item(list_index, old_index_size);
+	index_desc->index = list_index;
+	index_desc->cell_ii = old_index_size;
+	return first_new_block;
+}
+
+// Walks the cells of a ShmListChangeItem block by block, [first, last) being the changed cells of the current block.
+// A range spanning several blocks only comes from shm_list_extend, which fills every block but the last one up to its capacity.
+// The whole block entries cover the committed window of each block, cells staged within the transaction have entries of their own.
+typedef struct {
+	ShmListBlockRef block;
+	ShmListIndexItem *index_item;
+	ShmInt block_index;
+	ShmInt first;
+	ShmInt last;
+	ShmInt remaining;
+	bool whole_blocks;
+	bool started;
+} shm_list__change_range;
+
+static void
+shm_list_change_range_init(shm_list__change_range *range, ShmListChangeItem *item)
+{
+	range->block.shared = EMPTY_SHM;
+	range->block.local = NULL;
+	range->index_item = NULL;
+	range->block_index = item->block_index;
+	range->whole_blocks = item->item_index == -1;
+	range->first = item->item_index;
+	range->last = item->item_index;
+	range->remaining = item->count;
+	range->started = false;
+	shmassert(item->count > 0);
+}
+
+static bool
+shm_list_change_range_next(shm_list__change_range *range, ShmListIndex *list_index, ShmListBlockRef first_block)
+{
+	if (range->remaining <= 0)
+		return false;
+	if (range->started)
+	{
+		range->block_index++;
+		range->first = 0;
+	}
+	range->started = true;
+	range->index_item = NULL;
+	range->block = shm_list_get_block((int)range->block_index, list_index, first_block, &range->index_item);
+	shmassert(range->block.local);
+	if (range->whole_blocks)
+	{
+		ShmListCounts committed = shm_list_block_get_count(range->block.local, false);
+		range->first = committed.deleted;
+		range->last = committed.deleted + committed.count;
+		range->remaining--;
+		return true;
+	}
+	ShmInt capacity = range->block.local->capacity;
+	shmassert(range->first >= 0 && range->first < capacity);
+	range->last = range->remaining < capacity - range->first ? range->first + range->remaining : capacity;
+	range->remaining -= range->last - range->first;
+	return true;
+}
+
+// Cuts the cell ranges crossing into the block at boundary, the rest of such a range becomes an entry of its own.
+// Needed before the blocks get shifted or resized, the multi-block ranges rely on the capacities of the blocks they span.
+static void
+shm_list_changes_split_ranges(ThreadContext *thread, ShmList *list, ShmListIndex *list_index, ShmListBlockRef first_block,
+                              int boundary)
+{
+	ShmListChanges *changes = LOCAL(list->changes_shm);
+	if (changes == NULL)
+		return;
+	int count = changes->count;
+	for (int i = 0; i < count; ++i)
+	{
+		ShmListChangeItem *item = &changes->cells[i];
+		if (item->item_index == -1 || item->block_index >= boundary)
+			continue;
+		shm_list__change_range range;
+		shm_list_change_range_init(&range, item);
+		ShmInt head = 0;
+		while (shm_list_change_range_next(&range, list_index, first_block) && range.block_index < boundary)
+			head += range.last - range.first;
+		if (head < item->count)
+		{
+			ShmInt rest = item->count - head;
+			item->count = head;
+			shm_list_changes_push_range(thread, list, boundary, 0, rest);
+		}
+	}
+}
+
+// Inserts an empty block of the given capacity at the position of the index, a single top block becomes an index of two.
+// The ShmListChanges entries are moved along with the blocks they point to, index_desc is pointed to the new block.
+static ShmListBlock *
+shm_list_insert_block(ThreadContext *thread, ListRef list, int position, ShmInt capacity, shm_list__index_desc *index_desc)
+{
+	ShmListIndex *old_index = NULL;
+	ShmListBlockRef first_block = { EMPTY_SHM, NULL };
+	ShmRefcountedBlock *top_block = LOCAL(list.local->top_block);
+	shmassert(top_block);
+	if (SHM_TYPE_LIST_INDEX == top_block->type)
+		old_index = (ShmListIndex *)top_block;
+	else
+	{
+		first_block.local = (ShmListBlock *)top_block;
+		first_block.shared = list.local->top_block;
+	}
+	int old_index_capacity = old_index ? old_index->index_size : 1;
+	int new_index_capacity = old_index_capacity + 1;
+	shmassert(position >= 0 && position <= old_index_capacity);
+	shmassert(new_index_capacity < shm_list_max_index_size());
+
+	shm_list_changes_split_ranges(thread, list.local, old_index, first_block, position);
+	ShmListChanges *changes = LOCAL(list.local->changes_shm);
+	for (int i = 0; changes && i < changes->count; ++i)
+	{
+		ShmListChangeItem *item = &changes->cells[i];
+		if (item->block_index >= position)
+			item->block_index++;
+		else if (item->item_index == -1 && item->block_index + item->count > position)
+			item->count++; // the committed window of the new block is empty
+	}
+
+	ShmPointer new_block_shm = EMPTY_SHM;
+	ShmListBlock *new_block = shm_list_new_block(thread, list.local, &new_block_shm, (int)capacity, SHM_LIST_BLOCK_DEBUG_ID);
+	shmassert(new_block->count == 0 && new_block->new_count == -1);
+	ShmListIndex *new_index_block = NULL;
+	ShmListIndexItem *new_item = NULL;
+	if (old_index && position == old_index_capacity)
+	{
+		// appending a block extends the index in place
+		new_index_block = shm_list_index_reserve(thread, list, old_index, new_index_capacity);
+		new_item = shm_list_index_slot(new_index_block, position);
+		shm_pointer_move(thread, &new_item->block, &new_block_shm);
+		shm_atomic_int_set_release(&new_index_block->index_size, new_index_capacity);
+	}
+	else
+	{
+		ShmPointer new_index_shm = EMPTY_SHM;
+		new_index_block = shm_list_new_index_with_pages(thread, &new_index_shm, new_index_capacity);
+		if (old_index)
+		{
+			// the references are moved from the original index, because they are contained in the new index now
+			for (int i = 0; i < old_index_capacity; i++)
+				shm_list_index_move_item(shm_list_index_item(new_index_block, i < position ? i : i + 1),
+				                         shm_list_index_item(old_index, i));
+		}
+		else
+		{
+			ShmListIndexItem *item = shm_list_index_item(new_index_block, position == 0 ? 1 : 0);
+			shm_pointer_move(thread, &item->block, &list.local->top_block);
+			item->count = first_block.local->count;
+			item->new_count = first_block.local->new_count;
+			item->deleted = first_block.local->deleted;
+			item->new_deleted = first_block.local->new_deleted;
+		}
+		new_item = shm_list_index_item(new_index_block, position);
+		shm_pointer_move(thread, &new_item->block, &new_block_shm);
+		shm_list_index_sum_pages(new_index_block);
+		// shm_pointer_move is not thread-safe on weak ordering arch
+		shm_pointer_move(thread, &list.local->top_block, &new_index_shm);
+	}
+
+	index_desc->index = new_index_block;
+	index_desc->cell = new_item;
+	index_desc->cell_ii = position;
+	index_desc->block_shm = new_item->block;
+	return new_block;
+}
+
+// Sets the owned counts of the block changed by an insertion or a removal, along with its index item and the list totals.
+static void
+shm_list_update_block_counts(ThreadContext *thread, ListRef list, ShmListBlock *block, int block_index,
+                             ShmInt new_count, ShmInt new_deleted)
+{
+	ShmListCounts old_counts = shm_list_block_get_count(block, true);
+	ShmListIndex *list_index = NULL;
+	ShmListIndexItem *index_item = NULL;
+	ShmRefcountedBlock *top_block = LOCAL(list.local->top_block);
+	if (SHM_TYPE_LIST_INDEX == top_block->type)
+	{
+		list_index = (ShmListIndex *)top_block;
+		index_item = shm_list_index_item(list_index, block_index);
+		shm_list_validate_indexed_block(index_item, block);
+	}
+	else
+		shmassert(block_index == 0 && (ShmListBlock *)top_block == block);
+
+	ShmListCounts total_counts = shm_list_get_fast_count(thread, list.local, true);
+	if (new_count != old_counts.count)
+	{
+		block->new_count = new_count;
+		if (index_item)
+			shm_list_index_set_new_count(list_index, block_index, new_count);
+		shm_atomic_int_set_release(&list.local->new_count, total_counts.count + new_count - old_counts.count);
+	}
+	if (new_deleted != old_counts.deleted)
+	{
+		block->new_deleted = new_deleted;
+		if (index_item)
+			index_item->new_deleted = new_deleted;
+		shm_atomic_int_set_release(&list.local->new_deleted, total_counts.deleted + new_deleted - old_counts.deleted);
+	}
+}
+
+// Stages the cell dst of the block with an acquired copy of the owned value of the cell src.
+static void
+shm_list_stage_copy(ThreadContext *thread, ShmListBlock *block, ShmInt dst, ShmInt src)
+{
+	ShmPointer value = shm_list_cell_get_data(block, src, true);
+	if (SBOOL(value))
+		shm_pointer_acq(thread, value);
+	shm_list_stage_cell(thread, block, dst, value);
+}
+
 static int shm_list_append_do__old_count;
 static int shm_list_append_do__new_count;
 static ShmListBlock *shm_list_append_do__last_block;
@@ -1748,51 +2819,15 @@ shm_list_append_do(ThreadContext *thread, ListRef list, ShmPointer value, bool c
 			.block_shm = EMPTY_SHM,
 		};
 
-		ShmRefcountedBlock *top_block = LOCAL(list.local->top_block);
-		if (top_block == NULL)
-		{
-			// create initial block
-			shmassert(list.local->inited == false);
-			ShmPointer new_top_shm = EMPTY_SHM;
-			tail_block = shm_list_new_block(thread, list.local, &new_top_shm, 8, SHM_LIST_BLOCK_FIRST_DEBUG_ID);
-			tail_block_shm = new_top_shm;
-			top_block = (ShmRefcountedBlock *)tail_block;
-			index_desc.index = NULL;
-			index_desc.cell = NULL;
-			index_desc.cell_ii = 0;
-			index_desc.block_shm = new_top_shm;
-			shm_pointer_move(thread, &list.local->top_block, &new_top_shm);
-			list.local->inited = true;
-		}
-		else if (SHM_TYPE_LIST_BLOCK == top_block->type)
-		{
-			tail_block = (ShmListBlock *)top_block;
-			tail_block_shm = list.local->top_block;
-			index_desc.index = NULL;
-			index_desc.cell = NULL;
-			index_desc.cell_ii = 0;
-			index_desc.block_shm = tail_block_shm;
-		}
-		else if (SHM_TYPE_LIST_INDEX == top_block->type)
-		{
-			index_desc.index = (ShmListIndex *)top_block;
-			index_desc.cell_ii = index_desc.index->index_size - 1;
-			index_desc.cell = &index_desc.index->cells[index_desc.cell_ii];
-			shmassert(index_desc.index->index_size > 0);
-			shmassert(isizeof(ShmListIndexHeader) + ((intptr_t)index_desc.cell - (intptr_t)&index_desc.index->cells[0]) <
-					index_desc.index->size);
-			tail_block = LOCAL(index_desc.cell->block);
-			tail_block_shm = index_desc.cell->block;
-			index_desc.block_shm = tail_block_shm;
-			shm_list_validate_indexed_block(index_desc.cell, tail_block);
-		}
-		else
+		tail_block = shm_list_get_tail_block(thread, list, 8, &index_desc);
+		if (tail_block == NULL)
 		{
 			shmassert(false);
 			if (consume && SBOOL(value))
 				shm_pointer_release(thread, value);
 			return RESULT_FAILURE;
 		}
+		tail_block_shm = index_desc.block_shm;
 
 		ShmInt old_capacity = tail_block->capacity;
 		ShmListCounts old_cnts = shm_list_block_get_count(tail_block, owned);
@@ -1818,7 +2853,6 @@ shm_list_append_do(ThreadContext *thread, ListRef list, ShmPointer value, bool c
 			}
 		}
 
-		ShmInt max_index_size = shm_list_max_index_size();
 		ShmInt max_block_capacity = shm_list_max_block_capacity();
 
 		if (old_cnts.count + old_cnts.deleted >= old_capacity)
@@ -1830,63 +2864,12 @@ shm_list_append_do(ThreadContext *thread, ListRef list, ShmPointer value, bool c
 			if (old_capacity >= max_block_capacity)
 			{
 				// create a new block and rebuild index
-				ShmPointer new_tail_shm = EMPTY_SHM;
-				ShmListBlock *old_tail = tail_block;
-				ShmListIndex *old_index = index_desc.index;
-				tail_block = shm_list_new_block(thread, list.local, &new_tail_shm, max_block_capacity / 4, SHM_LIST_BLOCK_DEBUG_ID);
-
-				int new_index_capacity = 2; // first block already exists
-				if (index_desc.index)
-					new_index_capacity = index_desc.index->index_size + 1;
-				shmassert(new_index_capacity > 0 && new_index_capacity < max_index_size);
-				// alignment is not a problem here because everything is ShmInt
-				int index_size = isizeof(ShmListIndexHeader) + isizeof(ShmListIndexItem) * new_index_capacity;
-				ShmPointer new_index_shm = EMPTY_SHM;
-				ShmListIndex *new_index_block = new_shm_refcounted_block(thread, &new_index_shm, index_size, SHM_TYPE_LIST_INDEX, SHM_LIST_INDEX_DEBUG_ID);
-				new_index_block->index_size = new_index_capacity;
-
-				int last_idx = new_index_capacity - 1;
-				// clone the old index into new one
-				if (old_index)
-				{
-					shmassert(index_desc.index->index_size > 0);
-					memcpy(CAST_VL(&new_index_block->cells[0]), CAST_VL(&old_index->cells[0]),
-					       sizeof(ShmListIndexItem) * (puint)old_index->index_size);
-					// Clear the references from original index, because they are contained in the new index now
-					for (int i = 0; i < old_index->index_size; i++)
-						old_index->cells[i].block = EMPTY_SHM;
-				}
-				else
-				{
-					shmassert(list.local->top_block == index_desc.block_shm);
-					// move top_block into first position
-					shm_pointer_move(thread, &new_index_block->cells[0].block, &list.local->top_block);
-					new_index_block->cells[0].count = old_tail->count;
-					new_index_block->cells[0].new_count = old_tail->new_count;
-					new_index_block->cells[0].deleted = old_tail->deleted;
-					new_index_block->cells[0].new_deleted = old_tail->new_deleted;
-				}
-
-				memset(CAST_VL(&new_index_block->cells[last_idx]), 0xF9, sizeof(ShmListIndexItem));
-
-				new_index_block->cells[last_idx].block = new_tail_shm; // consume
-				new_index_block->cells[last_idx].count = tail_block->count;
-				new_index_block->cells[last_idx].new_count = tail_block->new_count;
-				new_index_block->cells[last_idx].deleted = tail_block->deleted;
-				new_index_block->cells[last_idx].new_deleted = tail_block->new_deleted;
-
+				tail_block = shm_list_add_tail_blocks(thread, list, 1, max_block_capacity / 4, &index_desc);
 				// index_item, list_index, old_count local vars should stay in sync
-				index_desc.cell = &new_index_block->cells[last_idx];
-				index_desc.index = new_index_block;
-				index_desc.cell_ii = last_idx;
-				index_desc.block_shm = new_tail_shm;
 				old_cnts.count = tail_block->count;
 				old_cnts.deleted = tail_block->deleted;
 				shmassert(old_cnts.count == 0);
 				shmassert(old_cnts.deleted == 0);
-
-				// shm_pointer_move is not thread-safe on weak ordering arch
-				shm_pointer_move(thread, &list.local->top_block, &new_index_shm);
 			}
 			else
 			{
@@ -1900,61 +2883,33 @@ shm_list_append_do(ThreadContext *thread, ListRef list, ShmPointer value, bool c
 				if (new_capacity > max_block_capacity)
 					new_capacity = max_block_capacity;
 
-				ShmPointer new_tail_shm = EMPTY_SHM;
-				int block_size = SHM_LIST_BLOCK_HEADER_SIZE + isizeof(ShmListCell) * new_capacity;
-				int old_block_size = SHM_LIST_BLOCK_HEADER_SIZE + isizeof(ShmListCell) * old_capacity;
-				shmassert(old_block_size < block_size);
-				ShmListBlock *old_tail_block = tail_block;
-				shmassert(index_desc.block_shm != EMPTY_SHM);
-				int old_tail_block_id = mm_block_get_debug_id(old_tail_block, index_desc.block_shm);
-				shmassert(SHM_LIST_BLOCK_FIRST_DEBUG_ID == old_tail_block_id || SHM_LIST_BLOCK_DEBUG_ID == old_tail_block_id);
-
-				tail_block = shm_list_new_block(thread, list.local, &new_tail_shm, new_capacity, old_tail_block_id);
-				shmassert(tail_block->size == block_size);
-
+				tail_block = shm_list_grow_block(thread, list, tail_block, new_capacity, &index_desc);
 				shm_list_append_do__last_block = tail_block;
-
-				tail_block->count = old_tail_block->count;
-				tail_block->new_count = old_tail_block->new_count;
-				tail_block->deleted = old_tail_block->deleted;
-				tail_block->new_deleted = old_tail_block->new_deleted;
-
-				memcpy(CAST_VL(&tail_block->cells[0]), CAST_VL(&old_tail_block->cells[0]), (size_t)(isizeof(ShmListCell) * old_capacity));
-				memset(CAST_VL(&tail_block->cells[old_capacity]), 0xF7, (size_t)(block_size - old_block_size));
-
-				if (index_desc.cell)
-					shm_pointer_move(thread, &index_desc.cell->block, &new_tail_shm);
-				else
-					shm_pointer_move(thread, &list.local->top_block, &new_tail_shm);
 			}
 		}
 
 		int idx = old_cnts.count + old_cnts.deleted;
 		shmassert(idx < tail_block->capacity);
-		ShmListCell *new_cell = &tail_block->cells[idx];
-		shm_list_init_cell(new_cell, list.shared);
-		shm_list_validate_cell(new_cell, list.shared);
 
-		// update cell
+		// update cell, it might still hold the committed data of an item popped within this transaction
 		if (!consume && SBOOL(value))
 			shm_pointer_acq(thread, value);
-		shm_pointer_move(thread, &new_cell->new_data, &value);
-		new_cell->has_new_data = true;
+		shm_list_stage_cell(thread, tail_block, idx, value);
 		// update block
 		tail_block->new_count = old_cnts.count + 1;
 		// update index
 		if (index_desc.cell)
-			index_desc.cell->new_count = old_cnts.count + 1;
+			shm_list_index_set_new_count(index_desc.index, index_desc.cell_ii, old_cnts.count + 1);
 		// update list
 		ShmListCounts old_total_counts = shm_list_get_fast_count(thread, list.local, owned);
-		p_atomic_int_set(&list.local->new_count, old_total_counts.count + 1);
+		shm_atomic_int_set_release(&list.local->new_count, old_total_counts.count + 1);
 
 		if (out_index)
 			*out_index = old_total_counts.count;
 
 		shm_list_append_do__new_count = old_cnts.count + 1;
 
-		shm_list_changes_push(thread, list.local, tail_block, index_desc.cell_ii, idx);
+		shm_list_changes_push_cells(thread, list.local, tail_block, index_desc.cell_ii, idx, 1);
 		transient_commit(thread);
 		// rslt->local = new_cell;
 
@@ -1974,16 +2929,14 @@ shm_list_append_consume(ThreadContext *thread, ListRef list, ShmPointer value, S
 	return shm_list_append_do(thread, list, value, true, index);
 }
 
-// result is acquired
+// Appends count values within a single transient transaction. The tail block and the index are grown to the final
+// capacity up front, then the cells are filled in a single pass and the whole range is recorded as one ShmListChanges entry.
+// Values are not consumed.
 int
-shm_list_popleft(ThreadContext *thread, ListRef list, ShmPointer *result, bool *valid)
+shm_list_extend(ThreadContext *thread, ListRef list, ShmPointer *values, ShmInt count)
 {
-	shm_pointer_empty(thread, result);
-	if (valid)
-		*valid = false;
-
+	shmassert(count >= 0);
 	shm_list_changes_check_inited(thread, list.local, NULL);
-
 	bool lock_taken = false;
 	if_failure(
 		transaction_lock_write(thread, &list.local->base.lock, list.shared, CONTAINER_LIST, &lock_taken),
@@ -1992,37 +2945,29 @@ shm_list_popleft(ThreadContext *thread, ListRef list, ShmPointer *result, bool *
 			return status;
 		}
 	);
-
 	shm_cell_check_write_lock(thread, &list.local->base.lock);
-	// Below we ensure that the block has no previous transaction data if lock_taken = true.
-	// We might consider checking all the blocks this way.
-
-	bool owned = true;
-	// similar to get_item_do
-	ShmListCounts count = shm_list_get_fast_count(thread, list.local, owned);
-
-	// Sleep(1000*1000); // producer_consumer.py leak trigger
-	if (count.count == 0)
+	if (count == 0)
 	{
 		transient_commit(thread);
 		return RESULT_OK;
 	}
 
+	bool owned = true;
+	ShmInt max_block_capacity = shm_list_max_block_capacity();
+	ShmInt initial_capacity = count < max_block_capacity ? count : max_block_capacity;
+	if (initial_capacity < 8)
+		initial_capacity = 8;
 	shm_list__index_desc index_desc;
-	shm_list__block_desc block_desc = shm_list_get_item_desc(thread, list, 0, owned, &index_desc);
-	if (block_desc.itemindex == -1)
+	ShmListBlock *tail_block = shm_list_get_tail_block(thread, list, initial_capacity, &index_desc);
+	if (tail_block == NULL)
 	{
-		transient_commit(thread);
-		return RESULT_OK;
+		shmassert(false);
+		return RESULT_FAILURE;
 	}
-	shmassert(block_desc.block);
-
-	if (index_desc.index)
-		shmassert(index_desc.cell);
 	if (lock_taken)
 	{
-		// verify it has no data from previous transactions, see desc at the begginning of func.
-		shm_list_block_verify_clean(block_desc.block);
+		// verify it has no data from previous transactions, see shm_list_append_do.
+		shm_list_block_verify_clean(tail_block);
 		if (index_desc.index)
 		{
 			shmassert(index_desc.cell->new_count == -1);
@@ -2030,49 +2975,388 @@ shm_list_popleft(ThreadContext *thread, ListRef list, ShmPointer *result, bool *
 		}
 	}
 
-	ShmListCounts old_cnts = shm_list_block_get_count(block_desc.block, owned);
-	if (block_desc.itemindex >= old_cnts.count + old_cnts.deleted)
+	ShmListCounts tail_cnts = shm_list_block_get_count(tail_block, owned);
+	ShmInt used = tail_cnts.count + tail_cnts.deleted;
+	if (used + count > tail_block->capacity && tail_block->capacity < max_block_capacity)
 	{
-		shmassert(false); // should've been handled by shm_list_get_item_desc
-		transient_commit(thread);
-		return RESULT_OK;
+		ShmInt new_capacity = used + count < max_block_capacity ? used + count : max_block_capacity;
+		tail_block = shm_list_grow_block(thread, list, tail_block, new_capacity, &index_desc);
+	}
+	ShmInt tail_free = tail_block->capacity - used;
+	int block_index = index_desc.cell_ii;
+	if (count > tail_free)
+	{
+		// every new block but the last one is filled up
+		ShmInt rest = count - tail_free;
+		int block_count = (int)((rest + max_block_capacity - 1) / max_block_capacity);
+		ShmInt last_count = rest - (block_count - 1) * max_block_capacity;
+		shm_list_add_tail_blocks(thread, list, block_count, last_count >= 8 ? last_count : 8, &index_desc);
 	}
-	int ii = block_desc.itemindex;
-	shmassert(ii >= 0 && ii < block_desc.block->capacity);
 
-	ShmListCell *cell = &block_desc.block->cells[ii];
-	shm_list_validate_cell(cell, list.shared);
-	// Update cell
-	// shm_pointer_empty(thread, &cell->new_data);
-	if (cell->has_new_data)
-		shm_pointer_move(thread, result, &cell->new_data);
-	else
+	ShmListIndex *list_index = index_desc.index;
+	ShmListBlockRef first_block = { EMPTY_SHM, NULL };
+	if (list_index == NULL)
 	{
-		*result = cell->data;
-		shm_pointer_acq(thread, *result);
-		cell->new_data = EMPTY_SHM;
+		first_block.local = tail_block;
+		first_block.shared = list.local->top_block;
 	}
-	cell->has_new_data = true;
-	// Update block
-	block_desc.block->new_count = old_cnts.count - 1;
-	block_desc.block->new_deleted = old_cnts.deleted + 1;
-	// Update index
-	if (index_desc.cell)
+	ShmInt ii = used;
+	if (tail_free == 0)
 	{
-		index_desc.cell->new_count = old_cnts.count - 1;
-		index_desc.cell->new_deleted = old_cnts.deleted + 1;
+		block_index++;
+		ii = 0;
 	}
-	// Update list
-	ShmListCounts old_total_counts = shm_list_get_fast_count(thread, list.local, owned);
-	p_atomic_int_set(&list.local->new_count, old_total_counts.count - 1);
-	p_atomic_int_set(&list.local->new_deleted, old_total_counts.deleted + 1);
-
-	shm_list_changes_push(thread, list.local, block_desc.block, index_desc.cell_ii, ii);
-
-	transient_commit(thread);
-	shmassert(SBOOL(*result));
-	if (valid)
-		*valid = true;
+	int first_block_index = block_index;
+	ShmInt first_ii = ii;
+	ShmInt filled = 0;
+	while (filled < count)
+	{
+		ShmListIndexItem *index_item = NULL;
+		ShmListBlock *block = shm_list_get_block(block_index, list_index, first_block, &index_item).local;
+		shmassert(block);
+		ShmListCounts cnts = shm_list_block_get_count(block, owned);
+		shmassert(ii == cnts.count + cnts.deleted);
+		ShmInt n = block->capacity - ii;
+		if (n > count - filled)
+			n = count - filled;
+		for (ShmInt i = 0; i < n; ++i)
+		{
+			ShmPointer value = values[filled + i];
+			if (SBOOL(value))
+				shm_pointer_acq(thread, value);
+			shm_list_stage_cell(thread, block, ii + i, value);
+			shm_list_make_shadow_cell(thread, block, ii + i)->changed = true; // covered by the range entry
+		}
+		// update block
+		block->new_count = cnts.count + n;
+		// update index
+		if (index_item)
+			shm_list_index_set_new_count(list_index, block_index, cnts.count + n);
+		filled += n;
+		block_index++;
+		ii = 0;
+	}
+	// update list
+	ShmListCounts old_total_counts = shm_list_get_fast_count(thread, list.local, owned);
+	shm_atomic_int_set_release(&list.local->new_count, old_total_counts.count + count);
+
+	shm_list_changes_push_range(thread, list.local, first_block_index, first_ii, count);
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+// Inserts at either end of a block holding this many items go into a new block instead of shifting the items.
+#define SHM_LIST_SHIFT_LIMIT 64
+
+// Inserts the value before the item at index, a negative index counts from the end, the index is clamped to the list
+// bounds like for list.insert(). The value is not consumed.
+// Every block keeps free cells at both ends of its items window, the items are shifted towards the closer end having
+// room, so the inserts at either end of a block are O(1) and the ones in the middle are bounded by the block capacity.
+// An insert at the end of a large block having no room at that end goes into a new neighbour block. Otherwise a full block
+// is grown, and a full block of the maximal capacity is split in halves.
+int
+shm_list_insert(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer value)
+{
+	shm_list_changes_check_inited(thread, list.local, NULL);
+	bool lock_taken = false;
+	if_failure(
+		transaction_lock_write(thread, &list.local->base.lock, list.shared, CONTAINER_LIST, &lock_taken),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_write_lock(thread, &list.local->base.lock);
+
+	bool owned = true;
+	ShmListCounts total_counts = shm_list_get_fast_count(thread, list.local, owned);
+	if (index < 0)
+		index += total_counts.count;
+	if (index < 0)
+		index = 0;
+	if (index > total_counts.count)
+		index = total_counts.count;
+
+	shm_list__index_desc index_desc;
+	if (LOCAL(list.local->top_block) == NULL)
+		shm_list_get_tail_block(thread, list, 8, &index_desc);
+	shm_list__block_desc block_desc = shm_list_get_item_desc_do(thread, list, index, owned, true, &index_desc);
+	shmassert(block_desc.block && block_desc.itemindex != -1);
+	ShmListBlock *block = block_desc.block;
+	int block_index = index_desc.cell_ii;
+	ShmListCounts cnts = shm_list_block_get_count(block, owned);
+	ShmInt local_ii = block_desc.itemindex - cnts.deleted;
+	shmassert(local_ii >= 0 && local_ii <= cnts.count);
+	ShmInt max_block_capacity = shm_list_max_block_capacity();
+
+	bool at_head = local_ii == 0 && cnts.deleted == 0;
+	bool at_tail = local_ii == cnts.count && cnts.deleted + cnts.count == block->capacity;
+	if ((at_head || at_tail) && cnts.count >= SHM_LIST_SHIFT_LIMIT)
+	{
+		// The new block takes the following inserts at the same end in O(1): the head inserts fill it from the end.
+		block_index = at_head ? block_index : block_index + 1;
+		block = shm_list_insert_block(thread, list, block_index, max_block_capacity / 4, &index_desc);
+		ShmInt ii = at_head ? block->capacity - 1 : 0;
+		if (SBOOL(value))
+			shm_pointer_acq(thread, value);
+		shm_list_stage_cell(thread, block, ii, value);
+		shm_list_update_block_counts(thread, list, block, block_index, 1, ii);
+		int status = shm_list_changes_push_cells(thread, list.local, block, block_index, ii, 1);
+		if (status != RESULT_OK)
+			return status;
+		transient_commit(thread);
+		return RESULT_OK;
+	}
+	if (cnts.deleted == 0 && cnts.count == block->capacity)
+	{
+		if (block->capacity < max_block_capacity)
+		{
+			ShmInt new_capacity;
+			if (block->capacity > 64)
+				new_capacity = block->capacity + block->capacity / 4;
+			else
+				new_capacity = block->capacity * 2;
+			if (new_capacity > max_block_capacity)
+				new_capacity = max_block_capacity;
+			ShmListBlockRef first_block = { index_desc.block_shm, block };
+			shm_list_changes_split_ranges(thread, list.local, index_desc.index, first_block, block_index + 1);
+			block = shm_list_grow_block(thread, list, block, new_capacity, &index_desc);
+		}
+		else
+		{
+			// split the block in halves, the upper one goes into the new block next to it
+			ShmListBlock *upper = shm_list_insert_block(thread, list, block_index + 1, max_block_capacity, &index_desc);
+			ShmInt half = cnts.count / 2;
+			ShmInt moved = cnts.count - half;
+			for (ShmInt ii = 0; ii < moved; ++ii)
+			{
+				ShmPointer moved_value = shm_list_cell_get_data(block, half + ii, owned);
+				if (SBOOL(moved_value))
+					shm_pointer_acq(thread, moved_value);
+				shm_list_stage_cell(thread, upper, ii, moved_value);
+			}
+			for (ShmInt ii = half; ii < cnts.count; ++ii)
+				shm_list_stage_cell(thread, block, ii, EMPTY_SHM);
+			shm_list_update_block_counts(thread, list, upper, block_index + 1, moved, 0);
+			shm_list_update_block_counts(thread, list, block, block_index, half, 0);
+			int status = shm_list_changes_push_cells(thread, list.local, block, block_index, half, moved);
+			if (status == RESULT_OK)
+				status = shm_list_changes_push_cells(thread, list.local, upper, block_index + 1, 0, moved);
+			if (status != RESULT_OK)
+				return status;
+			if (local_ii > half)
+			{
+				block = upper;
+				block_index++;
+				local_ii -= half;
+			}
+		}
+		cnts = shm_list_block_get_count(block, owned);
+	}
+
+	ShmInt first = cnts.deleted;
+	ShmInt end = cnts.deleted + cnts.count;
+	bool room_left = first > 0;
+	bool room_right = end < block->capacity;
+	shmassert(room_left || room_right);
+	int status;
+	if (room_left && (!room_right || local_ii <= cnts.count - local_ii))
+	{
+		// shift the items before the position one cell towards the head
+		for (ShmInt ii = first - 1; ii < first + local_ii - 1; ++ii)
+			shm_list_stage_copy(thread, block, ii, ii + 1);
+		if (SBOOL(value))
+			shm_pointer_acq(thread, value);
+		shm_list_stage_cell(thread, block, first + local_ii - 1, value);
+		shm_list_update_block_counts(thread, list, block, block_index, cnts.count + 1, first - 1);
+		status = shm_list_changes_push_cells(thread, list.local, block, block_index, first - 1, local_ii + 1);
+	}
+	else
+	{
+		// shift the items from the position one cell towards the tail
+		for (ShmInt ii = end; ii > first + local_ii; --ii)
+			shm_list_stage_copy(thread, block, ii, ii - 1);
+		if (SBOOL(value))
+			shm_pointer_acq(thread, value);
+		shm_list_stage_cell(thread, block, first + local_ii, value);
+		shm_list_update_block_counts(thread, list, block, block_index, cnts.count + 1, first);
+		status = shm_list_changes_push_cells(thread, list.local, block, block_index, first + local_ii, cnts.count - local_ii + 1);
+	}
+	if (status != RESULT_OK)
+		return status;
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+// Removes the item at index into the result (acquired), a negative index counts from the end.
+// Out of range index is not a failure, valid is set to false then.
+// The items are shifted from the closer end of the block, so removals at either end are O(1).
+int
+shm_list_pop(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer *result, bool *valid)
+{
+	shm_pointer_empty(thread, result);
+	if (valid)
+		*valid = false;
+
+	shm_list_changes_check_inited(thread, list.local, NULL);
+
+	bool lock_taken = false;
+	if_failure(
+		transaction_lock_write(thread, &list.local->base.lock, list.shared, CONTAINER_LIST, &lock_taken),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+
+	shm_cell_check_write_lock(thread, &list.local->base.lock);
+
+	bool owned = true;
+	// similar to get_item_do
+	ShmListCounts count = shm_list_get_fast_count(thread, list.local, owned);
+	if (index < 0)
+		index += count.count;
+
+	// Sleep(1000*1000); // producer_consumer.py leak trigger
+	if (index < 0 || index >= count.count)
+	{
+		transient_commit(thread);
+		return RESULT_OK;
+	}
+
+	shm_list__index_desc index_desc;
+	shm_list__block_desc block_desc = shm_list_get_item_desc(thread, list, index, owned, &index_desc);
+	if (block_desc.itemindex == -1)
+	{
+		shmassert(false); // the index is checked against the count above
+		transient_commit(thread);
+		return RESULT_OK;
+	}
+	ShmListBlock *block = block_desc.block;
+	shmassert(block);
+	int block_index = index_desc.cell_ii;
+
+	if (index_desc.index)
+		shmassert(index_desc.cell);
+	if (lock_taken)
+	{
+		// verify it has no data from previous transactions, see desc at the begginning of shm_list_append_do.
+		shm_list_block_verify_clean(block);
+		if (index_desc.index)
+		{
+			shmassert(index_desc.cell->new_count == -1);
+			shmassert(index_desc.cell->new_deleted == -1);
+		}
+	}
+
+	ShmListCounts cnts = shm_list_block_get_count(block, owned);
+	ShmInt first = cnts.deleted;
+	ShmInt last = cnts.deleted + cnts.count - 1;
+	ShmInt ii = block_desc.itemindex;
+	shmassert(ii >= first && ii <= last);
+
+	ShmListShadowCell *shadow_cell = shm_list_shadow_cell(block, ii);
+	if (shadow_cell && shadow_cell->has_new_data)
+		shm_pointer_move(thread, result, &shadow_cell->new_data);
+	else
+	{
+		*result = block->cells[ii].data;
+		shm_pointer_acq(thread, *result);
+	}
+
+	int status;
+	if (ii - first < last - ii)
+	{
+		// shift the items before it one cell towards the tail
+		for (ShmInt dst = ii; dst > first; --dst)
+			shm_list_stage_copy(thread, block, dst, dst - 1);
+		shm_list_stage_cell(thread, block, first, EMPTY_SHM);
+		shm_list_update_block_counts(thread, list, block, block_index, cnts.count - 1, first + 1);
+		status = shm_list_changes_push_cells(thread, list.local, block, block_index, first, ii - first + 1);
+	}
+	else
+	{
+		// shift the items after it one cell towards the head
+		for (ShmInt dst = ii; dst < last; ++dst)
+			shm_list_stage_copy(thread, block, dst, dst + 1);
+		shm_list_stage_cell(thread, block, last, EMPTY_SHM);
+		shm_list_update_block_counts(thread, list, block, block_index, cnts.count - 1, first);
+		status = shm_list_changes_push_cells(thread, list.local, block, block_index, ii, last - ii + 1);
+	}
+	if (status != RESULT_OK)
+	{
+		shm_pointer_empty(thread, result);
+		return status;
+	}
+
+	transient_commit(thread);
+	shmassert(SBOOL(*result));
+	if (valid)
+		*valid = true;
+	return RESULT_OK;
+}
+
+// result is acquired
+int
+shm_list_popleft(ThreadContext *thread, ListRef list, ShmPointer *result, bool *valid)
+{
+	return shm_list_pop(thread, list, 0, result, valid);
+}
+
+// Removes every item, the blocks keep the removed cells as deleted ones until the commit drops the emptied blocks.
+// A single ShmListChanges entry covers the committed items of all the blocks.
+int
+shm_list_clear(ThreadContext *thread, ListRef list)
+{
+	shm_list_changes_check_inited(thread, list.local, NULL);
+	bool lock_taken = false;
+	if_failure(
+		transaction_lock_write(thread, &list.local->base.lock, list.shared, CONTAINER_LIST, &lock_taken),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_write_lock(thread, &list.local->base.lock);
+
+	bool owned = true;
+	ShmListCounts total_counts = shm_list_get_fast_count(thread, list.local, owned);
+	if (total_counts.count == 0)
+	{
+		transient_commit(thread);
+		return RESULT_OK;
+	}
+
+	ShmListIndex *list_index = NULL;
+	ShmListBlockRef first_block = { EMPTY_SHM, NULL };
+	ShmRefcountedBlock *top_block = LOCAL(list.local->top_block);
+	shmassert(top_block);
+	if (SHM_TYPE_LIST_INDEX == top_block->type)
+		list_index = (ShmListIndex *)top_block;
+	else
+	{
+		first_block.local = (ShmListBlock *)top_block;
+		first_block.shared = list.local->top_block;
+	}
+	int block_count = list_index ? list_index->index_size : 1;
+	for (int block_index = 0; block_index < block_count; ++block_index)
+	{
+		ShmListIndexItem *index_item = NULL;
+		ShmListBlock *block = shm_list_get_block(block_index, list_index, first_block, &index_item).local;
+		ShmListCounts cnts = shm_list_block_get_count(block, owned);
+		for (ShmInt ii = cnts.deleted; ii < cnts.deleted + cnts.count; ++ii)
+		{
+			shm_list_stage_cell(thread, block, ii, EMPTY_SHM);
+			shm_list_make_shadow_cell(thread, block, ii)->changed = true; // covered by the whole block entry or by an entry of its own
+		}
+		shm_list_update_block_counts(thread, list, block, block_index, 0, cnts.deleted + cnts.count);
+	}
+	shmassert(shm_list_get_fast_count(thread, list.local, owned).count == 0);
+
+	int status = shm_list_changes_push_range(thread, list.local, 0, -1, block_count);
+	if (status != RESULT_OK)
+		return status;
+	transient_commit(thread);
 	return RESULT_OK;
 }
 
@@ -2105,117 +3389,129 @@ shm_list_commit(ThreadContext *thread, ShmList *list)
 	// We should be sorting the changes list by block_index and then processing their items for each one block in batches
 	// Dirty reads are kinda supported for growing the block size, because new_size is applied after the modification cycle thus showing the smallest valid block frame.
 	// Dirty reads are not implementing for removal -- the removal is not implemented at all.
+	shm_list__change_range range;
 	for (int i = 0; i < changes->count; ++i)
 	{
-		ShmListChangeItem *item = &changes->cells[i];
-		ShmListIndexItem *index_item = NULL;
-		ShmListBlockRef block = shm_list_get_block(item->block_index, list_index, first_block, &index_item);
+		shm_list_change_range_init(&range, &changes->cells[i]);
+		while (shm_list_change_range_next(&range, list_index, first_block))
+		{
+			ShmListIndexItem *index_item = range.index_item;
+			ShmListBlockRef block = range.block;
 
-		shmassert(block.local);
-		ShmListCounts counts = shm_list_block_get_count(block.local, true);
+			ShmListCounts counts = shm_list_block_get_count(block.local, true);
 
-		if (index_item)
-		{
-			// done by shm_list_get_block
-			// shmassert(index_item->count == old_count);
-			// shmassert(index_item->new_count == new_count);
-		}
-		else
-		{
-			ShmListCounts total_counts = shm_list_get_fast_count(thread, list, true);
-			shmassert(total_counts.count == counts.count);
-			shmassert(total_counts.deleted == counts.deleted);
-		}
-		// shmassert(counts.count != EVIL_MARK);
+			if (index_item)
+			{
+				// done by shm_list_get_block
+				// shmassert(index_item->count == old_count);
+				// shmassert(index_item->new_count == new_count);
+			}
+			else
+			{
+				ShmListCounts total_counts = shm_list_get_fast_count(thread, list, true);
+				shmassert(total_counts.count == counts.count);
+				shmassert(total_counts.deleted == counts.deleted);
+			}
+			// shmassert(counts.count != EVIL_MARK);
 
-		// this calculation holds true for as long as new elements are appended to the tail and old elements are removed from the head.
-		// "deleted" count can only grow by removing items from "count". Thus new_deleted + new_count >= deleted + count.
-		ShmInt max_actual_capacity = counts.count + counts.deleted;
-		shmassert(max_actual_capacity <= block.local->capacity);
+			// The items live in the [deleted, deleted + count) window, the removed cells around it are staged with EMPTY_SHM.
+			ShmInt window_end = counts.count + counts.deleted;
+			shmassert(window_end <= block.local->capacity);
 
-		ShmInt ii = item->item_index; // this index is from start of the block, not from the first actual data item.
-		shmassert(ii >= 0 && ii < max_actual_capacity);
+			for (ShmInt ii = range.first; ii < range.last; ++ii) // this index is from start of the block, not from the first actual data item.
+			{
+				shmassert(ii >= 0 && ii < block.local->capacity);
 
-		if (block.local->cells[ii].has_new_data)
-		{
-			block.local->cells[ii].has_new_data = false; // leak is better than wild pointer
-			if (ii >= counts.deleted)
-				shmassert(block.local->cells[ii].new_data != EMPTY_SHM);
-			else
-				shmassert(block.local->cells[ii].new_data == EMPTY_SHM);
-			shm_pointer_move_atomic(thread, &block.local->cells[ii].data, &block.local->cells[ii].new_data);
-			shmassert(block.local->cells[ii].changed);
-			block.local->cells[ii].changed = false;
+				ShmListShadowCell *shadow_cell = shm_list_shadow_cell(block.local, ii);
+				if (shadow_cell && shadow_cell->has_new_data)
+				{
+					shadow_cell->has_new_data = false; // leak is better than wild pointer
+					if (ii >= counts.deleted && ii < window_end)
+						shmassert(shadow_cell->new_data != EMPTY_SHM);
+					else
+						shmassert(shadow_cell->new_data == EMPTY_SHM);
+					shm_pointer_move_atomic(thread, &block.local->cells[ii].data, &shadow_cell->new_data);
+					shmassert(shadow_cell->changed);
+					shadow_cell->changed = false;
+				}
+			}
 		}
 	}
 	// second pass for setting the block->count, thus only valid part of block would be visible.
 	bool rebuild_index = false;
 	for (int i = 0; i < changes->count; ++i)
 	{
-		ShmListChangeItem *item = &changes->cells[i];
-		ShmListIndexItem *index_item = NULL;
-		ShmListBlockRef block = shm_list_get_block(item->block_index, list_index, first_block, &index_item);
-		shmassert(block.local);
-		ShmInt new_count = block.local->new_count;
-		ShmInt new_deleted = block.local->new_deleted;
-		if (new_count != -1)
+		shm_list_change_range_init(&range, &changes->cells[i]);
+		while (shm_list_change_range_next(&range, list_index, first_block))
 		{
-			// not sure about the order
-			p_atomic_int_set(&block.local->count, new_count);
-			p_atomic_int_set(&block.local->new_count, -1);
-			if (index_item)
+			ShmListIndexItem *index_item = range.index_item;
+			ShmListBlockRef block = range.block;
+			ShmInt new_count = block.local->new_count;
+			ShmInt new_deleted = block.local->new_deleted;
+			// the staged items are already published or dropped by the first pass
+			if (SBOOL(block.local->shadow))
+				shm_pointer_empty(thread, &block.local->shadow);
+			if (new_count != -1)
 			{
-				shmassert(index_item->new_count == new_count);
-				p_atomic_int_set(&index_item->count, new_count);
-				p_atomic_int_set(&index_item->new_count, -1);
-			}
+				// not sure about the order
+				shm_atomic_int_set_release(&block.local->count, new_count);
+				shm_atomic_int_set_release(&block.local->new_count, -1);
+				if (index_item)
+				{
+					shmassert(index_item->new_count == new_count);
+					shm_atomic_int_set_release(&index_item->count, new_count);
+					shm_atomic_int_set_release(&index_item->new_count, -1);
+					shm_list_index_end_page(list_index, range.block_index, true);
+				}
 
-			block.local->count_added_after_relocation += new_count - block.local->count;
+				block.local->count_added_after_relocation += new_count - block.local->count;
 
-			if (new_count == 0)
-				rebuild_index = true;
-		}
-		if (new_deleted != -1)
-		{
-			p_atomic_int_set(&block.local->deleted, new_deleted);
-			p_atomic_int_set(&block.local->new_deleted, -1);
-			if (index_item)
+				if (new_count == 0)
+					rebuild_index = true;
+			}
+			if (new_deleted != -1)
 			{
-				shmassert(index_item->new_deleted == new_deleted);
-				p_atomic_int_set(&index_item->deleted, new_deleted);
-				p_atomic_int_set(&index_item->new_deleted, -1);
+				shm_atomic_int_set_release(&block.local->deleted, new_deleted);
+				shm_atomic_int_set_release(&block.local->new_deleted, -1);
+				if (index_item)
+				{
+					shmassert(index_item->new_deleted == new_deleted);
+					shm_atomic_int_set_release(&index_item->deleted, new_deleted);
+					shm_atomic_int_set_release(&index_item->new_deleted, -1);
+				}
 			}
 		}
 	}
 
 	if (rebuild_index && list_index != NULL) {
-		// Some blocks are empty now, delete them.
-		// Do not delete the last block.
+		// Some blocks are empty now, delete them. Removals may empty the blocks anywhere in the list.
+		// Do not delete the last block when every block is empty.
 		shmassert(list_index->index_size > 1);
-		int first_valid = -1;
+		int final_index_size = 0;
 		for (int i = 0; i < list_index->index_size; i++)
 		{
-			shmassert(list_index->cells[i].new_count == -1); // transaction committed
-			shmassert(list_index->cells[i].new_deleted == -1); // transaction committed
-			if (first_valid != -1)
-				shmassert(list_index->cells[i].count != 0); // can't have empty blocks in the middle
-			if (list_index->cells[i].count != 0)
-				first_valid = i;
+			ShmListIndexItem *item = shm_list_index_item(list_index, i);
+			shmassert(item->new_count == -1); // transaction committed
+			shmassert(item->new_deleted == -1); // transaction committed
+			if (item->count != 0)
+				final_index_size++;
 		}
-		// Do not delete the last block.
-		if (first_valid == -1)
-			first_valid = list_index->index_size - 1;
-		int final_index_size = list_index->index_size - first_valid;
+		int single_index = list_index->index_size - 1;
+		if (final_index_size == 1)
+			for (int i = 0; i < list_index->index_size; i++)
+				if (shm_list_index_item(list_index, i)->count != 0)
+					single_index = i;
 		if (final_index_size < 2) {
 			// single block left
-			int last_index = list_index->index_size - 1;
-			shm_pointer_move(thread, &list->top_block, &list_index->cells[last_index].block);
-			list->count = list_index->cells[last_index].count;
-			list->new_count = list_index->cells[last_index].new_count;
-			list->deleted = list_index->cells[last_index].deleted;
-			list->new_deleted = list_index->cells[last_index].new_deleted;
-			for (int i = 0; i < last_index; i++)
-				shm_pointer_empty(thread, &list_index->cells[i].block);
+			for (int i = 0; i < list_index->index_size; i++)
+				if (i != single_index)
+					shm_pointer_empty(thread, &shm_list_index_item(list_index, i)->block);
+			ShmListIndexItem *single_item = shm_list_index_item(list_index, single_index);
+			list->count = single_item->count;
+			list->new_count = single_item->new_count;
+			list->deleted = single_item->deleted;
+			list->new_deleted = single_item->new_deleted;
+			shm_pointer_move(thread, &list->top_block, &single_item->block);
 		}
 		else
 		{
@@ -2225,59 +3521,102 @@ shm_list_commit(ThreadContext *thread, ShmList *list)
 			ShmInt delta_deleted = 0;
 			ShmListCounts new_counts = { 0, 0 };
 
-			for (int i = 0; i < first_valid; i++)
-			{
-				ShmListCounts index_counts = shm_list_index_get_count(&list_index->cells[i], true);
-				shmassert(index_counts.deleted >= 0);
-				shmassert(index_counts.count == 0);
-				delta_deleted += index_counts.deleted;
-			}
+			ShmPointer new_index_shm = EMPTY_SHM;
+			ShmListIndex *new_index_block = shm_list_new_index_with_pages(thread, &new_index_shm, final_index_size);
 
-			for (int i = first_valid; i < list_index->index_size; i++)
+			// move the filled blocks, release the empty ones.
+			int new_idx = 0;
+			for (int i = 0; i < list_index->index_size; i++)
 			{
-				ShmListCounts index_counts = shm_list_index_get_count(&list_index->cells[i], true);
+				ShmListIndexItem *item = shm_list_index_item(list_index, i);
+				ShmListCounts index_counts = shm_list_index_get_count(item, true);
 				shmassert(index_counts.deleted >= 0);
-				shmassert(index_counts.count != 0);
+				if (index_counts.count == 0)
+				{
+					delta_deleted += index_counts.deleted;
+					shm_pointer_empty(thread, &item->block);
+					continue;
+				}
 				new_counts.deleted += index_counts.deleted;
 				new_counts.count += index_counts.count;
+				shm_list_index_move_item(shm_list_index_item(new_index_block, new_idx), item);
+				new_idx++;
 			}
-
+			shmassert(new_idx == final_index_size);
 			shmassert(delta_deleted + new_counts.deleted == old_totals.deleted);
 			shmassert(new_counts.count == old_totals.count);
+			shm_list_index_sum_pages(new_index_block);
 
-			// alignment is not a problem here because everything is ShmInt
-			int index_size = isizeof(ShmListIndexHeader) + isizeof(ShmListIndexItem) * final_index_size;
-			ShmPointer new_index_shm = EMPTY_SHM;
-			ShmListIndex *new_index_block = new_shm_refcounted_block(thread, &new_index_shm, index_size, SHM_TYPE_LIST_INDEX, SHM_LIST_INDEX_DEBUG_ID);
-			new_index_block->index_size = final_index_size;
-
-			memcpy(CAST_VL(&new_index_block->cells[0]), CAST_VL(&list_index->cells[first_valid]),
-					sizeof(ShmListIndexItem) * (puint)final_index_size);
-			// clear copied blocks, release the deleted.
-			for (int i = 0; i < first_valid; i++)
-				shm_pointer_empty(thread, &list_index->cells[i].block);
-			for (int i = first_valid; i < list_index->index_size - 1; i++)
-				p_atomic_shm_pointer_set(&list_index->cells[i].block, EMPTY_SHM);
-
-			p_atomic_shm_pointer_set(&list->top_block, new_index_shm);
+			// shm_pointer_move is not thread-safe on weak ordering arch
+			shm_pointer_move(thread, &list->top_block, &new_index_shm);
 			list->new_deleted = new_counts.deleted;
 		}
 	}
 
 	if (list->new_count != -1)
 	{
-		p_atomic_int_set(&list->count, list->new_count);
-		p_atomic_int_set(&list->new_count, -1);
+		shm_atomic_int_set_release(&list->count, list->new_count);
+		shm_atomic_int_set_release(&list->new_count, -1);
 	}
 	if (list->new_deleted != -1)
 	{
-		p_atomic_int_set(&list->deleted, list->new_deleted);
-		p_atomic_int_set(&list->new_deleted, -1);
+		shm_atomic_int_set_release(&list->deleted, list->new_deleted);
+		shm_atomic_int_set_release(&list->new_deleted, -1);
 	}
 
 	return RESULT_OK;
 }
 
+// Releases the unused blocks left by a rolled back transaction: shm_list_extend allocates all of its blocks up front and
+// shm_list_insert adds the blocks next to the full ones. A single remaining block becomes the top block again.
+static void
+shm_list_trim_unused_blocks(ThreadContext *thread, ShmList *list, ShmListIndex *list_index)
+{
+	int final_index_size = 0;
+	int single_index = 0;
+	for (int i = 0; i < list_index->index_size; i++)
+	{
+		ShmListIndexItem *item = shm_list_index_item(list_index, i);
+		shmassert(item->new_count == -1 && item->new_deleted == -1);
+		if (item->count != 0 || item->deleted != 0)
+		{
+			final_index_size++;
+			single_index = i;
+		}
+	}
+	if (final_index_size == list_index->index_size)
+		return;
+
+	if (final_index_size <= 1)
+	{
+		for (int i = 0; i < list_index->index_size; i++)
+			if (i != single_index)
+				shm_pointer_empty(thread, &shm_list_index_item(list_index, i)->block);
+		ShmListIndexItem *single_item = shm_list_index_item(list_index, single_index);
+		shmassert(list->count == single_item->count);
+		shmassert(list->deleted == single_item->deleted);
+		shm_pointer_move(thread, &list->top_block, &single_item->block);
+		return;
+	}
+	ShmPointer new_index_shm = EMPTY_SHM;
+	ShmListIndex *new_index_block = shm_list_new_index_with_pages(thread, &new_index_shm, final_index_size);
+	int new_idx = 0;
+	for (int i = 0; i < list_index->index_size; i++)
+	{
+		ShmListIndexItem *item = shm_list_index_item(list_index, i);
+		if (item->count == 0 && item->deleted == 0)
+		{
+			shm_pointer_empty(thread, &item->block);
+			continue;
+		}
+		shm_list_index_move_item(shm_list_index_item(new_index_block, new_idx), item);
+		new_idx++;
+	}
+	shm_list_index_sum_pages(new_index_block);
+	shmassert(new_idx == final_index_size);
+	shm_pointer_move(thread, &list->top_block, &new_index_shm);
+}
+
 int
 shm_list_rollback(ThreadContext *thread, ShmList *list)
 {
@@ -2301,86 +3640,99 @@ shm_list_rollback(ThreadContext *thread, ShmList *list)
 	else
 		shmassert_msg(false, "Invalid top_block->type");
 
+	shm_list__change_range range;
 	for (int i = 0; i < changes->count; ++i)
 	{
-		ShmListChangeItem *item = &changes->cells[i];
-		ShmListIndexItem *index_item = NULL;
-		ShmListBlockRef block = shm_list_get_block(item->block_index, list_index, first_block, &index_item);
-		shmassert(block.local);
-		ShmListCounts counts = shm_list_block_get_count(block.local, true);
-		if (index_item)
-		{
-			// done by shm_list_get_block
-			// shmassert(index_item->count == old_count);
-			// shmassert(index_item->new_count == new_count);
-		}
-		else
+		shm_list_change_range_init(&range, &changes->cells[i]);
+		while (shm_list_change_range_next(&range, list_index, first_block))
 		{
-			ShmListCounts total_counts = shm_list_get_fast_count(thread, list, true);
-			shmassert(total_counts.count == counts.count);
-			shmassert(total_counts.deleted == counts.deleted);
-		}
-		// shmassert(counts.count != EVIL_MARK);
+			ShmListIndexItem *index_item = range.index_item;
+			ShmListBlockRef block = range.block;
+			ShmListCounts counts = shm_list_block_get_count(block.local, true);
+			if (index_item)
+			{
+				// done by shm_list_get_block
+				// shmassert(index_item->count == old_count);
+				// shmassert(index_item->new_count == new_count);
+			}
+			else
+			{
+				ShmListCounts total_counts = shm_list_get_fast_count(thread, list, true);
+				shmassert(total_counts.count == counts.count);
+				shmassert(total_counts.deleted == counts.deleted);
+			}
+			// shmassert(counts.count != EVIL_MARK);
 
-		// this calculation holds true for as long as new elements are appended to the tail and old elements are removed from the head.
-		// "deleted" count can only grow by removing items from "count". Thus new_deleted + new_count >= deleted + count.
-		ShmInt max_actual_capacity = counts.count + counts.deleted;
-		shmassert(max_actual_capacity <= block.local->capacity);
+			// The items live in the [deleted, deleted + count) window, the removed cells around it are staged with EMPTY_SHM.
+			ShmInt window_end = counts.count + counts.deleted;
+			shmassert(window_end <= block.local->capacity);
 
-		ShmInt ii = item->item_index;
-		shmassert(ii >= 0 && ii < max_actual_capacity);
+			for (ShmInt ii = range.first; ii < range.last; ++ii)
+			{
+				shmassert(ii >= 0 && ii < block.local->capacity);
 
-		if (block.local->cells[ii].has_new_data)
-		{
-			block.local->cells[ii].has_new_data = false; // leak is better than wild pointer
-			if (ii >= counts.deleted)
-				shmassert(block.local->cells[ii].new_data != EMPTY_SHM);
-			else
-				shmassert(block.local->cells[ii].new_data == EMPTY_SHM);
-			shm_pointer_empty_atomic(thread, &block.local->cells[ii].new_data);
+				ShmListShadowCell *shadow_cell = shm_list_shadow_cell(block.local, ii);
+				if (shadow_cell && shadow_cell->has_new_data)
+				{
+					shadow_cell->has_new_data = false; // leak is better than wild pointer
+					if (ii >= counts.deleted && ii < window_end)
+						shmassert(shadow_cell->new_data != EMPTY_SHM);
+					else
+						shmassert(shadow_cell->new_data == EMPTY_SHM);
+					shm_pointer_empty_atomic(thread, &shadow_cell->new_data);
 
-			shmassert(block.local->cells[ii].changed);
-			block.local->cells[ii].changed = false;
+					shmassert(shadow_cell->changed);
+					shadow_cell->changed = false;
+				}
+			}
 		}
 	}
 	for (int i = 0; i < changes->count; ++i)
 	{
-		ShmListChangeItem *item = &changes->cells[i];
-		ShmListIndexItem *index_item = NULL;
-		ShmListBlockRef block = shm_list_get_block(item->block_index, list_index, first_block, &index_item);
-		shmassert(block.local);
-		ShmInt new_count = block.local->new_count;
-		ShmInt new_deleted = block.local->new_deleted;
-
-		if (new_count != -1)
+		shm_list_change_range_init(&range, &changes->cells[i]);
+		while (shm_list_change_range_next(&range, list_index, first_block))
 		{
-			p_atomic_int_set(&block.local->new_count, -1);
-			if (index_item)
+			ShmListIndexItem *index_item = range.index_item;
+			ShmListBlockRef block = range.block;
+			ShmInt new_count = block.local->new_count;
+			ShmInt new_deleted = block.local->new_deleted;
+			// the staged items are already published or dropped by the first pass
+			if (SBOOL(block.local->shadow))
+				shm_pointer_empty(thread, &block.local->shadow);
+
+			if (new_count != -1)
 			{
-				shmassert(index_item->new_count == new_count);
-				p_atomic_int_set(&index_item->new_count, -1);
+				shm_atomic_int_set_release(&block.local->new_count, -1);
+				if (index_item)
+				{
+					shmassert(index_item->new_count == new_count);
+					shm_atomic_int_set_release(&index_item->new_count, -1);
+					shm_list_index_end_page(list_index, range.block_index, false);
+				}
 			}
-		}
 
-		if (new_deleted != -1)
-		{
-			p_atomic_int_set(&block.local->new_deleted, -1);
-			if (index_item)
+			if (new_deleted != -1)
 			{
-				shmassert(index_item->new_deleted == new_deleted);
-				p_atomic_int_set(&index_item->new_deleted, -1);
+				shm_atomic_int_set_release(&block.local->new_deleted, -1);
+				if (index_item)
+				{
+					shmassert(index_item->new_deleted == new_deleted);
+					shm_atomic_int_set_release(&index_item->new_deleted, -1);
+				}
 			}
 		}
 	}
 
 	if (list->new_count != -1)
 	{
-		p_atomic_int_set(&list->new_count, -1);
+		shm_atomic_int_set_release(&list->new_count, -1);
 	}
 	if (list->new_deleted != -1)
 	{
-		p_atomic_int_set(&list->new_deleted, -1);
+		shm_atomic_int_set_release(&list->new_deleted, -1);
 	}
+	if (list_index != NULL)
+		shm_list_trim_unused_blocks(thread, list, list_index);
 	return RESULT_OK;
 }
 
@@ -2388,13 +3740,174 @@ int
 shm_list_unlock(ThreadContext *thread, ShmList *list, ShmInt type)
 {
 	if (TRANSACTION_ELEMENT_WRITE == type)
-		p_atomic_shm_pointer_set(&list->base.lock.transaction_data, EMPTY_SHM);
+		shm_atomic_shm_pointer_set_release(&list->base.lock.transaction_data, EMPTY_SHM);
 	shm_list_changes_clear(thread, list);
 	_shm_cell_unlock(thread, &list->base.lock, type);
 	return RESULT_OK;
 }
 // end of ShmList
 
+// ShmArray
+
+ShmInt
+shm_array_max_count(ShmInt itemsize)
+{
+	shmassert(max_heap_block_size != 0 && itemsize > 0);
+	return ((ShmInt)max_heap_block_size - SHM_ARRAY_DATA_HEADER_SIZE) / itemsize;
+}
+
+ShmArrayData *
+new_shm_array_data(ThreadContext *thread, PShmPointer result, ShmInt itemsize, ShmInt count, int debug_id)
+{
+	shmassert(count >= 0 && count <= shm_array_max_count(itemsize));
+	ShmArrayData *data = new_shm_refcounted_block(thread, result, SHM_ARRAY_DATA_HEADER_SIZE + itemsize * count,
+	                                              SHM_TYPE_ARRAY_DATA, debug_id);
+	data->count = count;
+	data->itemsize = itemsize;
+	return data;
+}
+
+// Items are zero-filled.
+ShmArray *
+new_shm_array(ThreadContext *thread, PShmPointer result, ShmInt typecode, ShmInt itemsize, ShmInt count)
+{
+	ShmArray *array = get_mem(thread, result, sizeof(ShmArray), SHM_ARRAY_DEBUG_ID);
+	init_container((ShmContainer *)array, sizeof(ShmArray), SHM_TYPE_ARRAY);
+	array->typecode = typecode;
+	array->itemsize = itemsize;
+	array->count = count;
+	array->new_data = EMPTY_SHM;
+	new_shm_array_data(thread, &array->data, itemsize, count, SHM_ARRAY_DATA_DEBUG_ID);
+	return array;
+}
+
+static ShmPointer
+shm_array_get_data(ShmArray *array, bool owned)
+{
+	if (owned && SBOOL(array->new_data))
+		return array->new_data;
+	return p_atomic_shm_pointer_get(&array->data);
+}
+
+// Returns the acquired data block, its items stay unchanged until released.
+int
+shm_array_acq_data(ThreadContext *thread, ArrayRef array, ShmPointer *result)
+{
+	*result = EMPTY_SHM;
+	if_failure(
+		transaction_lock_read(thread, &array.local->lock, array.shared, CONTAINER_ARRAY, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_read_write_lock(thread, &array.local->lock);
+	bool owned = shm_cell_have_write_lock(thread, &array.local->lock);
+	ShmPointer data = shm_array_get_data(array.local, owned);
+	shm_pointer_acq(thread, data); // must acquire inside transient transaction
+	*result = data;
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+static void
+shm_array_copy_items(vl char *dest, ShmInt dest_step, vl char *src, ShmInt src_step, ShmInt itemsize, ShmInt count)
+{
+	if (dest_step == 1 && src_step == 1)
+	{
+		memcpy(CAST_VL(dest), CAST_VL(src), (size_t)(itemsize * count));
+		return;
+	}
+	for (ShmInt i = 0; i < count; ++i)
+	{
+		memcpy(CAST_VL(dest), CAST_VL(src), (size_t)itemsize);
+		dest += dest_step * itemsize;
+		src += src_step * itemsize;
+	}
+}
+
+// Copies count items starting at index and taking every step-th item into dest.
+// The range is checked by the caller, the count of an array never changes.
+int
+shm_array_get_range(ThreadContext *thread, ArrayRef array, ShmInt index, ShmInt step, ShmInt count, void *dest)
+{
+	shmassert(index >= 0 && step >= 1 && count >= 0);
+	shmassert(count == 0 || index + (count - 1) * step < array.local->count);
+	if_failure(
+		transaction_lock_read(thread, &array.local->lock, array.shared, CONTAINER_ARRAY, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_read_write_lock(thread, &array.local->lock);
+	bool owned = shm_cell_have_write_lock(thread, &array.local->lock);
+	ShmArrayData *data = LOCAL(shm_array_get_data(array.local, owned));
+	shmassert(data && data->count == array.local->count);
+	vl char *items = (vl char *)shm_array_data_items(data) + index * data->itemsize;
+	shm_array_copy_items(dest, 1, items, step, data->itemsize, count);
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+// Stores count items from src starting at index and taking every step-th item.
+// The first write of a transaction copies the committed items into new_data.
+int
+shm_array_set_range(ThreadContext *thread, ArrayRef array, ShmInt index, ShmInt step, ShmInt count, const void *src)
+{
+	shmassert(index >= 0 && step >= 1 && count >= 0);
+	shmassert(count == 0 || index + (count - 1) * step < array.local->count);
+	if_failure(
+		transaction_lock_write(thread, &array.local->lock, array.shared, CONTAINER_ARRAY, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		}
+	);
+	shm_cell_check_write_lock(thread, &array.local->lock);
+	ShmArrayData *new_data = LOCAL(array.local->new_data);
+	if (new_data == NULL)
+	{
+		ShmArrayData *data = LOCAL(array.local->data);
+		shmassert(data && data->count == array.local->count);
+		new_data = new_shm_array_data(thread, &array.local->new_data, data->itemsize, data->count, SHM_ARRAY_DATA_DEBUG_ID);
+		shm_array_copy_items(shm_array_data_items(new_data), 1, shm_array_data_items(data), 1,
+		                     data->itemsize, data->count);
+	}
+	vl char *items = (vl char *)shm_array_data_items(new_data) + index * new_data->itemsize;
+	shm_array_copy_items(items, step, (vl char *)src, 1, new_data->itemsize, count);
+	transient_commit(thread);
+	return RESULT_OK;
+}
+
+int
+shm_array_commit(ThreadContext *thread, ShmArray *array)
+{
+	shm_cell_check_write_lock(thread, &array->lock);
+	if (SBOOL(array->new_data))
+		shm_pointer_move_atomic(thread, &array->data, &array->new_data);
+	return RESULT_OK;
+}
+
+int
+shm_array_rollback(ThreadContext *thread, ShmArray *array)
+{
+	shm_cell_check_write_lock(thread, &array->lock);
+	if (SBOOL(array->new_data))
+		shm_pointer_empty(thread, &array->new_data);
+	return RESULT_OK;
+}
+
+int
+shm_array_unlock(ThreadContext *thread, ShmArray *array, ShmInt type)
+{
+	if (TRANSACTION_ELEMENT_WRITE == type)
+		shm_atomic_shm_pointer_set_release(&array->lock.transaction_data, EMPTY_SHM);
+	_shm_cell_unlock(thread, &array->lock, type);
+	return RESULT_OK;
+}
+// end of ShmArray
+
 
 // Start of ShmDict
 void
@@ -3010,7 +4523,7 @@ shm_dict_unlock(ThreadContext *thread, ShmDict *dict, ShmInt type)
 {
 	// shmassert(dict->lock.id == thread->self, "dict->lock.id == thread->self");
 	if (TRANSACTION_ELEMENT_WRITE == type)
-		p_atomic_shm_pointer_set(&dict->lock.transaction_data, EMPTY_SHM);
+		shm_atomic_shm_pointer_set_release(&dict->lock.transaction_data, EMPTY_SHM);
 	ShmDictDeltaArray *delta_array = LOCAL(dict->delta);
 	if (delta_array)
 		shm_dict_delta_clear(thread, delta_array);
@@ -3039,9 +4552,78 @@ new_shm_undict(ThreadContext *thread, PShmPointer shm_pointer)
 	undict->delta_buckets = EMPTY_SHM; // ShmUnDictTableHeader
 	undict->delta_count = 0;
 	undict->delta_deleted_count = 0;
+	undict->old_buckets = EMPTY_SHM;
+	undict->migrated_count = 0;
+	undict->entries = EMPTY_SHM;
+	undict->entry_count = 0;
+	undict->delta_appended = 0;
+	undict->segments = EMPTY_SHM;
 	return undict;
 }
 
+ShmUnDict *
+new_shm_undict_concurrent(ThreadContext *thread, PShmPointer shm_pointer)
+{
+	ShmUnDict *undict = new_shm_undict(thread, shm_pointer);
+	int segment_count = 1 << SHM_UNDICT_SEGMENT_LOG;
+	int total_size = isizeof(ShmUnDictSegments) - isizeof(ShmPointer) + isizeof(ShmPointer) * segment_count;
+	ShmUnDictSegments *segments = new_shm_refcounted_block(thread, &undict->segments, total_size,
+		SHM_TYPE_UNDICT_SEGMENTS, SHM_UNDICT_SEGMENTS_DEBUG_ID);
+	segments->log_count = SHM_UNDICT_SEGMENT_LOG;
+	ShmPointer *dicts = &segments->dicts;
+	for (int idx = 0; idx < segment_count; ++idx)
+		new_shm_undict(thread, &dicts[idx]);
+	return undict;
+}
+
+// Number of separately locked parts of the dict: the segments of a concurrent dict or the dict itself.
+int
+shm_undict_segment_count(ShmUnDict *dict)
+{
+	ShmUnDictSegments *segments = LOCAL(dict->segments);
+	return segments ? 1 << segments->log_count : 1;
+}
+
+// Returns false past the last segment.
+bool
+shm_undict_get_segment(UnDictRef dict, int segment_index, UnDictRef *segment)
+{
+	ShmUnDictSegments *segments = LOCAL(dict.local->segments);
+	if (!segments)
+	{
+		if (segment_index != 0)
+			return false;
+		*segment = dict;
+		return true;
+	}
+	if (segment_index < 0 || segment_index >= (1 << segments->log_count))
+		return false;
+	ShmPointer *dicts = &segments->dicts;
+	return init_undict_ref(dicts[segment_index], segment);
+}
+
+// The segment is selected by the high bits of the murmur3 finalizer, which are independent of both the low
+// hash bits selecting the table position and the 7 high bits of the control bytes. A plain multiplicative
+// hash correlates with the low bits of the FNV hashes of similar strings, so the keys of a segment
+// clustered at the same positions and overflowed the probing limit of the small tables.
+static UnDictRef
+shm_undict_key_segment(ShmUnDict *dict, uint32_t hash)
+{
+	ShmUnDictSegments *segments = LOCAL(dict->segments);
+	shmassert(segments);
+	ShmPointer *dicts = &segments->dicts;
+	uint32_t mixed = hash;
+	mixed ^= mixed >> 16;
+	mixed *= UINT32_C(0x85EBCA6B);
+	mixed ^= mixed >> 13;
+	mixed *= UINT32_C(0xC2B2AE35);
+	mixed ^= mixed >> 16;
+	UnDictRef segment;
+	init_undict_ref(dicts[mixed >> (32 - segments->log_count)], &segment);
+	shmassert(segment.local && segment.local->segments == EMPTY_SHM);
+	return segment;
+}
+
 int
 _shm_dict_get_element_size(ShmInt type)
 {
@@ -3070,7 +4652,7 @@ new_dict_table(ThreadContext *thread, ShmPointer *out_pntr, ShmInt type, int log
 	*out_pntr = EMPTY_SHM;
 	const int element_size = _shm_dict_get_element_size(type);
 	shmassert(element_size == item_size);
-	ShmWord block_total_size = isizeof(hash_table_header) - isizeof(hash_bucket) + element_size * (1 << log_count);
+	ShmWord block_total_size = hash_table_block_size(element_size, log_count);
 	if (block_total_size < 7000)
 	{
 		// simple in-place table
@@ -3085,7 +4667,7 @@ new_dict_table(ThreadContext *thread, ShmPointer *out_pntr, ShmInt type, int log
 		int log_index = 0;
 		do {
 			log_index++;
-			block_total_size = isizeof(hash_table_header) - isizeof(hash_bucket) + element_size * (1 << (log_count - log_index));
+			block_total_size = hash_table_block_size(element_size, log_count - log_index);
 		} while (block_total_size >= 7000);
 		shmassert(log_index > 0 && log_index < 16); // 64k * 4k = 256M seems decent
 
@@ -3113,6 +4695,62 @@ new_dict_table(ThreadContext *thread, ShmPointer *out_pntr, ShmInt type, int log
 
 // ShmUndict
 
+static hash_entry *
+shm_undict_entry_at(ShmUnDict *dict, ShmInt index)
+{
+	shmassert(index >= 0 && index < dict->entry_count);
+	hash_entries_header *entries = LOCAL(dict->entries);
+	shmassert(entries && entries->type == SHM_TYPE_UNDICT_ENTRIES);
+	ShmPointer *blocks = &entries->blocks;
+	hash_entry_block *block = LOCAL(blocks[index >> SHM_UNDICT_ENTRY_BLOCK_LOG]);
+	shmassert(block);
+	hash_entry *block_entries = (hash_entry *)&block->entries;
+	return &block_entries[index & ((1 << SHM_UNDICT_ENTRY_BLOCK_LOG) - 1)];
+}
+
+// Appends count empty entries and returns the first one's index. Only the block pointers are copied when
+// the entries header runs out of capacity.
+static ShmInt
+shm_undict_append_entries(ThreadContext *thread, ShmUnDict *dict, ShmInt count)
+{
+	ShmInt first = dict->entry_count;
+	ShmInt new_count = first + count;
+	if (count == 0)
+		return first;
+	int block_count = (new_count + (1 << SHM_UNDICT_ENTRY_BLOCK_LOG) - 1) >> SHM_UNDICT_ENTRY_BLOCK_LOG;
+	hash_entries_header *entries = LOCAL(dict->entries);
+	if (!entries || entries->block_capacity < block_count)
+	{
+		int capacity = entries ? entries->block_capacity : 1;
+		while (capacity < block_count)
+			capacity *= 2;
+		ShmPointer new_entries_shm;
+		int total_size = isizeof(hash_entries_header) - isizeof(ShmPointer) + isizeof(ShmPointer) * capacity;
+		hash_entries_header *new_entries = new_shm_refcounted_block(thread, &new_entries_shm, total_size,
+			SHM_TYPE_UNDICT_ENTRIES, SHM_UNDICT_ENTRIES_DEBUG_ID);
+		new_entries->block_capacity = capacity;
+		if (entries)
+		{
+			ShmPointer *old_blocks = &entries->blocks;
+			ShmPointer *new_blocks = &new_entries->blocks;
+			for (int idx = 0; idx < entries->block_capacity; ++idx)
+				if (SBOOL(old_blocks[idx]))
+					shm_pointer_move(thread, &new_blocks[idx], &old_blocks[idx]);
+		}
+		if (SBOOL(dict->entries))
+			shm_pointer_empty(thread, &dict->entries);
+		dict->entries = new_entries_shm;
+		entries = new_entries;
+	}
+	ShmPointer *blocks = &entries->blocks;
+	int block_size = isizeof(hash_entry_block) - isizeof(hash_entry) + isizeof(hash_entry) * (1 << SHM_UNDICT_ENTRY_BLOCK_LOG);
+	for (int idx = first >> SHM_UNDICT_ENTRY_BLOCK_LOG; idx < block_count; ++idx)
+		if (!SBOOL(blocks[idx]))
+			new_shm_refcounted_block(thread, &blocks[idx], block_size, SHM_TYPE_UNDICT_ENTRY_BLOCK, SHM_UNDICT_ENTRY_BLOCK_DEBUG_ID);
+	dict->entry_count = new_count;
+	return first;
+}
+
 bool
 shm_undict_get_table(ShmPointer p, hash_table_header **header_pntr, int item_size)
 {
@@ -3135,93 +4773,104 @@ shm_undict_compare_false(hash_bucket *bucket, ShmUnDictKey *key)
 }
 
 bool
-shm_undict_compare_key1(hash_bucket *bucket, ShmUnDictKey *key)
-{
-	RefUnicode s = shm_ref_unicode_get(bucket->key);
-
-	if (key->keysize != s.len)
-		return false;
-	else
-	{
-		for (int i = 0; i < s.len; ++i)
-		{
-			if (s.data[i] != key->key1[i])
-				return false;
-		}
-		return true;
-	}
+shm_undict_compare_key1(hash_bucket *bucket, ShmUnDictKey *key)
+{
+	Py_UCS1 buffer[SHM_IMMEDIATE_SHORT_MAX];
+	RefUnicode s = shm_unicode_key_get(bucket->key, buffer);
+	return shm_ref_unicode_equal(s, 1, key->key1, key->keysize);
 }
 bool
 shm_undict_compare_key2(hash_bucket *bucket, ShmUnDictKey *key)
 {
-	RefUnicode s = shm_ref_unicode_get(bucket->key);
+	Py_UCS1 buffer[SHM_IMMEDIATE_SHORT_MAX];
+	RefUnicode s = shm_unicode_key_get(bucket->key, buffer);
+	return shm_ref_unicode_equal(s, 2, key->key2, key->keysize);
+}
+bool
+shm_undict_compare_key4(hash_bucket *bucket, ShmUnDictKey *key)
+{
+	Py_UCS1 buffer[SHM_IMMEDIATE_SHORT_MAX];
+	RefUnicode s = shm_unicode_key_get(bucket->key, buffer);
+	return shm_ref_unicode_equal(s, 4, key->key4, key->keysize);
+}
 
-	if (key->keysize != s.len)
-		return false;
-	else
+bool
+shm_bytes_key_equal(ShmPointer key, const char *bytes, int size)
+{
+	if (shm_pointer_is_immediate(key))
 	{
-		for (int i = 0; i < s.len; ++i)
-		{
-			if (s.data[i] != key->key2[i])
-				return false;
-		}
-		return true;
+		uint8_t chars[SHM_IMMEDIATE_SHORT_MAX];
+		return shm_immediate_get_tag(key) == SHM_IMMEDIATE_SHORT_BYTES &&
+			shm_immediate_get_short(key, chars) == size &&
+			memcmp(chars, bytes, (size_t)size) == 0;
 	}
+	ShmValueHeader *header = LOCAL(key);
+	return header && SHM_TYPE(header->type) == SHM_TYPE(SHM_TYPE_BYTES) &&
+		shm_value_get_size(header) == size &&
+		memcmp(shm_value_get_data(header), bytes, (size_t)size) == 0;
 }
+
+// The str/bytes compare functions are called for any bucket with the same hash, so the bucket key might be of other type.
 bool
-shm_undict_compare_key4(hash_bucket *bucket, ShmUnDictKey *key)
+shm_undict_compare_bytes(hash_bucket *bucket, ShmUnDictKey *key)
 {
-	RefUnicode s = shm_ref_unicode_get(bucket->key);
-
-	return key->keysize == s.len && memcmp(CAST_VL(s.data), key->key4, (size_t)(s.len * isizeof(Py_UCS4))) == 0;
+	return shm_bytes_key_equal(bucket->key, key->key_bytes, key->keysize);
 }
 
 bool
-shm_undict_compare_ref_string(hash_bucket *bucket, ShmUnDictKey *key)
+shm_undict_compare_shm_key(hash_bucket *bucket, ShmUnDictKey *key)
 {
-	RefUnicode s = shm_ref_unicode_get(bucket->key);
-	RefUnicode s2 = shm_ref_unicode_get(key->key_shm);
+	return shm_value_equal(bucket->key, key->key_shm);
+}
 
-	return s2.len == s.len && memcmp(CAST_VL(s.data), CAST_VL(s2.data), (size_t)(s.len * isizeof(Py_UCS4))) == 0;
+bool
+shm_undict_compare_local_key(hash_bucket *bucket, ShmUnDictKey *key)
+{
+	return key->key_local_equal(bucket->key, key->key_local);
 }
 
 typedef enum {
-    key_invalid, key1, key2, key4, key_shm
+    key_invalid, key1, key2, key4, key_bytes, key_shm, key_local
 } ShmUndictKeyType;
 
 ShmUndictKeyType
 shm_undict_key_type(ShmUnDictKey *key)
 {
+	ShmUndictKeyType rslt = key_invalid;
+	int count = 0;
 	if (key->key1)
 	{
-		shmassert(!key->key2);
-		shmassert(!key->key4);
-		shmassert(!SBOOL(key->key_shm));
-		return key1;
+		rslt = key1;
+		count++;
 	}
-	else if (key->key2)
+	if (key->key2)
 	{
-		shmassert(!key->key1);
-		shmassert(!key->key4);
-		shmassert(!SBOOL(key->key_shm));
-		return key2;
+		rslt = key2;
+		count++;
 	}
-	else if (key->key4)
+	if (key->key4)
 	{
-		shmassert(!key->key1);
-		shmassert(!key->key2);
-		shmassert(!SBOOL(key->key_shm));
-		return key4;
+		rslt = key4;
+		count++;
 	}
-	else if (SBOOL(key->key_shm))
+	if (key->key_bytes)
 	{
-		shmassert(!key->key1);
-		shmassert(!key->key2);
-		shmassert(!key->key4);
-		return key_shm;
+		rslt = key_bytes;
+		count++;
 	}
-	shmassert(false);
-	return key_invalid;
+	if (SBOOL(key->key_shm))
+	{
+		rslt = key_shm;
+		count++;
+	}
+	if (key->key_local)
+	{
+		shmassert(key->key_local_equal && key->key_local_new);
+		rslt = key_local;
+		count++;
+	}
+	shmassert(count == 1);
+	return rslt;
 }
 
 hash_key_compare
@@ -3235,8 +4884,12 @@ shm_undict_key_compare_func(ShmUnDictKey *key)
 		return shm_undict_compare_key2;
 	case key4:
 		return shm_undict_compare_key4;
+	case key_bytes:
+		return shm_undict_compare_bytes;
 	case key_shm:
-		return shm_undict_compare_ref_string;
+		return shm_undict_compare_shm_key;
+	case key_local:
+		return shm_undict_compare_local_key;
 	case key_invalid:
 		shmassert(false);
 	}
@@ -3244,23 +4897,56 @@ shm_undict_key_compare_func(ShmUnDictKey *key)
 	return NULL;
 }
 
+// Keys of up to SHM_IMMEDIATE_SHORT_MAX Latin-1 characters are always stored as immediates regardless of the kind.
+static ShmPointer
+shm_unicode_new_key(ThreadContext *thread, int kind, const void *s, int len)
+{
+	if (len <= SHM_IMMEDIATE_SHORT_MAX)
+	{
+		Py_UCS1 chars[SHM_IMMEDIATE_SHORT_MAX];
+		bool fits = true;
+		for (int i = 0; i < len && fits; ++i)
+		{
+			Py_UCS4 c = shm_unicode_read(kind, s, i);
+			fits = c <= 0xFF;
+			chars[i] = (Py_UCS1)c;
+		}
+		if (fits)
+			return shm_immediate_from_short(SHM_IMMEDIATE_SHORT_STR, chars, len);
+	}
+	return shm_ref_unicode_new(thread, kind, s, len);
+}
+
+// Creates the key stored in the bucket, returns acquired reference.
 ShmPointer
 shm_undict_key_to_ref_string(ThreadContext *thread, ShmUnDictKey *key)
 {
 	switch (shm_undict_key_type(key))
 	{
 	case key1:
-		return shm_ref_unicode_new_ascii(thread, key->key1, key->keysize);
+		return shm_unicode_new_key(thread, 1, key->key1, key->keysize);
 	case key2:
-		shmassert_msg(false, "Not implemented");
-		break;
+		return shm_unicode_new_key(thread, 2, key->key2, key->keysize);
 	case key4:
-		return shm_ref_unicode_new(thread, key->key4, key->keysize);
-		break;
+		return shm_unicode_new_key(thread, 4, key->key4, key->keysize);
+	case key_bytes:
+	{
+		if (key->keysize <= SHM_IMMEDIATE_SHORT_MAX)
+			return shm_immediate_from_short(SHM_IMMEDIATE_SHORT_BYTES, (const uint8_t *)key->key_bytes, key->keysize);
+		ShmPointer rslt = EMPTY_SHM;
+		new_shm_bytes(thread, key->key_bytes, key->keysize, &rslt);
+		return rslt;
+	}
 	case key_shm:
 		shm_pointer_acq(thread, key->key_shm);
 		return key->key_shm;
 		break;
+	case key_local:
+	{
+		ShmPointer rslt = key->key_local_new(thread, key->key_local);
+		shmassert(SBOOL(rslt));
+		return rslt;
+	}
     case key_invalid:
 		shmassert(false);
 	}
@@ -3282,77 +4968,107 @@ shm_undict_validate_header(hash_table_header *header, bool is_delta)
 	shmassert(0 == header->revival_count);
 }
 
-// It's safe to pass a random itemindex here because its boundaries are verified.
+// Iterates the committed items in their insertion order. It's safe to pass a random itemindex here because
+// its boundaries are verified, the deleted items' holes return EMPTY_SHM.
 // Returns End of Table status
 bool
 shm_undict_get_bucket_at_index(ThreadContext *thread, ShmUnDict *dict, int itemindex, ShmPointer *result_key, ShmPointer *result_value)
 {
 	// Doesn't support handling own transient transaction yet
 	shmassert(thread->transaction_mode == TRANSACTION_PERSISTENT || thread->transaction_mode == TRANSACTION_TRANSIENT);
-	if (itemindex < 0)
-	{
-		if (result_key) *result_key = EMPTY_SHM;
-		if (result_value) *result_value = EMPTY_SHM;
+	shmassert_msg(dict->segments == EMPTY_SHM, "Iterate the segments of a concurrent dict instead");
+	if (result_key) *result_key = EMPTY_SHM;
+	if (result_value) *result_value = EMPTY_SHM;
+	if (itemindex < 0 || itemindex >= dict->entry_count)
 		return true;
-	}
-	hash_table_header *header = LOCAL(dict->buckets);
-	if (!header)
+
+	hash_entry *entry = shm_undict_entry_at(dict, itemindex);
+	ShmPointer key = entry->key;
+	if (!SBOOL(key))
+		return false;
+	ShmPointer value = entry->value;
+	shmassert(SBOOL(value));
+	if (result_key)
 	{
-		if (result_key) *result_key = EMPTY_SHM;
-		if (result_value) *result_value = EMPTY_SHM;
-		return true;
+		shm_pointer_acq(thread, key);
+		*result_key = key;
 	}
-	const int element_size = shm_dict_get_element_size(header);
-	shmassert(element_size == sizeof(hash_bucket));
-	if (itemindex >= (1 << header->log_count))
+	if (result_value)
 	{
-		if (result_key) *result_key = EMPTY_SHM;
-		if (result_value) *result_value = EMPTY_SHM;
-		return true;
+		shm_pointer_acq(thread, value);
+		*result_value = value;
 	}
-	hash_bucket *item = get_bucket_at_index(header, itemindex, element_size);
+	return false;
+}
 
-	switch (bucket_get_state(item))
+// Moves a set or reserved bucket into the same kind of table and leaves the source bucket deleted.
+// Returns the source bucket's state.
+static ShmInt
+shm_undict_move_bucket(ThreadContext *thread, hash_table_header *src_header, int src_index, hash_func_args *dest_args)
+{
+	const int src_item_size = shm_dict_get_element_size(src_header);
+	const bool to_delta = dest_args->bucket_item_size == sizeof(hash_delta_bucket);
+	shmassert(src_item_size == dest_args->bucket_item_size);
+	hash_bucket *src_item = get_bucket_at_index(src_header, src_index, src_item_size);
+	ShmInt state = to_delta ? delta_bucket_get_state((hash_delta_bucket *)src_item) : bucket_get_state(src_item);
+	switch (state)
 	{
 	case HASH_BUCKET_STATE_DELETED_RESERVED:
-		if (result_key) *result_key = EMPTY_SHM;
-		if (result_value) *result_value = EMPTY_SHM;
-		return false;
-		break;
 	case HASH_BUCKET_STATE_SET:
 	{
-		ShmPointer key = item->key;
-		ShmPointer value = item->value;
-		if (result_key)
-		{
-			if (SBOOL(key))
-				shm_pointer_acq(thread, key);
-			*result_key = key;
-		}
-		if (result_value)
+		hash_func_args copy_args = *dest_args;
+		copy_args.compare_key = shm_undict_compare_false; // We just copy, we don't need strict comparision.
+		ShmUnDictKey key = EMPTY_SHM_UNDICT_KEY;
+		key.hash = src_item->key_hash;
+		find_position_result find_rslt = hash_find_position(copy_args, &key);
+		shmassert(find_rslt.found == -1);
+		shmassert(find_rslt.last_free >= 0);
+		shmassert(find_rslt.found != -2);
+		hash_bucket *new_item = get_bucket_at_index(copy_args.header, find_rslt.last_free, copy_args.bucket_item_size);
+		shm_pointer_move_atomic(thread, &new_item->key, &src_item->key);
+		shmassert(shm_pointer_is_immediate(new_item->key) || shm_pointer_refcount(thread, new_item->key) > 0);
+		new_item->key_hash = src_item->key_hash;
+		new_item->entry = src_item->entry;
+		if (to_delta)
 		{
-			if (SBOOL(value))
-				shm_pointer_acq(thread, value);
-			*result_value = value;
+			hash_delta_bucket *new_delta = (hash_delta_bucket *)new_item;
+			hash_delta_bucket *src_delta = (hash_delta_bucket *)src_item;
+			shm_pointer_move_atomic(thread, &new_delta->value, &src_delta->value);
+			new_delta->orig_item = src_delta->orig_item;
+			new_delta->appended = src_delta->appended;
 		}
-		return false;
+		bucket_sync_ctrl(copy_args.header, find_rslt.last_free, copy_args.bucket_item_size);
 
+		src_item->key = NONE_SHM; // memset-friendly
+		src_item->key_hash = 1;
+		bucket_sync_ctrl(src_header, src_index, src_item_size);
 		break;
 	}
 	case HASH_BUCKET_STATE_DELETED:
+		// skip
+		shmassert(SBOOL(src_item->key) == false);
+		break;
 	case HASH_BUCKET_STATE_EMPTY:
-		if (result_key) *result_key = EMPTY_SHM;
-		if (result_value) *result_value = EMPTY_SHM;
-		return false;
+		// skip
 		break;
 	default:
 		shmassert(false);
-		if (result_key) *result_key = EMPTY_SHM;
-		if (result_value) *result_value = EMPTY_SHM;
-		return true;
 	}
+	return state;
+}
+
+// Marks a table with all the items moved out as relocated and unlinks its index subblocks,
+// the index block's destructor does not release them.
+static void
+shm_undict_table_relocated(ThreadContext *thread, hash_table_header *header)
+{
+	if (header->is_index)
+		shm_undict_index_destroy(thread, (hash_table_index_header *)header, false); // sets the relocated too
+	else
+		shm_atomic_int_set_release(&header->relocated, true);
 }
 
+// Grows the delta table at once. The persistent table is grown by shm_undict_grow_persistent() instead.
 void
 shm_undict_grow_table(ThreadContext *thread, ShmUnDict *dict, bool is_delta, int increment, int item_size,
 		hash_table_header **created_header, volatile ShmInt *created_bucket_count)
@@ -3370,8 +5086,7 @@ shm_undict_grow_table(ThreadContext *thread, ShmUnDict *dict, bool is_delta, int
 	shmassert(header->log_count < SHM_UNDICT_LOGCOUNT_LIMIT);
 	if (!header->is_index)
 	{
-		const int old_size = isizeof(hash_table_header) - isizeof(hash_bucket) + element_size * (1 << header->log_count);
-		shmassert(header->size == old_size);
+		shmassert(header->size == hash_table_block_size(element_size, header->log_count));
 	}
 
 	shmassert(increment > 0 && increment < SHM_UNDICT_LOGCOUNT_LIMIT);
@@ -3389,61 +5104,20 @@ shm_undict_grow_table(ThreadContext *thread, ShmUnDict *dict, bool is_delta, int
 	new_table_args.item_count = &new_count;
 	new_table_args.deleted_count = &new_deleted_count;
 	new_table_args.bucket_count = 1 << new_log_count;
-	new_table_args.compare_key = shm_undict_compare_false; // We just copy, we don't need strict comparision.
-
-	ShmUnDictKey key = EMPTY_SHM_UNDICT_KEY;
+	new_table_args.compare_key = shm_undict_compare_false;
 
-	p_atomic_int_set(&header->relocated, true);
+	shmassert(is_delta || dict->old_buckets == EMPTY_SHM);
 
-	for (long src_index = 0; src_index < (1 << header->log_count); ++src_index)
+	for (int src_index = 0; src_index < (1 << header->log_count); ++src_index)
 	{
-		hash_bucket *src_item = get_bucket_at_index(header, src_index, element_size);
-
-		bool is_deleted = false;
-		switch (bucket_get_state(src_item))
-		{
-		case HASH_BUCKET_STATE_DELETED_RESERVED:
-			shmassert(is_delta);
-			is_deleted = true;
-			// pass through
-		case HASH_BUCKET_STATE_SET:
-		{
-			key.hash = src_item->key_hash;
-			find_position_result find_rslt = hash_find_position(new_table_args, &key);
-			shmassert(find_rslt.found == -1);
-			shmassert(find_rslt.last_free >= 0);
-			shmassert(find_rslt.found != -2);
-			hash_bucket *new_item = get_bucket_at_index(new_table_args.header, find_rslt.last_free, new_table_args.bucket_item_size);
-			shm_pointer_move_atomic(thread, &new_item->key, &src_item->key);
-			shmassert(shm_pointer_refcount(thread, new_item->key) > 0);
-			shm_pointer_move_atomic(thread, &new_item->key_hash, &src_item->key_hash);
-			shm_pointer_move_atomic(thread, &new_item->value, &src_item->value);
-			if (is_delta)
-				((hash_delta_bucket *)new_item)->orig_item = ((hash_delta_bucket *)src_item)->orig_item;
-
-			if (is_deleted)
-				new_deleted_count++;
-			else
-				new_count++;
-
-			break;
-		}
-		case HASH_BUCKET_STATE_DELETED:
-			// skip
-			shmassert(SBOOL(src_item->key) == false);
-			break;
-		case HASH_BUCKET_STATE_EMPTY:
-			// skip
-			break;
-		default:
-			shmassert(false);
-		}
+		ShmInt state = shm_undict_move_bucket(thread, header, src_index, &new_table_args);
+		if (state == HASH_BUCKET_STATE_DELETED_RESERVED)
+			new_deleted_count++;
+		else if (state == HASH_BUCKET_STATE_SET)
+			new_count++;
 	}
 	// shm_undict_debug_print(thread, dict);
-
-	// we've already trashed the table -- might be a good idea to unlink the index->table references
-	if (header->is_index)
-		shm_undict_index_destroy(thread, (hash_table_index_header *)header, false);
+	shm_undict_table_relocated(thread, header);
 
 	if (is_delta)
 	{
@@ -3464,6 +5138,102 @@ shm_undict_grow_table(ThreadContext *thread, ShmUnDict *dict, bool is_delta, int
 		*created_bucket_count = new_table_args.bucket_count;
 }
 
+// Moves up to bucket_limit buckets (all of them for -1) from the old_buckets into the persistent table,
+// releases the old_buckets after the last one.
+void
+shm_undict_migrate(ThreadContext *thread, ShmUnDict *dict, hash_func_args *persist_args, int bucket_limit)
+{
+	hash_table_header *old_header = LOCAL(dict->old_buckets);
+	if (!old_header)
+		return;
+	shm_undict_validate_header(old_header, false);
+	int old_bucket_count = 1 << old_header->log_count;
+	int index = dict->migrated_count;
+	int end = old_bucket_count;
+	if (bucket_limit >= 0 && bucket_limit < old_bucket_count - index)
+		end = index + bucket_limit;
+	for (; index < end; ++index)
+		shm_undict_move_bucket(thread, old_header, index, persist_args);
+	dict->migrated_count = index;
+
+	if (index == old_bucket_count)
+	{
+		shm_undict_table_relocated(thread, old_header);
+		shm_pointer_empty(thread, &dict->old_buckets);
+		dict->migrated_count = 0;
+	}
+}
+
+// Moves the key's bucket from the old_buckets into the persistent table,
+// so a modification of the key only has to deal with the persistent table.
+static void
+shm_undict_migrate_key(ThreadContext *thread, ShmUnDict *dict, hash_func_args *persist_args, ShmUnDictKey *key)
+{
+	hash_table_header *old_header = LOCAL(dict->old_buckets);
+	if (!old_header)
+		return;
+	hash_func_args old_args = *persist_args;
+	old_args.header = old_header;
+	old_args.bucket_count = 1 << old_header->log_count;
+	find_position_result rslt = hash_find_position(old_args, key);
+	if (rslt.found >= 0)
+		shm_undict_move_bucket(thread, old_header, rslt.found, persist_args);
+}
+
+// Replaces the persistent table with a twice larger empty one, the items are moved there from the old_buckets
+// by the following modifications (SHM_UNDICT_MIGRATE_STEP buckets each), so no single modification rehashes
+// the whole table. Lookups check both tables meanwhile.
+void
+shm_undict_grow_persistent(ThreadContext *thread, ShmUnDict *dict, hash_func_args *persist_args)
+{
+	// the previous migration normally finishes long before
+	shm_undict_migrate(thread, dict, persist_args, -1);
+	shmassert(dict->old_buckets == EMPTY_SHM);
+
+	hash_table_header *header = persist_args->header;
+	shm_undict_validate_header(header, false);
+	int new_log_count = header->log_count + 1;
+	shmassert(new_log_count < SHM_UNDICT_LOGCOUNT_LIMIT);
+	ShmPointer new_table_shm;
+	hash_table_header *new_header = new_dict_table(thread, &new_table_shm, header->type, new_log_count, sizeof(hash_bucket));
+	// the dict's reference to the table passes to old_buckets
+	dict->old_buckets = dict->buckets;
+	dict->buckets = new_table_shm;
+	dict->migrated_count = 0;
+	dict->deleted_count = 0; // deleted buckets stay in the old table
+
+	persist_args->header = new_header;
+	persist_args->bucket_count = 1 << new_log_count;
+}
+
+// Finds the key in the persistent table or in the old_buckets during migration.
+// The found index is in the shm_undict_get_bucket_at_index() numbering, old_buckets' buckets follow the persistent table.
+static hash_bucket *
+shm_undict_find_persistent(ShmUnDict *dict, hash_func_args *persist_args, ShmUnDictKey *key, hash_index *found_index)
+{
+	find_position_result rslt = hash_find_position(*persist_args, key);
+	if (rslt.found >= 0)
+	{
+		*found_index = rslt.found;
+		return get_bucket_at_index(persist_args->header, rslt.found, sizeof(hash_bucket));
+	}
+	hash_table_header *old_header = LOCAL(dict->old_buckets);
+	if (old_header)
+	{
+		hash_func_args old_args = *persist_args;
+		old_args.header = old_header;
+		old_args.bucket_count = 1 << old_header->log_count;
+		rslt = hash_find_position(old_args, key);
+		if (rslt.found >= 0)
+		{
+			*found_index = persist_args->bucket_count + rslt.found;
+			return get_bucket_at_index(old_header, rslt.found, sizeof(hash_bucket));
+		}
+	}
+	*found_index = -1;
+	return NULL;
+}
+
 bool
 grow_or_allocate_delta(ThreadContext *thread, ShmUnDict *dict, hash_func_args *delta_args, hash_table_header **delta_header)
 {
@@ -3484,204 +5254,224 @@ grow_or_allocate_delta(ThreadContext *thread, ShmUnDict *dict, hash_func_args *d
 	return false;
 }
 
-int
-shm_undict_set_do(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key,
+// The body of shm_undict_set_do. The dict (segment) is write-locked by the caller, which also
+// commits the transient transaction, so several items can be set under a single lock.
+static void
+shm_undict_set_locked(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key,
     ShmPointer value, bool consume, DictProfiling *profiling)
 {
-	bool lock_taken1 = false;
-	uint64_t tmp;
-	tmp = rdtsc();
-	if (profiling) profiling->counter1 += rdtsc() - tmp;
-	tmp = rdtsc();
-	bool had_write_lock = shm_cell_have_write_lock(thread, &dict.local->lock);
-	if_failure(transaction_lock_write(thread, &dict.local->lock, dict.shared, CONTAINER_UNORDERED_DICT, &lock_taken1),
-	{
-		if (SBOOL(value) && consume)
-			shm_pointer_release(thread, value);
-		transient_abort(thread);
-		return status;
-	});
-	shm_cell_check_write_lock(thread, &dict.local->lock);
-	if (!had_write_lock)
-	{
-		shmassert(dict.local->delta_buckets == EMPTY_SHM);
-		shmassert(dict.local->delta_count == 0);
-		shmassert(dict.local->delta_deleted_count == 0);
-	}
-	if (profiling) profiling->counter2 += rdtsc() - tmp;
-	tmp = rdtsc();
-	{
-		//ShmDictElement *element = shm_dict_find(thread, dict, hash, key, keysize));
-		//if ( ! element)
-		hash_func_args delta_args;
-		delta_args.thread = thread;
-		delta_args.bucket_item_size = sizeof(hash_delta_bucket);
-		shm_undict_get_table(dict.local->delta_buckets, &delta_args.header, delta_args.bucket_item_size);
-		delta_args.item_count = &dict.local->delta_count;
-		delta_args.deleted_count = &dict.local->delta_deleted_count;
-		delta_args.bucket_count = delta_args.header ? (1 << delta_args.header->log_count) : 0;
-		delta_args.compare_key = shm_undict_key_compare_func(key);
-		hash_func_args orig_args;
-		orig_args.thread = thread;
-		orig_args.bucket_item_size = sizeof(hash_bucket);
-		shm_undict_get_table(dict.local->buckets, &orig_args.header, orig_args.bucket_item_size);
-		orig_args.item_count = &dict.local->delta_count;
-		orig_args.deleted_count = &dict.local->delta_deleted_count;
-		orig_args.bucket_count = orig_args.header ? (1 << orig_args.header->log_count) : 0;
-		orig_args.compare_key = shm_undict_key_compare_func(key);
-		bool modified = false;
+	uint64_t tmp = rdtsc();
+	//ShmDictElement *element = shm_dict_find(thread, dict, hash, key, keysize));
+	//if ( ! element)
+	hash_func_args delta_args;
+	delta_args.thread = thread;
+	delta_args.bucket_item_size = sizeof(hash_delta_bucket);
+	shm_undict_get_table(dict.local->delta_buckets, &delta_args.header, delta_args.bucket_item_size);
+	delta_args.item_count = &dict.local->delta_count;
+	delta_args.deleted_count = &dict.local->delta_deleted_count;
+	delta_args.bucket_count = delta_args.header ? (1 << delta_args.header->log_count) : 0;
+	delta_args.compare_key = shm_undict_key_compare_func(key);
+	hash_func_args orig_args;
+	orig_args.thread = thread;
+	orig_args.bucket_item_size = sizeof(hash_bucket);
+	shm_undict_get_table(dict.local->buckets, &orig_args.header, orig_args.bucket_item_size);
+	orig_args.item_count = &dict.local->delta_count;
+	orig_args.deleted_count = &dict.local->delta_deleted_count;
+	orig_args.bucket_count = orig_args.header ? (1 << orig_args.header->log_count) : 0;
+	orig_args.compare_key = shm_undict_key_compare_func(key);
+	bool modified = false;
+	{
+		find_position_result rslt_delta = { -1, -1 };
+		hash_delta_bucket *found_delta_bucket = NULL;
+		hash_delta_bucket *new_delta_bucket = NULL;
+		int new_delta_index = -1;
+		shmassert(SBOOL(dict.local->delta_buckets) == (delta_args.header != NULL));
+		if (delta_args.header)
 		{
-			find_position_result rslt_delta = { -1, -1 };
-			hash_delta_bucket *found_delta_bucket = NULL;
-			hash_delta_bucket *new_delta_bucket = NULL;
-			shmassert(SBOOL(dict.local->delta_buckets) == (delta_args.header != NULL));
-			if (delta_args.header)
+			if (*delta_args.item_count + *delta_args.deleted_count > delta_args.bucket_count / 2 + 1)
+				shm_undict_grow_table(thread, dict.local, true, 1, delta_args.bucket_item_size, &delta_args.header, &delta_args.bucket_count);
+			for (int cycle = 1; cycle <= 2; ++cycle)
 			{
-				if (*delta_args.item_count + *delta_args.deleted_count > delta_args.bucket_count / 2 + 1)
-					shm_undict_grow_table(thread, dict.local, true, 1, delta_args.bucket_item_size, &delta_args.header, &delta_args.bucket_count);
-				for (int cycle = 1; cycle <= 2; ++cycle)
-				{
-					rslt_delta = hash_find_position(delta_args, key);
+				rslt_delta = hash_find_position(delta_args, key);
 
-					if (rslt_delta.found >= 0)
-					{
-						// replacing previously modified item
-						shmassert(rslt_delta.found < delta_args.bucket_count);
-						found_delta_bucket = (hash_delta_bucket *)
-							get_bucket_at_index(delta_args.header, rslt_delta.found, delta_args.bucket_item_size);
-					}
-					else if (rslt_delta.last_free >= 0)
-					{
-						shmassert(rslt_delta.last_free < delta_args.bucket_count);
-						new_delta_bucket = (hash_delta_bucket *)
-							get_bucket_at_index(delta_args.header, rslt_delta.last_free, delta_args.bucket_item_size);
-					}
+				if (rslt_delta.found >= 0)
+				{
+					// replacing previously modified item
+					shmassert(rslt_delta.found < delta_args.bucket_count);
+					found_delta_bucket = (hash_delta_bucket *)
+						get_bucket_at_index(delta_args.header, rslt_delta.found, delta_args.bucket_item_size);
+				}
+				else if (rslt_delta.last_free >= 0)
+				{
+					shmassert(rslt_delta.last_free < delta_args.bucket_count);
+					new_delta_index = rslt_delta.last_free;
+					new_delta_bucket = (hash_delta_bucket *)
+						get_bucket_at_index(delta_args.header, new_delta_index, delta_args.bucket_item_size);
+				}
 
-					if (rslt_delta.found == -2)
-					{
-						shmassert(cycle != 2);
-						shmassert(!found_delta_bucket && !new_delta_bucket);
-						shm_undict_grow_table(thread, dict.local, true, 1, delta_args.bucket_item_size, &delta_args.header, &delta_args.bucket_count);
-					}
-					if (rslt_delta.found == -1 && rslt_delta.last_free == -1)
-						break;
+				if (rslt_delta.found == -2)
+				{
+					shmassert(cycle != 2);
+					shmassert(!found_delta_bucket && !new_delta_bucket);
+					shm_undict_grow_table(thread, dict.local, true, 1, delta_args.bucket_item_size, &delta_args.header, &delta_args.bucket_count);
 				}
+				if (rslt_delta.found == -1 && rslt_delta.last_free == -1)
+					break;
 			}
-			shmassert(rslt_delta.found > -2);
-			if (found_delta_bucket)
+		}
+		shmassert(rslt_delta.found > -2);
+		if (found_delta_bucket)
+		{
+			switch (delta_bucket_get_state(found_delta_bucket))
 			{
-				switch (bucket_get_state((hash_bucket*)found_delta_bucket))
-				{
-				case HASH_BUCKET_STATE_SET:
-				case HASH_BUCKET_STATE_DELETED_RESERVED:
+			case HASH_BUCKET_STATE_SET:
+			case HASH_BUCKET_STATE_DELETED_RESERVED:
+			{
+				// update the existing delta item
+				bool was_valid = found_delta_bucket->value != EMPTY_SHM;
+				bool set_valid = value != EMPTY_SHM;
+				if (consume)
+					shm_pointer_move(thread, &found_delta_bucket->value, &value);
+				else
+					shm_pointer_copy(thread, &found_delta_bucket->value, value);
+				if (was_valid != set_valid)
 				{
-					// update the existing delta item
-					bool was_valid = found_delta_bucket->value != EMPTY_SHM;
-					bool set_valid = value != EMPTY_SHM;
-					if (consume)
-						shm_pointer_move(thread, &found_delta_bucket->value, &value);
-					else
-						shm_pointer_copy(thread, &found_delta_bucket->value, value);
-					if (was_valid != set_valid)
+					if (was_valid)
 					{
-						if (was_valid)
-						{
-							(*delta_args.deleted_count)++;
-							(*delta_args.item_count)--;
-						}
-						else
-						{
-
-							(*delta_args.deleted_count)--;
-							(*delta_args.item_count)++;
-						}
+						(*delta_args.deleted_count)++;
+						(*delta_args.item_count)--;
 					}
+					else
+					{
 
-					modified = true;
-					break;
+						(*delta_args.deleted_count)--;
+						(*delta_args.item_count)++;
+						// a reinserted key goes to the end like in the Python's dict
+						found_delta_bucket->appended = dict.local->delta_appended++;
+					}
 				}
-				default:
-					shmassert(false);
+
+				modified = true;
+				break;
+			}
+			default:
+				shmassert(false);
+			}
+		}
+		else
+		{
+			hash_index persist_found = -1;
+			hash_bucket *bucket = shm_undict_find_persistent(dict.local, &orig_args, key, &persist_found);
+			if (bucket)
+			{
+				if (grow_or_allocate_delta(thread, dict.local, &delta_args, &delta_args.header)) {
+					find_position_result new_delta_probe = hash_find_position(delta_args, key);
+					shmassert(new_delta_probe.found == -1 && new_delta_probe.last_free >= 0);
+					new_delta_index = new_delta_probe.last_free;
+					new_delta_bucket = (hash_delta_bucket *)
+						get_bucket_at_index(delta_args.header, new_delta_index, delta_args.bucket_item_size);
 				}
+				shmassert(new_delta_bucket);
+				// create a linked item in the dict.local->delta_buckets
+				shmassert(bucket_get_state(bucket) == HASH_BUCKET_STATE_SET);
+				// validate_bucket(bucket); - done by hash_find_position
+				shm_pointer_copy(thread, &new_delta_bucket->key, bucket->key);
+				new_delta_bucket->key_hash = bucket->key_hash;
+				new_delta_bucket->entry = bucket->entry;
+				if (consume)
+					shm_pointer_move(thread, &new_delta_bucket->value, &value);
+				else
+					shm_pointer_copy(thread, &new_delta_bucket->value, value);
+				new_delta_bucket->orig_item = (int32_t)persist_found;
+				new_delta_bucket->appended = -1;
+				bucket_sync_ctrl(delta_args.header, new_delta_index, delta_args.bucket_item_size);
+
+				if (value == EMPTY_SHM)
+					(*delta_args.deleted_count)++;
+				else
+					(*delta_args.item_count)++;
+
+				modified = true;
 			}
 			else
 			{
-				find_position_result persist_probe = hash_find_position(orig_args, key);
-				if (persist_probe.found >= 0)
+				if (value != EMPTY_SHM)
 				{
+					// create a brand new item in the dict.local->delta_buckets
 					if (grow_or_allocate_delta(thread, dict.local, &delta_args, &delta_args.header)) {
-						find_position_result new_delta_probe = hash_find_position(delta_args, key);
-						shmassert(new_delta_probe.found == -1 && new_delta_probe.last_free >= 0);
+						find_position_result new_delta_rslt = hash_find_position(delta_args, key);
+						shmassert(new_delta_rslt.found == -1 && new_delta_rslt.last_free >= 0);
+						new_delta_index = new_delta_rslt.last_free;
 						new_delta_bucket = (hash_delta_bucket *)
-							get_bucket_at_index(delta_args.header, new_delta_probe.last_free, delta_args.bucket_item_size);
+							get_bucket_at_index(delta_args.header, new_delta_index, delta_args.bucket_item_size);
 					}
-					shmassert(new_delta_bucket);
-					shmassert(persist_probe.found < orig_args.bucket_count);
-					hash_bucket *bucket = get_bucket_at_index(orig_args.header, persist_probe.found, orig_args.bucket_item_size);
-					// create a linked item in the dict.local->delta_buckets
-					shmassert(bucket_get_state(bucket) == HASH_BUCKET_STATE_SET);
-					// validate_bucket(bucket); - done by hash_find_position
-					shm_pointer_copy(thread, &new_delta_bucket->key, bucket->key);
-					new_delta_bucket->key_hash = bucket->key_hash;
+					new_delta_bucket->key = shm_undict_key_to_ref_string(thread, key);
+					new_delta_bucket->key_hash = key->hash;
+					new_delta_bucket->entry = 0;
 					if (consume)
 						shm_pointer_move(thread, &new_delta_bucket->value, &value);
 					else
 						shm_pointer_copy(thread, &new_delta_bucket->value, value);
-					new_delta_bucket->orig_item = persist_probe.found;
-
-					if (value == EMPTY_SHM)
-						delta_args.deleted_count++;
-					else
-						delta_args.item_count++;
+					new_delta_bucket->orig_item = -1;
+					new_delta_bucket->appended = dict.local->delta_appended++;
+					bucket_sync_ctrl(delta_args.header, new_delta_index, delta_args.bucket_item_size);
 
+					dict.local->delta_count++;
 					modified = true;
 				}
-				else
-				{
-					if (value != EMPTY_SHM)
-					{
-						// create a brand new item in the dict.local->delta_buckets
-						if (grow_or_allocate_delta(thread, dict.local, &delta_args, &delta_args.header)) {
-							find_position_result new_delta_rslt = hash_find_position(delta_args, key);
-							shmassert(new_delta_rslt.found == -1 && new_delta_rslt.last_free >= 0);
-							new_delta_bucket = (hash_delta_bucket *)
-								get_bucket_at_index(delta_args.header, new_delta_rslt.last_free, delta_args.bucket_item_size);
-						}
-						new_delta_bucket->key = shm_undict_key_to_ref_string(thread, key);
-						new_delta_bucket->key_hash = key->hash;
-						if (consume)
-							shm_pointer_move(thread, &new_delta_bucket->value, &value);
-						else
-							shm_pointer_copy(thread, &new_delta_bucket->value, value);
-						new_delta_bucket->orig_item = -1;
-
-						dict.local->delta_count++;
-						modified = true;
-					}
-				}
 			}
 		}
-		if (profiling) profiling->counter3 += rdtsc() - tmp;
-		if (modified)
-		{
-			tmp = rdtsc();
-			// we probably need to verify the dict.lical->lock.changes_shm value
-			// shmassert(shm_dict_push_delta(thread, &dict.local->delta, DICT_DELTA_CHANGED, value, element_shm));
-		}
-		if (SBOOL(value))
-		{
-			tmp = rdtsc();
-			// release in case the value was not moved
-			if (consume)
-				shm_pointer_release(thread, value);
-			if (profiling) profiling->counter6 += rdtsc() - tmp;
-		}
+	}
+	if (profiling) profiling->counter3 += rdtsc() - tmp;
+	if (modified)
+	{
+		tmp = rdtsc();
+		// we probably need to verify the dict.lical->lock.changes_shm value
+		// shmassert(shm_dict_push_delta(thread, &dict.local->delta, DICT_DELTA_CHANGED, value, element_shm));
+	}
+	if (SBOOL(value))
+	{
+		tmp = rdtsc();
+		// release in case the value was not moved
+		if (consume)
+			shm_pointer_release(thread, value);
+		if (profiling) profiling->counter6 += rdtsc() - tmp;
+	}
+}
+
+int
+shm_undict_set_do(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key,
+    ShmPointer value, bool consume, DictProfiling *profiling)
+{
+	if (dict.local->segments != EMPTY_SHM)
+		return shm_undict_set_do(thread, shm_undict_key_segment(dict.local, key->hash), key, value, consume, profiling);
+	bool lock_taken1 = false;
+	uint64_t tmp;
+	tmp = rdtsc();
+	if (profiling) profiling->counter1 += rdtsc() - tmp;
+	tmp = rdtsc();
+	bool had_write_lock = shm_cell_have_write_lock(thread, &dict.local->lock);
+	if_failure(transaction_lock_write(thread, &dict.local->lock, dict.shared, CONTAINER_UNORDERED_DICT, &lock_taken1),
+	{
+		if (SBOOL(value) && consume)
+			shm_pointer_release(thread, value);
+		transient_abort(thread);
+		return status;
+	});
+	shm_cell_check_write_lock(thread, &dict.local->lock);
+	if (!had_write_lock)
+	{
+		shmassert(dict.local->delta_buckets == EMPTY_SHM);
+		shmassert(dict.local->delta_count == 0);
+		shmassert(dict.local->delta_deleted_count == 0);
+	}
+	if (profiling) profiling->counter2 += rdtsc() - tmp;
+	shm_undict_set_locked(thread, dict, key, value, consume, profiling);
 
-		tmp = rdtsc();
-		transient_commit(thread);
-		if (profiling) profiling->counter7 += rdtsc() - tmp;
-		return RESULT_OK;
-	};
+	tmp = rdtsc();
+	transient_commit(thread);
+	if (profiling) profiling->counter7 += rdtsc() - tmp;
+	return RESULT_OK;
 }
 
 int
@@ -3714,6 +5504,8 @@ release_persistent_table(ThreadContext *thread, ShmUnDict *dict);
 int
 shm_undict_set_item_raw(ThreadContext *thread, ShmUnDict *dict, ShmUnDictKey *key, ShmPointer value, bool consume)
 {
+	if (dict->segments != EMPTY_SHM)
+		return shm_undict_set_item_raw(thread, shm_undict_key_segment(dict, key->hash).local, key, value, consume);
 	shmassert(dict->delta_buckets == EMPTY_SHM);
 	shmassert(dict->delta_count == 0);
 	shmassert(dict->delta_deleted_count == 0);
@@ -3729,10 +5521,11 @@ shm_undict_set_item_raw(ThreadContext *thread, ShmUnDict *dict, ShmUnDictKey *ke
 	persist_args.item_count = &dict->count;
 	persist_args.deleted_count = &dict->deleted_count;
 	persist_args.bucket_count = 1 << persist_args.header->log_count;
-	persist_args.compare_key = shm_undict_compare_ref_string;
+	persist_args.compare_key = shm_undict_key_compare_func(key);
 
 	if (*persist_args.item_count + *persist_args.deleted_count > persist_args.bucket_count / 2 + 1)
-		shm_undict_grow_table(thread, dict, false, 1, persist_args.bucket_item_size, &persist_args.header, &persist_args.bucket_count);
+		shm_undict_grow_persistent(thread, dict, &persist_args);
+	shm_undict_migrate(thread, dict, &persist_args, SHM_UNDICT_MIGRATE_STEP);
 
 	find_position_result persist_rslt = { .found = -1, .last_free = -1 };
 	for (int cycle = 1; cycle <= 4; ++cycle)
@@ -3741,7 +5534,7 @@ shm_undict_set_item_raw(ThreadContext *thread, ShmUnDict *dict, ShmUnDictKey *ke
 
 		persist_rslt = hash_find_position(persist_args, key);
 		if (persist_rslt.found == -2)
-			shm_undict_grow_table(thread, dict, false, 1, persist_args.bucket_item_size, &persist_args.header, &persist_args.bucket_count);
+			shm_undict_grow_persistent(thread, dict, &persist_args);
 		else
 			break;
 	}
@@ -3752,19 +5545,153 @@ shm_undict_set_item_raw(ThreadContext *thread, ShmUnDict *dict, ShmUnDictKey *ke
 	{
 		// allocate a new persistent item
 		hash_bucket *last_free = get_bucket_at_index(persist_args.header, persist_rslt.last_free, sizeof(hash_bucket));
-		if (consume)
-			shm_pointer_move(thread, &last_free->value, &value);
-		else
-			shm_pointer_copy(thread, &last_free->value, value);
-
 		last_free->key = shm_undict_key_to_ref_string(thread, key);
 		last_free->key_hash = key->hash;
+		last_free->entry = (uint32_t)shm_undict_append_entries(thread, dict, 1);
+		bucket_sync_ctrl(persist_args.header, persist_rslt.last_free, sizeof(hash_bucket));
+		hash_entry *entry = shm_undict_entry_at(dict, last_free->entry);
+		entry->key = last_free->key;
+		if (consume)
+			shm_pointer_move(thread, &entry->value, &value);
+		else
+			shm_pointer_copy(thread, &entry->value, value);
 		(*persist_args.item_count)++;
 	}
 
 	return RESULT_OK;
 }
 
+// Adds the delta's new key into the persistent table's free bucket and fills the key's appended entry.
+// The key and the value are moved out of the delta bucket, which is left deleted.
+static void
+shm_undict_commit_new_key(ThreadContext *thread, ShmUnDict *dict, hash_func_args *persist_args, hash_index position,
+		hash_delta_bucket *delta_bucket, ShmInt appended_base)
+{
+	shmassert(delta_bucket->orig_item == -1 && delta_bucket->appended >= 0);
+	hash_bucket *bucket = get_bucket_at_index(persist_args->header, position, sizeof(hash_bucket));
+	shm_pointer_move(thread, &bucket->key, &delta_bucket->key);
+	shmassert(shm_pointer_is_immediate(bucket->key) || shm_pointer_refcount(thread, bucket->key) > 0);
+	bucket->key_hash = delta_bucket->key_hash;
+	bucket->entry = (uint32_t)(appended_base + delta_bucket->appended);
+	bucket_sync_ctrl(persist_args->header, position, sizeof(hash_bucket));
+
+	hash_entry *entry = shm_undict_entry_at(dict, bucket->entry);
+	shmassert(!SBOOL(entry->key));
+	entry->key = bucket->key;
+	shm_pointer_move(thread, &entry->value, &delta_bucket->value);
+	(*persist_args->item_count)++;
+
+	delta_bucket->key = NONE_SHM; // memset-friendly
+	delta_bucket->key_hash = 1;
+}
+
+// Commits a delta outweighing the persistent table by building the resulting table at once. The persistent items
+// and the delta's new keys are moved into a table sized for the result without comparing any keys,
+// the merge loop of shm_undict_commit() is left with the existing keys' modifications and never grows the table.
+static void
+shm_undict_commit_rebuild(ThreadContext *thread, ShmUnDict *dict, hash_table_header *delta_header, ShmInt appended_base)
+{
+	int final_count = dict->count + dict->delta_count;
+	int log_count = 2; // 4 items by default
+	while ((1 << log_count) / 2 + 1 < final_count)
+		log_count++;
+	shmassert(log_count < SHM_UNDICT_LOGCOUNT_LIMIT);
+
+	ShmPointer new_table_shm;
+	hash_func_args new_args;
+	new_args.thread = thread;
+	new_args.header = new_dict_table(thread, &new_table_shm, SHM_TYPE_UNDICT_TABLE, log_count, sizeof(hash_bucket));
+	new_args.bucket_item_size = sizeof(hash_bucket);
+	new_args.item_count = &dict->count;
+	new_args.deleted_count = &dict->deleted_count;
+	new_args.bucket_count = 1 << log_count;
+	new_args.compare_key = shm_undict_compare_false;
+
+	ShmPointer tables[2] = { dict->buckets, dict->old_buckets };
+	for (int table = 0; table < 2; ++table)
+	{
+		hash_table_header *header = LOCAL(tables[table]);
+		if (!header)
+			continue;
+		shm_undict_validate_header(header, false);
+		for (int index = 0; index < (1 << header->log_count); ++index)
+			shm_undict_move_bucket(thread, header, index, &new_args);
+		shm_undict_table_relocated(thread, header);
+	}
+	shm_pointer_empty(thread, &dict->old_buckets);
+	dict->migrated_count = 0;
+	dict->deleted_count = 0;
+	shm_pointer_move(thread, &dict->buckets, &new_table_shm);
+
+	// orig_item == -1 means the key was not in the persistent table when it was set, nobody could've added it since
+	for (int delta_index = 0; delta_index < (1 << delta_header->log_count); ++delta_index)
+	{
+		hash_delta_bucket *delta_bucket = (hash_delta_bucket *)get_bucket_at_index(delta_header, delta_index, sizeof(hash_delta_bucket));
+		if (delta_bucket->orig_item == -1 && delta_bucket_get_state(delta_bucket) == HASH_BUCKET_STATE_SET)
+		{
+			ShmUnDictKey key = EMPTY_SHM_UNDICT_KEY;
+			key.hash = delta_bucket->key_hash;
+			find_position_result rslt = hash_find_position(new_args, &key);
+			shmassert(rslt.found == -1 && rslt.last_free >= 0);
+			shm_undict_commit_new_key(thread, dict, &new_args, rslt.last_free, delta_bucket, appended_base);
+		}
+	}
+}
+
+// Moves the items into the front entries keeping their order and releases the unused entry blocks,
+// the buckets are renumbered through the old to new entry index map.
+static void
+shm_undict_pack_entries(ThreadContext *thread, ShmUnDict *dict)
+{
+	int32_t *new_index = malloc(sizeof(int32_t) * (size_t)dict->entry_count);
+	shmassert(new_index);
+	ShmInt packed = 0;
+	for (ShmInt index = 0; index < dict->entry_count; ++index)
+	{
+		hash_entry *entry = shm_undict_entry_at(dict, index);
+		if (!SBOOL(entry->key))
+		{
+			new_index[index] = -1;
+			continue;
+		}
+		new_index[index] = (int32_t)packed;
+		if (packed != index)
+		{
+			hash_entry *dest = shm_undict_entry_at(dict, packed);
+			dest->key = entry->key;
+			shm_pointer_move(thread, &dest->value, &entry->value);
+			entry->key = NONE_SHM;
+		}
+		packed++;
+	}
+	shmassert(packed == dict->count);
+
+	ShmPointer tables[2] = { dict->buckets, dict->old_buckets };
+	for (int table = 0; table < 2; ++table)
+	{
+		hash_table_header *header = LOCAL(tables[table]);
+		if (!header)
+			continue;
+		for (int index = 0; index < (1 << header->log_count); ++index)
+		{
+			hash_bucket *bucket = get_bucket_at_index(header, index, sizeof(hash_bucket));
+			if (bucket_get_state(bucket) == HASH_BUCKET_STATE_SET)
+			{
+				shmassert(new_index[bucket->entry] >= 0);
+				bucket->entry = (uint32_t)new_index[bucket->entry];
+			}
+		}
+	}
+	free(new_index);
+
+	hash_entries_header *entries = LOCAL(dict->entries);
+	ShmPointer *blocks = &entries->blocks;
+	for (int idx = (int)((packed + (1 << SHM_UNDICT_ENTRY_BLOCK_LOG) - 1) >> SHM_UNDICT_ENTRY_BLOCK_LOG); idx < entries->block_capacity; ++idx)
+		if (SBOOL(blocks[idx]))
+			shm_pointer_empty(thread, &blocks[idx]);
+	dict->entry_count = packed;
+}
+
 int
 shm_undict_commit(ThreadContext *thread, ShmUnDict *dict)
 {
@@ -3773,7 +5700,17 @@ shm_undict_commit(ThreadContext *thread, ShmUnDict *dict)
 	hash_table_header *delta_header;
 	if (shm_undict_get_table(dict->delta_buckets, &delta_header, sizeof(hash_delta_bucket)))
 	{
-		bool persistent_relocated = false;
+		// the (re)inserted keys' entries in their insertion order, the ones deleted afterwards are left as holes
+		ShmInt appended_base = shm_undict_append_entries(thread, dict, dict->delta_appended);
+		// the orig_item indices are not valid after the buckets had been moved
+		bool persistent_relocated = dict->old_buckets != EMPTY_SHM;
+		// a bulk load or a rewrite of the most of the dict
+		bool rebuilt = dict->delta_count + dict->delta_deleted_count > dict->count;
+		if (rebuilt)
+		{
+			shm_undict_commit_rebuild(thread, dict, delta_header, appended_base);
+			persistent_relocated = true;
+		}
 		hash_func_args persist_args;
 		persist_args.thread = thread;
 		persist_args.bucket_item_size = sizeof(hash_bucket);
@@ -3788,25 +5725,32 @@ shm_undict_commit(ThreadContext *thread, ShmUnDict *dict)
 		persist_args.item_count = &dict->count;
 		persist_args.deleted_count = &dict->deleted_count;
 		persist_args.bucket_count = 1 << persist_args.header->log_count;
-		persist_args.compare_key = shm_undict_compare_ref_string;
+		persist_args.compare_key = shm_undict_compare_shm_key;
 		ShmUnDictKey key = EMPTY_SHM_UNDICT_KEY;
 
 		for (int delta_index = 0; delta_index < (1 << delta_header->log_count); ++delta_index)
 		{
 			if (*persist_args.item_count + *persist_args.deleted_count > persist_args.bucket_count / 2 + 1)
 			{
-				shm_undict_grow_table(thread, dict, false, 1, persist_args.bucket_item_size, &persist_args.header, &persist_args.bucket_count);
+				shm_undict_grow_persistent(thread, dict, &persist_args);
 				persistent_relocated = true;
 			}
+			shm_undict_migrate(thread, dict, &persist_args, SHM_UNDICT_MIGRATE_STEP);
 
 			hash_delta_bucket *delta_bucket = (hash_delta_bucket *)get_bucket_at_index(delta_header, delta_index, sizeof(hash_delta_bucket));
-			switch (bucket_get_state((hash_bucket *)delta_bucket))
+			switch (delta_bucket_get_state(delta_bucket))
 			{
 			case HASH_BUCKET_STATE_DELETED_RESERVED:
 			case HASH_BUCKET_STATE_SET:
 			{
-				// if (*persist_args.item_count + *persist_args.deleted_count > persist_args.bucket_count / 2 + 1)
-				//      shm_undict_grow_table(thread, dict, false, 1, persist_args.bucket_item_size, &persist_args.header, &persist_args.bucket_count);
+				if (delta_bucket->orig_item >= 0 && delta_bucket->value != EMPTY_SHM && delta_bucket->appended < 0)
+				{
+					// the modified item keeps its entry, so its bucket is not even looked up
+					hash_entry *entry = shm_undict_entry_at(dict, delta_bucket->entry);
+					shmassert(SBOOL(entry->key));
+					shm_pointer_move(thread, &entry->value, &delta_bucket->value);
+					break;
+				}
 
 				find_position_result persist_rslt = { .found = -1, .last_free = -1 };
 				key.hash = delta_bucket->key_hash;
@@ -3815,10 +5759,11 @@ shm_undict_commit(ThreadContext *thread, ShmUnDict *dict)
 				{
 					shmassert(cycle < 4);
 
+					shm_undict_migrate_key(thread, dict, &persist_args, &key);
 					persist_rslt = hash_find_position(persist_args, &key);
 					if (persist_rslt.found == -2)
 					{
-						shm_undict_grow_table(thread, dict, false, 1, persist_args.bucket_item_size, &persist_args.header, &persist_args.bucket_count);
+						shm_undict_grow_persistent(thread, dict, &persist_args);
 						persistent_relocated = true;
 					}
 					else
@@ -3832,61 +5777,49 @@ shm_undict_commit(ThreadContext *thread, ShmUnDict *dict)
 						shmassert(persist_rslt.found == delta_bucket->orig_item);
 
 					hash_bucket *found_bucket = get_bucket_at_index(persist_args.header, persist_rslt.found, sizeof(hash_bucket));
-
 					shmassert(bucket_get_state(found_bucket) == HASH_BUCKET_STATE_SET);
-					int persist_state = bucket_get_state(found_bucket);
-					bool was_valid = persist_state == HASH_BUCKET_STATE_SET;
-					bool set_valid = delta_bucket->value != EMPTY_SHM;
-					// modification
-					shm_pointer_copy(thread, &found_bucket->value, delta_bucket->value);
-					// shm_pointer_empty(thread, &delta_buckets[delta_index].key);
-					delta_bucket->key_hash = 1; // effectively making it HASH_BUCKET_STATE_DELETED, which is invalid for delta table.
-
-					if (was_valid != set_valid)
+					shmassert(found_bucket->entry == delta_bucket->entry);
+					// the previous entry becomes a hole both for the deletion and the reinsertion
+					hash_entry *entry = shm_undict_entry_at(dict, found_bucket->entry);
+					shm_pointer_empty(thread, &entry->value);
+					entry->key = NONE_SHM;
+					if (delta_bucket->value != EMPTY_SHM)
 					{
-						if (was_valid)
-						{
-							(*persist_args.deleted_count)++;
-							(*persist_args.item_count)--;
-						}
-						else
-						{
-							(*persist_args.item_count)++;
-							if (persist_state == HASH_BUCKET_STATE_DELETED)
-								(*persist_args.deleted_count)--;
-						}
+						shmassert(delta_bucket->appended >= 0);
+						found_bucket->entry = (uint32_t)(appended_base + delta_bucket->appended);
+						hash_entry *new_entry = shm_undict_entry_at(dict, found_bucket->entry);
+						shmassert(!SBOOL(new_entry->key));
+						new_entry->key = found_bucket->key;
+						shm_pointer_move(thread, &new_entry->value, &delta_bucket->value);
 					}
-					if (set_valid == false && was_valid)
+					else
 					{
-						// The element is in temporary HASH_BUCKET_STATE_DELETED_RESERVED state
 						uint32_t hash = found_bucket->key_hash;
 						 // Save the hash because it's gonna be modified
 						ShmPointer deleted_key = bucket_delete(found_bucket);
+						bucket_sync_ctrl(persist_args.header, persist_rslt.found, sizeof(hash_bucket));
 						found_bucket = NULL;
-						shmassert(shm_pointer_refcount(thread, deleted_key) > 0);
+						shmassert(shm_pointer_is_immediate(deleted_key) || shm_pointer_refcount(thread, deleted_key) > 0);
 						shm_pointer_release(thread, deleted_key);
+						(*persist_args.deleted_count)++;
+						(*persist_args.item_count)--;
 						// now the persist_rslt.found's state is HASH_BUCKET_STATE_DELETED
 						hash_compact_tail(persist_args, persist_rslt.found, hash);
+						// the chain's following buckets might have been moved closer to the base
+						persistent_relocated = true;
 					}
 				}
 				else
 				{
 					shmassert(persist_rslt.last_free >= 0);
 					if (delta_bucket->value != EMPTY_SHM)
-					{
-						// allocate a new persistent item
-						hash_bucket *last_free = get_bucket_at_index(persist_args.header, persist_rslt.last_free, sizeof(hash_bucket));
-						// modification
-						shm_pointer_copy(thread, &last_free->value, delta_bucket->value);
-						shm_pointer_copy(thread, &last_free->key, delta_bucket->key);
-						shmassert(shm_pointer_refcount(thread, delta_bucket->key) >= 2);
-						last_free->key_hash = delta_bucket->key_hash;
-						(*persist_args.item_count)++;
-						delta_bucket->key_hash = 1; // effectively making it HASH_BUCKET_STATE_DELETED, which is invalid for delta table.
-					}
+						shm_undict_commit_new_key(thread, dict, &persist_args, persist_rslt.last_free, delta_bucket, appended_base);
 				}
 				break;
 			}
+			case HASH_BUCKET_STATE_DELETED:
+				shmassert(rebuilt); // moved by shm_undict_commit_rebuild()
+				break;
 			case HASH_BUCKET_STATE_EMPTY:
 				// skip
 				break;
@@ -3899,6 +5832,9 @@ shm_undict_commit(ThreadContext *thread, ShmUnDict *dict)
 		dict->delta_deleted_count = 0;
 		release_delta_table(thread, dict, true);
 		shm_pointer_empty(thread, &dict->delta_buckets);
+		// the holes of the deleted and reinserted items outnumber the items
+		if (dict->entry_count - dict->count > dict->count && dict->entry_count > (1 << SHM_UNDICT_ENTRY_BLOCK_LOG))
+			shm_undict_pack_entries(thread, dict);
 	}
 	else if (dict->delta_buckets == NONE_SHM)
 	{
@@ -3908,6 +5844,7 @@ shm_undict_commit(ThreadContext *thread, ShmUnDict *dict)
 	shmassert(dict->delta_buckets == EMPTY_SHM);
 	shmassert(dict->delta_count == 0);
 	shmassert(dict->delta_deleted_count == 0);
+	shmassert(dict->delta_appended == 0);
 	shm_cell_check_write_lock(thread, &dict->lock);
 	return RESULT_OK;
 }
@@ -3929,22 +5866,31 @@ shm_undict_unlock(ThreadContext *thread, ShmUnDict *dict, ShmInt type)
 {
 	// shmassert(dict->lock.id == thread->self, "dict->lock.id == thread->self");
 	if (TRANSACTION_ELEMENT_WRITE == type)
-		p_atomic_shm_pointer_set(&dict->lock.transaction_data, EMPTY_SHM);
+		shm_atomic_shm_pointer_set_release(&dict->lock.transaction_data, EMPTY_SHM);
 	_shm_cell_unlock(thread, &dict->lock, type);
 	return RESULT_OK;
 }
 
+// Read-locks every segment of a concurrent dict, so the iteration over segments sees a consistent state.
 int
 _shm_undict_get_count(ThreadContext *thread, UnDictRef dict, ShmInt *rslt, bool commit)
 {
-	if_failure(transaction_lock_read(thread, &dict.local->lock, dict.shared, CONTAINER_UNORDERED_DICT, NULL),
+	ShmInt count = 0;
+	UnDictRef segment;
+	for (int idx = 0; shm_undict_get_segment(dict, idx, &segment); ++idx)
 	{
-		transient_abort(thread);
-		return status;
-	});
-	shm_cell_check_read_lock(thread, &dict.local->lock);
+		if_failure(idx == 0 ?
+			transaction_lock_read(thread, &segment.local->lock, segment.shared, CONTAINER_UNORDERED_DICT, NULL) :
+			transaction_lock_read_continued(thread, &segment.local->lock, segment.shared, CONTAINER_UNORDERED_DICT, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		});
+		shm_cell_check_read_lock(thread, &segment.local->lock);
 
-	*rslt = p_atomic_int_get(&dict.local->count);
+		count += shm_atomic_int_get_acquire(&segment.local->count);
+	}
+	*rslt = count;
 
 	if (commit)
 		transient_commit(thread);
@@ -3959,19 +5905,10 @@ shm_undict_get_count(ThreadContext *thread, UnDictRef dict, ShmInt *rslt)
 
 int shm_undict_get__last_status = -1;
 
-int
-shm_undict_get_do(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, ShmPointer *value, bool acquire)
+// The body of shm_undict_get_do. The dict (segment) is read-locked by the caller.
+static void
+shm_undict_get_locked(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, ShmPointer *value, bool acquire)
 {
-	shmassert(value);
-	shmassert(*value == EMPTY_SHM);
-	if_failure(transaction_lock_read(thread, &dict.local->lock, dict.shared, CONTAINER_UNORDERED_DICT, NULL),
-	{
-		shm_undict_get__last_status = status;
-		transient_abort(thread);
-		return status;
-	});
-	shm_cell_check_read_lock(thread, &dict.local->lock);
-
 	if (shm_cell_have_write_lock(thread, &dict.local->lock))
 	{
 		// search the item in the delta table first
@@ -3988,7 +5925,7 @@ shm_undict_get_do(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, ShmP
 		if (delta_rslt.found >= 0)
 		{
 			hash_delta_bucket *found = (hash_delta_bucket *)get_bucket_at_index(delta_args.header, delta_rslt.found, delta_args.bucket_item_size);
-			ShmInt state = bucket_get_state((hash_bucket *)found);
+			ShmInt state = delta_bucket_get_state(found);
 			shmassert(state == HASH_BUCKET_STATE_SET || state == HASH_BUCKET_STATE_DELETED_RESERVED);
 			ShmPointer retval = EMPTY_SHM;
 			if (state == HASH_BUCKET_STATE_SET)
@@ -4004,8 +5941,7 @@ shm_undict_get_do(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, ShmP
 					             "Handling pointer within a transient transaction without incrementing refcount leads to undefined behaivour.");
 			}
 			*value = retval;
-			transient_commit(thread);
-			return RESULT_OK;
+			return;
 		}
 	}
 	else
@@ -4021,13 +5957,13 @@ shm_undict_get_do(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, ShmP
 	persist_args.compare_key = shm_undict_key_compare_func(key);
 
 	ShmPointer retval2 = EMPTY_SHM;
-	find_position_result persist_rslt = hash_find_position(persist_args, key);
-	if (persist_rslt.found >= 0)
+	hash_index found_index = -1;
+	hash_bucket *found = shm_undict_find_persistent(dict.local, &persist_args, key, &found_index);
+	if (found)
 	{
-		hash_bucket *found = get_bucket_at_index(persist_args.header, persist_rslt.found, persist_args.bucket_item_size);
 		ShmInt state = bucket_get_state(found);
 		shmassert(state == HASH_BUCKET_STATE_SET);
-		retval2 = found->value;
+		retval2 = shm_undict_entry_at(dict.local, found->entry)->value;
 		if (acquire)
 		{
 			if (SBOOL(retval2))
@@ -4038,6 +5974,24 @@ shm_undict_get_do(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, ShmP
 			             "Handling pointer within a transient transaction without incrementing refcount leads to undefined behaivour.");
 	}
 	*value = retval2;
+}
+
+int
+shm_undict_get_do(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, ShmPointer *value, bool acquire)
+{
+	shmassert(value);
+	shmassert(*value == EMPTY_SHM);
+	if (dict.local->segments != EMPTY_SHM)
+		return shm_undict_get_do(thread, shm_undict_key_segment(dict.local, key->hash), key, value, acquire);
+	if_failure(transaction_lock_read(thread, &dict.local->lock, dict.shared, CONTAINER_UNORDERED_DICT, NULL),
+	{
+		shm_undict_get__last_status = status;
+		transient_abort(thread);
+		return status;
+	});
+	shm_cell_check_read_lock(thread, &dict.local->lock);
+
+	shm_undict_get_locked(thread, dict, key, value, acquire);
 
 	transient_commit(thread);
 	return RESULT_OK;
@@ -4055,17 +6009,107 @@ shm_undict_acq(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, ShmPoin
 	return shm_undict_get_do(thread, dict, key, value, true);
 }
 
+// Locks the dict (segment) holding the key unless the transaction already owns the lock,
+// so a batch takes every lock once instead of once per item.
+static int
+shm_undict_lock_key_segment(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, bool write, UnDictRef *segment)
+{
+	*segment = dict.local->segments != EMPTY_SHM ? shm_undict_key_segment(dict.local, key->hash) : dict;
+	ShmLock *lock = &segment->local->lock;
+	if (write ? shm_cell_have_write_lock(thread, lock) : shm_cell_have_read_lock(thread, lock))
+		return RESULT_OK;
+	bool had_write_lock = shm_cell_have_write_lock(thread, lock);
+	bool continued = thread->transaction_mode == TRANSACTION_TRANSIENT;
+	int status;
+	if (write)
+		status = continued ?
+			transaction_lock_write_continued(thread, lock, segment->shared, CONTAINER_UNORDERED_DICT, NULL) :
+			transaction_lock_write(thread, lock, segment->shared, CONTAINER_UNORDERED_DICT, NULL);
+	else
+		status = continued ?
+			transaction_lock_read_continued(thread, lock, segment->shared, CONTAINER_UNORDERED_DICT, NULL) :
+			transaction_lock_read(thread, lock, segment->shared, CONTAINER_UNORDERED_DICT, NULL);
+	if (status != RESULT_OK)
+		return status;
+	if (write)
+	{
+		shm_cell_check_write_lock(thread, lock);
+		if (!had_write_lock)
+		{
+			shmassert(segment->local->delta_buckets == EMPTY_SHM);
+			shmassert(segment->local->delta_count == 0);
+			shmassert(segment->local->delta_deleted_count == 0);
+		}
+	}
+	else
+		shm_cell_check_read_lock(thread, lock);
+	return RESULT_OK;
+}
+
+// Looks up all the keys within a single transient transaction. The found values are acquired,
+// missing keys yield EMPTY_SHM. On failure nothing is retained and the values are left empty.
+int
+shm_undict_acq_many(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *keys, ShmPointer *values, int count)
+{
+	for (int i = 0; i < count; ++i)
+		shmassert(values[i] == EMPTY_SHM);
+	for (int i = 0; i < count; ++i)
+	{
+		UnDictRef segment;
+		if_failure(shm_undict_lock_key_segment(thread, dict, &keys[i], false, &segment),
+		{
+			for (int j = 0; j < i; ++j)
+				shm_pointer_empty(thread, &values[j]);
+			transient_abort(thread);
+			return status;
+		});
+		shm_undict_get_locked(thread, segment, &keys[i], &values[i], true);
+	}
+
+	if (count > 0)
+		transient_commit(thread);
+	return RESULT_OK;
+}
+
+// Sets all the items within a single transient transaction, EMPTY_SHM value deletes the key.
+// The values are not consumed. On failure the whole batch is rolled back by transient_abort.
+int
+shm_undict_set_many(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *keys, ShmPointer *values, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		UnDictRef segment;
+		if_failure(shm_undict_lock_key_segment(thread, dict, &keys[i], true, &segment),
+		{
+			transient_abort(thread);
+			return status;
+		});
+		shm_undict_set_locked(thread, segment, &keys[i], values[i], false, NULL);
+	}
+
+	if (count > 0)
+		transient_commit(thread);
+	return RESULT_OK;
+}
+
 volatile char *
 shm_undict_debug_scan_for_item(ShmUnDict *dict, ShmUnDictKey *key)
 {
-	hash_table_header *header;
-	shm_undict_get_table(dict->buckets, &header, sizeof(hash_bucket));
-	int item_count = (1 << header->log_count);
-	for (int idx = 0; idx < item_count; ++idx)
+	if (dict->segments != EMPTY_SHM)
+		return shm_undict_debug_scan_for_item(shm_undict_key_segment(dict, key->hash).local, key);
+	ShmPointer tables[2] = { dict->buckets, dict->old_buckets };
+	for (int table = 0; table < 2; ++table)
 	{
-		hash_bucket *bucket = get_bucket_at_index(header, idx, sizeof(hash_bucket));
-		if (bucket->key_hash == key->hash)
-			return (volatile char *)bucket;
+		hash_table_header *header;
+		if (!shm_undict_get_table(tables[table], &header, sizeof(hash_bucket)))
+			continue;
+		int item_count = (1 << header->log_count);
+		for (int idx = 0; idx < item_count; ++idx)
+		{
+			hash_bucket *bucket = get_bucket_at_index(header, idx, sizeof(hash_bucket));
+			if (bucket->key_hash == key->hash && SBOOL(bucket->key))
+				return (volatile char *)bucket;
+		}
 	}
 	return NULL;
 }
@@ -4073,20 +6117,30 @@ shm_undict_debug_scan_for_item(ShmUnDict *dict, ShmUnDictKey *key)
 void
 print_items_to_file(FILE *pFile, ShmUnDict *dict)
 {
+	ShmUnDictSegments *segments = LOCAL(dict->segments);
+	if (segments)
+	{
+		ShmPointer *dicts = &segments->dicts;
+		for (int idx = 0; idx < (1 << segments->log_count); ++idx)
+			print_items_to_file(pFile, LOCAL(dicts[idx]));
+		return;
+	}
 	hash_table_header *header;
 	shm_undict_get_table(dict->buckets, &header, sizeof(hash_bucket));
 	int bucket_count = (1 << header->log_count);
 	for (int idx = 0; idx < bucket_count; ++idx)
 	{
 		hash_bucket *bucket = get_bucket_at_index(header, idx, sizeof(hash_bucket));
-		RefUnicode s = shm_ref_unicode_get(bucket->key);
+		Py_UCS1 buffer[SHM_IMMEDIATE_SHORT_MAX];
+		RefUnicode s = shm_unicode_key_get(bucket->key, buffer);
 		if (s.data)
 		{
 			for (int i = 0; i < s.len; ++i)
-				fputc((unsigned char)s.data[i], pFile);
-			if (SBOOL(bucket->value))
+				fputc((unsigned char)shm_unicode_read(s.kind, s.data, i), pFile);
+			ShmPointer value = shm_undict_entry_at(dict, bucket->entry)->value;
+			if (SBOOL(value))
 			{
-				fprintf(pFile, ": %d\n", bucket->value);
+				fprintf(pFile, ": %d\n", value);
 			}
 			else
 				fprintf(pFile, ": empty\n");
@@ -4100,6 +6154,14 @@ print_items_to_file(FILE *pFile, ShmUnDict *dict)
 void
 shm_undict_debug_print(ThreadContext *thread, ShmUnDict *dict, bool full)
 {
+	ShmUnDictSegments *segments = LOCAL(dict->segments);
+	if (segments)
+	{
+		ShmPointer *dicts = &segments->dicts;
+		for (int idx = 0; idx < (1 << segments->log_count); ++idx)
+			shm_undict_debug_print(thread, LOCAL(dicts[idx]), full);
+		return;
+	}
 	hash_table_header *persist_header;
 	shm_undict_get_table(dict->buckets, &persist_header, sizeof(hash_bucket));
 
@@ -4111,27 +6173,33 @@ shm_undict_debug_print(ThreadContext *thread, ShmUnDict *dict, bool full)
 		return;
 	}
 	int count = 0;
-	for (int index = 0; index < (1 << persist_header->log_count); ++index)
-	{
-		hash_bucket *bucket = get_bucket_at_index(persist_header, index, sizeof(hash_bucket));
-		if (bucket_get_state(bucket) == HASH_BUCKET_STATE_SET)
+	ShmPointer tables[2] = { dict->buckets, dict->old_buckets };
+	for (int table = 0; table < 2 && shm_undict_get_table(tables[table], &persist_header, sizeof(hash_bucket)); ++table)
+		for (int index = 0; index < (1 << persist_header->log_count); ++index)
 		{
-			count++;
-			if (full)
+			hash_bucket *bucket = get_bucket_at_index(persist_header, index, sizeof(hash_bucket));
+			if (bucket_get_state(bucket) == HASH_BUCKET_STATE_SET)
 			{
-				RefUnicode s = shm_ref_unicode_get(bucket->key);
-				ShmValueHeader *val = LOCAL(bucket->value);
-				const char *data = shm_value_get_data(val);
-				for (int i = 0; i < s.len; ++i)
-					putchar((unsigned char)s.data[i]);
-				putchar('=');
-				// for (int i = 0; i < shm_value_get_length(val); ++i)
-				//	putchar(data[i]);
-				printf("%s", data);
-				putchar('\n');
+				count++;
+				if (full)
+				{
+					Py_UCS1 buffer[SHM_IMMEDIATE_SHORT_MAX];
+					RefUnicode s = shm_unicode_key_get(bucket->key, buffer);
+					ShmPointer value = shm_undict_entry_at(dict, bucket->entry)->value;
+					ShmValueHeader *val = LOCAL(value);
+					for (int i = 0; i < s.len; ++i)
+						putchar((unsigned char)shm_unicode_read(s.kind, s.data, i));
+					putchar('=');
+					// for (int i = 0; i < shm_value_get_length(val); ++i)
+					//	putchar(data[i]);
+					if (val)
+						printf("%s", (const char *)shm_value_get_data(val));
+					else
+						printf("<immediate %#lx>", (unsigned long)value);
+					putchar('\n');
+				}
 			}
 		}
-	}
 	printf("count: %d\n", count);
 	if (full)
 		printf("===========================\n");
@@ -4145,9 +6213,9 @@ release_delta_table(ThreadContext *thread, ShmUnDict *dict, bool invalidated)
 	{
 		for (int delta_index = 0; delta_index < (1 << delta_header->log_count); ++delta_index)
 		{
-			hash_bucket *bucket = get_bucket_at_index(delta_header, delta_index, sizeof(hash_delta_bucket));
+			hash_delta_bucket *bucket = (hash_delta_bucket *)get_bucket_at_index(delta_header, delta_index, sizeof(hash_delta_bucket));
 			shmassert(bucket->key != ((__ShmPointer)-1));
-			switch (bucket_get_state(bucket))
+			switch (delta_bucket_get_state(bucket))
 			{
 			case HASH_BUCKET_STATE_DELETED_RESERVED:
 			case HASH_BUCKET_STATE_SET:
@@ -4172,6 +6240,35 @@ release_delta_table(ThreadContext *thread, ShmUnDict *dict, bool invalidated)
 		dict->delta_deleted_count = 0;
 		shm_pointer_empty(thread, &dict->delta_buckets);
 	}
+	dict->delta_appended = 0;
+}
+
+static void
+release_persistent_items(ThreadContext *thread, hash_table_header *header)
+{
+	for (int index = 0; index < (1 << header->log_count); ++index)
+	{
+		hash_bucket *bucket = get_bucket_at_index(header, index, sizeof(hash_bucket));
+		shmassert(bucket->key != ((__ShmPointer)-1));
+		switch (bucket_get_state(bucket))
+		{
+		case HASH_BUCKET_STATE_DELETED_RESERVED:
+			shmassert(false);
+			break;
+		case HASH_BUCKET_STATE_DELETED:
+		case HASH_BUCKET_STATE_EMPTY:
+			break;
+		case HASH_BUCKET_STATE_SET:
+			if (SBOOL(bucket->key))
+			{
+				shm_pointer_empty(thread, &bucket->key);
+				bucket->key = 0; // memset-friendly
+			}
+			break;
+		default:
+			shmassert(false);
+		}
+	}
 }
 
 void
@@ -4180,51 +6277,44 @@ release_persistent_table(ThreadContext *thread, ShmUnDict *dict)
 	hash_table_header *header;
 	if (shm_undict_get_table(dict->buckets, &header, sizeof(hash_bucket)))
 	{
-		for (int index = 0; index < (1 << header->log_count); ++index)
+		release_persistent_items(thread, header);
+		if (shm_undict_get_table(dict->old_buckets, &header, sizeof(hash_bucket)))
 		{
-			hash_bucket *bucket = get_bucket_at_index(header, index, sizeof(hash_bucket));
-			shmassert(bucket->key != ((__ShmPointer)-1));
-			switch (bucket_get_state(bucket))
-			{
-			case HASH_BUCKET_STATE_DELETED_RESERVED:
-				shmassert(false);
-				break;
-			case HASH_BUCKET_STATE_DELETED:
-			case HASH_BUCKET_STATE_EMPTY:
-				break;
-			case HASH_BUCKET_STATE_SET:
-				shm_pointer_empty(thread, &bucket->value);
-				if (SBOOL(bucket->key))
-				{
-					shm_pointer_empty(thread, &bucket->key);
-					bucket->key = 0; // memset-friendly
-				}
-				break;
-			default:
-				shmassert(false);
-			}
+			release_persistent_items(thread, header);
+			shm_pointer_empty(thread, &dict->old_buckets);
+			dict->migrated_count = 0;
 		}
 		dict->count = 0;
 		dict->deleted_count = 0;
 		shm_pointer_empty(thread, &dict->buckets);
 	}
+	// the entry blocks release the values
+	if (SBOOL(dict->entries))
+		shm_pointer_empty(thread, &dict->entries);
+	dict->entry_count = 0;
 }
 
 int
 shm_undict_clear(ThreadContext *thread, UnDictRef dict)
 {
-	if_failure(transaction_lock_write(thread, &dict.local->lock, dict.shared, CONTAINER_UNORDERED_DICT, NULL),
+	UnDictRef segment;
+	for (int idx = 0; shm_undict_get_segment(dict, idx, &segment); ++idx)
 	{
-		transient_abort(thread);
-		return status;
-	});
-	release_delta_table(thread, dict.local, false);
+		if_failure(idx == 0 ?
+			transaction_lock_write(thread, &segment.local->lock, segment.shared, CONTAINER_UNORDERED_DICT, NULL) :
+			transaction_lock_write_continued(thread, &segment.local->lock, segment.shared, CONTAINER_UNORDERED_DICT, NULL),
+		{
+			transient_abort(thread);
+			return status;
+		});
+		release_delta_table(thread, segment.local, false);
 
-	shmassert(dict.local->delta_buckets == EMPTY_SHM);
-	shmassert(dict.local->delta_count == 0);
-	shmassert(dict.local->delta_deleted_count == 0);
+		shmassert(segment.local->delta_buckets == EMPTY_SHM);
+		shmassert(segment.local->delta_count == 0);
+		shmassert(segment.local->delta_deleted_count == 0);
 
-	dict.local->delta_buckets = NONE_SHM;
+		segment.local->delta_buckets = NONE_SHM;
+	}
 
 	return RESULT_OK;
 }
@@ -4246,6 +6336,18 @@ shm_undict_destroy(ThreadContext *thread, ShmUnDict *dict, ShmPointer dict_shm)
 	if (dict->buckets != EMPTY_SHM)
 		shm_pointer_empty_atomic(thread, &dict->buckets);
 
+	hash_table_header *old = LOCAL(dict->old_buckets);
+	if (old)
+	{
+		shm_undict_validate_header(old, false);
+		if (old->is_index)
+			shm_undict_index_destroy(thread, (hash_table_index_header *)old, true);
+		else
+			shm_undict_table_destroy(thread, old);
+	}
+	if (dict->old_buckets != EMPTY_SHM)
+		shm_pointer_empty_atomic(thread, &dict->old_buckets);
+
 	hash_table_header *delta = LOCAL(dict->delta_buckets);
 	if (delta)
 	{
@@ -4258,6 +6360,21 @@ shm_undict_destroy(ThreadContext *thread, ShmUnDict *dict, ShmPointer dict_shm)
 	if (dict->delta_buckets != EMPTY_SHM)
 		shm_pointer_empty_atomic(thread, &dict->delta_buckets);
 
+	// the entry blocks release the values
+	if (dict->entries != EMPTY_SHM)
+		shm_pointer_empty_atomic(thread, &dict->entries);
+
+	ShmUnDictSegments *segments = LOCAL(dict->segments);
+	if (segments)
+	{
+		ShmPointer *dicts = &segments->dicts;
+		for (int idx = 0; idx < (1 << segments->log_count); ++idx)
+			if (SBOOL(p_atomic_shm_pointer_get(&dicts[idx])))
+				shm_pointer_empty_atomic(thread, &dicts[idx]);
+	}
+	if (dict->segments != EMPTY_SHM)
+		shm_pointer_empty_atomic(thread, &dict->segments);
+
 	shm_pointer_empty_atomic(thread, &dict->class_name);
 }
 
@@ -4281,10 +6398,29 @@ shm_undict_table_destroy(ThreadContext *thread, hash_table_header *header)
 	{
 		hash_bucket *buckets = &header->buckets;
 		for (int idx = 0; idx < cnt; idx++)
-		{
 			shm_pointer_empty_atomic(thread, &buckets[idx].key);
-			shm_pointer_empty_atomic(thread, &buckets[idx].value);
-		}
+	}
+}
+
+static void
+shm_undict_entries_destroy(ThreadContext *thread, hash_entries_header *entries)
+{
+	ShmPointer *blocks = &entries->blocks;
+	for (int idx = 0; idx < entries->block_capacity; ++idx)
+		if (SBOOL(p_atomic_shm_pointer_get(&blocks[idx])))
+			shm_pointer_empty_atomic(thread, &blocks[idx]);
+}
+
+static void
+shm_undict_entry_block_destroy(ThreadContext *thread, hash_entry_block *block)
+{
+	hash_entry *entries = (hash_entry *)&block->entries;
+	for (int idx = 0; idx < (1 << SHM_UNDICT_ENTRY_BLOCK_LOG); ++idx)
+	{
+		// the keys are owned by the buckets
+		entries[idx].key = NONE_SHM;
+		if (SBOOL(p_atomic_shm_pointer_get(&entries[idx].value)))
+			shm_pointer_empty_atomic(thread, &entries[idx].value);
 	}
 }
 
@@ -4325,6 +6461,16 @@ shm_refcounted_block_before_release(ThreadContext *thread, ShmPointer shm_pointe
 		int id = mm_block_get_debug_id(block, shm_pointer);
 		shmassert(SHM_LIST_INDEX_DEBUG_ID == id);
 	}
+	if (obj_type == SHM_TYPE(SHM_TYPE_LIST_SHADOW))
+	{
+		int id = mm_block_get_debug_id(block, shm_pointer);
+		shmassert(SHM_LIST_SHADOW_DEBUG_ID == id);
+	}
+	if (obj_type == SHM_TYPE(SHM_TYPE_LIST_INDEX_PAGE))
+	{
+		int id = mm_block_get_debug_id(block, shm_pointer);
+		shmassert(SHM_LIST_INDEX_PAGE_DEBUG_ID == id);
+	}
 }
 
 void
@@ -4340,7 +6486,7 @@ shm_refcounted_block_destroy(ThreadContext *thread, ShmPointer shm_pointer, ShmR
 	case SHM_TYPE(SHM_TYPE_TUPLE):
 		{
 			ShmValueHeader *header = LOCAL(shm_pointer);
-			int size = shm_value_get_length(header);
+			int size = shm_value_get_size(header); // empty tuple has no data
 			shmassert(size % sizeof(ShmPointer) == 0);
 			int count = size / isizeof(ShmPointer);
 			__ShmPointer *elements = shm_value_get_data(header);
@@ -4355,6 +6501,39 @@ shm_refcounted_block_destroy(ThreadContext *thread, ShmPointer shm_pointer, ShmR
 	case SHM_TYPE(SHM_TYPE_LIST):
 		// shm_list_destroy(thread, (ShmList *)obj, shm_pointer);
 		break;
+	case SHM_TYPE(SHM_TYPE_ARRAY):
+		{
+			ShmArray *array = (ShmArray *)obj;
+			if (SBOOL(array->data))
+				shm_pointer_empty(thread, &array->data);
+			if (SBOOL(array->new_data))
+				shm_pointer_empty(thread, &array->new_data);
+		}
+		break;
+	case SHM_TYPE(SHM_TYPE_ARRAY_DATA):
+		break;
+	case SHM_TYPE(SHM_TYPE_TABLE):
+		{
+			ShmTable *table = (ShmTable *)obj;
+			if (SBOOL(table->index))
+				shm_pointer_empty(thread, &table->index);
+		}
+		break;
+	case SHM_TYPE(SHM_TYPE_TABLE_INDEX):
+		shm_table_index_destroy(thread, (ShmTableIndex *)obj);
+		break;
+	case SHM_TYPE(SHM_TYPE_BLOB):
+		{
+			ShmBlob *blob = (ShmBlob *)obj;
+			if (SBOOL(blob->index))
+				shm_pointer_empty(thread, &blob->index);
+			if (SBOOL(blob->new_index))
+				shm_pointer_empty(thread, &blob->new_index);
+		}
+		break;
+	case SHM_TYPE(SHM_TYPE_BLOB_INDEX):
+		shm_blob_index_destroy(thread, (ShmBlobIndex *)obj);
+		break;
 	case SHM_TYPE(SHM_TYPE_LIST_BLOCK):
 		// not implemented
 		{
@@ -4362,13 +6541,38 @@ shm_refcounted_block_destroy(ThreadContext *thread, ShmPointer shm_pointer, ShmR
 			shmassert(SHM_LIST_BLOCK_FIRST_DEBUG_ID == id || SHM_LIST_BLOCK_DEBUG_ID == id);
 		}
 		break;
-	case SHM_TYPE(SHM_TYPE_LIST_CELL):
-		shmassert(false); // not refcounted
+	case SHM_TYPE(SHM_TYPE_LIST_SHADOW):
+		{
+			int id = mm_block_get_debug_id(obj, shm_pointer);
+			shmassert(SHM_LIST_SHADOW_DEBUG_ID == id);
+			ShmListShadow *shadow = (ShmListShadow *)obj;
+			ShmInt chunk_count = (shadow->capacity + SHM_LIST_SHADOW_CHUNK_SIZE - 1) >> SHM_LIST_SHADOW_CHUNK_LOG;
+			for (ShmInt chunk_ii = 0; chunk_ii < chunk_count; ++chunk_ii)
+				if (SBOOL(shadow->chunks[chunk_ii]))
+					shm_pointer_empty_atomic(thread, &shadow->chunks[chunk_ii]);
+		}
+		break;
+	case SHM_TYPE(SHM_TYPE_LIST_SHADOW_CHUNK):
+		{
+			int id = mm_block_get_debug_id(obj, shm_pointer);
+			shmassert(SHM_LIST_SHADOW_CHUNK_DEBUG_ID == id);
+		}
 		break;
 	case SHM_TYPE(SHM_TYPE_LIST_INDEX):
 		{
 			int id = mm_block_get_debug_id(obj, shm_pointer);
 			shmassert(SHM_LIST_INDEX_DEBUG_ID == id);
+			// the pages are owned by the root, while the blocks are moved out of them explicitly
+			ShmListIndex *list_index = (ShmListIndex *)obj;
+			for (ShmInt page_ii = 0; page_ii < list_index->page_capacity; ++page_ii)
+				if (SBOOL(list_index->pages[page_ii].page))
+					shm_pointer_empty_atomic(thread, &list_index->pages[page_ii].page);
+		}
+		break;
+	case SHM_TYPE(SHM_TYPE_LIST_INDEX_PAGE):
+		{
+			int id = mm_block_get_debug_id(obj, shm_pointer);
+			shmassert(SHM_LIST_INDEX_PAGE_DEBUG_ID == id);
 		}
 		break;
 	case SHM_TYPE(SHM_TYPE_LIST_CHANGES):
@@ -4421,5 +6625,14 @@ shm_refcounted_block_destroy(ThreadContext *thread, ShmPointer shm_pointer, ShmR
 		break;
 		shm_undict_index_destroy(thread, (hash_table_index_header *)obj, true);
 		break;
+	case SHM_TYPE(SHM_TYPE_UNDICT_SEGMENTS):
+		// released by shm_undict_destroy
+		break;
+	case SHM_TYPE(SHM_TYPE_UNDICT_ENTRIES):
+		shm_undict_entries_destroy(thread, (hash_entries_header *)obj);
+		break;
+	case SHM_TYPE(SHM_TYPE_UNDICT_ENTRY_BLOCK):
+		shm_undict_entry_block_destroy(thread, (hash_entry_block *)obj);
+		break;
 	}
 }
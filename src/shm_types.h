@@ -278,8 +278,9 @@ typedef vl struct {
 	ShmPointer threads[MAX_THREAD_COUNT];
 } ShmCoordinatorData;
 
+// Every heap takes whole cache lines, so threads' allocations don't invalidate the neighbouring heaps.
 typedef vl struct {
-	ShmInt size;
+	SHM_CACHE_ALIGNED ShmInt size;
 	// semi-volatile
 	ShmPointer thread;
 	ShmThreadID owner;
@@ -307,21 +308,26 @@ typedef vl struct {
 	ShmInt type;
 	ShmProcessID coordinator_process;
 	ShmCoordinatorData coordinator_data;
-	ShmSimpleLock lock;
-	ShmInt ticket;
-	ShmInt mm_last_used_root_sector;
+	// Frequently written fields are grouped by their writers, each group on its own cache line.
+	SHM_CACHE_ALIGNED ShmSimpleLock lock;
+	SHM_CACHE_ALIGNED ShmInt mm_last_used_root_sector;
 	ShmInt last_available_event_id;
 	ShmInt block_count;
 	ShmChunk block_groups[SHM_BLOCK_COUNT / SHM_BLOCK_GROUP_SIZE];
 	ShmThreads threads;
 	ShmSuperheap superheap;
-	ShmInt has_garbage;
+	SHM_CACHE_ALIGNED ShmInt has_garbage;
+	ShmInt pending_garbage; // blocks pushed to the threads' free lists and not yet processed by reclaimer
+	ShmInt garbage_soft_limit; // pending_garbage watermarks for allocator's backpressure, zero disables
+	ShmInt garbage_hard_limit;
 	ShmInt stop_reclaimer;
 	ShmEvent has_garbage_event;
-	ShmPointer root_container; // dictionary for storing global objects visible for every worker
+	SHM_CACHE_ALIGNED ShmPointer root_container; // dictionary for storing global objects visible for every worker
 	// debug
-	ShmPointer ticket_history[64];
-	ShmInt debug_lock_count;
+#if DEBUG_TICKET_HISTORY
+	SHM_CACHE_ALIGNED ShmPointer ticket_history[64];
+#endif
+	SHM_CACHE_ALIGNED ShmInt debug_lock_count;
 	ShmInt pending_lock_count;
 	ShmInt debug_max_lock_count;
 	type_debug_id_list type_debug_ids;
@@ -359,6 +365,9 @@ extern vl char * superblock_mmap[SHM_BLOCK_COUNT / SHM_BLOCK_GROUP_SIZE]; // arr
 #define SHM_TYPE_FLAG_MUTABLE (4 << 8)
 #define SHM_TYPE_MASK ((1 << 8) - 1)
 #define SHM_TYPE_RELEASE_MARK 0xFF000000
+// PEP 393 kind of the SHM_TYPE_UNICODE string: 1, 2 or 4 bytes per character. Zero is the legacy UCS4 string.
+#define SHM_TYPE_UNICODE_KIND_SHIFT 16
+#define SHM_TYPE_UNICODE_KIND_MASK (7 << SHM_TYPE_UNICODE_KIND_SHIFT)
 #define SHM_TYPE_CELL  (SHM_TYPE_FLAG_MUTABLE | SHM_TYPE_FLAG_REFCOUNTED)
 
 #define SHM_TYPE_BOOL     (1 | SHM_TYPE_FLAG_REFCOUNTED)
@@ -374,8 +383,10 @@ extern vl char * superblock_mmap[SHM_BLOCK_COUNT / SHM_BLOCK_GROUP_SIZE]; // arr
 #define SHM_TYPE_TUPLE  (0x30 | SHM_TYPE_FLAG_REFCOUNTED)
 #define SHM_TYPE_LIST  (0x40 | SHM_TYPE_CELL)
 #define SHM_TYPE_LIST_BLOCK  (0x41 | SHM_TYPE_FLAG_REFCOUNTED)
-#define SHM_TYPE_LIST_CELL  (0x42 | SHM_TYPE_FLAG_CONTAINED)
+#define SHM_TYPE_LIST_SHADOW  (0x42 | SHM_TYPE_FLAG_REFCOUNTED)
+#define SHM_TYPE_LIST_SHADOW_CHUNK  (0x42 | 1 | SHM_TYPE_FLAG_REFCOUNTED)
 #define SHM_TYPE_LIST_INDEX  (0x44 | SHM_TYPE_FLAG_REFCOUNTED)
+#define SHM_TYPE_LIST_INDEX_PAGE  (0x44 | 1 | SHM_TYPE_FLAG_REFCOUNTED)
 #define SHM_TYPE_LIST_CHANGES  0x48
 #define SHM_TYPE_QUEUE  (0x50 | SHM_TYPE_CELL)
 #define SHM_TYPE_QUEUE_CELL  (0x51 | SHM_TYPE_CELL)
@@ -388,7 +399,16 @@ extern vl char * superblock_mmap[SHM_BLOCK_COUNT / SHM_BLOCK_GROUP_SIZE]; // arr
 #define SHM_TYPE_UNDICT_INDEX  (0x74 | 1 | SHM_TYPE_FLAG_REFCOUNTED)
 #define SHM_TYPE_UNDICT_DELTA_TABLE  (0x76 | SHM_TYPE_FLAG_REFCOUNTED)
 #define SHM_TYPE_UNDICT_DELTA_INDEX  (0x76 | 1 | SHM_TYPE_FLAG_REFCOUNTED)
+#define SHM_TYPE_UNDICT_SEGMENTS  (0x78 | SHM_TYPE_FLAG_REFCOUNTED)
+#define SHM_TYPE_UNDICT_ENTRIES  (0x7A | SHM_TYPE_FLAG_REFCOUNTED)
+#define SHM_TYPE_UNDICT_ENTRY_BLOCK  (0x7C | SHM_TYPE_FLAG_REFCOUNTED)
 #define SHM_TYPE_PROMISE  (0x80 | SHM_TYPE_CELL)
+#define SHM_TYPE_ARRAY  (0x90 | SHM_TYPE_CELL)
+#define SHM_TYPE_ARRAY_DATA  (0x91 | SHM_TYPE_FLAG_REFCOUNTED)
+#define SHM_TYPE_TABLE  (0xA0 | SHM_TYPE_CELL)
+#define SHM_TYPE_TABLE_INDEX  (0xA1 | SHM_TYPE_FLAG_REFCOUNTED)
+#define SHM_TYPE_BLOB  (0xB0 | SHM_TYPE_CELL)
+#define SHM_TYPE_BLOB_INDEX  (0xB1 | SHM_TYPE_FLAG_REFCOUNTED)
 #define SHM_TYPE_DEBUG    0xAA
 
 static inline ShmInt
@@ -580,6 +600,70 @@ p_atomic_shm_pointer_exchange(ShmPointer *p, __ShmPointer new_value)
 	return (__ShmPointer)(ppointer)p_atomic_pointer_exchange(p, (ppointer)new_value);
 }
 
+// Atomics with explicit memory order. The p_atomic_* functions above are out of line and sequentially consistent,
+// so every store costs a full fence (xchg/mfence on x86, dmb ish on ARM64) even when it only publishes a value
+// or bumps a statistics counter. Keep p_atomic_* for the lock protocol where store->load ordering matters
+// (writer_lock, thread_state, transaction_mode vs test_finished), use these everywhere else.
+#if defined(P_CC_GNU) || defined(P_CC_CLANG)
+	#define SHM_ATOMIC_LOAD(p, order) __atomic_load_n((p), (order))
+	#define SHM_ATOMIC_STORE(p, value, order) __atomic_store_n((p), (value), (order))
+	#define SHM_ATOMIC_FETCH_ADD(p, value, order) __atomic_fetch_add((p), (value), (order))
+	#define SHM_RELAXED __ATOMIC_RELAXED
+	#define SHM_ACQUIRE __ATOMIC_ACQUIRE
+	#define SHM_RELEASE __ATOMIC_RELEASE
+#else
+	// MSVC: aligned volatile access has acquire/release semantic on x86/x64 (/volatile:ms), RMW is always a full barrier.
+	#define SHM_ATOMIC_LOAD(p, order) (*(p))
+	#define SHM_ATOMIC_STORE(p, value, order) (*(p) = (value))
+	#define SHM_ATOMIC_FETCH_ADD(p, value, order) p_atomic_int_add((p), (value))
+	#define SHM_RELAXED 0
+	#define SHM_ACQUIRE 0
+	#define SHM_RELEASE 0
+#endif
+
+static inline ShmInt
+shm_atomic_int_get_relaxed(vl ShmInt *p)
+{
+	return SHM_ATOMIC_LOAD(p, SHM_RELAXED);
+}
+
+static inline ShmInt
+shm_atomic_int_get_acquire(vl ShmInt *p)
+{
+	return SHM_ATOMIC_LOAD(p, SHM_ACQUIRE);
+}
+
+static inline void
+shm_atomic_int_set_relaxed(vl ShmInt *p, ShmInt value)
+{
+	SHM_ATOMIC_STORE(p, value, SHM_RELAXED);
+}
+
+static inline void
+shm_atomic_int_set_release(vl ShmInt *p, ShmInt value)
+{
+	SHM_ATOMIC_STORE(p, value, SHM_RELEASE);
+}
+
+// Returns the previous value. Meant for counters which do not order any other memory access.
+static inline ShmInt
+shm_atomic_int_add_relaxed(vl ShmInt *p, ShmInt value)
+{
+	return SHM_ATOMIC_FETCH_ADD(p, value, SHM_RELAXED);
+}
+
+static inline __ShmPointer
+shm_atomic_shm_pointer_get_acquire(vl ShmPointer *p)
+{
+	return SHM_ATOMIC_LOAD(p, SHM_ACQUIRE);
+}
+
+static inline void
+shm_atomic_shm_pointer_set_release(vl ShmPointer *p, __ShmPointer value)
+{
+	SHM_ATOMIC_STORE(p, value, SHM_RELEASE);
+}
+
 #define LOCK_UNLOCKED 0
 #define LOCK_PENDING  EMPTY_SHM
 
@@ -717,17 +801,40 @@ typedef vl2 struct {
 // ShmList
 // ---------------------------
 
-// Need a special type because ShmListCell cannot be handled as a separate object e.g. with shm_pointer_to_pointer
+// A cell holds only the committed item, so the readers scan plain pointers.
+// The items staged by the transaction owning the list are kept in the ShmListShadow of the block.
 typedef vl struct _ShmListCell
 {
-	SHM_CONTAINED_BLOCK
-	// ShmCellBase
 	ShmPointer  data;
+} ShmListCell;
+
+typedef vl struct _ShmListShadowCell
+{
 	ShmPointer  new_data;
 	ShmInt      has_new_data;
-	// ShmListCell
 	ShmInt changed; // for committing, to avoid registering changes for same cell twice
-} ShmListCell;
+} ShmListShadowCell;
+
+#define SHM_LIST_SHADOW_CHUNK_LOG 6
+#define SHM_LIST_SHADOW_CHUNK_SIZE (1 << SHM_LIST_SHADOW_CHUNK_LOG)
+
+typedef vl struct _ShmListShadowChunk
+{
+	SHM_REFCOUNTED_BLOCK
+	ShmListShadowCell cells[SHM_LIST_SHADOW_CHUNK_SIZE];
+} ShmListShadowChunk;
+
+// Side table of a block touched by the current transaction, only the owner of the list reads and writes it.
+// The chunks of shadow cells are allocated on the first write to their range of the block,
+// so a small transaction doesn't pay for the capacity of the block. Released by the commit and the rollback.
+typedef vl struct _ShmListShadow
+{
+	SHM_REFCOUNTED_BLOCK
+	ShmInt capacity; // same as of the block
+	ShmPointer chunks[P_MAXINT / sizeof(ShmPointer) / 2];
+} ShmListShadow;
+
+#define SHM_LIST_SHADOW_HEADER_SIZE offsetof(ShmListShadow, chunks[0])
 
 typedef vl struct _ShmListBlockHeader
 {
@@ -752,6 +859,7 @@ typedef vl struct _ShmListBlock
 	ShmInt new_deleted;
 	ShmInt count_added_after_relocation;
 	ShmInt capacity; // count + deleted <= capacity
+	ShmPointer shadow; // ShmListShadow of the owning transaction or EMPTY_SHM
 	ShmListCell cells[P_MAXINT / sizeof(ShmListCell) / 2];
 } ShmListBlock;
 
@@ -770,26 +878,56 @@ typedef vl struct _ShmListIndexItem
 	ShmPointer block;
 } ShmListIndexItem;
 
+// The index items are kept in pages of SHM_LIST_INDEX_PAGE_SIZE, the blocks are numbered across the pages,
+// so the block i is the item i % SHM_LIST_INDEX_PAGE_SIZE of the page i / SHM_LIST_INDEX_PAGE_SIZE.
+#define SHM_LIST_INDEX_PAGE_LOG 8
+#define SHM_LIST_INDEX_PAGE_SIZE (1 << SHM_LIST_INDEX_PAGE_LOG)
+
+typedef vl struct _ShmListIndexPage
+{
+	// type is SHM_TYPE_LIST_INDEX_PAGE
+	SHM_REFCOUNTED_BLOCK
+	ShmListIndexItem cells[SHM_LIST_INDEX_PAGE_SIZE];
+} ShmListIndexPage;
+
+typedef vl struct _ShmListIndexPageRef
+{
+	// sums of the counts of the page's items, so the lookups skip the whole pages
+	ShmInt count;
+	ShmInt new_count;
+	// ShmListIndexPage
+	ShmPointer page;
+} ShmListIndexPageRef;
+
 typedef vl struct _ShmListIndexHeader
 {
 	SHM_REFCOUNTED_BLOCK
 	// ShmListIndexHeader
 	ShmInt index_size;
+	ShmInt page_capacity;
 } ShmListIndexHeader;
 
 typedef vl struct _ShmListIndex
 {
 	SHM_REFCOUNTED_BLOCK
 	// ShmListIndex
-	// sorry, I was tired of coding mutable structures - just made an immutable one. Thanksfully it's not resized often.
-	ShmInt index_size;
-	// alignment is not a problem here because everything is ShmInt
-	ShmListIndexItem cells[P_MAXINT / sizeof(ShmListCell) / 2];
+	// Blocks are appended in place: the new items are filled first and then published by index_size.
+	// A full pages array is reallocated with double capacity, which copies only the page references.
+	// Inserting or removing blocks in the middle builds a new index.
+	ShmInt index_size; // number of blocks
+	ShmInt page_capacity;
+	ShmListIndexPageRef pages[P_MAXINT / sizeof(ShmListIndexPageRef) / 2];
 } ShmListIndex;
 
+// the page references are aligned for ShmPointer, so they don't start right after ShmListIndexHeader
+#define SHM_LIST_INDEX_HEADER_SIZE offsetof(ShmListIndex, pages[0])
+
 typedef vl struct {
 	ShmInt block_index;
 	ShmInt item_index;
+	// Number of the changed cells starting from item_index, the range continues from the start of the following blocks.
+	// item_index == -1 marks count whole blocks starting from block_index instead, see shm_list_clear.
+	ShmInt count;
 } ShmListChangeItem;
 
 typedef vl struct _ShmListChanges {
@@ -839,8 +977,13 @@ shm_list_get_item(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer
 int
 shm_list_acq_item(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer *result);
 int
+shm_list_acq_range(ThreadContext *thread, ListRef list, ShmInt index, ShmInt step, ShmInt count,
+                   ShmPointer *results, ShmInt *fetched);
+int
 shm_list_set_item_raw(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer value, bool consume);
 int
+shm_list_set_range_raw(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer *values, ShmInt count);
+int
 shm_list_set_item(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer value);
 int
 shm_list_consume_item(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer value);
@@ -853,10 +996,236 @@ shm_list_append(ThreadContext *thread, ListRef list, ShmPointer value, ShmInt *i
 int
 shm_list_append_consume(ThreadContext *thread, ListRef list, ShmPointer value, ShmInt *index);
 int
+shm_list_extend(ThreadContext *thread, ListRef list, ShmPointer *values, ShmInt count);
+int
 shm_list_popleft(ThreadContext *thread, ListRef list, ShmPointer *result, bool *valid);
+int
+shm_list_insert(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer value);
+int
+shm_list_pop(ThreadContext *thread, ListRef list, ShmInt index, ShmPointer *result, bool *valid);
+int
+shm_list_clear(ThreadContext *thread, ListRef list);
 void
 shm_list_print_to_file(FILE *file, ShmList *list);
 
+// Arrays
+
+// Items are stored inline in a single ShmArrayData block, so the array is limited by the largest heap block,
+// see shm_array_max_count.
+// The committed block is never modified: the first write of a transaction copies it into new_data
+// and the commit replaces the data, so an acquired data block is a stable snapshot for readers.
+typedef vl struct _ShmArrayData
+{
+	SHM_REFCOUNTED_BLOCK
+	ShmInt count;
+	ShmInt itemsize;
+	// items follow, aligned to 8 bytes
+} ShmArrayData;
+
+#define SHM_ARRAY_DATA_HEADER_SIZE ((isizeof(ShmArrayData) + 7) & ~7)
+
+typedef vl struct _ShmArray
+{
+	SHM_CONTAINER
+	ShmInt typecode; // array module typecode of the items, not interpreted by the container
+	ShmInt itemsize;
+	ShmInt count;
+	ShmPointer data; // ShmArrayData
+	ShmPointer new_data; // ShmArrayData
+} ShmArray;
+
+typedef vl2 struct {
+	ShmPointer shared;
+	ShmArray *local;
+} ArrayRef;
+
+ShmArray *
+new_shm_array(ThreadContext *thread, PShmPointer result, ShmInt typecode, ShmInt itemsize, ShmInt count);
+ShmArrayData *
+new_shm_array_data(ThreadContext *thread, PShmPointer result, ShmInt itemsize, ShmInt count, int debug_id);
+ShmInt
+shm_array_max_count(ShmInt itemsize);
+static inline vl void *
+shm_array_data_items(ShmArrayData *data)
+{
+	return (vl void *)((vl char *)data + SHM_ARRAY_DATA_HEADER_SIZE);
+}
+int
+shm_array_acq_data(ThreadContext *thread, ArrayRef array, ShmPointer *result);
+int
+shm_array_get_range(ThreadContext *thread, ArrayRef array, ShmInt index, ShmInt step, ShmInt count, void *dest);
+int
+shm_array_set_range(ThreadContext *thread, ArrayRef array, ShmInt index, ShmInt step, ShmInt count, const void *src);
+int
+shm_array_commit(ThreadContext *thread, ShmArray *array);
+int
+shm_array_rollback(ThreadContext *thread, ShmArray *array);
+int
+shm_array_unlock(ThreadContext *thread, ShmArray *array, ShmInt type);
+
+// Tables, see shm_table.c
+
+#define SHM_TABLE_MAX_COLUMNS 32
+#define SHM_TABLE_NAME_SIZE 32
+#define SHM_TABLE_CHUNK_LOG 12
+#define SHM_TABLE_CHUNK_ROWS (1 << SHM_TABLE_CHUNK_LOG)
+
+typedef vl struct {
+	ShmInt typecode; // array module typecode
+	ShmInt itemsize;
+	char name[SHM_TABLE_NAME_SIZE]; // null-terminated UTF-8
+} ShmTableColumn;
+
+// Chunk pointers of all the columns, chunk number i of the column c is at chunks[i * column_count + c].
+// The chunks are ShmArrayData of SHM_TABLE_CHUNK_ROWS items.
+typedef vl struct _ShmTableIndex
+{
+	SHM_REFCOUNTED_BLOCK
+	ShmInt column_count;
+	ShmInt capacity; // in chunks per column
+	ShmPointer chunks[P_MAXINT / sizeof(ShmPointer) / 2];
+} ShmTableIndex;
+
+#define SHM_TABLE_INDEX_HEADER_SIZE offsetof(ShmTableIndex, chunks[0])
+
+// Rows are only appended and never modified, so the appended rows are written in place past the committed count,
+// they are invisible to the readers until the commit publishes the new count.
+typedef vl struct _ShmTable
+{
+	SHM_CONTAINER
+	ShmInt column_count;
+	ShmInt count;
+	ShmInt new_count; // -1 unless the rows are appended by the lock owner
+	// Currently storage can only grow, the index and the chunks are kept even if the appending transaction is rolled back.
+	ShmPointer index; // ShmTableIndex
+	ShmTableColumn columns[SHM_TABLE_MAX_COLUMNS];
+} ShmTable;
+
+typedef vl2 struct {
+	ShmPointer shared;
+	ShmTable *local;
+} TableRef;
+
+enum {
+	SHM_TABLE_LT,
+	SHM_TABLE_LE,
+	SHM_TABLE_EQ,
+	SHM_TABLE_NE,
+	SHM_TABLE_GE,
+	SHM_TABLE_GT,
+};
+
+enum {
+	SHM_TABLE_COUNT,
+	SHM_TABLE_SUM,
+	SHM_TABLE_MIN,
+	SHM_TABLE_MAX,
+};
+
+// Values are widened to 64 bits: signed integer columns use i, unsigned ones use u and floating point ones use d,
+// see shm_table_typecode_kind.
+typedef union {
+	int64_t i;
+	uint64_t u;
+	double d;
+} ShmTableValue;
+
+enum {
+	SHM_TABLE_KIND_INVALID,
+	SHM_TABLE_KIND_SIGNED,
+	SHM_TABLE_KIND_UNSIGNED,
+	SHM_TABLE_KIND_FLOAT,
+};
+
+typedef struct {
+	ShmInt column;
+	int op; // SHM_TABLE_LT...
+	ShmTableValue value;
+} ShmTablePredicate;
+
+int
+shm_table_typecode_kind(ShmInt typecode);
+ShmTable *
+new_shm_table(ThreadContext *thread, PShmPointer result, ShmInt column_count, const ShmTableColumn *columns);
+ShmInt
+shm_table_max_count(ShmInt column_count);
+int
+shm_table_get_count(ThreadContext *thread, TableRef table, ShmInt *count);
+int
+shm_table_append(ThreadContext *thread, TableRef table, ShmInt count, const void *const *columns);
+int
+shm_table_get_range(ThreadContext *thread, TableRef table, ShmInt column, ShmInt start, ShmInt count, void *dest);
+int
+shm_table_aggregate(ThreadContext *thread, TableRef table, ShmInt column, int aggregate,
+                    const ShmTablePredicate *predicates, int predicate_count, ShmTableValue *result, ShmInt *matched);
+int
+shm_table_filter(ThreadContext *thread, TableRef table, const ShmTablePredicate *predicates, int predicate_count,
+                 ShmInt *rows, ShmInt capacity, ShmInt *found);
+int
+shm_table_commit(ThreadContext *thread, ShmTable *table);
+int
+shm_table_rollback(ThreadContext *thread, ShmTable *table);
+int
+shm_table_unlock(ThreadContext *thread, ShmTable *table, ShmInt type);
+void
+shm_table_index_destroy(ThreadContext *thread, ShmTableIndex *index);
+
+// Blobs, see shm_blob.c
+
+// A version of the blob: its length and the segments holding the bytes. The segments are ShmArrayData of segment_size
+// items of 1 byte, a missing segment reads as zeros. The bytes past the length are always zero.
+typedef vl struct _ShmBlobIndex
+{
+	SHM_REFCOUNTED_BLOCK
+	ShmInt length; // of the blob in bytes
+	ShmInt capacity; // in segments
+	ShmPointer segments[P_MAXINT / sizeof(ShmPointer) / 2];
+} ShmBlobIndex;
+
+#define SHM_BLOB_INDEX_HEADER_SIZE offsetof(ShmBlobIndex, segments[0])
+
+// The committed index and its segments are never modified. The first write of a transaction copies the index
+// into new_index, each written segment is copied once more, and the commit replaces the index,
+// so an acquired index is a stable snapshot readers can copy from without holding the lock.
+typedef vl struct _ShmBlob
+{
+	SHM_CONTAINER
+	ShmInt segment_size;
+	ShmPointer index; // ShmBlobIndex, EMPTY_SHM for the empty blob
+	ShmPointer new_index; // ShmBlobIndex
+} ShmBlob;
+
+typedef vl2 struct {
+	ShmPointer shared;
+	ShmBlob *local;
+} BlobRef;
+
+ShmBlob *
+new_shm_blob(ThreadContext *thread, PShmPointer result);
+ShmInt
+shm_blob_max_size(ShmBlob *blob);
+int
+shm_blob_acq_index(ThreadContext *thread, BlobRef blob, ShmPointer *result);
+static inline ShmInt
+shm_blob_index_size(ShmBlobIndex *index)
+{
+	return index ? index->length : 0;
+}
+void
+shm_blob_index_read(ShmBlob *blob, ShmBlobIndex *index, ShmInt position, ShmInt count, void *dest);
+int
+shm_blob_write(ThreadContext *thread, BlobRef blob, ShmInt position, ShmInt count, const void *src);
+int
+shm_blob_truncate(ThreadContext *thread, BlobRef blob, ShmInt size);
+int
+shm_blob_commit(ThreadContext *thread, ShmBlob *blob);
+int
+shm_blob_rollback(ThreadContext *thread, ShmBlob *blob);
+int
+shm_blob_unlock(ThreadContext *thread, ShmBlob *blob, ShmInt type);
+void
+shm_blob_index_destroy(ThreadContext *thread, ShmBlobIndex *index);
+
 // Strings
 
 /*typedef vl struct {
@@ -871,16 +1240,58 @@ typedef uint32_t Py_UCS4;
 typedef uint16_t Py_UCS2;
 typedef uint8_t Py_UCS1;
 
+// Characters are stored with the narrowest kind that fits the string, like the CPython's PEP 393 strings.
+// The kind is kept in the type field (SHM_TYPE_UNICODE_KIND_MASK), so ShmValueHeader strings share the layout.
 typedef vl struct {
 	SHM_REFCOUNTED_BLOCK
-	Py_UCS4 chars;
+	Py_UCS1 chars[1];
 } ShmRefUnicode;
 
+#define SHM_REF_UNICODE_HEADER_SIZE ((int)offsetof(ShmRefUnicode, chars))
+
 typedef struct {
 	ShmInt len;
-	vl Py_UCS4 *data;
+	int kind; // 1, 2, or 4
+	vl void *data;
 } RefUnicode;
 
+static inline ShmInt
+shm_unicode_type(int kind)
+{
+	shmassert(kind == 1 || kind == 2 || kind == 4);
+	return SHM_TYPE_UNICODE | (kind << SHM_TYPE_UNICODE_KIND_SHIFT);
+}
+
+static inline int
+shm_type_get_unicode_kind(ShmInt type)
+{
+	int kind = (type & SHM_TYPE_UNICODE_KIND_MASK) >> SHM_TYPE_UNICODE_KIND_SHIFT;
+	return kind ? kind : 4;
+}
+
+// same as PyUnicode_READ
+static inline Py_UCS4
+shm_unicode_read(int kind, const vl void *data, ShmInt index)
+{
+	if (kind == 1)
+		return ((const vl Py_UCS1 *)data)[index];
+	else if (kind == 2)
+		return ((const vl Py_UCS2 *)data)[index];
+	else
+		return ((const vl Py_UCS4 *)data)[index];
+}
+
+static inline void
+shm_unicode_write(int kind, vl void *data, ShmInt index, Py_UCS4 value)
+{
+	if (kind == 1)
+		((vl Py_UCS1 *)data)[index] = (Py_UCS1)value;
+	else if (kind == 2)
+		((vl Py_UCS2 *)data)[index] = (Py_UCS2)value;
+	else
+		((vl Py_UCS4 *)data)[index] = value;
+}
+
 void
 ASCII_from_UCS4(Py_UCS1 *to, const Py_UCS4 *from, ShmInt length);
 void
@@ -891,17 +1302,49 @@ UCS4_format_number(Py_UCS4 *to, int number);
 ShmPointer
 shm_ref_unicode_new_ascii(ThreadContext *thread, const Py_UCS1 *s, int len);
 ShmPointer
-shm_ref_unicode_new(ThreadContext *thread, const Py_UCS4 *s, int len);
+shm_ref_unicode_new(ThreadContext *thread, int kind, const void *s, int len);
 RefUnicode
 shm_ref_unicode_get(ShmPointer p);
+RefUnicode
+shm_unicode_value_get(ShmValueHeader *value);
+// String dict keys are ShmRefUnicode or short string immediates, buffer receives the characters of the immediate
+// and must be at least SHM_IMMEDIATE_SHORT_MAX long. Other keys give len = -1 and data = NULL.
+RefUnicode
+shm_unicode_key_get(ShmPointer key, Py_UCS1 *buffer);
+bool
+shm_ref_unicode_equal(RefUnicode s1, int kind2, const void *data2, ShmInt len2);
+// Bytes dict keys are ShmValue of SHM_TYPE_BYTES or short bytes immediates, false for the keys of other types.
+bool
+shm_bytes_key_equal(ShmPointer key, const char *bytes, int size);
 
 uint32_t
 hash_string(const Py_UCS4 *s, int len);
 uint32_t
 hash_string_ascii(const char *s, int len);
+uint32_t
+hash_string_ucs2(const Py_UCS2 *s, int len);
+uint32_t
+hash_string_kind(int kind, const void *s, int len);
+uint32_t
+hash_bytes(const char *s, int len);
+uint32_t
+hash_int(int64_t value);
+uint32_t
+hash_double(double value);
+uint32_t
+hash_tuple_start(int count);
+uint32_t
+hash_tuple_add(uint32_t hash, uint32_t item_hash);
+// Hash and equality of the immutable values usable as dict keys: None, bool, int, float, str, bytes and tuples of them.
+uint32_t
+shm_value_hash(ShmPointer value);
+bool
+shm_value_equal(ShmPointer value1, ShmPointer value2);
 
 ShmValueHeader *
 new_shm_unicode_value(ThreadContext *thread, const char *s, int length, PShmPointer shm_pointer);
+ShmValueHeader *
+new_shm_unicode_value_kind(ThreadContext *thread, int kind, const void *s, int length, PShmPointer shm_pointer);
 
 // ---------------------------
 // Hash trie, but then I realized we don't really need multiversioning and lock-free operations,
@@ -967,18 +1410,38 @@ typedef vl struct _ShmDict
 // Unordered hash map
 // ShmUnDict
 
+// Reads the key_local of ShmUnDictKey: compares it to a stored key, or creates the stored key and returns acquired reference.
+typedef bool(*shm_local_key_equal)(ShmPointer stored, const void *key_local);
+typedef ShmPointer(*shm_local_key_new)(ThreadContext *thread, const void *key_local);
+
+// Exactly one of key1/key2/key4 (str), key_bytes, key_shm or key_local is set. key_shm is any value already in the shared memory,
+// e.g. int immediate, and its hash is shm_value_hash(key_shm). key_local is a key outside of the shared memory, e.g. a tuple
+// of the caller's objects, so the lookups don't allocate it. Its hash must be shm_value_hash() of the stored key it creates.
 typedef struct {
 	uint32_t hash;
 	Py_UCS1 *key1;
 	Py_UCS2 *key2;
 	Py_UCS4 *key4;
+	const char *key_bytes;
 	ShmPointer key_shm;
+	const void *key_local;
+	shm_local_key_equal key_local_equal;
+	shm_local_key_new key_local_new;
 	int keysize;
 } ShmUnDictKey;
 
-#define EMPTY_SHM_UNDICT_KEY { .hash = 0, .key1 = NULL,.key2 = NULL,.key4 = NULL, .keysize = 0, .key_shm = EMPTY_SHM }
+#define EMPTY_SHM_UNDICT_KEY { .hash = 0, .key1 = NULL,.key2 = NULL,.key4 = NULL, .key_bytes = NULL, .keysize = 0, .key_shm = EMPTY_SHM, \
+	.key_local = NULL, .key_local_equal = NULL, .key_local_new = NULL }
 
 #define SHM_UNDICT_LOGCOUNT_LIMIT 28
+// Buckets of the previous persistent table moved into the grown one per modification,
+// must be above 2 for the move to finish before the grown table fills up to the next growth.
+#define SHM_UNDICT_MIGRATE_STEP 32
+// A concurrent dict spreads the keys over 1 << SHM_UNDICT_SEGMENT_LOG separately locked segments,
+// so the writers of keys from different segments neither wait for nor abort each other.
+#define SHM_UNDICT_SEGMENT_LOG 4
+// The entries are allocated in blocks of 1 << SHM_UNDICT_ENTRY_BLOCK_LOG, so appending never copies the existing ones.
+#define SHM_UNDICT_ENTRY_BLOCK_LOG 8
 
 typedef vl struct _ShmUnDict
 {
@@ -991,8 +1454,26 @@ typedef vl struct _ShmUnDict
 	ShmPointer delta_buckets; // ShmUnDictTableHeader
 	ShmInt delta_count;
 	ShmInt delta_deleted_count;
+	// The previous persistent table while it's moved into the buckets, see shm_undict_migrate()
+	ShmPointer old_buckets;
+	ShmInt migrated_count; // old_buckets' buckets before this index are moved
+	// hash_entries_header: the items' values in the insertion order, the buckets refer to them.
+	// Deleted items leave holes, which are packed by the commit once they outnumber the items.
+	ShmPointer entries;
+	ShmInt entry_count; // including the holes
+	ShmInt delta_appended; // entries to be appended by the commit
+	// ShmUnDictSegments of a concurrent dict, EMPTY_SHM otherwise. Set once on creation, the items are kept
+	// in the segments and the fields above are unused.
+	ShmPointer segments;
 } ShmUnDict;
 
+typedef vl struct {
+	// type is SHM_TYPE_UNDICT_SEGMENTS
+	SHM_REFCOUNTED_BLOCK
+	ShmInt log_count;
+	ShmPointer dicts; // ShmUnDict[1 << log_count]
+} ShmUnDictSegments;
+
 // ---------------------------------
 #define LOCAL_REFERENCE_BLOCK_SIZE 50
 
@@ -1085,6 +1566,9 @@ typedef vl2 struct {
 #define CONTAINER_DICT_DELTA 4
 #define CONTAINER_UNORDERED_DICT 5
 #define CONTAINER_PROMISE 6
+#define CONTAINER_ARRAY 7
+#define CONTAINER_TABLE 8
+#define CONTAINER_BLOB 9
 
 #define TRANSACTION_ELEMENT_READ 1
 #define TRANSACTION_ELEMENT_WRITE 2
@@ -1119,8 +1603,13 @@ typedef vl struct {
 } ShmTransactionStack;
 
 #define THREAD_FREE_LIST_BLOCK_SIZE 50
+// Reclaimer backlog (superblock->pending_garbage, in blocks) at which allocator stops growing the arena eagerly.
+// Soft limit just yields the CPU to the reclaimer, hard limit waits for it for tens of milliseconds.
+#define DEFAULT_GARBAGE_SOFT_LIMIT (THREAD_FREE_LIST_BLOCK_SIZE * 2000)
+#define DEFAULT_GARBAGE_HARD_LIMIT (THREAD_FREE_LIST_BLOCK_SIZE * 8000)
 
-typedef vl struct {
+// Owned by a single thread until published with CAS on ThreadContext.free_list, so no volatile here.
+typedef struct {
 	ShmInt capacity;
 	ShmInt count;
 	ShmPointer next; // (ShmFreeList*)
@@ -1129,7 +1618,8 @@ typedef vl struct {
 
 #define DELTA_STACK_SIZE 50
 
-typedef vl struct {
+// Only accessed by the owner thread (debug dumps aside), so no volatile here.
+typedef struct {
 	ShmFreeList *free_list;
 	ShmPointer free_list_shm;
 	ShmTransactionStack *transaction_stack;
@@ -1149,7 +1639,6 @@ typedef vl struct {
 	ShmPointer last_wait_writer_lock;
 	ShmPointer last_wait_next_writer;
 
-	ShmInt last_known_ticket;
 
 	ShmInt pending_lock_count;
 
@@ -1292,6 +1781,10 @@ int
 transaction_lock_write(ThreadContext *thread, ShmLock *lock, ShmPointer lock_shm, int container_type, bool *lock_taken);
 int
 transaction_lock_read(ThreadContext *thread, ShmLock *lock, ShmPointer container_shm, int container_type, bool *lock_taken);
+int
+transaction_lock_write_continued(ThreadContext *thread, ShmLock *lock, ShmPointer lock_shm, int container_type, bool *lock_taken);
+int
+transaction_lock_read_continued(ThreadContext *thread, ShmLock *lock, ShmPointer container_shm, int container_type, bool *lock_taken);
 
 int
 transaction_unlock_local(ThreadContext *thread, ShmLock *lock, ShmPointer lock_shm, int status, bool lock_taken);
@@ -1306,6 +1799,10 @@ shm_types_transaction_unlock(ThreadContext *thread, ShmTransactionElement *eleme
 void
 transient_check_clear(ThreadContext *thread);
 
+ShmInt
+shm_ticket_clock(void);
+ShmInt
+shm_ticket_clock_diff(ShmInt later, ShmInt earlier);
 int
 start_transaction(ThreadContext *thread, int mode, int locking_mode, int is_initial, int *recursion_count);
 void
@@ -1331,26 +1828,180 @@ transient_abort(ThreadContext *thread);
 int
 init_thread_context(ThreadContext **context);
 
-ShmWord
-shm_pointer_get_block(ShmPointer pntr);
+SHM_ALWAYS_INLINE ShmWord
+shm_pointer_get_block(ShmPointer pntr)
+{
+	return (pntr) >> SHM_OFFSET_BITS;
+}
 
-ShmWord
-shm_pointer_get_offset(ShmPointer pntr);
+SHM_ALWAYS_INLINE ShmWord
+shm_pointer_get_offset(ShmPointer pntr)
+{
+	return (pntr) & SHM_INVALID_OFFSET; // 20 bits
+}
 
-bool
-shm_pointer_is_valid(ShmPointer pntr);
+// Immediate values are packed right into the ShmPointer instead of a refcounted heap block.
+// Heap blocks and the fields referenced by ShmPointer are at least 4-aligned, so a real pointer never has the lowest bit set.
+// Lowest 3 bits are the tag: 001 - signed integer in the upper bits, 011 - bool, 101 - float32 in the upper 32 bits
+// (64-bit ShmPointer only), 111 - short string with the lowest byte being LLLSS111: SS = 00 for Latin-1 str,
+// 01 for bytes, LLL is the length, the characters are in the upper bytes and the unused ones are zero,
+// so two short strings are equal when their ShmPointer-s are equal. SS = 11 is never an immediate, which excludes
+// EMPTY_SHM and the pointers with SHM_INVALID_OFFSET.
+// Immediates are not empty for SBOOL, but LOCAL() returns NULL for them and acq/release are no-op.
+#define SHM_IMMEDIATE_TAG_BITS 3
+#define SHM_IMMEDIATE_TAG_MASK ((1 << SHM_IMMEDIATE_TAG_BITS) - 1)
+#define SHM_IMMEDIATE_SHORT_TAG_MASK 0x1F
+#define SHM_IMMEDIATE_INT 1
+#define SHM_IMMEDIATE_BOOL 3
+#define SHM_IMMEDIATE_FLOAT 5
+#define SHM_IMMEDIATE_SHORT_STR 0x07
+#define SHM_IMMEDIATE_SHORT_BYTES 0x0F
+#define SHM_IMMEDIATE_SHORT_INVALID 0x1F
+#define SHM_IMMEDIATE_INT_MAX (INTPTR_MAX >> SHM_IMMEDIATE_TAG_BITS)
+#define SHM_IMMEDIATE_INT_MIN (INTPTR_MIN >> SHM_IMMEDIATE_TAG_BITS)
+#define SHM_IMMEDIATE_SHORT_MAX ((int)sizeof(__ShmPointer) - 1)
+
+SHM_ALWAYS_INLINE bool
+shm_pointer_is_immediate(ShmPointer pntr)
+{
+	return (pntr & 1) != 0 && (pntr & SHM_IMMEDIATE_SHORT_TAG_MASK) != SHM_IMMEDIATE_SHORT_INVALID;
+}
 
-bool
-SBOOL(ShmPointer pntr);
+SHM_ALWAYS_INLINE int
+shm_immediate_get_tag(ShmPointer pntr)
+{
+	if ((pntr & SHM_IMMEDIATE_TAG_MASK) == SHM_IMMEDIATE_TAG_MASK)
+		return (int)(pntr & SHM_IMMEDIATE_SHORT_TAG_MASK);
+	return (int)(pntr & SHM_IMMEDIATE_TAG_MASK);
+}
+
+SHM_ALWAYS_INLINE __ShmPointer
+shm_immediate_from_int(intptr_t value)
+{
+	shmassert(value >= SHM_IMMEDIATE_INT_MIN && value <= SHM_IMMEDIATE_INT_MAX);
+	return ((__ShmPointer)value << SHM_IMMEDIATE_TAG_BITS) | SHM_IMMEDIATE_INT;
+}
+
+SHM_ALWAYS_INLINE intptr_t
+shm_immediate_get_int(ShmPointer pntr)
+{
+	return (intptr_t)pntr >> SHM_IMMEDIATE_TAG_BITS; // arithmetic shift keeps the sign
+}
+
+SHM_ALWAYS_INLINE __ShmPointer
+shm_immediate_from_bool(bool value)
+{
+	return ((__ShmPointer)(value ? 1 : 0) << SHM_IMMEDIATE_TAG_BITS) | SHM_IMMEDIATE_BOOL;
+}
+
+SHM_ALWAYS_INLINE bool
+shm_immediate_get_bool(ShmPointer pntr)
+{
+	return (pntr >> SHM_IMMEDIATE_TAG_BITS) != 0;
+}
+
+#if INTPTR_MAX > 2147483647
+	#define SHM_IMMEDIATE_HAS_FLOAT 1
+	// Only doubles exactly representable as float32 are stored as immediates.
+	SHM_ALWAYS_INLINE bool
+	shm_immediate_float_fits(double value)
+	{
+		return (double)(float)value == value;
+	}
+
+	SHM_ALWAYS_INLINE __ShmPointer
+	shm_immediate_from_float(double value)
+	{
+		float f = (float)value;
+		uint32_t bits;
+		memcpy(&bits, &f, sizeof(bits));
+		return ((__ShmPointer)bits << 32) | SHM_IMMEDIATE_FLOAT;
+	}
+
+	SHM_ALWAYS_INLINE double
+	shm_immediate_get_float(ShmPointer pntr)
+	{
+		uint32_t bits = (uint32_t)(pntr >> 32);
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+#else
+	#define SHM_IMMEDIATE_HAS_FLOAT 0
+#endif
+
+// tag is SHM_IMMEDIATE_SHORT_STR or SHM_IMMEDIATE_SHORT_BYTES, chars are Latin-1 characters or bytes
+SHM_ALWAYS_INLINE __ShmPointer
+shm_immediate_from_short(int tag, const uint8_t *chars, int length)
+{
+	shmassert(length >= 0 && length <= SHM_IMMEDIATE_SHORT_MAX);
+	__ShmPointer rslt = (__ShmPointer)tag | ((__ShmPointer)length << 5);
+	for (int i = 0; i < length; ++i)
+		rslt |= (__ShmPointer)chars[i] << (8 * (i + 1));
+	return rslt;
+}
+
+SHM_ALWAYS_INLINE int
+shm_immediate_get_short_length(ShmPointer pntr)
+{
+	return (int)((pntr >> 5) & 7);
+}
+
+// Returns the length, chars should have a room for SHM_IMMEDIATE_SHORT_MAX items.
+SHM_ALWAYS_INLINE int
+shm_immediate_get_short(ShmPointer pntr, uint8_t *chars)
+{
+	int length = shm_immediate_get_short_length(pntr);
+	for (int i = 0; i < length; ++i)
+		chars[i] = (uint8_t)(pntr >> (8 * (i + 1)));
+	return length;
+}
+
+SHM_ALWAYS_INLINE bool
+shm_pointer_is_valid(ShmPointer pntr)
+{
+	ShmWord block = shm_pointer_get_block(pntr);
+	return !shm_pointer_is_immediate(pntr) && block >= 0 && block <= SHM_MAX_BLOCK && pntr != NONE_SHM && shm_pointer_get_offset(pntr) != SHM_INVALID_OFFSET &&
+	       shm_pointer_get_offset(pntr) > SHM_FIXED_CHUNK_HEADER_SIZE; // only internal routines can read the header
+}
+
+// Immediates might have any upper bits, so negative ints and short strings could look like SHM_INVALID_BLOCK
+SHM_ALWAYS_INLINE bool
+SBOOL(ShmPointer pntr)
+{
+	return shm_pointer_is_immediate(pntr) || (shm_pointer_get_block(pntr) != SHM_INVALID_BLOCK && pntr != NONE_SHM);
+}
 
 void *
 shm_pointer_to_pointer_root(ShmPointer pntr);
-void *
-shm_pointer_to_pointer_unsafe(ShmPointer pntr);
+// Block group is not mapped into this process yet or the block index is out of range.
+SHM_COLD void *
+shm_pointer_to_pointer_slow(ShmPointer pntr);
 void *
 shm_pointer_to_pointer_no_side(ShmPointer pntr);
-void *
-shm_pointer_to_pointer(ShmPointer pntr);
+
+// Fast path only needs the process-local superblock_mmap. Once the group is mapped, the whole
+// SHM_BLOCK_GROUP_SIZE blocks range is backed, block_count is only verified on the slow path.
+SHM_ALWAYS_INLINE void *
+shm_pointer_to_pointer_unsafe(ShmPointer pntr)
+{
+	ShmWord idx = shm_pointer_get_block(pntr);
+	if (P_LIKELY(idx >= 0 && idx < SHM_MAX_BLOCK))
+	{
+		vl char *group = superblock_mmap[idx / SHM_BLOCK_GROUP_SIZE];
+		if (P_LIKELY(group != NULL))
+			return CAST_VL(group + (idx % SHM_BLOCK_GROUP_SIZE) * SHM_FIXED_CHUNK_SIZE + shm_pointer_get_offset(pntr));
+	}
+	return shm_pointer_to_pointer_slow(pntr);
+}
+
+SHM_ALWAYS_INLINE void *
+shm_pointer_to_pointer(ShmPointer pntr)
+{
+	if (P_UNLIKELY(!shm_pointer_is_valid(pntr)))
+		return NULL;
+	return shm_pointer_to_pointer_unsafe(pntr);
+}
 
 ShmPointer
 shm_pointer_shift(ShmPointer value, ShmWord offset);
@@ -1358,8 +2009,17 @@ shm_pointer_shift(ShmPointer value, ShmWord offset);
 #define LOCAL(x)  shm_pointer_to_pointer(x)
 
 // ShmInt is usually 32 bit, while ShmPointer is 32 or 64
-ShmPointer
-pack_shm_pointer(ShmWord offset, ShmWord block);
+SHM_ALWAYS_INLINE ShmPointer
+pack_shm_pointer(ShmWord offset, ShmWord block)
+{
+	shmassert(offset >= 0);
+	shmassert(offset <= (ShmWord)SHM_INVALID_OFFSET);
+	shmassert(block >= 0);
+	shmassert(block <= SHM_MAX_BLOCK || block == SHM_INVALID_BLOCK);
+	uintptr_t _offset = (uintptr_t)offset & SHM_INVALID_OFFSET;
+	uintptr_t _block = (uintptr_t)block & SHM_INVALID_BLOCK;
+	return (_block << SHM_OFFSET_BITS) | _offset;
+}
 ShmPointer
 pointer_to_shm_pointer(void *pntr, ShmWord block);
 
@@ -1406,7 +2066,7 @@ debug_id_to_str(int id);
 	#include "safe_lib.h"
 #endif
 
-#define TYPE_DEBUG_ID_STRING_COUNT 31
+#define TYPE_DEBUG_ID_STRING_COUNT 45
 
 enum {
 	SHM_THREAD_CONTEXT_ID,
@@ -1420,6 +2080,9 @@ enum {
 	SHM_LIST_BLOCK_FIRST_DEBUG_ID,
 	SHM_LIST_BLOCK_DEBUG_ID,
 	SHM_LIST_INDEX_DEBUG_ID,
+	SHM_LIST_INDEX_PAGE_DEBUG_ID,
+	SHM_LIST_SHADOW_DEBUG_ID,
+	SHM_LIST_SHADOW_CHUNK_DEBUG_ID,
 	SHM_LIST_CHANGES_DEBUG_ID,
 
 	SHM_QUEUE_DEBUG_ID,
@@ -1438,9 +2101,23 @@ enum {
 	SHM_UNDICT_DELTA_TABLE_INDEX_DEBUG_ID,
 	SHM_UNDICT_TABLE_BLOCK_DEBUG_ID,
 	SHM_UNDICT_DELTA_TABLE_BLOCK_DEBUG_ID,
+	SHM_UNDICT_SEGMENTS_DEBUG_ID,
+	SHM_UNDICT_ENTRIES_DEBUG_ID,
+	SHM_UNDICT_ENTRY_BLOCK_DEBUG_ID,
 
 	SHM_PROMISE_DEBUG_ID,
 
+	SHM_ARRAY_DEBUG_ID,
+	SHM_ARRAY_DATA_DEBUG_ID,
+
+	SHM_TABLE_DEBUG_ID,
+	SHM_TABLE_INDEX_DEBUG_ID,
+	SHM_TABLE_CHUNK_DEBUG_ID,
+
+	SHM_BLOB_DEBUG_ID,
+	SHM_BLOB_INDEX_DEBUG_ID,
+	SHM_BLOB_SEGMENT_DEBUG_ID,
+
 	PRIVATE_DATA_FREE_LIST2_DEBUG_ID,
 
 	THREAD_LOCAL_VARS_DEBUG_ID,
@@ -1465,9 +2142,12 @@ init_debug_type_ids(type_debug_id_list *list)
 		"ShmListBlock first",
 		"ShmListBlock",
 		"ShmListIndex",
+		"ShmListIndex page",
+		"ShmListShadow",
+		"ShmListShadow chunk",
 		"ShmListChanges",
 
-		"ShmQueue", // 10
+		"ShmQueue", // 13
 		"ShmQueueCell",
 		"ShmQueueChanges",
 
@@ -1478,20 +2158,34 @@ init_debug_type_ids(type_debug_id_list *list)
 
 		"ShmUnDict",
 		"ShmUnDict table",
-		"ShmUnDict delta table",
-		"ShmUnDict table index", // 20
+		"ShmUnDict delta table", // 22
+		"ShmUnDict table index",
 		"ShmUnDict delta table index",
 		"ShmUnDict table block",
 		"ShmUnDict delta table block",
+		"ShmUnDict segments",
+		"ShmUnDict entries",
+		"ShmUnDict entry block",
+
+		"ShmPromise", // 30
+
+		"ShmArray",
+		"ShmArray data",
+
+		"ShmTable",
+		"ShmTable index",
+		"ShmTable chunk",
 
-		"ShmPromise",
+		"ShmBlob",
+		"ShmBlob index",
+		"ShmBlob segment",
 
 		"t->private_data->free_list 2",
 		"thread->local_vars",
-		"val",
+		"val", // 41
 		"exit_flag",
 		"test_mm",
-		"test_mm_medium", // 30
+		"test_mm_medium",
 	};
 	for (int i = 0; i < TYPE_DEBUG_ID_STRING_COUNT; i++)
 	{
@@ -1516,6 +2210,8 @@ shm_value_get_data(ShmValueHeader *value);
 
 ShmValueHeader *
 new_shm_value(ThreadContext *thread, ShmInt item_size, ShmInt type, PShmPointer shm_pointer);
+ShmInt
+shm_value_max_size(void);
 
 vl void *
 new_shm_refcounted_block(ThreadContext *thread, PShmPointer shm_pointer, int total_size, ShmInt type, int debug_id);
@@ -1657,6 +2353,12 @@ typedef struct {
 
 ShmUnDict *
 new_shm_undict(ThreadContext *thread, PShmPointer shm_pointer);
+ShmUnDict *
+new_shm_undict_concurrent(ThreadContext *thread, PShmPointer shm_pointer);
+int
+shm_undict_segment_count(ShmUnDict *dict);
+bool
+shm_undict_get_segment(UnDictRef dict, int segment_index, UnDictRef *segment);
 bool
 shm_undict_get_bucket_at_index(ThreadContext *thread, ShmUnDict *dict, int itemindex, ShmPointer *key, ShmPointer *value);
 int
@@ -1686,6 +2388,10 @@ shm_undict_get(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, ShmPoin
 int
 shm_undict_acq(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *key, ShmPointer *value);
 int
+shm_undict_acq_many(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *keys, ShmPointer *values, int count);
+int
+shm_undict_set_many(ThreadContext *thread, UnDictRef dict, ShmUnDictKey *keys, ShmPointer *values, int count);
+int
 shm_undict_clear(ThreadContext *thread, UnDictRef dict);
 void
 shm_undict_debug_print(ThreadContext *thread, ShmUnDict *dict, bool full);
@@ -1697,8 +2403,28 @@ shm_refcounted_block_destroy(ThreadContext *thread, ShmPointer shm_pointer, ShmR
 ShmRefcountedBlock *
 shm_pointer_to_refcounted(ThreadContext *thread, ShmPointer pointer, bool strict_refcounted, bool strict_check_type);
 
-vl void *
-shm_pointer_acq(ThreadContext *thread, ShmPointer pointer);
+// Contained, released or non-refcounted blocks, full checks of shm_pointer_to_refcounted.
+SHM_COLD vl void *
+shm_pointer_acq_slow(ThreadContext *thread, ShmPointer pointer);
+// Refcount went up from zero, only allowed inside transaction.
+SHM_COLD void
+shm_pointer_acq_revived(ThreadContext *thread, ShmRefcountedBlock *block);
+
+SHM_ALWAYS_INLINE vl void *
+shm_pointer_acq(ThreadContext *thread, ShmPointer pointer)
+{
+	if (shm_pointer_is_immediate(pointer))
+		return NULL;
+	ShmRefcountedBlock *block = (ShmRefcountedBlock *)LOCAL(pointer);
+	puint type_mask = SHM_TYPE_FLAG_REFCOUNTED | SHM_TYPE_FLAG_CONTAINED | SHM_TYPE_RELEASE_MARK;
+	if (P_LIKELY(block && ((puint)block->type & type_mask) == SHM_TYPE_FLAG_REFCOUNTED))
+	{
+		if (P_UNLIKELY(shm_atomic_int_add_relaxed(&block->refcount, 1) == 0))
+			shm_pointer_acq_revived(thread, block);
+		return block;
+	}
+	return shm_pointer_acq_slow(thread, pointer);
+}
 // dec ref and free
 bool
 shm_pointer_release(ThreadContext *thread, ShmPointer pointer);
@@ -168,6 +168,7 @@ extern void _shmassert(bool condition, char *condition_msg, char *message, char
 #endif
 
 #define DEBUG_LOCK 0
+#define DEBUG_TICKET_HISTORY 0 // record the last transaction starters in superblock->ticket_history
 #define DEBUG_SHM_EVENTS true
 #define alloc_flinch true
 extern bool random_flinch;
@@ -23,7 +23,8 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
-//  Simple linear probing hash array
+//  Linear probing hash array. The buckets are probed HASH_GROUP_SIZE at a time through their control bytes,
+//  so only the buckets with a matching 7-bit hash tag get their keys compared.
 
 #include <stdbool.h>
 #include <stdint.h>
@@ -31,6 +32,22 @@
 #include "shm_types.h"
 #include "unordered_map.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define HASH_GROUP_SSE2
+#elif defined(__aarch64__)
+	#include <arm_neon.h>
+	#define HASH_GROUP_NEON
+#endif
+
+#if defined(__GNUC__)
+	#define HASH_PREFETCH(addr) __builtin_prefetch((const void *)(addr))
+#elif defined(HASH_GROUP_SSE2)
+	#define HASH_PREFETCH(addr) _mm_prefetch((const char *)(addr), _MM_HINT_T0)
+#else
+	#define HASH_PREFETCH(addr)
+#endif
+
 int
 calc_pos(int base_pos, int step, int bucket_count)
 {
@@ -61,12 +78,7 @@ ShmInt
 bucket_get_state(hash_bucket *bucket)
 {
 	if (bucket->key != 0)
-	{
-		if (bucket->value == EMPTY_SHM)
-			return HASH_BUCKET_STATE_DELETED_RESERVED;
-		else
-			return HASH_BUCKET_STATE_SET;
-	}
+		return HASH_BUCKET_STATE_SET;
 	else
 	{
 		if (bucket->key_hash == 0)
@@ -77,6 +89,15 @@ bucket_get_state(hash_bucket *bucket)
 	}
 }
 
+ShmInt
+delta_bucket_get_state(hash_delta_bucket *bucket)
+{
+	ShmInt state = bucket_get_state((hash_bucket *)bucket);
+	if (state == HASH_BUCKET_STATE_SET && bucket->value == EMPTY_SHM)
+		return HASH_BUCKET_STATE_DELETED_RESERVED;
+	return state;
+}
+
 void
 validate_bucket(hash_bucket *bucket)
 {
@@ -85,25 +106,19 @@ validate_bucket(hash_bucket *bucket)
 	case HASH_BUCKET_STATE_EMPTY:
 		shmassert(SBOOL(bucket->key) == false);
 		shmassert(bucket->key_hash == 0);
-		shmassert(SBOOL(bucket->value) == false);
 		break;
 	case HASH_BUCKET_STATE_DELETED:
 		shmassert(SBOOL(bucket->key) == false);
 		shmassert(bucket->key_hash == 1);
-		shmassert(SBOOL(bucket->value) == false);
-		break;
-	case HASH_BUCKET_STATE_DELETED_RESERVED:
-		shmassert(SBOOL(bucket->key));
-		shmassert(bucket->value == EMPTY_SHM);
 		break;
 	default:
 		shmassert(SBOOL(bucket->key));
-		shmassert(bucket->value != EMPTY_SHM);
 	}
 }
 
-hash_bucket *
-get_bucket_at_index(hash_table_header *header, int itemindex, int item_size)
+// Returns the in-place table holding the itemindex, which is either the header itself or one of the index subblocks.
+static hash_table_header *
+get_block_at_index(hash_table_header *header, int itemindex, int *local_index)
 {
 	if (header->is_index)
 	{
@@ -116,30 +131,124 @@ get_bucket_at_index(hash_table_header *header, int itemindex, int item_size)
 		int item_mask = (1 << log_local_count) - 1;
 		shmassert(item_mask > 0);
 		int index_index = itemindex >> log_local_count;
-		int local_index = itemindex & item_mask;
+		*local_index = itemindex & item_mask;
 
 		ShmPointer *index_blocks = &index_header->blocks;
 		hash_table_header *subblock = LOCAL(index_blocks[index_index]);
 		shmassert(subblock->log_count == log_local_count);
-		shmassert(local_index < (1 << log_local_count));
-		shmassert(local_index >= 0);
-		uintptr_t buckets = (uintptr_t)&subblock->buckets;
-		shmassert(buckets);
-
-		uintptr_t rslt = buckets + (puint)(local_index * item_size);
-		shmassert(rslt < (uintptr_t)subblock + (puint)subblock->size);
-		return (hash_bucket *)rslt;
+		shmassert(*local_index < (1 << log_local_count));
+		shmassert(*local_index >= 0);
+		return subblock;
 	}
 	else
 	{
-		uintptr_t buckets = (uintptr_t)header + sizeof(hash_table_header) - sizeof(hash_bucket);
-		shmassert(buckets);
-		uintptr_t rslt = buckets + (puint)(itemindex * item_size);
-		shmassert(rslt < (uintptr_t)header + (puint)header->size);
-		return (hash_bucket *)rslt;
+		*local_index = itemindex;
+		return header;
 	}
 }
 
+static vl uint8_t *
+get_block_ctrl(hash_table_header *block, int item_size)
+{
+	return (vl uint8_t *)((uintptr_t)&block->buckets + (puint)(item_size << block->log_count));
+}
+
+hash_bucket *
+get_bucket_at_index(hash_table_header *header, int itemindex, int item_size)
+{
+	int local_index;
+	hash_table_header *block = get_block_at_index(header, itemindex, &local_index);
+	uintptr_t buckets = (uintptr_t)&block->buckets;
+	shmassert(buckets);
+	uintptr_t rslt = buckets + (puint)(local_index * item_size);
+	shmassert(rslt < (uintptr_t)block + (puint)block->size);
+	return (hash_bucket *)rslt;
+}
+
+ShmWord
+hash_table_block_size(int item_size, int log_count)
+{
+	return isizeof(hash_table_header) - isizeof(hash_bucket) + (item_size + 1) * (1 << log_count) + HASH_GROUP_SIZE - 1;
+}
+
+static uint8_t
+hash_ctrl_tag(uint32_t hash)
+{
+	return (uint8_t)(HASH_CTRL_FULL | (hash >> 25));
+}
+
+static uint8_t
+bucket_ctrl(hash_bucket *bucket)
+{
+	switch (bucket_get_state(bucket))
+	{
+	case HASH_BUCKET_STATE_SET:
+		return hash_ctrl_tag(bucket->key_hash);
+	case HASH_BUCKET_STATE_DELETED:
+		return HASH_CTRL_DELETED;
+	default:
+		return HASH_CTRL_EMPTY;
+	}
+}
+
+void
+bucket_sync_ctrl(hash_table_header *header, int itemindex, int item_size)
+{
+	int local_index;
+	hash_table_header *block = get_block_at_index(header, itemindex, &local_index);
+	hash_bucket *bucket = (hash_bucket *)((uintptr_t)&block->buckets + (puint)(local_index * item_size));
+	get_block_ctrl(block, item_size)[local_index] = bucket_ctrl(bucket);
+}
+
+// Bit N of the result is set when ctrl[N] == value
+static uint32_t
+hash_group_match(const uint8_t *ctrl, uint8_t value)
+{
+#if defined(HASH_GROUP_SSE2)
+	__m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)value)));
+#elif defined(HASH_GROUP_NEON)
+	// no movemask on NEON: keep a distinct bit in every matching lane and sum each half
+	static const uint8_t lane_bits[HASH_GROUP_SIZE] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+	uint8x16_t masked = vandq_u8(vceqq_u8(vld1q_u8(ctrl), vdupq_n_u8(value)), vld1q_u8(lane_bits));
+	return (uint32_t)vaddv_u8(vget_low_u8(masked)) | ((uint32_t)vaddv_u8(vget_high_u8(masked)) << 8);
+#else
+	uint32_t rslt = 0;
+	for (int i = 0; i < HASH_GROUP_SIZE; ++i)
+		if (ctrl[i] == value)
+			rslt |= 1u << i;
+	return rslt;
+#endif
+}
+
+// Bit N of the result is set when ctrl[N] is a set or reserved bucket
+static uint32_t
+hash_group_match_full(const uint8_t *ctrl)
+{
+#if defined(HASH_GROUP_SSE2)
+	return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)ctrl));
+#else
+	uint32_t rslt = 0;
+	for (int i = 0; i < HASH_GROUP_SIZE; ++i)
+		if (ctrl[i] & HASH_CTRL_FULL)
+			rslt |= 1u << i;
+	return rslt;
+#endif
+}
+
+static int
+lowest_bit_index(uint32_t mask)
+{
+	shmassert(mask != 0);
+#if defined(_MSC_VER)
+	unsigned long rslt;
+	_BitScanForward(&rslt, mask);
+	return (int)rslt;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
 int calc_base_index(uint32_t hash, int bucket_count)
 {
 	shmassert(bucket_count > 0);
@@ -147,16 +256,21 @@ int calc_base_index(uint32_t hash, int bucket_count)
 	return (int)rslt;
 }
 
+// A couple of control groups are always allowed: the few keys of a small table (e.g. of a concurrent dict's segment)
+// easily form a chain of 5 buckets, which used to fail the moves into a freshly allocated table.
 int
 hash_max_collision_size(ShmInt bucket_count)
 {
 	int rslt = bucket_count / 8;
-	if (rslt < 4)
-		rslt = 4 - 1;
+	if (rslt < 2 * HASH_GROUP_SIZE - 1)
+		rslt = 2 * HASH_GROUP_SIZE - 1;
+	if (rslt > bucket_count - 1)
+		rslt = bucket_count - 1;
 
 	return rslt;
 }
  
+// Deleted buckets are skipped and never reused here, hash_compact_tail() turns them into empty ones.
 find_position_result
 hash_find_position(hash_func_args args, ShmUnDictKey *key)
 {
@@ -166,10 +280,10 @@ hash_find_position(hash_func_args args, ShmUnDictKey *key)
 		return rslt;
 	}
 	shmassert(count_bits(args.bucket_count) == 1);
-	int base_index = calc_base_index(key->hash, args.bucket_count);
+	int test_pos = calc_base_index(key->hash, args.bucket_count);
 	int attempt_number = 0;
-	int first_deleted_pos = -1;
 	int max_attempts = hash_max_collision_size(args.bucket_count);
+	uint8_t tag = hash_ctrl_tag(key->hash);
 
 	while (true)
 	{
@@ -178,47 +292,60 @@ hash_find_position(hash_func_args args, ShmUnDictKey *key)
 			find_position_result rslt = { -2, -2 };
 			return rslt;
 		}
-		int test_pos = calc_pos(base_index, attempt_number, args.bucket_count);
-		if (test_pos == -1)
+		if (attempt_number >= args.bucket_count)
 		{
 			// full circle
 			shmassert(false);
 			find_position_result rslt = { -1, -1 };
 			return rslt;
 		}
-		hash_bucket *bucket = get_bucket_at_index(args.header, test_pos, args.bucket_item_size);
-		validate_bucket(bucket);
-		switch (bucket_get_state(bucket))
+		int local_index;
+		hash_table_header *block = get_block_at_index(args.header, test_pos, &local_index);
+		const uint8_t *ctrl = CAST_VL(get_block_ctrl(block, args.bucket_item_size) + local_index);
+		uintptr_t group_buckets = (uintptr_t)&block->buckets + (puint)(local_index * args.bucket_item_size);
+		// The control bytes and the buckets are in different cache lines, fetch both at once.
+		// A hit is almost always the first bucket at the table's load factor.
+		HASH_PREFETCH(group_buckets);
+		// the group must not cross the block's end nor the probing limit
+		int width = (1 << block->log_count) - local_index;
+		if (width > HASH_GROUP_SIZE)
+			width = HASH_GROUP_SIZE;
+		if (width > max_attempts + 1 - attempt_number)
+			width = max_attempts + 1 - attempt_number;
+		if (width > args.bucket_count - attempt_number)
+			width = args.bucket_count - attempt_number;
+		uint32_t valid = (1u << width) - 1;
+
+		uint32_t empty = hash_group_match(ctrl, HASH_CTRL_EMPTY) & valid;
+		uint32_t candidates = (args.compare_key ? hash_group_match(ctrl, tag) : hash_group_match_full(ctrl)) & valid;
+		if (empty)
+			candidates &= (empty & (~empty + 1)) - 1; // the chain ends at the first empty bucket
+		while (candidates)
 		{
-		case HASH_BUCKET_STATE_SET:
-		case HASH_BUCKET_STATE_DELETED_RESERVED:
-			if (!args.compare_key || args.compare_key(bucket, key))
+			int group_index = lowest_bit_index(candidates);
+			candidates &= candidates - 1;
+			hash_bucket *bucket = (hash_bucket *)(group_buckets + (puint)(group_index * args.bucket_item_size));
+			validate_bucket(bucket);
+			shmassert(bucket_ctrl(bucket) == ctrl[group_index]);
+			// The stored hash rejects the rest of the collisions without dereferencing the key
+			if (!args.compare_key || (bucket->key_hash == key->hash && args.compare_key(bucket, key)))
 			{
-				find_position_result rslt = { .found = test_pos, .last_free = -1 };
+				find_position_result rslt = { .found = test_pos + group_index, .last_free = -1 };
 				return rslt;
 			}
-			break;
-		case HASH_BUCKET_STATE_DELETED:
-			if (first_deleted_pos != -1)
-				first_deleted_pos = test_pos;
-			break;
-		case HASH_BUCKET_STATE_EMPTY:
-			{
-				find_position_result rslt;
-				rslt.found = -1;
-				if (first_deleted_pos != -1)
-					rslt.last_free = first_deleted_pos;
-				else
-					rslt.last_free = test_pos;
-
-				return rslt;
-			}
-			break;
-		default:
-			shmassert(false);
+		}
+		if (empty)
+		{
+			find_position_result rslt;
+			rslt.found = -1;
+			rslt.last_free = test_pos + lowest_bit_index(empty);
+			return rslt;
 		}
 
-		attempt_number++;
+		attempt_number += width;
+		test_pos += width;
+		if (test_pos >= args.bucket_count)
+			test_pos -= args.bucket_count;
 	}
 }
 
@@ -239,7 +366,6 @@ swap_buckets(hash_bucket *bucket1, hash_bucket *bucket2)
 void
 bucket_empty_deleted(hash_bucket *bucket)
 {
-	shmassert(bucket->value == EMPTY_SHM);
 	shmassert(bucket_get_state(bucket) == HASH_BUCKET_STATE_DELETED);
 	bucket->key = 0; // memset-friendly
 }
@@ -248,7 +374,6 @@ bucket_empty_deleted(hash_bucket *bucket)
 ShmPointer
 bucket_delete(hash_bucket *bucket)
 {
-	shmassert(bucket->value == EMPTY_SHM);
 	shmassert(SBOOL(bucket->key));
 
 	ShmPointer key_shm = bucket->key;
@@ -276,6 +401,7 @@ hash_compact_tail(hash_func_args args, hash_index deleted_index, uint32_t base_h
 	shmassert(deleted_pos == deleted_index);
 	prev_bucket = get_bucket_at_index(args.header, deleted_index, args.bucket_item_size);
 	shmassert(prev_bucket);
+	int prev_pos = deleted_index;
 
 	while (true)
 	{
@@ -304,13 +430,13 @@ hash_compact_tail(hash_func_args args, hash_index deleted_index, uint32_t base_h
 				if (bucket_get_state(prev_bucket) == HASH_BUCKET_STATE_DELETED)
 				{
 					bucket_empty_deleted(prev_bucket);
+					bucket_sync_ctrl(args.header, prev_pos, args.bucket_item_size);
 					if (args.deleted_count)
 						args.deleted_count--;
 				}
 			}
 			return;
 			break;
-		case HASH_BUCKET_STATE_DELETED_RESERVED:
 		case HASH_BUCKET_STATE_SET:
 			if (same_bucket(base_hash, bucket->key_hash, mask))
 			{
@@ -318,6 +444,8 @@ hash_compact_tail(hash_func_args args, hash_index deleted_index, uint32_t base_h
 				hash_bucket *deleted_bucket = get_bucket_at_index(args.header, deleted_pos, args.bucket_item_size);
 				shmassert(deleted_bucket != bucket);
 				swap_buckets(bucket, deleted_bucket);
+				bucket_sync_ctrl(args.header, deleted_pos, args.bucket_item_size);
+				bucket_sync_ctrl(args.header, test_pos, args.bucket_item_size);
 				deleted_pos = test_pos;
 			}
 			break;
@@ -327,6 +455,7 @@ hash_compact_tail(hash_func_args args, hash_index deleted_index, uint32_t base_h
 
 		step_num++;
 		prev_bucket = bucket;
+		prev_pos = test_pos;
 	}
 }
 
@@ -32,19 +32,38 @@ enum hash_bucket_state { HASH_BUCKET_STATE_INVALID, HASH_BUCKET_STATE_EMPTY, HAS
 };
 typedef intptr_t hash_index;
 
+// The persistent table only maps the keys to their positions in the dict's insertion-ordered entries,
+// the values are kept in the entries.
 typedef vl struct {
 	uint32_t key_hash;
+	uint32_t entry;
 	ShmPointer key; // EMPTY_SHM for empty and deleted (determinted by key_hash), otherwise set
-	ShmPointer value;
 } hash_bucket;
 
 typedef volatile struct {
+	// hash_bucket
 	uint32_t key_hash;
+	uint32_t entry; // the persistent item's entry, unused for orig_item == -1
 	ShmPointer key;
-	ShmPointer value;
-	hash_index orig_item;
+	// hash_delta_bucket
+	ShmPointer value; // EMPTY_SHM for the key deleted by the transaction
+	int32_t orig_item;
+	int32_t appended; // order of the key's (re)insertion within the transaction, -1 for the kept position
 } hash_delta_bucket;
 
+typedef vl struct {
+	ShmPointer key; // the bucket's key, not counted here. NONE_SHM for the deleted item's hole.
+	ShmPointer value;
+} hash_entry;
+
+// Every table block keeps a control byte per bucket after the buckets array, so the probing
+// scans HASH_GROUP_SIZE buckets at once without touching the buckets themselves.
+// Zero is the empty state, so the memclear-ed blocks are valid empty tables.
+#define HASH_CTRL_EMPTY 0x00
+#define HASH_CTRL_DELETED 0x01
+#define HASH_CTRL_FULL 0x80 // | 7 high bits of the hash, the low bits select the base position
+#define HASH_GROUP_SIZE 16
+
 typedef vl struct {
 	// type is SHM_TYPE_UNDICT_TABLE or SHM_TYPE_UNDICT_DELTA_TABLE
 	SHM_REFCOUNTED_BLOCK
@@ -54,6 +73,7 @@ typedef vl struct {
 	ShmInt relocated; // this block's state is invalid
 	// hash_bucket[] or hash_delta_bucket[]
 	hash_bucket buckets;
+	// followed by uint8_t ctrl[1 << log_count] and HASH_GROUP_SIZE - 1 bytes of padding for the group loads
 } hash_table_header;
 
 typedef vl struct {
@@ -69,6 +89,19 @@ typedef vl struct {
 } hash_table_index_header;
 
 
+typedef vl struct {
+	// type is SHM_TYPE_UNDICT_ENTRY_BLOCK
+	SHM_REFCOUNTED_BLOCK
+	hash_entry entries; // hash_entry[1 << SHM_UNDICT_ENTRY_BLOCK_LOG]
+} hash_entry_block;
+
+typedef vl struct {
+	// type is SHM_TYPE_UNDICT_ENTRIES
+	SHM_REFCOUNTED_BLOCK
+	ShmInt block_capacity;
+	ShmPointer blocks; // hash_entry_block[block_capacity], the ones past the dict's entry_count are not allocated
+} hash_entries_header;
+
 typedef struct {
 	hash_index found;
 	hash_index last_free;
@@ -90,9 +123,21 @@ typedef struct {
 ShmInt
 bucket_get_state(hash_bucket *bucket);
 
+// Same as bucket_get_state() plus HASH_BUCKET_STATE_DELETED_RESERVED for the keys deleted by the transaction
+ShmInt
+delta_bucket_get_state(hash_delta_bucket *bucket);
+
 hash_bucket *
 get_bucket_at_index(hash_table_header *header, int itemindex, int item_size);
 
+// size of a table block with 1 << log_count buckets, including the control bytes
+ShmWord
+hash_table_block_size(int item_size, int log_count);
+
+// Updates the control byte after the bucket's key has been set or removed
+void
+bucket_sync_ctrl(hash_table_header *header, int itemindex, int item_size);
+
 void
 validate_bucket(hash_bucket *bucket);
 
@@ -115,6 +115,75 @@ void test_mm(ThreadContext *thread)
 	}
 }
 
+#define TEST_THROTTLE_COUNT 20000
+static ShmPointer test_throttle_data[3][TEST_THROTTLE_COUNT];
+extern int garbage_throttled;
+extern int garbage_throttle_drained;
+
+static void
+test_garbage_throttle_fill(ThreadContext *thread, int batch)
+{
+	for (int j = 0; j < TEST_THROTTLE_COUNT; ++j)
+	{
+		ShmAbstractBlock *data = get_mem(thread, &test_throttle_data[batch][j], 200, TEST_MM_DEBUG_ID);
+		data->type = 0;
+	}
+}
+
+static void
+test_garbage_throttle_free(ThreadContext *thread, int batch)
+{
+	for (int j = 0; j < TEST_THROTTLE_COUNT; ++j)
+		free_mem(thread, test_throttle_data[batch][j], -1);
+}
+
+// Stops the reclaimer so the freed blocks pile up above the watermarks, the allocator should throttle
+// before taking every new chunk and still grow the arena while the backlog stays. Once the reclaimer
+// catches up the arena grows without throttling.
+void test_garbage_throttle(ThreadContext *thread)
+{
+	ShmInt soft_limit = superblock->garbage_soft_limit;
+	ShmInt hard_limit = superblock->garbage_hard_limit;
+	superblock->garbage_soft_limit = 1000;
+	superblock->garbage_hard_limit = 4000;
+
+	superblock->stop_reclaimer = true;
+	test_garbage_throttle_fill(thread, 0);
+	test_garbage_throttle_free(thread, 0);
+	shmassert(superblock->pending_garbage >= 4000);
+
+	int throttled = garbage_throttled;
+	int drained = garbage_throttle_drained;
+	ShmInt block_count = superblock->block_count;
+	uint64_t tmp = rdtsc();
+	// the freed blocks are not reclaimed yet, so the arena has to grow
+	test_garbage_throttle_fill(thread, 1);
+	printf("1. Throttled allocation: %9.3f ms, throttled %d times, %d chunks added\n", (rdtsc() - tmp) / 3500000.0,
+		garbage_throttled - throttled, superblock->block_count - block_count);
+	shmassert(garbage_throttled > throttled);
+	shmassert(garbage_throttle_drained == drained);
+	shmassert(superblock->block_count > block_count);
+
+	superblock->stop_reclaimer = false;
+	shm_event_signal(&superblock->has_garbage_event);
+	for (int i = 0; i < 500 && superblock->pending_garbage >= superblock->garbage_soft_limit; ++i)
+		Sleep(10);
+	shmassert(superblock->pending_garbage < superblock->garbage_soft_limit);
+
+	// two more live batches don't fit into the reclaimed space
+	throttled = garbage_throttled;
+	block_count = superblock->block_count;
+	test_garbage_throttle_fill(thread, 0);
+	test_garbage_throttle_fill(thread, 2);
+	shmassert(garbage_throttled == throttled);
+	shmassert(superblock->block_count > block_count);
+
+	for (int batch = 0; batch < 3; ++batch)
+		test_garbage_throttle_free(thread, batch);
+	superblock->garbage_soft_limit = soft_limit;
+	superblock->garbage_hard_limit = hard_limit;
+}
+
 
 #define TEST_LOCK_THREAD_COUNT 3
 
@@ -338,6 +407,7 @@ create_random_dict_key(ShmDictKey *key, uint64_t *counter_rand, uint64_t *counte
 void
 print_main_thread_counters(ThreadContext *thread)
 {
+	printf("1. Results registered, summed transaction age in clock ticks (~65 us):\n");
 	printf("1. Times:        waiting %5d, %5d,        waiting2 %5d, %5d,\n",
 		thread->private_data->times_waiting, thread->private_data->tickets_waiting,
 		thread->private_data->times_waiting2, thread->private_data->tickets_waiting2);
@@ -449,8 +519,7 @@ test_dict(ThreadContext *thread, DictLocalReference *dict, char prefix, int kite
 			// thread->private_data->times_waiting = 0;
 			// thread->private_data->times_repeated = 0;
 			// thread->private_data->times_early_aborted = 0;
-			last_ticket = p_atomic_int_get(&superblock->ticket);
-			thread->private_data->last_known_ticket = p_atomic_int_get(&superblock->ticket);
+			last_ticket = shm_ticket_clock();
 
 			start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, &start_recursion_count);
 		}
@@ -691,7 +760,7 @@ test_dict(ThreadContext *thread, DictLocalReference *dict, char prefix, int kite
 		assert(start_recursion_count == commit_recursion_count);
 		++iteration;
 
-		int ticket_diff = p_atomic_int_get(&superblock->ticket) - last_ticket;
+		int ticket_diff = shm_ticket_clock_diff(shm_ticket_clock(), last_ticket);
 		if (ticket_diff > max_tickets_during_retry)
 			max_tickets_during_retry = ticket_diff;
 		if (max_tickets_during_retry > 10)
@@ -754,8 +823,7 @@ test_dict(ThreadContext *thread, DictLocalReference *dict, char prefix, int kite
 			second_clear.counter1 / 3500000.0, second_clear.counter2 / 3500000.0, second_clear.counter3 / 3500000.0,
 			second_clear.counter4 / 3500000.0, second_clear.counter5 / 3500000.0, second_clear.counter6 / 3500000.0,
 			second_clear.counter7 / 3500000.0);
-		printf("1. Max ticket: %i\n", superblock->ticket);
-		printf("1. Max tickets passed when retrying: %d\n", max_tickets_during_retry);
+		printf("1. Max clock ticks passed when retrying: %d\n", max_tickets_during_retry);
 		printf("1. Commit count: %i\n", commit_count);
 		printf("1. Dict size: %i\n", cnt);
 		printf("1. Retries: %d, max %d\n", total_retries, single_iteration_retries_max);
@@ -771,10 +839,11 @@ test_dict(ThreadContext *thread, DictLocalReference *dict, char prefix, int kite
 			verify_dict_data(thread, dict, &dict_local_count, &dict_local_good);
 			printf("%c. Legacy dict verification: %d good out of %d\n", prefix, dict_local_good, dict_local_count);
 		}
-		printf("2. Max tickets passed when retrying: %d\n", max_tickets_during_retry);
+		printf("2. Max clock ticks passed when retrying: %d\n", max_tickets_during_retry);
 		printf("2. Commit count: %i\n", commit_count);
 		printf("2. Retries: %d, max %d\n", total_retries, single_iteration_retries_max);
 		printf("2. Total time %9.3f\n", time_spent);
+		printf("2. Results registered, summed transaction age in clock ticks (~65 us):\n");
 		printf("2. Times:       waiting %5d, %5d,         waiting2 %5d, %5d,\n",
 			thread->private_data->times_waiting, thread->private_data->tickets_waiting,
 			thread->private_data->times_waiting2, thread->private_data->tickets_waiting2);
@@ -855,8 +924,7 @@ test_list(ThreadContext *thread, ListRef *list, int kiterations, bool concurrent
 			// thread->private_data->times_waiting = 0;
 			// thread->private_data->times_repeated = 0;
 			// thread->private_data->times_early_aborted = 0;
-			last_ticket = p_atomic_int_get(&superblock->ticket);
-			thread->private_data->last_known_ticket = p_atomic_int_get(&superblock->ticket);
+			last_ticket = shm_ticket_clock();
 
 			start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
 			started = true;
@@ -952,10 +1020,34 @@ verify_list(ThreadContext *thread, ListRef *list, int kiterations, int deleted_c
 		int len = snprintf(buf, 15, "i%d", iteration + deleted_count);
 		shmassert(len == str.len);
 		for (int i = 0; i < str.len; i++)
-			shmassert(str.data[i] == (Py_UCS4)buf[i]);
+			shmassert(shm_unicode_read(str.kind, str.data, i) == (Py_UCS4)buf[i]);
 
 		iteration++;
 	}
+	// the ranges walk over the blocks instead of looking up each item
+	for (int step = 1; step <= 3; step += 2)
+	{
+		int index = 0;
+		while (index < count.count)
+		{
+			ShmPointer values[100];
+			ShmInt fetched = 0;
+			CHECK_RETRY(shm_list_acq_range(thread, *list, index, step, 100, values, &fetched), thread);
+			ShmInt available = (count.count - index + step - 1) / step;
+			shmassert(fetched == (available < 100 ? available : 100));
+			for (int i = 0; i < fetched; i++)
+			{
+				RefUnicode str = shm_ref_unicode_get(values[i]);
+				char buf[15];
+				int len = snprintf(buf, 15, "i%d", index + i * step + deleted_count);
+				shmassert(len == str.len);
+				for (int j = 0; j < str.len; j++)
+					shmassert(shm_unicode_read(str.kind, str.data, j) == (Py_UCS4)buf[j]);
+				shm_pointer_release(thread, values[i]);
+			}
+			index += fetched * step;
+		}
+	}
 	commit_transaction(thread, NULL);
 }
 
@@ -985,10 +1077,10 @@ int test_undict(ThreadContext *thread, UnDictRef undict, char prefix)
 		char buf[15];
 		int len = snprintf(buf, 15, "%c.i%d", prefix, iteration);
 		ShmValueHeader *header = new_shm_unicode_value(thread, buf, len, &value_shm);
-		shmassert(shm_value_get_length(header) == len * isizeof(Py_UCS4));
+		shmassert(shm_value_get_length(header) == len);
 		ShmUnDictKey key2 = EMPTY_SHM_UNDICT_KEY;
 		key2.hash = hash_string_ascii(buf, len);
-		key2.key4 = shm_value_get_data(header);
+		key2.key1 = shm_value_get_data(header);
 		key2.keysize = len;
 
 		// value_data = NULL;
@@ -1055,6 +1147,662 @@ int test_undict(ThreadContext *thread, UnDictRef undict, char prefix)
 	return RESULT_OK;
 }
 
+static void undict_order_set(ThreadContext *thread, UnDictRef undict, int number, bool set)
+{
+	ShmPointer value_shm;
+	char buf[15];
+	int len = snprintf(buf, 15, "o%d", number);
+	ShmValueHeader *header = new_shm_unicode_value(thread, buf, len, &value_shm);
+	ShmUnDictKey key = EMPTY_SHM_UNDICT_KEY;
+	key.hash = hash_string_ascii(buf, len);
+	key.key1 = shm_value_get_data(header);
+	key.keysize = len;
+	int rslt = shm_undict_consume_item(thread, undict, &key, set ? value_shm : EMPTY_SHM, NULL);
+	shmassert(rslt == RESULT_OK);
+	if (!set)
+		shm_pointer_release(thread, value_shm);
+}
+
+// Iterates the dict and checks the keys come in the order first, first + step, ... of count keys
+static void verify_undict_order(ThreadContext *thread, UnDictRef undict, int first, int step, int count)
+{
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	ShmInt dict_count = -1;
+	shmassert(shm_undict_get_count(thread, undict, &dict_count) == RESULT_OK);
+	shmassert(dict_count == count);
+	int found = 0;
+	int itemindex = 0;
+	while (true)
+	{
+		ShmPointer key = EMPTY_SHM;
+		if (shm_undict_get_bucket_at_index(thread, undict.local, itemindex++, &key, NULL))
+			break;
+		if (key == EMPTY_SHM)
+			continue;
+		Py_UCS1 buffer[SHM_IMMEDIATE_SHORT_MAX];
+		RefUnicode s = shm_unicode_key_get(key, buffer);
+		char buf[15];
+		int len = 0;
+		for (; len < s.len && len < 14; ++len)
+			buf[len] = (char)shm_unicode_read(s.kind, s.data, len);
+		buf[len] = 0;
+		shm_pointer_release(thread, key);
+		shmassert(atoi(buf + 1) == first + found * step);
+		found++;
+	}
+	shmassert(found == count);
+	commit_transaction(thread, NULL);
+}
+
+// Negative ints in [-2^17, -1] have the same upper bits as SHM_INVALID_BLOCK, SBOOL must still see them as values,
+// otherwise the containers take them for EMPTY_SHM.
+void test_immediates(ThreadContext *thread)
+{
+	const intptr_t ints[] = { 0, 1, -1, -2, -(1 << 16), -(1 << 17) + 1, -(1 << 17), -(1 << 17) - 1,
+	                          SHM_IMMEDIATE_INT_MIN, SHM_IMMEDIATE_INT_MAX };
+	const int count = (int)(sizeof(ints) / sizeof(ints[0]));
+	ListRef list;
+	list.local = new_shm_list(thread, &list.shared);
+	UnDictRef undict;
+	undict.local = new_shm_undict(thread, &undict.shared);
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	static char bufs[sizeof(ints) / sizeof(ints[0])][15];
+	for (int i = 0; i < count; ++i)
+	{
+		ShmPointer value = shm_immediate_from_int(ints[i]);
+		shmassert(SBOOL(value));
+		shmassert(!shm_pointer_is_valid(value));
+		shmassert(shm_immediate_get_int(value) == ints[i]);
+		shmassert(shm_list_append(thread, list, value, NULL) == RESULT_OK);
+
+		int len = snprintf(bufs[i], 15, "i%d", i);
+		ShmUnDictKey key = EMPTY_SHM_UNDICT_KEY;
+		key.hash = hash_string_ascii(bufs[i], len);
+		key.key1 = (Py_UCS1 *)bufs[i];
+		key.keysize = len;
+		shmassert(shm_undict_set_item(thread, undict, &key, value, NULL) == RESULT_OK);
+	}
+	shmassert(SBOOL(shm_immediate_from_bool(false)));
+#if SHM_IMMEDIATE_HAS_FLOAT
+	shmassert(SBOOL(shm_immediate_from_float(-1.0)));
+#endif
+	for (int i = 0; i < count; ++i)
+	{
+		ShmPointer value = EMPTY_SHM;
+		ShmInt fetched = 0;
+		shmassert(shm_list_acq_range(thread, list, i, 1, 1, &value, &fetched) == RESULT_OK);
+		shmassert(fetched == 1 && value == shm_immediate_from_int(ints[i]));
+
+		ShmUnDictKey key = EMPTY_SHM_UNDICT_KEY;
+		key.hash = hash_string_ascii(bufs[i], (int)strlen(bufs[i]));
+		key.key1 = (Py_UCS1 *)bufs[i];
+		key.keysize = (int)strlen(bufs[i]);
+		value = EMPTY_SHM;
+		shmassert(shm_undict_acq(thread, undict, &key, &value) == RESULT_OK);
+		shmassert(value == shm_immediate_from_int(ints[i]));
+	}
+	ShmInt dict_count = -1;
+	shmassert(shm_undict_get_count(thread, undict, &dict_count) == RESULT_OK);
+	shmassert(dict_count == count);
+	commit_transaction(thread, NULL);
+
+	shm_pointer_release(thread, list.shared);
+	shm_pointer_release(thread, undict.shared);
+}
+
+void test_undict_order(ThreadContext *thread)
+{
+	UnDictRef undict;
+	undict.local = new_shm_undict(thread, &undict.shared);
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	for (int i = 0; i < 300; ++i)
+		undict_order_set(thread, undict, 600 - i, true);
+	commit_transaction(thread, NULL);
+	// the keys set by one transaction keep their order too, the existing key keeps its position
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	for (int i = 0; i < 300; ++i)
+		undict_order_set(thread, undict, 300 - i, true);
+	undict_order_set(thread, undict, 600, true);
+	commit_transaction(thread, NULL);
+	verify_undict_order(thread, undict, 600, -1, 600);
+	// reverse the order of the key numbers above to [1, 601)
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	for (int i = 600; i >= 1; --i)
+		undict_order_set(thread, undict, i, false);
+	for (int i = 1; i <= 600; ++i)
+		undict_order_set(thread, undict, i, true);
+	commit_transaction(thread, NULL);
+	verify_undict_order(thread, undict, 1, 1, 600);
+	// the deleted items' holes outnumber the items and get packed
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	for (int i = 1; i <= 600; ++i)
+		if (i % 5 != 0)
+			undict_order_set(thread, undict, i, false);
+	commit_transaction(thread, NULL);
+	shmassert(undict.local->count == 120);
+	shmassert(undict.local->entry_count == 120);
+	verify_undict_order(thread, undict, 5, 5, 120);
+
+	shm_pointer_release(thread, undict.shared);
+}
+
+#define UNDICT_BATCH_SIZE 200
+
+// The batch spans all the segments of a concurrent dict within a single transient transaction
+void test_undict_batch(ThreadContext *thread)
+{
+	UnDictRef undict;
+	undict.local = new_shm_undict_concurrent(thread, &undict.shared);
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	static char bufs[UNDICT_BATCH_SIZE + 1][15];
+	ShmUnDictKey keys[UNDICT_BATCH_SIZE + 1];
+	ShmPointer values[UNDICT_BATCH_SIZE + 1];
+	for (int i = 0; i <= UNDICT_BATCH_SIZE; ++i)
+	{
+		int len = snprintf(bufs[i], 15, "b%d", i);
+		keys[i] = (ShmUnDictKey)EMPTY_SHM_UNDICT_KEY;
+		keys[i].hash = hash_string_ascii(bufs[i], len);
+		keys[i].key1 = (Py_UCS1 *)bufs[i];
+		keys[i].keysize = len;
+		values[i] = i < UNDICT_BATCH_SIZE ? shm_immediate_from_int(i) : EMPTY_SHM;
+	}
+	shmassert(shm_undict_set_many(thread, undict, keys, values, UNDICT_BATCH_SIZE) == RESULT_OK);
+	shmassert(thread->transaction_mode == TRANSACTION_IDLE);
+	ShmInt count = -1;
+	shmassert(shm_undict_get_count(thread, undict, &count) == RESULT_OK);
+	shmassert(count == UNDICT_BATCH_SIZE);
+
+	// the last key is missing
+	for (int i = 0; i <= UNDICT_BATCH_SIZE; ++i)
+		values[i] = EMPTY_SHM;
+	shmassert(shm_undict_acq_many(thread, undict, keys, values, UNDICT_BATCH_SIZE + 1) == RESULT_OK);
+	for (int i = 0; i < UNDICT_BATCH_SIZE; ++i)
+		shmassert(values[i] == shm_immediate_from_int(i));
+	shmassert(values[UNDICT_BATCH_SIZE] == EMPTY_SHM);
+
+	// EMPTY_SHM deletes the key
+	for (int i = 0; i < UNDICT_BATCH_SIZE; ++i)
+		values[i] = i % 2 ? EMPTY_SHM : shm_immediate_from_int(-i);
+	shmassert(shm_undict_set_many(thread, undict, keys, values, UNDICT_BATCH_SIZE) == RESULT_OK);
+	shmassert(shm_undict_get_count(thread, undict, &count) == RESULT_OK);
+	shmassert(count == UNDICT_BATCH_SIZE / 2);
+	ShmPointer value = EMPTY_SHM;
+	shmassert(shm_undict_acq(thread, undict, &keys[2], &value) == RESULT_OK);
+	shmassert(value == shm_immediate_from_int(-2));
+	value = EMPTY_SHM;
+	shmassert(shm_undict_acq(thread, undict, &keys[3], &value) == RESULT_OK);
+	shmassert(value == EMPTY_SHM);
+	commit_transaction(thread, NULL);
+
+	shm_pointer_release(thread, undict.shared);
+}
+
+#define LIST_EXTEND_SIZE 20000
+
+static int
+list_index_size(ListRef list)
+{
+	ShmRefcountedBlock *top_block = LOCAL(list.local->top_block);
+	if (top_block->type == SHM_TYPE_LIST_INDEX)
+		return (int)((ShmListIndex *)top_block)->index_size;
+	return 1;
+}
+
+// shm_list_extend records a range spanning several blocks as a single change
+void test_list_extend(ThreadContext *thread)
+{
+	ListRef list;
+	list.local = new_shm_list(thread, &list.shared);
+	static ShmPointer values[LIST_EXTEND_SIZE];
+	for (int i = 0; i < LIST_EXTEND_SIZE; ++i)
+		values[i] = shm_immediate_from_int(i);
+
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_append(thread, list, shm_immediate_from_int(-1), NULL) == RESULT_OK);
+	shmassert(shm_list_extend(thread, list, values, LIST_EXTEND_SIZE) == RESULT_OK);
+	shmassert(shm_list_extend(thread, list, values, 10) == RESULT_OK);
+	shmassert(shm_list_extend(thread, list, values, 0) == RESULT_OK);
+	shmassert(thread->transaction_mode == TRANSACTION_IDLE);
+	ShmListCounts counts = SHM_LIST_INVALID_COUNTS;
+	shmassert(shm_list_get_count(thread, list, &counts, true) == RESULT_OK);
+	shmassert(counts.count == 1 + LIST_EXTEND_SIZE + 10);
+	commit_transaction(thread, NULL);
+	int index_size = list_index_size(list);
+	shmassert(index_size > 2);
+
+	// the rollback releases the blocks allocated by the extend
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_extend(thread, list, values, LIST_EXTEND_SIZE) == RESULT_OK);
+	shmassert(shm_list_extend(thread, list, values, LIST_EXTEND_SIZE) == RESULT_OK);
+	counts = shm_list_get_fast_count(thread, list.local, true);
+	shmassert(counts.count == 1 + 3 * LIST_EXTEND_SIZE + 10);
+	shmassert(list_index_size(list) > index_size);
+	abort_transaction_retaining(thread);
+	commit_transaction(thread, NULL);
+	shmassert(list_index_size(list) == index_size);
+
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_append(thread, list, shm_immediate_from_int(-2), NULL) == RESULT_OK);
+	shmassert(shm_list_get_count(thread, list, &counts, true) == RESULT_OK);
+	shmassert(counts.count == 1 + LIST_EXTEND_SIZE + 10 + 1);
+	for (ShmInt index = 0; index < counts.count;)
+	{
+		ShmPointer fetched_values[100];
+		ShmInt fetched = 0;
+		shmassert(shm_list_acq_range(thread, list, index, 1, 100, fetched_values, &fetched) == RESULT_OK);
+		shmassert(fetched > 0);
+		for (ShmInt i = index; i < index + fetched; ++i)
+		{
+			ShmInt expected = i - 1;
+			if (i == 0)
+				expected = -1;
+			else if (i > LIST_EXTEND_SIZE + 10)
+				expected = -2;
+			else if (i > LIST_EXTEND_SIZE)
+				expected = i - 1 - LIST_EXTEND_SIZE;
+			shmassert(fetched_values[i - index] == shm_immediate_from_int(expected));
+		}
+		index += fetched;
+	}
+	commit_transaction(thread, NULL);
+
+	shm_pointer_release(thread, list.shared);
+}
+
+static void
+verify_list_items(ThreadContext *thread, ListRef list, ShmInt *expected, ShmInt count)
+{
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	ShmListCounts counts = SHM_LIST_INVALID_COUNTS;
+	shmassert(shm_list_get_count(thread, list, &counts, true) == RESULT_OK);
+	shmassert(counts.count == count);
+	for (ShmInt index = 0; index < count;)
+	{
+		ShmPointer fetched_values[100];
+		ShmInt fetched = 0;
+		shmassert(shm_list_acq_range(thread, list, index, 1, 100, fetched_values, &fetched) == RESULT_OK);
+		shmassert(fetched > 0);
+		for (ShmInt i = index; i < index + fetched; ++i)
+			shmassert(fetched_values[i - index] == shm_immediate_from_int(expected[i]));
+		index += fetched;
+	}
+	commit_transaction(thread, NULL);
+}
+
+// insertions and removals at the ends and in the middle of the blocks, with a rollback of the block split
+void test_list_mutations(ThreadContext *thread)
+{
+	ListRef list;
+	list.local = new_shm_list(thread, &list.shared);
+	static ShmInt expected[2 * LIST_EXTEND_SIZE];
+	static ShmPointer values[LIST_EXTEND_SIZE];
+	for (int i = 0; i < LIST_EXTEND_SIZE; ++i)
+	{
+		values[i] = shm_immediate_from_int(i);
+		expected[i] = i;
+	}
+	ShmInt count = LIST_EXTEND_SIZE;
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_extend(thread, list, values, LIST_EXTEND_SIZE) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	int index_size = list_index_size(list);
+
+	// the first block is full, a split is rolled back along with the inserts at the ends
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_insert(thread, list, 100, shm_immediate_from_int(-1)) == RESULT_OK);
+	for (int i = 0; i < DELTA_ARRAY_SIZE + 10; ++i)
+		shmassert(shm_list_insert(thread, list, 0, shm_immediate_from_int(-1)) == RESULT_OK);
+	shmassert(shm_list_insert(thread, list, -1, shm_immediate_from_int(-1)) == RESULT_OK);
+	ShmPointer popped = EMPTY_SHM;
+	bool valid = false;
+	for (int i = 0; i < DELTA_ARRAY_SIZE + 10; ++i)
+	{
+		shmassert(shm_list_pop(thread, list, -1, &popped, &valid) == RESULT_OK);
+		shmassert(valid && popped != EMPTY_SHM);
+	}
+	shmassert(shm_list_get_fast_count(thread, list.local, true).count == LIST_EXTEND_SIZE + 2);
+	shmassert(list_index_size(list) > index_size);
+	abort_transaction_retaining(thread);
+	commit_transaction(thread, NULL);
+	shmassert(list_index_size(list) == index_size);
+	verify_list_items(thread, list, expected, count);
+
+	// each operation is a transaction of its own
+	unsigned int seed = 12345;
+	for (int step = 0; step < 3000; ++step)
+	{
+		seed = seed * 1103515245 + 12345;
+		unsigned int r = seed >> 8;
+		ShmInt position;
+		switch (r % 3 == 0 ? 0 : r % 5)
+		{
+			case 0: position = (ShmInt)((r / 8) % (unsigned int)(count + 1)); break;
+			case 1: position = 0; break;
+			case 2: position = count; break;
+			case 3: position = count > 0 ? (ShmInt)((r / 8) % (unsigned int)count) : 0; break;
+			default: position = count > 0 ? count - 1 : 0; break;
+		}
+		start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+		if ((r & 4) && count < 2 * LIST_EXTEND_SIZE)
+		{
+			shmassert(shm_list_insert(thread, list, position, shm_immediate_from_int(step)) == RESULT_OK);
+			memmove(&expected[position + 1], &expected[position], sizeof(ShmInt) * (size_t)(count - position));
+			expected[position] = step;
+			count++;
+		}
+		else
+		{
+			shmassert(shm_list_pop(thread, list, position, &popped, &valid) == RESULT_OK);
+			shmassert(valid == (position < count));
+			if (valid)
+			{
+				shmassert(popped == shm_immediate_from_int(expected[position]));
+				memmove(&expected[position], &expected[position + 1], sizeof(ShmInt) * (size_t)(count - position - 1));
+				count--;
+			}
+		}
+		commit_transaction(thread, NULL);
+	}
+	verify_list_items(thread, list, expected, count);
+
+	// removals drop the emptied blocks on commit
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_clear(thread, list) == RESULT_OK);
+	shmassert(shm_list_insert(thread, list, 5, shm_immediate_from_int(7)) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	shmassert(list_index_size(list) == 1);
+	expected[0] = 7;
+	verify_list_items(thread, list, expected, 1);
+
+	shm_pointer_release(thread, list.shared);
+}
+
+static void
+verify_list_item(ThreadContext *thread, ListRef list, ShmInt index, ShmInt expected)
+{
+	ShmPointer value = EMPTY_SHM;
+	ShmInt fetched = 0;
+	shmassert(shm_list_acq_range(thread, list, index, 1, 1, &value, &fetched) == RESULT_OK);
+	shmassert(fetched == 1 && value == shm_immediate_from_int(expected));
+}
+
+// the index grows by pages in place, the middle insertions and the rollbacks rebuild it
+void test_list_index_pages(ThreadContext *thread)
+{
+	ListRef list;
+	list.local = new_shm_list(thread, &list.shared);
+	static ShmPointer values[LIST_EXTEND_SIZE];
+	for (int i = 0; i < LIST_EXTEND_SIZE; ++i)
+		values[i] = shm_immediate_from_int(i);
+	ShmInt count = 0;
+	do
+	{
+		start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+		shmassert(shm_list_extend(thread, list, values, LIST_EXTEND_SIZE) == RESULT_OK);
+		commit_transaction(thread, NULL);
+		count += LIST_EXTEND_SIZE;
+	} while (list_index_size(list) <= 2 * SHM_LIST_INDEX_PAGE_SIZE + 10);
+	ShmListIndex *list_index = LOCAL(list.local->top_block);
+	shmassert(list_index->page_capacity >= 3);
+	int index_size = list_index_size(list);
+
+	// get_count verifies the sums of the pages
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	ShmListCounts counts = SHM_LIST_INVALID_COUNTS;
+	shmassert(shm_list_get_count(thread, list, &counts, true) == RESULT_OK);
+	shmassert(counts.count == count);
+	for (ShmInt index = 0; index < count; index += 997)
+		verify_list_item(thread, list, index, index % LIST_EXTEND_SIZE);
+	verify_list_item(thread, list, count - 1, LIST_EXTEND_SIZE - 1);
+	commit_transaction(thread, NULL);
+
+	// the blocks appended across the page boundary are released by the rollback
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	for (int i = 0; i < 3 * SHM_LIST_INDEX_PAGE_SIZE / 2; ++i)
+		shmassert(shm_list_append(thread, list, shm_immediate_from_int(-1), NULL) == RESULT_OK);
+	shmassert(shm_list_extend(thread, list, values, LIST_EXTEND_SIZE) == RESULT_OK);
+	abort_transaction_retaining(thread);
+	commit_transaction(thread, NULL);
+	shmassert(list_index_size(list) == index_size);
+
+	// a full block in the middle of the second page is split
+	ShmInt position = (ShmInt)SHM_LIST_INDEX_PAGE_SIZE * (count / index_size) + 7;
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_insert(thread, list, position, shm_immediate_from_int(-1)) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	shmassert(list_index_size(list) == index_size + 1);
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_get_count(thread, list, &counts, true) == RESULT_OK);
+	shmassert(counts.count == count + 1);
+	verify_list_item(thread, list, position - 1, (position - 1) % LIST_EXTEND_SIZE);
+	verify_list_item(thread, list, position, -1);
+	verify_list_item(thread, list, position + 1, position % LIST_EXTEND_SIZE);
+	verify_list_item(thread, list, count, LIST_EXTEND_SIZE - 1);
+	ShmPointer popped = EMPTY_SHM;
+	bool valid = false;
+	shmassert(shm_list_pop(thread, list, position, &popped, &valid) == RESULT_OK);
+	shmassert(valid && popped == shm_immediate_from_int(-1));
+	commit_transaction(thread, NULL);
+
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_get_count(thread, list, &counts, true) == RESULT_OK);
+	shmassert(counts.count == count);
+	for (ShmInt index = position - 3000; index < position + 3000; ++index)
+		verify_list_item(thread, list, index, index % LIST_EXTEND_SIZE);
+	commit_transaction(thread, NULL);
+
+	shm_pointer_release(thread, list.shared);
+}
+
+// the staged items live in the shadow chunks of the block until the commit or the rollback releases them
+void test_list_shadow(ThreadContext *thread)
+{
+	shmassert(sizeof(ShmListCell) == sizeof(ShmPointer));
+	ListRef list;
+	list.local = new_shm_list(thread, &list.shared);
+	ShmPointer values[200];
+	for (int i = 0; i < 200; ++i)
+		values[i] = shm_immediate_from_int(i);
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_extend(thread, list, values, 200) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	ShmListBlock *block = LOCAL(list.local->top_block);
+	shmassert(block && SHM_TYPE_LIST_BLOCK == block->type);
+	shmassert(block->shadow == EMPTY_SHM);
+
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_set_item(thread, list, 5, shm_immediate_from_int(-5)) == RESULT_OK);
+	shmassert(shm_list_set_item(thread, list, 150, shm_immediate_from_int(-150)) == RESULT_OK);
+	ShmListShadow *shadow = LOCAL(block->shadow);
+	shmassert(shadow && shadow->capacity == block->capacity);
+	shmassert(SBOOL(shadow->chunks[0]) && !SBOOL(shadow->chunks[1]) && SBOOL(shadow->chunks[2]));
+	// the committed cells are untouched until the commit
+	shmassert(block->cells[5].data == shm_immediate_from_int(5));
+	abort_transaction_retaining(thread);
+	commit_transaction(thread, NULL);
+	shmassert(block->shadow == EMPTY_SHM);
+
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_list_set_item(thread, list, 150, shm_immediate_from_int(-150)) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	shmassert(block->shadow == EMPTY_SHM);
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	verify_list_item(thread, list, 5, 5);
+	verify_list_item(thread, list, 149, 149);
+	verify_list_item(thread, list, 150, -150);
+	commit_transaction(thread, NULL);
+
+	shm_pointer_release(thread, list.shared);
+}
+
+// writes go to a copy of the items, an acquired data block keeps the items it had when acquired
+void test_array(ThreadContext *thread)
+{
+	ArrayRef array;
+	array.local = new_shm_array(thread, &array.shared, 'q', sizeof(int64_t), 1000);
+	shmassert(shm_array_max_count(sizeof(int64_t)) >= 1000);
+	int64_t values[1000];
+	for (int i = 0; i < 1000; ++i)
+		values[i] = i * 10;
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_array_set_range(thread, array, 0, 1, 1000, values) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	shmassert(array.local->new_data == EMPTY_SHM);
+
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	ShmPointer snapshot = EMPTY_SHM;
+	shmassert(shm_array_acq_data(thread, array, &snapshot) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	ShmArrayData *snapshot_data = LOCAL(snapshot);
+	shmassert(snapshot_data->count == 1000 && snapshot_data->itemsize == sizeof(int64_t));
+
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	int64_t negative[2] = { -1, -2 };
+	shmassert(shm_array_set_range(thread, array, 1, 998, 2, negative) == RESULT_OK);
+	int64_t fetched[2] = { 0, 0 };
+	shmassert(shm_array_get_range(thread, array, 1, 998, 2, fetched) == RESULT_OK);
+	shmassert(fetched[0] == -1 && fetched[1] == -2);
+	abort_transaction_retaining(thread);
+	commit_transaction(thread, NULL);
+	shmassert(array.local->new_data == EMPTY_SHM);
+
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_array_set_range(thread, array, 999, 1, 1, &negative[0]) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_array_get_range(thread, array, 0, 333, 4, values) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	shmassert(values[0] == 0 && values[1] == 3330 && values[2] == 6660 && values[3] == -1);
+
+	int64_t *snapshot_items = (int64_t *)CAST_VL(shm_array_data_items(snapshot_data));
+	shmassert(snapshot_items[1] == 10 && snapshot_items[999] == 9990);
+	shm_pointer_release(thread, snapshot);
+	shm_pointer_release(thread, array.shared);
+}
+
+// appended rows stay invisible until the commit, the aggregates see the committed rows only
+void test_table(ThreadContext *thread)
+{
+	ShmTableColumn columns[2] = { { 'q', sizeof(int64_t), "n" }, { 'd', sizeof(double), "half" } };
+	TableRef table;
+	table.local = new_shm_table(thread, &table.shared, 2, columns);
+	// spans more chunks than the initial index holds
+	const ShmInt count = SHM_TABLE_CHUNK_ROWS * 5 + 100;
+	int64_t *numbers = malloc(count * sizeof(int64_t));
+	double *halves = malloc(count * sizeof(double));
+	for (ShmInt i = 0; i < count; ++i)
+	{
+		numbers[i] = i;
+		halves[i] = i * 0.5;
+	}
+	const void *values[2] = { numbers, halves };
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_table_append(thread, table, count, values) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	shmassert(table.local->count == count && table.local->new_count == -1);
+
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	shmassert(shm_table_append(thread, table, 10, values) == RESULT_OK);
+	ShmInt visible = 0;
+	shmassert(shm_table_get_count(thread, table, &visible) == RESULT_OK && visible == count + 10);
+	abort_transaction_retaining(thread);
+	commit_transaction(thread, NULL);
+	shmassert(table.local->count == count);
+
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	ShmTableValue result;
+	ShmInt matched = 0;
+	shmassert(shm_table_aggregate(thread, table, 0, SHM_TABLE_SUM, NULL, 0, &result, &matched) == RESULT_OK);
+	shmassert(result.i == (int64_t)count * (count - 1) / 2 && matched == count);
+	ShmTablePredicate predicates[2] = {
+		{ .column = 0, .op = SHM_TABLE_GE, .value.i = 100 },
+		{ .column = 1, .op = SHM_TABLE_LT, .value.d = 100.0 },
+	};
+	// 100 <= n < 200
+	shmassert(shm_table_aggregate(thread, table, 1, SHM_TABLE_MAX, predicates, 2, &result, &matched) == RESULT_OK);
+	shmassert(matched == 100 && result.d == 199 * 0.5);
+	shmassert(shm_table_aggregate(thread, table, 0, SHM_TABLE_MIN, predicates, 2, &result, &matched) == RESULT_OK);
+	shmassert(result.i == 100);
+	shmassert(shm_table_aggregate(thread, table, -1, SHM_TABLE_COUNT, predicates, 1, &result, &matched) == RESULT_OK);
+	shmassert(result.i == count - 100);
+	ShmInt found = 0;
+	ShmInt *rows = malloc(count * sizeof(ShmInt));
+	predicates[0].op = SHM_TABLE_EQ;
+	predicates[0].value.i = SHM_TABLE_CHUNK_ROWS * 5 + 1;
+	shmassert(shm_table_filter(thread, table, predicates, 1, rows, count, &found) == RESULT_OK);
+	shmassert(found == 1 && rows[0] == SHM_TABLE_CHUNK_ROWS * 5 + 1);
+	free(rows);
+	double half = 0;
+	shmassert(shm_table_get_range(thread, table, 1, count - 1, 1, &half) == RESULT_OK && half == (count - 1) * 0.5);
+	shmassert(shm_table_get_range(thread, table, 1, count, 1, &half) == RESULT_INVALID);
+	commit_transaction(thread, NULL);
+
+	free(numbers);
+	free(halves);
+	shm_pointer_release(thread, table.shared);
+}
+
+// a write spanning the segments is invisible to an acquired index, the rollback keeps the committed version
+void test_blob(ThreadContext *thread)
+{
+	BlobRef blob;
+	blob.local = new_shm_blob(thread, &blob.shared);
+	const ShmInt segment_size = blob.local->segment_size;
+	const ShmInt size = segment_size * 2 + 100;
+	char *bytes = malloc(size);
+	for (ShmInt i = 0; i < size; ++i)
+		bytes[i] = (char)(i % 251);
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	// the gap before the position reads as zeros
+	shmassert(shm_blob_write(thread, blob, 10, size - 10, bytes + 10) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	shmassert(blob.local->new_index == EMPTY_SHM);
+
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	ShmPointer snapshot = EMPTY_SHM;
+	shmassert(shm_blob_acq_index(thread, blob, &snapshot) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	ShmBlobIndex *snapshot_index = LOCAL(snapshot);
+	shmassert(shm_blob_index_size(snapshot_index) == size);
+
+	start_transaction(thread, TRANSACTION_PERSISTENT, LOCKING_WRITE, true, NULL);
+	shmassert(shm_blob_truncate(thread, blob, segment_size + 1) == RESULT_OK);
+	ShmPointer own = EMPTY_SHM;
+	shmassert(shm_blob_acq_index(thread, blob, &own) == RESULT_OK);
+	shmassert(shm_blob_index_size(LOCAL(own)) == segment_size + 1);
+	shm_pointer_release(thread, own);
+	abort_transaction_retaining(thread);
+	commit_transaction(thread, NULL);
+	shmassert(blob.local->new_index == EMPTY_SHM);
+
+	// crosses the segment boundary, then extends past the end
+	char marks[4] = { 'a', 'b', 'c', 'd' };
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	shmassert(shm_blob_write(thread, blob, segment_size - 2, 4, marks) == RESULT_OK);
+	shmassert(shm_blob_truncate(thread, blob, segment_size + 1) == RESULT_OK);
+	shmassert(shm_blob_truncate(thread, blob, size) == RESULT_OK);
+	shmassert(shm_blob_write(thread, blob, shm_blob_max_size(blob.local), 1, marks) == RESULT_INVALID);
+	commit_transaction(thread, NULL);
+
+	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+	ShmPointer current = EMPTY_SHM;
+	shmassert(shm_blob_acq_index(thread, blob, &current) == RESULT_OK);
+	commit_transaction(thread, NULL);
+	char *fetched = malloc(size);
+	shm_blob_index_read(blob.local, LOCAL(current), 0, size, fetched);
+	shmassert(fetched[0] == 0 && fetched[10] == bytes[10]);
+	shmassert(memcmp(fetched + segment_size - 2, marks, 3) == 0);
+	shmassert(fetched[segment_size + 1] == 0 && fetched[size - 1] == 0);
+	shm_pointer_release(thread, current);
+
+	shm_blob_index_read(blob.local, snapshot_index, 0, size, fetched);
+	shmassert(fetched[0] == 0 && memcmp(fetched + 10, bytes + 10, size - 10) == 0);
+	shm_pointer_release(thread, snapshot);
+	free(fetched);
+	free(bytes);
+	shm_pointer_release(thread, blob.shared);
+}
+
 int verify_undict(ThreadContext *thread, UnDictRef undict, int count, char prefix)
 {
 	start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
@@ -1379,10 +2127,35 @@ int main(int argc, char *argv[])
 
 		test_mm(thread);
 		test_locks(thread);
+		test_garbage_throttle(thread);
+		printf("1. Test_garbage_throttle finished\n");
 
 		const char *ascii_abc = "abc";
 		const Py_UCS4 UCS4_abc[3] = {'a', 'b', 'c'};
 		shmassert(hash_string_ascii(ascii_abc, 3) == hash_string(UCS4_abc, 3));
+		const Py_UCS2 UCS2_abc[3] = {'a', 'b', 'c'};
+		shmassert(hash_string_ucs2(UCS2_abc, 3) == hash_string(UCS4_abc, 3));
+
+		test_immediates(thread);
+		printf("1. Test_immediates finished\n");
+		test_undict_order(thread);
+		printf("1. Test_undict_order finished\n");
+		test_undict_batch(thread);
+		printf("1. Test_undict_batch finished\n");
+		test_list_extend(thread);
+		printf("1. Test_list_extend finished\n");
+		test_list_mutations(thread);
+		printf("1. Test_list_mutations finished\n");
+		test_list_index_pages(thread);
+		printf("1. Test_list_index_pages finished\n");
+		test_list_shadow(thread);
+		printf("1. Test_list_shadow finished\n");
+		test_array(thread);
+		printf("1. Test_array finished\n");
+		test_table(thread);
+		printf("1. Test_table finished\n");
+		test_blob(thread);
+		printf("1. Test_blob finished\n");
 
 		random_flinch = true;
 		reclaimer_debug_info = true;
@@ -1404,6 +2177,20 @@ int main(int argc, char *argv[])
 		shm_undict_clear(thread, undict);
 		commit_transaction(thread, NULL);
 
+		// the concurrent processes test uses the segmented dict
+		UnDictRef undict_concurrent;
+		undict_concurrent.local = new_shm_undict_concurrent(thread, &undict_concurrent.shared);
+		test_undict(thread, undict_concurrent, 'c');
+		succeded = verify_undict(thread, undict_concurrent, 1000, 'c');
+		printf("1. Verify_undict segmented: %d of %d\n", succeded, 1000 * 2 / 3);
+		shmassert(succeded == 1000 * 2 / 3);
+		start_transaction(thread, TRANSACTION_IDLE, LOCKING_WRITE, true, NULL);
+		ShmInt segmented_count = -1;
+		while (shm_undict_get_count(thread, undict_concurrent, &segmented_count) != RESULT_OK)
+			;
+		shmassert(segmented_count == 1000 * 2 / 3);
+		commit_transaction(thread, NULL);
+
 		// superblock->stop_reclaimer = true;
 
 		LocalReference *loc_ref = thread_local_ref(thread, EMPTY_SHM);
@@ -1468,7 +2255,7 @@ int main(int argc, char *argv[])
 		volatile unsigned int args[additional_args_count] =
 			{ dummy,
 			  promise.shared, ret_promise.shared, promise2.shared, ret_promise2.shared,
-			  queue->shared, dict->shared, list_2->shared, list_3->shared, undict.shared };
+			  queue->shared, dict->shared, list_2->shared, list_3->shared, undict_concurrent.shared };
 		process_handles handles2;
 		created_proc = run_child_process(argv[0], '2', additional_args_count, args, &handles2);
 
@@ -1519,10 +2306,10 @@ int main(int argc, char *argv[])
 			shmassert(ret2_wait_result == RESULT_OK);
 			printf("1. Passed return barrier #2.\n");
 
-			test_undict(thread, undict, '1');
+			test_undict(thread, undict_concurrent, '1');
 			Sleep(1);
 			printf("1. Undict concurrent test finished.\n");
-			int succeded = verify_undict(thread, undict, 1000, '1');
+			int succeded = verify_undict(thread, undict_concurrent, 1000, '1');
 			printf("1. Verify_undict concurrent: %d out of %d\n", succeded, 1000 * 2 / 3);
 
 			printf("1. Second test_dict...\n");
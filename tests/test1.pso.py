@@ -174,6 +174,19 @@ def run_parent():
     log_msg('ShmDict keys: {0!r}'.format(d2.keys()))
     log_msg('      values: {0!r}'.format(d2.values()))
 
+    # tuple keys are compared right from the Python objects, True == 1 like in dict, floats are rejected
+    d3 = pso.ShmDict()
+    d3[(1, 'a', (None, b'b'))] = 'tuple'
+    d3[(True,)] = 'one'
+    d3[(1,)] = 'one again'
+    if d3[(1, 'a', (None, b'b'))] != 'tuple' or d3[(True,)] != 'one again' or len(d3) != 2:
+        raise Exception('tuple keys mismatch: {0!r}'.format(dict(d3)))
+    try:
+        d3[(1.0,)] = 'float'
+        raise Exception('float in a tuple key accepted')
+    except TypeError:
+        pass
+
     print('dict with value:', d['first'])
     del d['first']
     try: